@@ -2,13 +2,33 @@
 #import "KOWindowController.h"
 #import "lua/lauxlib.h"
 #import "lua/lualib.h"
+#import "bufferlib.h"
+#import "greplib.h"
+#import "grep.h"
 
 int luaopen_window(lua_State* L);
+int luaopen_buffer(lua_State* L);
+int luaopen_regex(lua_State* L);
+int luaopen_highlight(lua_State* L);
+int luaopen_wrap(lua_State* L);
+int luaopen_markers(lua_State* L);
+int luaopen_cursors(lua_State* L);
+int luaopen_grep(lua_State* L);
+int luaopen_fuzzy(lua_State* L);
 
 @interface KOAppDelegate ()
 @property lua_State* L;
 @end
 
+// called on a loader's or a search's thread; the progress gets to Lua on the main one
+static void ko_app_wake(void) {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        lua_State* L = [(KOAppDelegate*)[NSApp delegate] L];
+        ko_bufferlib_poll(L);
+        ko_greplib_poll(L);
+    });
+}
+
 @implementation KOAppDelegate
 
 - (void)applicationDidFinishLaunching:(NSNotification *)aNotification {
@@ -23,6 +43,32 @@ int luaopen_window(lua_State* L);
     luaopen_window(L);               // [window]
     lua_setglobal(L, "window");      // []
     
+    luaopen_buffer(L);               // [buffer]
+    lua_setglobal(L, "buffer");      // []
+    ko_buffer_setwake(ko_app_wake);
+    
+    luaopen_regex(L);                // [regex]
+    lua_setglobal(L, "regex");       // []
+    
+    luaopen_highlight(L);            // [highlight]
+    lua_setglobal(L, "highlight");   // []
+    
+    luaopen_wrap(L);                 // [wrap]
+    lua_setglobal(L, "wrap");        // []
+    
+    luaopen_markers(L);              // [markers]
+    lua_setglobal(L, "markers");     // []
+    
+    luaopen_cursors(L);              // [cursors]
+    lua_setglobal(L, "cursors");     // []
+    
+    luaopen_grep(L);                 // [grep]
+    lua_setglobal(L, "grep");        // []
+    ko_grep_setwake(ko_app_wake);
+    
+    luaopen_fuzzy(L);                // [fuzzy]
+    lua_setglobal(L, "fuzzy");       // []
+    
     lua_getglobal(L, "package");     // [package]
     lua_getfield(L, -1, "path");     // [package, path]
     lua_pushliteral(L, ";");         // [package, path, ";"]
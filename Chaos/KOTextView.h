@@ -1,7 +1,10 @@
 #import <Cocoa/Cocoa.h>
+#import "grid.h"
 
 typedef void(^KOKeyDownHandler)(BOOL ctrl, BOOL alt, BOOL cmd, NSString* str);
 
+NSColor* KOColorFromHandle(ko_color c);
+
 @interface KOTextView : NSView
 
 @property (readonly) CGFloat charWidth;
@@ -10,6 +13,11 @@ typedef void(^KOKeyDownHandler)(BOOL ctrl, BOOL alt, BOOL cmd, NSString* str);
 @property (readonly) int rows;
 @property (readonly) int cols;
 
+@property (readonly) ko_grid* grid;
+
+// cells with this background are left to the window to draw
+@property ko_color backgroundColor;
+
 @property (copy) KOKeyDownHandler keyDownHandler;
 
 - (void) useFont:(NSFont*)font;
@@ -19,9 +27,9 @@ typedef void(^KOKeyDownHandler)(BOOL ctrl, BOOL alt, BOOL cmd, NSString* str);
 
 - (NSSize) realViewSize;
 
-- (void) setChar:(unsigned short)c x:(int)x y:(int)y fg:(NSColor*)fg bg:(NSColor*)bg;
-
-- (void) clear:(NSColor*)bg;
+// call after writing into the grid; the changes get diffed and drawn on the next pass of the run loop
+- (void) setNeedsCommit;
+- (void) commit;
 
 - (void) postponeRedraws:(dispatch_block_t)blk;
 
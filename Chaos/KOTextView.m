@@ -2,6 +2,25 @@
 #import <QuartzCore/QuartzCore.h>
 
 
+// palette handles are dense, so this is just an array index once a color has been seen
+NSColor* KOColorFromHandle(ko_color c) {
+    static NSMutableArray* colors;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        colors = [NSMutableArray array];
+    });
+    
+    while ([colors count] <= c) {
+        uint32_t rgb = ko_color_rgb((ko_color)[colors count]);
+        [colors addObject:[NSColor colorWithCalibratedRed:(CGFloat)(unsigned char)(rgb >> 16) / 0xff
+                                                    green:(CGFloat)(unsigned char)(rgb >> 8) / 0xff
+                                                     blue:(CGFloat)(unsigned char)(rgb) / 0xff
+                                                    alpha: 1.0]];
+    }
+    
+    return [colors objectAtIndex:c];
+}
+
 @interface KOTextView ()
 
 @property (readwrite) CGFloat charWidth;
@@ -10,28 +29,59 @@
 @property (readwrite) int rows;
 @property (readwrite) int cols;
 
-@property NSMutableAttributedString* buffer;
-@property NSMutableDictionary* defaultAttrs;
+@property (readwrite) ko_grid* grid;
+@property NSFont* currentFont;
 
 @property BOOL postponeRedraws;
+@property BOOL commitPending;
+
+- (NSRect) rectForCellX:(int)x y:(int)y;
 
 @end
 
+static void KOInvalidateSpan(void* ctx, int y, int x, int n) {
+    KOTextView* tv = (__bridge KOTextView*)ctx;
+    [tv setNeedsDisplayInRect:NSUnionRect([tv rectForCellX:x y:y], [tv rectForCellX:x + n - 1 y:y])];
+}
+
+static void KOFillCells(void* ctx, int x, int y, int w, int h, ko_color color) {
+    KOTextView* tv = (__bridge KOTextView*)ctx;
+    [KOColorFromHandle(color) setFill];
+    NSRectFill(NSUnionRect([tv rectForCellX:x y:y], [tv rectForCellX:x + w - 1 y:y + h - 1]));
+}
+
+// slides the pixels that survive a scroll over to where the cells went; the diff then only repaints what's exposed
+static int KOScrollCells(void* ctx, const ko_grid_move* m) {
+    KOTextView* tv = (__bridge KOTextView*)ctx;
+    
+    int sx = m->x + MAX(m->dx, 0);
+    int sy = m->y + MAX(m->dy, 0);
+    int sw = m->w - abs(m->dx);
+    int sh = m->h - abs(m->dy);
+    
+    NSRect src = NSUnionRect([tv rectForCellX:sx y:sy], [tv rectForCellX:sx + sw - 1 y:sy + sh - 1]);
+    NSRect from = [tv rectForCellX:sx y:sy];
+    NSRect to = [tv rectForCellX:sx - m->dx y:sy - m->dy];
+    NSSize by = NSMakeSize(NSMinX(to) - NSMinX(from), NSMinY(to) - NSMinY(from));
+    
+    [tv translateRectsNeedingDisplayInRect:src by:by];
+    [tv scrollRect:src by:by];
+    return 1;
+}
+
 @implementation KOTextView
 
 - (id) initWithFrame:(NSRect)frameRect {
     if (self = [super initWithFrame:frameRect]) {
-        self.buffer = [[NSMutableAttributedString alloc] init];
-        self.defaultAttrs = [NSMutableDictionary dictionary];
-        
-        NSMutableParagraphStyle* pstyle = [[NSParagraphStyle defaultParagraphStyle] mutableCopy];
-        [pstyle setLineBreakMode:NSLineBreakByCharWrapping];
-        
-        self.defaultAttrs[NSParagraphStyleAttributeName] = pstyle;
+        self.grid = ko_grid_new(0, 0);
     }
     return self;
 }
 
+- (void) dealloc {
+    ko_grid_free(self.grid);
+}
+
 - (BOOL) acceptsFirstResponder { return YES; }
 
 - (void) keyDown:(NSEvent *)theEvent {
@@ -47,6 +97,25 @@
     if ([str characterAtIndex:0] == 13)
         str = @"return";
     
+    if ([str characterAtIndex:0] == 9)
+        str = @"tab";
+    
+    if ([str characterAtIndex:0] == 27)
+        str = @"escape";
+    
+    // same names the terminal backend uses
+    switch ([str characterAtIndex:0]) {
+        case NSUpArrowFunctionKey:    str = @"up"; break;
+        case NSDownArrowFunctionKey:  str = @"down"; break;
+        case NSLeftArrowFunctionKey:  str = @"left"; break;
+        case NSRightArrowFunctionKey: str = @"right"; break;
+        case NSHomeFunctionKey:       str = @"home"; break;
+        case NSEndFunctionKey:        str = @"end"; break;
+        case NSPageUpFunctionKey:     str = @"pageup"; break;
+        case NSPageDownFunctionKey:   str = @"pagedown"; break;
+        case NSDeleteFunctionKey:     str = @"forwarddelete"; break;
+    }
+    
 //    NSLog(@"%d", [str characterAtIndex:0]);
     
     if (self.keyDownHandler)
@@ -54,14 +123,13 @@
 }
 
 - (NSFont*) font {
-    return [self.defaultAttrs objectForKey:NSFontAttributeName];
+    return self.currentFont;
 }
 
 - (void) useFont:(NSFont*)font {
-    self.defaultAttrs[NSFontAttributeName] = font;
-    [self.buffer addAttribute:NSFontAttributeName value:font range:NSMakeRange(0, [self.buffer length])];
+    self.currentFont = font;
     
-    NSAttributedString* as = [[NSAttributedString alloc] initWithString:@"x" attributes:self.defaultAttrs];
+    NSAttributedString* as = [[NSAttributedString alloc] initWithString:@"x" attributes:@{NSFontAttributeName: font}];
     CTFramesetterRef frameSetter = CTFramesetterCreateWithAttributedString((__bridge CFAttributedStringRef)as);
     CGSize suggestedSize = CTFramesetterSuggestFrameSizeWithConstraints(frameSetter, CFRangeMake(0, 1), NULL, CGSizeMake(CGFLOAT_MAX, CGFLOAT_MAX), NULL);
     CFRelease(frameSetter);
@@ -75,13 +143,10 @@
                       self.charHeight * self.rows);
 }
 
-- (NSRect) rectForCharacterIndex:(NSUInteger)i {
-    NSRect bounds = [self bounds];
-    bounds.size = [self realViewSize]; // awww, duplicated code :/
-    
+- (NSRect) rectForCellX:(int)x y:(int)y {
     NSRect r;
-    r.origin.x = (i % self.cols) * self.charWidth;
-    r.origin.y = NSMaxY(bounds) - (((i / self.cols) + 1) * self.charHeight);
+    r.origin.x = x * self.charWidth;
+    r.origin.y = [self realViewSize].height - ((y + 1) * self.charHeight);
     r.size.width = self.charWidth;
     r.size.height = self.charHeight;
     
@@ -90,90 +155,93 @@
     return r;
 }
 
+// the grid's front buffer is the source of truth; this just turns each visible row into one CTLine
 - (void) drawRect:(NSRect)dirtyRect {
     if (self.postponeRedraws)
         return;
     
+    ko_grid* g = self.grid;
+    NSFont* font = self.currentFont;
+    
     CGContextRef ctx = [[NSGraphicsContext currentContext] graphicsPort];
     CGContextSetTextMatrix(ctx, CGAffineTransformIdentity);
     
-    NSRect bounds = [self bounds];
-    bounds.size = [self realViewSize];
-    
-    CTFramesetterRef framesetter = CTFramesetterCreateWithAttributedString((__bridge CFAttributedStringRef)self.buffer);
+    CGFloat top = [self realViewSize].height;
+    CGFloat descent = CTFontGetDescent((__bridge CTFontRef)font);
     
-    CGMutablePathRef path = CGPathCreateMutable();
-    CGPathAddRect(path, NULL, bounds);
+    int firstRow = MAX(0, (int)floor((top - NSMaxY(dirtyRect)) / self.charHeight));
+    int lastRow = MIN(g->rows - 1, (int)ceil((top - NSMinY(dirtyRect)) / self.charHeight));
     
-    CTFrameRef textFrame = CTFramesetterCreateFrame(framesetter, CFRangeMake(0,0), path, NULL);
+    // we have to manually draw backgrounds :/ but at least it's one fill per same-colored rect, not per cell
     
-    // we have to manually draw backgrounds :/
+    ko_grid_bgrects(g, firstRow, lastRow + 1, self.backgroundColor, KOFillCells, (__bridge void*)self);
     
-    [self.buffer enumerateAttribute:NSBackgroundColorAttributeName
-                            inRange:NSMakeRange(0, [self.buffer length])
-                            options:NSAttributedStringEnumerationLongestEffectiveRangeNotRequired
-                         usingBlock:^(NSColor* color, NSRange range, BOOL *stop) {
-                             if (color && ![color isEqual:[[self window] backgroundColor]]) {
-                                 [color setFill];
-                                 if (NSEqualRanges(range, NSMakeRange(0, [self.buffer length]))) {
-                                     [NSBezierPath fillRect:[self bounds]];
-                                 }
-                                 else {
-                                     for (NSUInteger i = range.location; i < NSMaxRange(range); i++) {
-                                         NSRect bgRect = [self rectForCharacterIndex:i];
-                                         [NSBezierPath fillRect:bgRect];
-                                     }
-                                 }
-                             }
-                         }];
+    // okay, now draw the actual text (one line per row! ha!)
     
-    // okay, now draw the actual text (just one line! ha!)
+    unichar chars[g->cols * 2 + 1];
     
-    CTFrameDraw(textFrame, ctx);
-    
-    CFRelease(framesetter);
-    CFRelease(textFrame);
-    CGPathRelease(path);
+    for (int y = firstRow; y <= lastRow; y++) {
+        const ko_cell* row = ko_grid_front_row(g, y);
+        
+        NSUInteger len = 0;
+        for (int x = 0; x < g->cols; x++) {
+            uint32_t ch = row[x].ch;
+            if (ch > 0xFFFF) {
+                ch -= 0x10000;
+                chars[len++] = 0xD800 + (ch >> 10);
+                chars[len++] = 0xDC00 + (ch & 0x3FF);
+            }
+            else {
+                chars[len++] = ch;
+            }
+        }
+        
+        NSString* str = [[NSString alloc] initWithCharacters:chars length:len];
+        NSMutableAttributedString* line = [[NSMutableAttributedString alloc] initWithString:str attributes:@{NSFontAttributeName: font}];
+        
+        NSUInteger runStart = 0, pos = 0;
+        for (int x = 0; x < g->cols; x++) {
+            pos += row[x].ch > 0xFFFF ? 2 : 1;
+            if (x == g->cols - 1 || row[x + 1].fg != row[x].fg) {
+                [line addAttribute:NSForegroundColorAttributeName value:KOColorFromHandle(row[x].fg) range:NSMakeRange(runStart, pos - runStart)];
+                runStart = pos;
+            }
+        }
+        
+        CTLineRef ctline = CTLineCreateWithAttributedString((__bridge CFAttributedStringRef)line);
+        CGContextSetTextPosition(ctx, 0, top - (y + 1) * self.charHeight + descent);
+        CTLineDraw(ctline, ctx);
+        CFRelease(ctline);
+    }
 }
 
 - (void) useGridSize:(NSSize)size {
     self.cols = size.width;
     self.rows = size.height;
     
-    // whenever we resize the grid, (if change > 0) just pad to length with " " and re-font the newly added text
-    
-    NSUInteger newBufferLen = self.cols * self.rows;
-    NSUInteger oldLen = [self.buffer length];
-    NSInteger diff = newBufferLen - oldLen;
-    
-    if (diff > 0) {
-        NSString* padding = [@"" stringByPaddingToLength:diff withString:@" " startingAtIndex:0];
-        [[self.buffer mutableString] appendString:padding];
-        [self.buffer setAttributes:self.defaultAttrs range:NSMakeRange(oldLen, diff)];
-    }
+    ko_grid_resize(self.grid, self.cols, self.rows);
 }
 
-- (void) setChar:(unsigned short)c x:(int)x y:(int)y fg:(NSColor*)fg bg:(NSColor*)bg {
-    NSUInteger i = x + y * self.cols;
-    NSRange r = NSMakeRange(i, 1);
-    [self.buffer replaceCharactersInRange:r withString:[NSString stringWithFormat:@"%C", c]];
-    if (fg) [self.buffer addAttribute:NSForegroundColorAttributeName value:fg range:r];
-    if (bg) [self.buffer addAttribute:NSBackgroundColorAttributeName value:bg range:r];
+- (void) setNeedsCommit {
+    if (self.commitPending)
+        return;
     
-    if (!self.postponeRedraws) {
-        NSRect r = [self rectForCharacterIndex:i];
-        [self setNeedsDisplayInRect:r];
-    }
+    self.commitPending = YES;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [self commit];
+    });
 }
 
-- (void) clear:(NSColor*)bg {
-    NSString* padding = [@"" stringByPaddingToLength:[self.buffer length] withString:@" " startingAtIndex:0];
-    NSRange r = NSMakeRange(0, [self.buffer length]);
-    [self.buffer replaceCharactersInRange:r withString:padding];
-    [self.buffer addAttribute:NSBackgroundColorAttributeName value:bg range:r];
+- (void) commit {
+    self.commitPending = NO;
     
-    if (!self.postponeRedraws)
-        [self setNeedsDisplay:YES];
+    if (self.postponeRedraws) {
+        ko_grid_commit(self.grid, NULL, NULL);
+    }
+    else {
+        ko_grid_commit_scrolls(self.grid, KOScrollCells, (__bridge void*)self);
+        ko_grid_commit(self.grid, KOInvalidateSpan, (__bridge void*)self);
+    }
 }
 
 - (void) postponeRedraws:(dispatch_block_t)blk {
@@ -1,5 +1,6 @@
 #import <Cocoa/Cocoa.h>
 #import "KOTextView.h"
+#import "frame.h"
 
 @interface KOWindowController : NSWindowController <NSWindowDelegate>
 
@@ -10,10 +11,20 @@
 - (int) cols;
 - (int) rows;
 
-- (void) setChar:(unsigned short)c x:(int)x y:(int)y fg:(NSColor*)fg bg:(NSColor*)bg;
-- (void) clear:(NSColor*)bg;
+- (ko_grid*) grid;
+- (void) gridChanged;
+- (void) useBackgroundColor:(ko_color)bg;
 
 @property (copy) dispatch_block_t windowResizedHandler;
+@property (copy) dispatch_block_t redrawHandler;
+
+// asks for a redraw; however often this is called, redrawHandler runs at most once per frame
+- (void) invalidate;
+- (ko_frame*) frameScheduler;
+
+// for when whatever the handlers draw with is going away: a frame that's
+// already scheduled won't run, and invalidate does nothing from then on
+- (void) stopFrames;
 
 - (void) useKeyDownHandler:(KOKeyDownHandler)handler;
 
@@ -1,10 +1,15 @@
 #import "KOWindowController.h"
+#import <QuartzCore/QuartzCore.h>
 
-@interface KOWindowController ()
+@interface KOWindowController () {
+    ko_frame scheduler;
+}
 
 @property (weak) IBOutlet KOTextView* tv;
 @property BOOL ignoreResizesForASecond;
 @property NSSize padding;
+@property BOOL resizedSinceLastFrame;
+@property BOOL framesStopped;
 
 @end
 
@@ -17,6 +22,8 @@
 - (void)windowDidLoad {
     [super windowDidLoad];
     
+    ko_frame_init(&scheduler, KO_FRAME_DEFAULT_RATE);
+    
     [self usePadding:NSMakeSize(5, 5)];
     [self useFont:[NSFont fontWithName:@"Menlo" size:12]];
     [self useGridSize:NSMakeSize(80, 24)];
@@ -61,8 +68,12 @@
     return self.tv.rows;
 }
 
-- (void) setChar:(unsigned short)c x:(int)x y:(int)y fg:(NSColor*)fg bg:(NSColor*)bg {
-    [self.tv setChar:c x:x y:y fg:fg bg:bg];
+- (ko_grid*) grid {
+    return self.tv.grid;
+}
+
+- (void) gridChanged {
+    [self.tv setNeedsCommit];
 }
 
 - (void) useGridSize:(NSSize)size {
@@ -93,14 +104,67 @@
         
         self.ignoreResizesForASecond = NO;
         
+        // a resize drag sends lots of these; let the next frame deal with them all at once
+        self.resizedSinceLastFrame = YES;
+        [self invalidate];
+    }];
+}
+
+- (void) invalidate {
+    if (self.framesStopped)
+        return;
+    
+    double delay = ko_frame_invalidate(&scheduler, CACurrentMediaTime());
+    if (delay >= 0)
+        [self runFrameAfter:delay];
+}
+
+- (void) runFrameAfter:(double)delay {
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+        [self runFrame];
+    });
+}
+
+- (void) runFrame {
+    if (self.framesStopped)
+        return;
+    
+    double now = CACurrentMediaTime();
+    
+    if (!ko_frame_tick(&scheduler, now)) {
+        if (scheduler.dirty)
+            [self runFrameAfter:ko_frame_delay(&scheduler, now)];
+        return;
+    }
+    
+    if (self.resizedSinceLastFrame) {
+        self.resizedSinceLastFrame = NO;
         if (self.windowResizedHandler)
             self.windowResizedHandler();
-    }];
+    }
+    
+    if (self.redrawHandler)
+        self.redrawHandler();
+    
+    [self.tv commit];
+}
+
+- (ko_frame*) frameScheduler {
+    return &scheduler;
+}
+
+- (void) stopFrames {
+    self.framesStopped = YES;
+    scheduler.dirty = 0;
 }
 
-- (void) clear:(NSColor*)bg {
-    [[self window] setBackgroundColor:bg];
-    [self.tv clear:bg];
+- (void) useBackgroundColor:(ko_color)bg {
+    // cells in the window's color aren't painted by the view, so changing it means repainting everything
+    if (bg != self.tv.backgroundColor) {
+        [[self window] setBackgroundColor:KOColorFromHandle(bg)];
+        self.tv.backgroundColor = bg;
+        ko_grid_damage_all(self.tv.grid);
+    }
 }
 
 @end
@@ -0,0 +1,1591 @@
+#include "buffer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+enum { KO_PIECE_ORIGINAL, KO_PIECE_ADD };
+
+// nodes refer to each other by index into one array; 0 is "none" and always has sum 0
+typedef struct ko_piece {
+    uint32_t left, right;
+    uint32_t prio;
+    uint32_t source;
+    size_t start;
+    size_t len;
+    size_t sum;                 // bytes covered by this subtree
+    size_t lines;               // newlines in this piece
+    size_t nlsum;               // newlines in this subtree
+} ko_piece;
+
+// newline counts per chunk of the original or the add buffer, for the chunks
+// indexed so far. finding a newline inside a chunk means scanning it, which
+// keeps the index tiny (and the mapped original's pages untouched until they're needed).
+#define KO_LINE_CHUNK 4096
+
+typedef struct ko_lineindex {
+    size_t* before;             // before[i]: newlines in the bytes before chunk i
+    size_t n, cap;              // chunks [0, n - 1) are indexed
+} ko_lineindex;
+
+// a piece's newline count when the original isn't indexed that far yet
+#define KO_LINES_UNKNOWN ((size_t)-1)
+
+// how much of the original a query indexes at a time when it runs out
+#define KO_INDEX_STEP (1 << 20)
+
+// counts the original's newlines per chunk (into its own array, which holds
+// every chunk from the start) and checks it's UTF-8, on a worker thread. the
+// worker publishes done after filling in before up to there; the main thread
+// only ever reads what's been published, and copies it into its own index.
+typedef struct ko_loader {
+    pthread_t thread;
+    const ko_buffer* b;
+    size_t* before;
+    size_t done;                // chunks published (atomic)
+    size_t invalid;             // bad UTF-8 sequences in them (atomic)
+    int cancel;                 // (atomic)
+} ko_loader;
+
+// how much the worker does between publishing, and how often it wakes the main thread
+#define KO_LOAD_STEP (1 << 20)
+#define KO_LOAD_WAKE_INTERVAL 0.05
+
+// a run of the original or the add buffer that an edit took out, kept for undo
+typedef struct ko_span {
+    uint32_t source;
+    size_t start, len;
+} ko_span;
+
+// one insert or delete. undoing it takes the added text back out and puts
+// the removed spans back in; redoing does the opposite.
+typedef struct ko_edit {
+    size_t pos;
+    size_t added, addlen;       // what it inserted, in the add buffer
+    size_t removed, nremoved;   // what it took out, in the journal's spans
+    size_t removedlen;
+    int first;                  // the first edit of an undo step
+} ko_edit;
+
+typedef struct ko_journal {
+    ko_edit* edits;
+    size_t n, cap;
+    size_t done;                // edits past this were undone and can be redone
+    ko_span* spans;
+    size_t nspans, spancap;
+    size_t undo, redo;          // steps each way
+    int joinable;               // the next edit can carry on the last one's step
+    int depth;                  // ko_buffer_begin nesting
+    int opened;                 // the current transaction has started its step
+    size_t batch;               // the last step was the same edit at this many places: its last edits, one each, in order
+} ko_journal;
+
+// something following the buffer's changes (ko_buffer_watch)
+typedef struct ko_watch {
+    ko_buffer_watch_fn fn;
+    void* ctx;
+} ko_watch;
+
+struct ko_buffer {
+    char* original;
+    size_t origlen;
+    int mapped;                 // original is a read-only mmap of a file
+
+    char* add;
+    size_t addlen, addcap;
+
+    ko_lineindex index[2];      // by source; the original's is filled in lazily, the add buffer's as it grows
+    ko_loader* loader;          // while the original is being loaded in the background
+    size_t invalid;             // what the loader found, once it's finished
+
+    ko_piece* nodes;
+    uint32_t nnodes, cap;
+    uint32_t freelist;          // chained through .right
+    uint32_t npieces;
+    uint32_t root;
+    uint32_t seed;
+
+    ko_journal journal;
+    size_t version;             // edits so far
+    ko_watch* watches;
+    size_t nwatches, watchcap;
+};
+
+static inline const char* ko_piece_bytes(const ko_buffer* b, const ko_piece* p) {
+    return (p->source == KO_PIECE_ORIGINAL ? b->original : b->add) + p->start;
+}
+
+static size_t ko_count_newlines(const char* p, size_t len) {
+    size_t n = 0, i = 0;
+
+    // eight bytes at a time: a byte's top bit survives in t only if it wasn't '\n'
+    const uint64_t low = 0x7F7F7F7F7F7F7F7Full, nl = 0x0A0A0A0A0A0A0A0Aull;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        uint64_t x = w ^ nl;
+        uint64_t t = ((x & low) + low) | x;
+        n += (((~t & ~low) >> 7) * 0x0101010101010101ull) >> 56;
+    }
+
+    for (; i < len; i++)
+        n += p[i] == '\n';
+    return n;
+}
+
+static inline const char* ko_source_bytes(const ko_buffer* b, uint32_t source) {
+    return source == KO_PIECE_ORIGINAL ? b->original : b->add;
+}
+
+static inline size_t ko_source_length(const ko_buffer* b, uint32_t source) {
+    return source == KO_PIECE_ORIGINAL ? b->origlen : b->addlen;
+}
+
+// takes whatever the loader has counted that the original's index hasn't
+static void ko_lineindex_adopt(ko_buffer* b) {
+    if (!b->loader)
+        return;
+
+    ko_lineindex* ix = &b->index[KO_PIECE_ORIGINAL];
+    size_t n = __atomic_load_n(&b->loader->done, __ATOMIC_ACQUIRE) + 1;
+    if (n <= ix->n)
+        return;
+
+    if (n > ix->cap) {
+        ix->cap = n;
+        ix->before = realloc(ix->before, ix->cap * sizeof(size_t));
+    }
+    memcpy(ix->before + ix->n, b->loader->before + ix->n, (n - ix->n) * sizeof(size_t));
+    ix->n = n;
+}
+
+// indexes whole chunks of a source until it's indexed up to at least upto (or it runs out)
+static void ko_lineindex_extend(ko_buffer* b, uint32_t source, size_t upto) {
+    ko_lineindex* ix = &b->index[source];
+    if (source == KO_PIECE_ORIGINAL)
+        ko_lineindex_adopt(b);
+
+    const char* bytes = ko_source_bytes(b, source);
+    size_t len = ko_source_length(b, source);
+
+    for (size_t at = (ix->n - 1) * KO_LINE_CHUNK; at < upto && at < len; at += KO_LINE_CHUNK) {
+        size_t n = len - at < KO_LINE_CHUNK ? len - at : KO_LINE_CHUNK;
+
+        // only the original (which never grows) gets a partial last chunk
+        if (n < KO_LINE_CHUNK && source == KO_PIECE_ADD)
+            break;
+
+        if (ix->n == ix->cap) {
+            ix->cap *= 2;
+            ix->before = realloc(ix->before, ix->cap * sizeof(size_t));
+        }
+        ix->before[ix->n] = ix->before[ix->n - 1] + ko_count_newlines(bytes + at, n);
+        ix->n++;
+    }
+}
+
+// how far into the original newlines can be counted without indexing more
+static inline size_t ko_buffer_indexed(const ko_buffer* b) {
+    size_t n = (b->index[KO_PIECE_ORIGINAL].n - 1) * KO_LINE_CHUNK;
+    return n < b->origlen ? n : b->origlen;
+}
+
+static inline int ko_source_known(const ko_buffer* b, uint32_t source, size_t end) {
+    return source == KO_PIECE_ADD || end <= ko_buffer_indexed(b);
+}
+
+// newlines in a source before pos, which has to be somewhere it's known
+static size_t ko_newlines_before(const ko_buffer* b, uint32_t source, size_t pos) {
+    const ko_lineindex* ix = &b->index[source];
+    size_t i = pos / KO_LINE_CHUNK;
+    if (i > ix->n - 1)
+        i = ix->n - 1;          // the add buffer's last, partial chunk
+    return ix->before[i] + ko_count_newlines(ko_source_bytes(b, source) + i * KO_LINE_CHUNK, pos - i * KO_LINE_CHUNK);
+}
+
+static size_t ko_newlines_count(const ko_buffer* b, uint32_t source, size_t start, size_t len) {
+    // short runs are quicker to count directly than from the chunks they're in
+    if (len < start % KO_LINE_CHUNK + (start + len) % KO_LINE_CHUNK)
+        return ko_count_newlines(ko_source_bytes(b, source) + start, len);
+    return ko_newlines_before(b, source, start + len) - ko_newlines_before(b, source, start);
+}
+
+// where a source's newline number g (from 0) is, which has to be somewhere it's known
+static size_t ko_newline_find(const ko_buffer* b, uint32_t source, size_t g) {
+    const ko_lineindex* ix = &b->index[source];
+    const char* bytes = ko_source_bytes(b, source);
+
+    // the last chunk with fewer than g newlines before it
+    size_t lo = 0, hi = ix->n - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        if (ix->before[mid] <= g)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    const char* p = bytes + lo * KO_LINE_CHUNK;
+    const char* end = bytes + ko_source_length(b, source);
+    for (size_t k = g - ix->before[lo]; ; k--) {
+        p = memchr(p, '\n', end - p);
+        if (!k)
+            return p - bytes;
+        p++;
+    }
+}
+
+static uint32_t ko_buffer_random(ko_buffer* b) {
+    uint32_t x = b->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return b->seed = x;
+}
+
+static uint32_t ko_piece_new(ko_buffer* b, uint32_t source, size_t start, size_t len) {
+    uint32_t i = b->freelist;
+    if (i) {
+        b->freelist = b->nodes[i].right;
+    }
+    else {
+        if (b->nnodes == b->cap) {
+            b->cap *= 2;
+            b->nodes = realloc(b->nodes, b->cap * sizeof(ko_piece));
+        }
+        i = b->nnodes++;
+    }
+
+    size_t lines = ko_source_known(b, source, start + len) ? ko_newlines_count(b, source, start, len) : KO_LINES_UNKNOWN;
+    b->nodes[i] = (ko_piece){ 0, 0, ko_buffer_random(b), source, start, len, len, lines, lines };
+    b->npieces++;
+    return i;
+}
+
+static void ko_piece_release(ko_buffer* b, uint32_t t) {
+    if (!t) return;
+    ko_piece_release(b, b->nodes[t].left);
+    ko_piece_release(b, b->nodes[t].right);
+    b->nodes[t].right = b->freelist;
+    b->freelist = t;
+    b->npieces--;
+}
+
+static inline void ko_piece_update(ko_buffer* b, uint32_t t) {
+    ko_piece* n = &b->nodes[t];
+    size_t l = b->nodes[n->left].nlsum, r = b->nodes[n->right].nlsum;
+    n->sum = b->nodes[n->left].sum + n->len + b->nodes[n->right].sum;
+    n->nlsum = (l == KO_LINES_UNKNOWN || n->lines == KO_LINES_UNKNOWN || r == KO_LINES_UNKNOWN) ? KO_LINES_UNKNOWN : l + n->lines + r;
+}
+
+// fills in the counts of pieces the original's index has caught up with.
+// unknown pieces are always the original's last few (in document order the
+// original's pieces only go forward through it), so this stops at the first one still unknown.
+static void ko_piece_refresh(ko_buffer* b, uint32_t t) {
+    if (!t || b->nodes[t].nlsum != KO_LINES_UNKNOWN)
+        return;
+
+    ko_piece_refresh(b, b->nodes[t].left);
+
+    ko_piece* n = &b->nodes[t];
+    if (n->lines == KO_LINES_UNKNOWN) {
+        if (!ko_source_known(b, n->source, n->start + n->len)) {
+            ko_piece_update(b, t);
+            return;
+        }
+        n->lines = ko_newlines_count(b, n->source, n->start, n->len);
+    }
+
+    ko_piece_refresh(b, n->right);
+    ko_piece_update(b, t);
+}
+
+static uint32_t ko_piece_merge(ko_buffer* b, uint32_t l, uint32_t r) {
+    if (!l) return r;
+    if (!r) return l;
+
+    if (b->nodes[l].prio > b->nodes[r].prio) {
+        b->nodes[l].right = ko_piece_merge(b, b->nodes[l].right, r);
+        ko_piece_update(b, l);
+        return l;
+    }
+    else {
+        b->nodes[r].left = ko_piece_merge(b, l, b->nodes[r].left);
+        ko_piece_update(b, r);
+        return r;
+    }
+}
+
+// cuts piece t in two after its first k bytes, leaving it the first part;
+// returns the second, a new piece on its own
+static uint32_t ko_piece_cleave(ko_buffer* b, uint32_t t, size_t k) {
+    uint32_t tail = ko_piece_new(b, b->nodes[t].source, b->nodes[t].start + k, b->nodes[t].len - k);
+
+    b->nodes[t].len = k;
+    if (b->nodes[t].lines != KO_LINES_UNKNOWN)
+        b->nodes[t].lines -= b->nodes[tail].lines;
+    else if (ko_source_known(b, b->nodes[t].source, b->nodes[t].start + k))
+        b->nodes[t].lines = ko_newlines_count(b, b->nodes[t].source, b->nodes[t].start, k);
+    return tail;
+}
+
+// splits t into the first pos bytes and the rest, cutting a piece in two if pos falls inside one.
+// (indices only: making a new piece can move the node array.)
+static void ko_piece_split(ko_buffer* b, uint32_t t, size_t pos, uint32_t* l, uint32_t* r) {
+    if (!t) {
+        *l = *r = 0;
+        return;
+    }
+
+    size_t lsum = b->nodes[b->nodes[t].left].sum;
+    size_t len = b->nodes[t].len;
+
+    if (pos <= lsum) {
+        uint32_t a, c;
+        ko_piece_split(b, b->nodes[t].left, pos, &a, &c);
+        b->nodes[t].left = c;
+        ko_piece_update(b, t);
+        *l = a;
+        *r = t;
+    }
+    else if (pos >= lsum + len) {
+        uint32_t a, c;
+        ko_piece_split(b, b->nodes[t].right, pos - lsum - len, &a, &c);
+        b->nodes[t].right = a;
+        ko_piece_update(b, t);
+        *l = t;
+        *r = c;
+    }
+    else {
+        uint32_t right = b->nodes[t].right;
+        uint32_t tail = ko_piece_cleave(b, t, pos - lsum);
+        b->nodes[t].right = 0;
+        ko_piece_update(b, t);
+
+        *l = t;
+        *r = ko_piece_merge(b, tail, right);
+    }
+}
+
+// takes over original, which is either malloc'd or mapped
+static ko_buffer* ko_buffer_make(char* original, size_t len, int mapped) {
+    ko_buffer* b = calloc(1, sizeof(ko_buffer));
+
+    b->original = original;
+    b->origlen = len;
+    b->mapped = mapped;
+
+    b->addcap = 4096;
+    b->add = malloc(b->addcap);
+
+    for (int source = 0; source < 2; source++) {
+        ko_lineindex* ix = &b->index[source];
+        ix->cap = 64;
+        ix->before = malloc(ix->cap * sizeof(size_t));
+        ix->before[0] = 0;
+        ix->n = 1;
+    }
+
+    b->cap = 64;
+    b->nodes = calloc(b->cap, sizeof(ko_piece));
+    b->nnodes = 1;
+    b->seed = 0x9E3779B9u;
+
+    if (len)
+        b->root = ko_piece_new(b, KO_PIECE_ORIGINAL, 0, len);
+
+    return b;
+}
+
+ko_buffer* ko_buffer_new(const char* text, size_t len) {
+    char* original = malloc(len ? len : 1);
+    memcpy(original, text, len);
+    return ko_buffer_make(original, len, 0);
+}
+
+ko_buffer* ko_buffer_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return NULL;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        close(fd);
+        errno = EISDIR;
+        return NULL;
+    }
+
+    // mmap can't map nothing
+    if (st.st_size == 0) {
+        close(fd);
+        return ko_buffer_new("", 0);
+    }
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int err = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        errno = err;
+        return NULL;
+    }
+
+    return ko_buffer_make(map, st.st_size, 1);
+}
+
+static void ko_loader_stop(ko_buffer* b);
+
+void ko_buffer_free(ko_buffer* b) {
+    if (!b) return;
+    ko_loader_stop(b);
+    if (b->mapped)
+        munmap(b->original, b->origlen);
+    else
+        free(b->original);
+    free(b->add);
+    free(b->nodes);
+    free(b->index[0].before);
+    free(b->index[1].before);
+    free(b->journal.edits);
+    free(b->journal.spans);
+    free(b->watches);
+    free(b);
+}
+
+size_t ko_buffer_length(const ko_buffer* b) {
+    return b->nodes[b->root].sum;
+}
+
+size_t ko_buffer_version(const ko_buffer* b) {
+    return b->version;
+}
+
+void ko_buffer_watch(ko_buffer* b, ko_buffer_watch_fn fn, void* ctx) {
+    if (b->nwatches == b->watchcap) {
+        b->watchcap = b->watchcap ? b->watchcap * 2 : 4;
+        b->watches = realloc(b->watches, b->watchcap * sizeof(ko_watch));
+    }
+    b->watches[b->nwatches++] = (ko_watch){ fn, ctx };
+}
+
+void ko_buffer_unwatch(ko_buffer* b, ko_buffer_watch_fn fn, void* ctx) {
+    for (size_t i = 0; i < b->nwatches; i++) {
+        if (b->watches[i].fn == fn && b->watches[i].ctx == ctx) {
+            memmove(b->watches + i, b->watches + i + 1, (b->nwatches - i - 1) * sizeof(ko_watch));
+            b->nwatches--;
+            return;
+        }
+    }
+}
+
+static void ko_buffer_notify(ko_buffer* b, const ko_buffer_change* c, size_t n) {
+    for (size_t i = 0; i < b->nwatches; i++)
+        b->watches[i].fn(b->watches[i].ctx, b, c, n);
+}
+
+// puts a run of the original or the add buffer at pos
+static void ko_buffer_place(ko_buffer* b, size_t pos, uint32_t source, size_t start, size_t len) {
+    b->version++;
+
+    uint32_t l, r;
+    ko_piece_split(b, b->root, pos, &l, &r);
+
+    // typing keeps appending right after the previous insert, so usually the
+    // piece before pos already ends where the new bytes start and just grows
+    uint32_t last = l;
+    while (last && b->nodes[last].right)
+        last = b->nodes[last].right;
+
+    size_t lines = ko_source_known(b, source, start + len) ? ko_newlines_count(b, source, start, len) : KO_LINES_UNKNOWN;
+
+    if (last && lines != KO_LINES_UNKNOWN && b->nodes[last].lines != KO_LINES_UNKNOWN &&
+        b->nodes[last].source == source && b->nodes[last].start + b->nodes[last].len == start) {
+        b->nodes[last].len += len;
+        b->nodes[last].lines += lines;
+        for (uint32_t t = l; t; t = b->nodes[t].right) {
+            b->nodes[t].sum += len;
+            if (b->nodes[t].nlsum != KO_LINES_UNKNOWN)
+                b->nodes[t].nlsum += lines;
+        }
+    }
+    else {
+        l = ko_piece_merge(b, l, ko_piece_new(b, source, start, len));
+    }
+
+    b->root = ko_piece_merge(b, l, r);
+
+    ko_buffer_change c = { pos, 0, len, 0, lines };
+    ko_buffer_notify(b, &c, 1);
+}
+
+static void ko_journal_keep(ko_journal* j, const ko_buffer* b, uint32_t t) {
+    if (!t) return;
+    const ko_piece* n = &b->nodes[t];
+    ko_journal_keep(j, b, n->left);
+    if (j->nspans == j->spancap) {
+        j->spancap = j->spancap ? j->spancap * 2 : 64;
+        j->spans = realloc(j->spans, j->spancap * sizeof(ko_span));
+    }
+    j->spans[j->nspans++] = (ko_span){ n->source, n->start, n->len };
+    ko_journal_keep(j, b, n->right);
+}
+
+// takes out [pos, pos + len); if j is given, what was there is added to its spans
+static void ko_buffer_cut(ko_buffer* b, size_t pos, size_t len, ko_journal* j) {
+    b->version++;
+
+    uint32_t l, m, r;
+    ko_piece_split(b, b->root, pos, &l, &r);
+    ko_piece_split(b, r, len, &m, &r);
+    if (j)
+        ko_journal_keep(j, b, m);
+    size_t lines = b->nodes[m].nlsum;
+    ko_piece_release(b, m);
+    b->root = ko_piece_merge(b, l, r);
+
+    ko_buffer_change c = { pos, len, 0, lines, 0 };
+    ko_buffer_notify(b, &c, 1);
+}
+
+// ---- the same change at many places in one go
+
+// a batch this big compared to the pieces is quicker to do in one walk over
+// all of them, rebuilding the tree, than one split and merge at a time
+static int ko_buffer_sweeps(const ko_buffer* b, size_t n) {
+    return n > 1 && n * 16 >= b->npieces;
+}
+
+// lists t's pieces in order
+static void ko_piece_list(const ko_buffer* b, uint32_t t, uint32_t* list, size_t* n) {
+    if (!t) return;
+    ko_piece_list(b, b->nodes[t].left, list, n);
+    list[(*n)++] = t;
+    ko_piece_list(b, b->nodes[t].right, list, n);
+}
+
+// makes a treap of the pieces in list, in that order, in one pass: each one
+// goes on the end of the right spine, under the last node there that outranks it
+static uint32_t ko_piece_build(ko_buffer* b, const uint32_t* list, size_t n, uint32_t* spine) {
+    size_t depth = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t t = list[i], last = 0;
+        while (depth > 0 && b->nodes[spine[depth - 1]].prio < b->nodes[t].prio) {
+            last = spine[--depth];
+            ko_piece_update(b, last);
+        }
+        b->nodes[t].left = last;
+        b->nodes[t].right = 0;
+        if (depth > 0)
+            b->nodes[spine[depth - 1]].right = t;
+        spine[depth++] = t;
+    }
+    while (depth > 1)
+        ko_piece_update(b, spine[--depth]);
+    if (depth == 0)
+        return 0;
+    ko_piece_update(b, spine[0]);
+    return spine[0];
+}
+
+// puts the same run of the add buffer at each of pos (ascending, as of before any of it)
+static void ko_buffer_place_many(ko_buffer* b, const size_t* pos, size_t n, size_t start, size_t len) {
+    size_t total = ko_buffer_length(b);
+    if (!ko_buffer_sweeps(b, n)) {
+        for (size_t i = 0; i < n; i++)
+            ko_buffer_place(b, (pos[i] < total ? pos[i] : total) + i * len, KO_PIECE_ADD, start, len);
+        return;
+    }
+
+    b->version++;
+    size_t lines = ko_newlines_count(b, KO_PIECE_ADD, start, len);
+    size_t cap = b->npieces + 2 * n;
+    uint32_t* list = malloc(cap * sizeof(uint32_t));
+    uint32_t* spine = malloc(cap * sizeof(uint32_t));
+    ko_buffer_change* c = malloc(n * sizeof(ko_buffer_change));
+
+    // goes through the pieces as they were (listed in spine, which isn't needed
+    // till they're all listed again), cutting them at each place and putting the run in
+    size_t np = 0, out = 0, off = 0, i = 0;
+    ko_piece_list(b, b->root, spine, &np);
+    for (size_t k = 0; k <= np; k++) {
+        uint32_t t = k < np ? spine[k] : 0;
+        size_t end = t ? off + b->nodes[t].len : SIZE_MAX;
+
+        while (i < n && pos[i] < end) {
+            if (t && pos[i] > off) {
+                uint32_t tail = ko_piece_cleave(b, t, pos[i] - off);
+                list[out++] = t;
+                t = tail;
+                off = pos[i];
+            }
+
+            // like typing does, the run grows the piece that ends where it starts
+            uint32_t last = out ? list[out - 1] : 0;
+            if (last && b->nodes[last].lines != KO_LINES_UNKNOWN && b->nodes[last].source == KO_PIECE_ADD &&
+                b->nodes[last].start + b->nodes[last].len == start) {
+                b->nodes[last].len += len;
+                b->nodes[last].lines += lines;
+            }
+            else {
+                list[out++] = ko_piece_new(b, KO_PIECE_ADD, start, len);
+            }
+
+            c[i] = (ko_buffer_change){ (pos[i] < total ? pos[i] : total) + i * len, 0, len, 0, lines };
+            i++;
+        }
+        if (t) {
+            list[out++] = t;
+            off = end;
+        }
+    }
+
+    b->root = ko_piece_build(b, list, out, spine);
+    ko_buffer_notify(b, c, n);
+    free(list);
+    free(spine);
+    free(c);
+}
+
+// takes out len[i] bytes at each pos[i] (ascending, as of before any of it, not
+// overlapping), setting took[i] to how many that was. if j is given, what was
+// taken goes on its spans, kept[i] of them for each.
+static void ko_buffer_cut_many(ko_buffer* b, const size_t* pos, const size_t* len, size_t n,
+                               ko_journal* j, size_t* took, size_t* kept) {
+    if (!ko_buffer_sweeps(b, n)) {
+        size_t gone = 0;
+        for (size_t i = 0; i < n; i++) {
+            size_t at = pos[i] - gone;
+            size_t total = ko_buffer_length(b);
+            size_t spans = j ? j->nspans : 0;
+            took[i] = at >= total ? 0 : len[i] < total - at ? len[i] : total - at;
+            if (took[i])
+                ko_buffer_cut(b, at, took[i], j);
+            kept[i] = j ? j->nspans - spans : 0;
+            gone += took[i];
+        }
+        return;
+    }
+
+    b->version++;
+    size_t cap = b->npieces + 2 * n;
+    uint32_t* list = malloc(cap * sizeof(uint32_t));
+    uint32_t* spine = malloc(cap * sizeof(uint32_t));
+    ko_buffer_change* c = malloc(n * sizeof(ko_buffer_change));
+
+    size_t np = 0, out = 0, off = 0, i = 0, gone = 0, nc = 0;
+    size_t bytes = 0, lines = 0, spans = j ? j->nspans : 0;    // what cut i has taken so far
+    ko_piece_list(b, b->root, spine, &np);
+    for (size_t k = 0; k <= np; k++) {
+        uint32_t t = k < np ? spine[k] : 0;
+
+        while (i < n) {
+            if (len[i] == 0 || pos[i] + len[i] <= off || k == np) {
+                // cut i has taken all it's going to
+                took[i] = bytes;
+                kept[i] = j ? j->nspans - spans : 0;
+                if (bytes)
+                    c[nc++] = (ko_buffer_change){ pos[i] - gone, bytes, 0, lines, 0 };
+                gone += bytes;
+                bytes = lines = 0;
+                spans = j ? j->nspans : 0;
+                i++;
+                continue;
+            }
+            if (!t || pos[i] >= off + b->nodes[t].len)
+                break;
+
+            if (pos[i] > off) {
+                // the part before the cut stays
+                uint32_t tail = ko_piece_cleave(b, t, pos[i] - off);
+                list[out++] = t;
+                t = tail;
+                off = pos[i];
+                continue;
+            }
+
+            // t starts in the cut, so it goes, as far as the cut does
+            uint32_t tail = pos[i] + len[i] - off < b->nodes[t].len ? ko_piece_cleave(b, t, pos[i] + len[i] - off) : 0;
+            bytes += b->nodes[t].len;
+            off += b->nodes[t].len;
+            if (lines != KO_LINES_UNKNOWN)
+                lines = b->nodes[t].lines == KO_LINES_UNKNOWN ? KO_LINES_UNKNOWN : lines + b->nodes[t].lines;
+            b->nodes[t].left = b->nodes[t].right = 0;
+            if (j)
+                ko_journal_keep(j, b, t);
+            ko_piece_release(b, t);
+            t = tail;
+        }
+
+        if (t) {
+            list[out++] = t;
+            off += b->nodes[t].len;
+        }
+    }
+
+    b->root = ko_piece_build(b, list, out, spine);
+    if (nc)
+        ko_buffer_notify(b, c, nc);
+    free(list);
+    free(spine);
+    free(c);
+}
+
+// ---- the undo journal
+
+// the last edit, if the next one at pos (taking out len bytes) carries on from it in the same step
+static ko_edit* ko_journal_continues(ko_journal* j, size_t pos, size_t len) {
+    if (j->done == 0 || j->done < j->n)
+        return NULL;
+
+    ko_edit* e = &j->edits[j->done - 1];
+    if (j->depth > 0)
+        return j->opened ? e : NULL;
+
+    // typing, backspacing or forward-deleting right where the last edit left off
+    size_t at = e->pos + e->addlen;
+    if (j->joinable && (pos == at || pos + len == at))
+        return e;
+    return NULL;
+}
+
+static ko_edit* ko_journal_push(ko_journal* j, size_t pos, int first) {
+    // a new edit can't be redone past
+    if (j->done < j->n) {
+        j->nspans = j->edits[j->done].removed;
+        j->n = j->done;
+        j->redo = 0;
+    }
+
+    if (j->n == j->cap) {
+        j->cap = j->cap ? j->cap * 2 : 256;
+        j->edits = realloc(j->edits, j->cap * sizeof(ko_edit));
+    }
+
+    ko_edit* e = &j->edits[j->n++];
+    *e = (ko_edit){ .pos = pos, .removed = j->nspans, .first = first };
+    j->done = j->n;
+    j->undo += first;
+    j->joinable = 1;
+    j->batch = 0;
+    if (j->depth > 0)
+        j->opened = 1;
+    return e;
+}
+
+// copies str onto the end of the add buffer; returns where it went
+static size_t ko_buffer_append(ko_buffer* b, const char* str, size_t len) {
+    if (b->addlen + len > b->addcap) {
+        while (b->addlen + len > b->addcap)
+            b->addcap *= 2;
+        b->add = realloc(b->add, b->addcap);
+    }
+
+    size_t start = b->addlen;
+    memcpy(b->add + start, str, len);
+    b->addlen += len;
+    ko_lineindex_extend(b, KO_PIECE_ADD, b->addlen);
+    return start;
+}
+
+void ko_buffer_insert(ko_buffer* b, size_t pos, const char* str, size_t len) {
+    if (len == 0)
+        return;
+    if (pos > ko_buffer_length(b))
+        pos = ko_buffer_length(b);
+
+    size_t start = ko_buffer_append(b, str, len);
+    ko_buffer_place(b, pos, KO_PIECE_ADD, start, len);
+
+    // the inserted text never moves in the add buffer, so the journal only needs where it is.
+    // typing grows the last edit's insert, since it's right after it in both.
+    ko_journal* j = &b->journal;
+    ko_edit* e = ko_journal_continues(j, pos, 0);
+    if (e && pos == e->pos + e->addlen && e->added + e->addlen == start) {
+        e->addlen += len;
+        return;
+    }
+
+    e = ko_journal_push(j, pos, !e);
+    e->added = start;
+    e->addlen = len;
+}
+
+void ko_buffer_delete(ko_buffer* b, size_t pos, size_t len) {
+    size_t total = ko_buffer_length(b);
+    if (pos >= total || len == 0)
+        return;
+    if (len > total - pos)
+        len = total - pos;
+
+    // backspacing over what the last edit typed just takes it back out of that edit
+    ko_journal* j = &b->journal;
+    ko_edit* e = ko_journal_continues(j, pos, len);
+    if (e && pos >= e->pos && pos + len == e->pos + e->addlen) {
+        ko_buffer_cut(b, pos, len, NULL);
+        e->addlen -= len;
+
+        // all of it, and it was a step of its own: there's nothing left to undo
+        if (e->addlen == 0 && e->nremoved == 0 && e->first) {
+            j->n = --j->done;
+            j->undo--;
+            j->joinable = 0;
+            j->opened = 0;
+        }
+        return;
+    }
+
+    // the removed text stays where it is too; the journal keeps the pieces that pointed at it
+    int first = !e;
+    e = ko_journal_push(j, pos, first);
+    ko_buffer_cut(b, pos, len, j);
+    e->nremoved = j->nspans - e->removed;
+    e->removedlen = len;
+}
+
+// ---- the same edit at many places
+
+#define KO_NO_BATCH ((size_t)-1)
+
+// where the last step's batch of n edits starts, if the next batch of n can carry it on.
+// each of its edits has its pos as of the text with the ones before it done
+// (and none after), so edit i's inserted text is still at [pos, pos + addlen).
+static size_t ko_journal_batch(const ko_journal* j, size_t n) {
+    if (!j->joinable || j->depth > 0 || j->batch != n || j->done < j->n)
+        return KO_NO_BATCH;
+    return j->done - n;
+}
+
+// whether the next edit starts an undo step, or is part of an open transaction's
+static int ko_journal_first(const ko_journal* j) {
+    return !(j->depth > 0 && j->opened && j->done == j->n && j->done > 0);
+}
+
+void ko_buffer_insert_many(ko_buffer* b, const size_t* pos, size_t n, const char* str, size_t len) {
+    if (len == 0 || n == 0)
+        return;
+
+    // the text goes in the add buffer once, and every place gets a piece of
+    // the same bytes. so the next key grows each of those pieces, like typing
+    // in one place does, rather than adding n more.
+    size_t start = ko_buffer_append(b, str, len);
+    size_t total = ko_buffer_length(b);
+    ko_buffer_place_many(b, pos, n, start, len);
+
+    // typing at each of them right where the last batch left off
+    ko_journal* j = &b->journal;
+    size_t from = ko_journal_batch(j, n);
+    for (size_t i = 0; from != KO_NO_BATCH && i < n; i++) {
+        const ko_edit* e = &j->edits[from + i];
+        if (pos[i] != e->pos + e->addlen || e->added + e->addlen != start)
+            from = KO_NO_BATCH;
+    }
+
+    if (from != KO_NO_BATCH) {
+        for (size_t i = 0; i < n; i++) {
+            ko_edit* e = &j->edits[from + i];
+            e->pos += i * len;
+            e->addlen += len;
+        }
+        return;
+    }
+
+    int first = ko_journal_first(j);
+    for (size_t i = 0; i < n; i++) {
+        ko_edit* e = ko_journal_push(j, (pos[i] < total ? pos[i] : total) + i * len, first && i == 0);
+        e->added = start;
+        e->addlen = len;
+    }
+    j->batch = n;
+}
+
+void ko_buffer_delete_many(ko_buffer* b, const size_t* pos, const size_t* len, size_t n) {
+    if (n == 0)
+        return;
+
+    size_t* took = malloc(2 * n * sizeof(size_t));
+    size_t* kept = took + n;
+
+    // backspacing over what the last batch typed takes it back out of those edits
+    ko_journal* j = &b->journal;
+    size_t from = ko_journal_batch(j, n);
+    for (size_t i = 0; from != KO_NO_BATCH && i < n; i++) {
+        const ko_edit* e = &j->edits[from + i];
+        if (pos[i] < e->pos || pos[i] + len[i] != e->pos + e->addlen)
+            from = KO_NO_BATCH;
+    }
+
+    if (from != KO_NO_BATCH) {
+        ko_buffer_cut_many(b, pos, len, n, NULL, took, kept);
+
+        size_t gone = 0, left = 0;
+        for (size_t i = 0; i < n; i++) {
+            ko_edit* e = &j->edits[from + i];
+            e->pos -= gone;
+            e->addlen -= took[i];
+            left += e->addlen + e->nremoved;
+            gone += took[i];
+        }
+
+        // all of it, and it was a step of its own: there's nothing left to undo
+        if (left == 0 && j->edits[from].first) {
+            j->n = j->done = from;
+            j->undo--;
+            j->joinable = 0;
+            j->batch = 0;
+        }
+        free(took);
+        return;
+    }
+
+    // the edits go in first (which drops anything that could have been
+    // redone, spans included), then get filled in with what came out
+    int first = ko_journal_first(j);
+    for (size_t i = 0; i < n; i++)
+        ko_journal_push(j, pos[i], first && i == 0);
+    size_t k = j->n - n;
+    size_t spans = j->nspans;
+    ko_buffer_cut_many(b, pos, len, n, j, took, kept);
+
+    size_t gone = 0;
+    for (size_t i = 0; i < n; i++) {
+        ko_edit* e = &j->edits[k + i];
+        e->pos -= gone;
+        e->removed = spans;
+        e->nremoved = kept[i];
+        e->removedlen = took[i];
+        spans += kept[i];
+        gone += took[i];
+    }
+    j->batch = n;
+    free(took);
+}
+
+void ko_buffer_seal(ko_buffer* b) {
+    b->journal.joinable = 0;
+}
+
+void ko_buffer_begin(ko_buffer* b) {
+    if (b->journal.depth++ == 0)
+        b->journal.opened = 0;
+}
+
+void ko_buffer_end(ko_buffer* b) {
+    if (b->journal.depth > 0 && --b->journal.depth == 0)
+        b->journal.joinable = 0;
+}
+
+int ko_buffer_undo(ko_buffer* b, size_t* pos) {
+    ko_journal* j = &b->journal;
+    if (j->done == 0)
+        return 0;
+
+    // take each edit of the step back out, last first
+    ko_edit* e;
+    do {
+        e = &j->edits[--j->done];
+        ko_buffer_cut(b, e->pos, e->addlen, NULL);
+        size_t at = e->pos;
+        for (size_t k = e->removed; k < e->removed + e->nremoved; k++) {
+            ko_buffer_place(b, at, j->spans[k].source, j->spans[k].start, j->spans[k].len);
+            at += j->spans[k].len;
+        }
+    } while (!e->first);
+
+    j->undo--;
+    j->redo++;
+    j->joinable = 0;
+    if (pos)
+        *pos = e->pos + e->removedlen;
+    return 1;
+}
+
+int ko_buffer_redo(ko_buffer* b, size_t* pos) {
+    ko_journal* j = &b->journal;
+    if (j->done == j->n)
+        return 0;
+
+    ko_edit* e;
+    do {
+        e = &j->edits[j->done++];
+        ko_buffer_cut(b, e->pos, e->removedlen, NULL);
+        if (e->addlen)
+            ko_buffer_place(b, e->pos, KO_PIECE_ADD, e->added, e->addlen);
+    } while (j->done < j->n && !j->edits[j->done].first);
+
+    j->undo++;
+    j->redo--;
+    j->joinable = 0;
+    if (pos)
+        *pos = e->pos + e->addlen;
+    return 1;
+}
+
+// lets the system have back the pages of a mapped original that bytes..bytes + len covers
+// (whole pages only); they're read from the file again if they're needed
+static void ko_buffer_drop(const ko_buffer* b, const char* bytes, size_t len) {
+    if (!b->mapped || bytes < b->original || bytes >= b->original + b->origlen)
+        return;
+
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t lo = ((uintptr_t)bytes + page - 1) & ~(page - 1);
+    uintptr_t hi = ((uintptr_t)bytes + len) & ~(page - 1);
+    if (hi > lo)
+        madvise((void*)lo, hi - lo, MADV_DONTNEED);
+}
+
+int ko_buffer_index(ko_buffer* b, size_t bytes) {
+    size_t from = ko_buffer_indexed(b);
+    if (from == b->origlen)
+        return 1;
+
+    // if the loader has got further, that's as good as counting
+    ko_lineindex_adopt(b);
+    if (ko_buffer_indexed(b) > from) {
+        ko_piece_refresh(b, b->root);
+        return ko_buffer_indexed(b) == b->origlen;
+    }
+
+    ko_lineindex_extend(b, KO_PIECE_ORIGINAL, from + bytes);
+    ko_piece_refresh(b, b->root);
+
+    // indexing read those pages, but nobody's necessarily looking at them
+    ko_buffer_drop(b, b->original + from, ko_buffer_indexed(b) - from);
+
+    return ko_buffer_indexed(b) == b->origlen;
+}
+
+// ---- loading in the background
+
+static void (*ko_buffer_wake)(void);
+
+void ko_buffer_setwake(void (*wake)(void)) {
+    __atomic_store_n(&ko_buffer_wake, wake, __ATOMIC_RELEASE);
+}
+
+static void ko_loader_notify(void) {
+    void (*wake)(void) = __atomic_load_n(&ko_buffer_wake, __ATOMIC_ACQUIRE);
+    if (wake)
+        wake();
+}
+
+static double ko_loader_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// a UTF-8 check that can stop after any byte and carry on from there
+typedef struct ko_utf8_check {
+    int need;                   // continuation bytes still to come
+    unsigned char lo, hi;       // the range the next one has to be in
+    size_t invalid;
+} ko_utf8_check;
+
+static void ko_utf8_check_bytes(ko_utf8_check* u, const unsigned char* s, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        // mostly it's ASCII, eight bytes at a time
+        if (!u->need) {
+            uint64_t w;
+            while (i + 8 <= len && (memcpy(&w, s + i, 8), !(w & 0x8080808080808080ull)))
+                i += 8;
+            if (i == len)
+                break;
+        }
+
+        unsigned char c = s[i];
+        if (u->need) {
+            if (c >= u->lo && c <= u->hi) {
+                u->need--;
+                u->lo = 0x80;
+                u->hi = 0xBF;
+                i++;
+                continue;
+            }
+            // cut short; c starts something new
+            u->invalid++;
+            u->need = 0;
+        }
+        i++;
+
+        // the lead byte says how many more, and (for overlongs, surrogates and past U+10FFFF) what the next can be
+        u->lo = 0x80;
+        u->hi = 0xBF;
+        if (c < 0x80)                    ;
+        else if (c >= 0xC2 && c <= 0xDF) u->need = 1;
+        else if (c == 0xE0)              { u->need = 2; u->lo = 0xA0; }
+        else if (c == 0xED)              { u->need = 2; u->hi = 0x9F; }
+        else if (c >= 0xE1 && c <= 0xEF) u->need = 2;
+        else if (c == 0xF0)              { u->need = 3; u->lo = 0x90; }
+        else if (c >= 0xF1 && c <= 0xF3) u->need = 3;
+        else if (c == 0xF4)              { u->need = 3; u->hi = 0x8F; }
+        else                             u->invalid++;
+    }
+}
+
+static void* ko_loader_run(void* arg) {
+    ko_loader* l = arg;
+    const char* bytes = l->b->original;
+    size_t len = l->b->origlen;
+    size_t nchunks = (len + KO_LINE_CHUNK - 1) / KO_LINE_CHUNK;
+    ko_utf8_check u = { 0 };
+    double woke = 0;
+
+    for (size_t i = 0; i < nchunks; ) {
+        if (__atomic_load_n(&l->cancel, __ATOMIC_ACQUIRE))
+            return NULL;
+
+        size_t from = i * KO_LINE_CHUNK;
+        size_t end = i + KO_LOAD_STEP / KO_LINE_CHUNK;
+        if (end > nchunks) end = nchunks;
+
+        for (; i < end; i++) {
+            size_t at = i * KO_LINE_CHUNK;
+            size_t n = len - at < KO_LINE_CHUNK ? len - at : KO_LINE_CHUNK;
+            l->before[i + 1] = l->before[i] + ko_count_newlines(bytes + at, n);
+            ko_utf8_check_bytes(&u, (const unsigned char*)bytes + at, n);
+        }
+        size_t to = i == nchunks ? len : i * KO_LINE_CHUNK;
+        if (i == nchunks && u.need)
+            u.invalid++;
+
+        __atomic_store_n(&l->invalid, u.invalid, __ATOMIC_RELAXED);
+        __atomic_store_n(&l->done, i, __ATOMIC_RELEASE);
+
+        // reading the pages in was the point, but nobody's looking at them yet
+        ko_buffer_drop(l->b, bytes + from, to - from);
+
+        double now = ko_loader_now();
+        if (i == nchunks || now - woke >= KO_LOAD_WAKE_INTERVAL) {
+            woke = now;
+            ko_loader_notify();
+        }
+    }
+    return NULL;
+}
+
+int ko_buffer_load(ko_buffer* b) {
+    if (b->loader || !b->origlen)
+        return 0;
+
+    ko_loader* l = calloc(1, sizeof(ko_loader));
+    l->b = b;
+    l->before = calloc((b->origlen + KO_LINE_CHUNK - 1) / KO_LINE_CHUNK + 1, sizeof(size_t));
+
+    int err = pthread_create(&l->thread, NULL, ko_loader_run, l);
+    if (err) {
+        free(l->before);
+        free(l);
+        errno = err;
+        return -1;
+    }
+
+    b->loader = l;
+    return 0;
+}
+
+static void ko_loader_stop(ko_buffer* b) {
+    ko_loader* l = b->loader;
+    if (!l)
+        return;
+
+    __atomic_store_n(&l->cancel, 1, __ATOMIC_RELEASE);
+    pthread_join(l->thread, NULL);
+    ko_lineindex_adopt(b);
+    b->invalid = __atomic_load_n(&l->invalid, __ATOMIC_RELAXED);
+
+    b->loader = NULL;
+    free(l->before);
+    free(l);
+}
+
+int ko_buffer_loading(ko_buffer* b, double* fraction) {
+    if (b->loader) {
+        // stopping it takes the rest of what it counted, so it has to be before the refresh
+        if (__atomic_load_n(&b->loader->done, __ATOMIC_ACQUIRE) == (b->origlen + KO_LINE_CHUNK - 1) / KO_LINE_CHUNK)
+            ko_loader_stop(b);
+        else
+            ko_lineindex_adopt(b);
+        ko_piece_refresh(b, b->root);
+    }
+
+    if (fraction)
+        *fraction = b->origlen ? (double)ko_buffer_indexed(b) / b->origlen : 1.0;
+    return b->loader != NULL;
+}
+
+// the line index is a cache: queries that run past what's indexed index some more and try again
+static ko_buffer* ko_buffer_cache(const ko_buffer* b) {
+    return (ko_buffer*)b;
+}
+
+size_t ko_buffer_lines(const ko_buffer* b) {
+    while (b->nodes[b->root].nlsum == KO_LINES_UNKNOWN)
+        ko_buffer_index(ko_buffer_cache(b), KO_INDEX_STEP);
+    return b->nodes[b->root].nlsum + 1;
+}
+
+// finds where line starts, from the newline before it. returns 1 if it did,
+// -1 if there's no such line, or 0 if that's past what's indexed.
+static int ko_buffer_find_line(const ko_buffer* b, size_t line, size_t* offset) {
+    size_t k = line, base = 0;
+    int unsure = 0;
+    uint32_t t = b->root;
+
+    while (t) {
+        const ko_piece* n = &b->nodes[t];
+        size_t lsum = b->nodes[n->left].sum;
+        size_t lnl = b->nodes[n->left].nlsum;
+
+        if (lnl == KO_LINES_UNKNOWN) {
+            // it's in there if it's in the indexed part
+            unsure = 1;
+            t = n->left;
+            continue;
+        }
+
+        // only the part of the piece that's indexed counts
+        size_t lines = n->lines;
+        if (lines == KO_LINES_UNKNOWN) {
+            size_t indexed = ko_buffer_indexed(b);
+            lines = n->start < indexed ? ko_newlines_count(b, n->source, n->start, indexed - n->start) : 0;
+        }
+
+        if (k <= lnl) {
+            t = n->left;
+        }
+        else if (k <= lnl + lines) {
+            size_t g = ko_newlines_before(b, n->source, n->start) + (k - lnl) - 1;
+            *offset = base + lsum + (ko_newline_find(b, n->source, g) - n->start) + 1;
+            return 1;
+        }
+        else if (n->lines == KO_LINES_UNKNOWN) {
+            return 0;
+        }
+        else {
+            k -= lnl + n->lines;
+            base += lsum + n->len;
+            t = n->right;
+        }
+    }
+
+    // without anything unsure, everything got counted on the way
+    return unsure ? 0 : -1;
+}
+
+static int ko_buffer_line_start(const ko_buffer* b, size_t line, size_t* offset) {
+    int found;
+    if (line == 0) {
+        *offset = 0;
+        return 1;
+    }
+    while (!(found = ko_buffer_find_line(b, line, offset)))
+        ko_buffer_index(ko_buffer_cache(b), KO_INDEX_STEP);
+    return found > 0;
+}
+
+size_t ko_buffer_line_offset(const ko_buffer* b, size_t line) {
+    size_t offset;
+    if (!ko_buffer_line_start(b, line, &offset))
+        ko_buffer_line_start(b, b->nodes[b->root].nlsum, &offset);
+    return offset;
+}
+
+int ko_buffer_line_range(const ko_buffer* b, size_t line, size_t* start, size_t* end) {
+    if (!ko_buffer_line_start(b, line, start))
+        return 0;
+    if (ko_buffer_line_start(b, line + 1, end))
+        (*end)--;
+    else
+        *end = ko_buffer_length(b);
+    return 1;
+}
+
+// counts the newlines before pos; returns 0 if that's past what's indexed
+static int ko_buffer_find_offset(const ko_buffer* b, size_t pos, size_t* line) {
+    size_t nl = 0;
+    uint32_t t = b->root;
+
+    while (t) {
+        const ko_piece* n = &b->nodes[t];
+        size_t lsum = b->nodes[n->left].sum;
+        size_t lnl = b->nodes[n->left].nlsum;
+
+        if (pos <= lsum) {
+            t = n->left;
+            continue;
+        }
+        if (lnl == KO_LINES_UNKNOWN)
+            return 0;
+
+        if (pos <= lsum + n->len) {
+            if (!ko_source_known(b, n->source, n->start + (pos - lsum)))
+                return 0;
+            *line = nl + lnl + ko_newlines_count(b, n->source, n->start, pos - lsum);
+            return 1;
+        }
+        if (n->lines == KO_LINES_UNKNOWN)
+            return 0;
+
+        nl += lnl + n->lines;
+        pos -= lsum + n->len;
+        t = n->right;
+    }
+
+    *line = nl;
+    return 1;
+}
+
+size_t ko_buffer_offset_line(const ko_buffer* b, size_t pos) {
+    size_t line;
+    while (!ko_buffer_find_offset(b, pos, &line))
+        ko_buffer_index(ko_buffer_cache(b), KO_INDEX_STEP);
+    return line;
+}
+
+// in-order walk over the pieces overlapping [pos, pos + len); returns 0 once fn asked to stop
+static int ko_piece_walk(const ko_buffer* b, uint32_t t, size_t pos, size_t len, ko_buffer_span_fn fn, void* ctx) {
+    while (t && len) {
+        const ko_piece* n = &b->nodes[t];
+        size_t lsum = b->nodes[n->left].sum;
+
+        if (pos < lsum) {
+            size_t take = lsum - pos < len ? lsum - pos : len;
+            if (!ko_piece_walk(b, n->left, pos, take, fn, ctx))
+                return 0;
+            pos += take;
+            len -= take;
+        }
+
+        if (len && pos < lsum + n->len) {
+            size_t k = pos - lsum;
+            size_t take = n->len - k < len ? n->len - k : len;
+            if (!fn(ctx, ko_piece_bytes(b, n) + k, take))
+                return 0;
+            pos += take;
+            len -= take;
+        }
+
+        // the rest is in the right subtree; loop instead of recursing
+        pos -= lsum + n->len;
+        t = n->right;
+    }
+    return 1;
+}
+
+void ko_buffer_spans(const ko_buffer* b, size_t pos, size_t len, ko_buffer_span_fn fn, void* ctx) {
+    size_t total = ko_buffer_length(b);
+    if (pos >= total)
+        return;
+    if (len > total - pos)
+        len = total - pos;
+    ko_piece_walk(b, b->root, pos, len, fn, ctx);
+}
+
+// the same, last piece first
+static int ko_piece_rwalk(const ko_buffer* b, uint32_t t, size_t pos, size_t len, ko_buffer_span_fn fn, void* ctx) {
+    while (t && len) {
+        const ko_piece* n = &b->nodes[t];
+        size_t lsum = b->nodes[n->left].sum;
+        size_t mid = lsum + n->len;
+        size_t end = pos + len;
+
+        if (end > mid) {
+            size_t from = pos > mid ? pos : mid;
+            if (!ko_piece_rwalk(b, n->right, from - mid, end - from, fn, ctx))
+                return 0;
+            len = from - pos;
+            end = from;
+        }
+
+        if (len && end > lsum) {
+            size_t from = pos > lsum ? pos : lsum;
+            if (!fn(ctx, ko_piece_bytes(b, n) + (from - lsum), end - from))
+                return 0;
+            len = from - pos;
+        }
+
+        // the rest is in the left subtree
+        t = n->left;
+    }
+    return 1;
+}
+
+void ko_buffer_rspans(const ko_buffer* b, size_t pos, size_t len, ko_buffer_span_fn fn, void* ctx) {
+    size_t total = ko_buffer_length(b);
+    if (pos >= total)
+        return;
+    if (len > total - pos)
+        len = total - pos;
+    ko_piece_rwalk(b, b->root, pos, len, fn, ctx);
+}
+
+static int ko_buffer_copyspan(void* ctx, const char* bytes, size_t len) {
+    char** out = ctx;
+    memcpy(*out, bytes, len);
+    *out += len;
+    return 1;
+}
+
+size_t ko_buffer_copy(const ko_buffer* b, size_t pos, size_t len, char* out) {
+    char* end = out;
+    ko_buffer_spans(b, pos, len, ko_buffer_copyspan, &end);
+    return end - out;
+}
+
+// ---- saving
+
+// writes are batched this many spans at a time, and kept well under the 2 GB
+// some systems won't write (or writev) in one call
+#define KO_SAVE_IOVS 64
+#define KO_SAVE_MAX_BYTES (1u << 30)
+
+typedef struct ko_save {
+    const ko_buffer* b;
+    int fd;
+    struct iovec iov[KO_SAVE_IOVS];
+    int n;
+    size_t bytes;               // in iov
+    size_t written;
+    int failed;                 // errno
+} ko_save;
+
+static void ko_save_flush(ko_save* sv) {
+    struct iovec* iov = sv->iov;
+    int n = sv->n;
+
+    while (n > 0 && !sv->failed) {
+        ssize_t w = writev(sv->fd, iov, n);
+        if (w < 0) {
+            if (errno != EINTR)
+                sv->failed = errno;
+            continue;
+        }
+        sv->written += w;
+
+        // a short write leaves the rest for another go
+        while (n > 0 && (size_t)w >= iov->iov_len) {
+            w -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (char*)iov->iov_base + w;
+            iov->iov_len -= w;
+        }
+    }
+
+    // what came straight from a mapped file doesn't need to stay in memory
+    for (int k = 0; k < sv->n; k++)
+        ko_buffer_drop(sv->b, sv->iov[k].iov_base, sv->iov[k].iov_len);
+
+    sv->n = 0;
+    sv->bytes = 0;
+}
+
+static int ko_save_span(void* ctx, const char* bytes, size_t len) {
+    ko_save* sv = ctx;
+
+    while (len && !sv->failed) {
+        size_t n = len < KO_SAVE_MAX_BYTES - sv->bytes ? len : KO_SAVE_MAX_BYTES - sv->bytes;
+        sv->iov[sv->n++] = (struct iovec){ (void*)bytes, n };
+        sv->bytes += n;
+        bytes += n;
+        len -= n;
+
+        if (sv->n == KO_SAVE_IOVS || sv->bytes == KO_SAVE_MAX_BYTES)
+            ko_save_flush(sv);
+    }
+
+    return !sv->failed;
+}
+
+static int ko_save_sync(int fd) {
+#ifdef F_FULLFSYNC
+    // on macOS, fsync doesn't make it past the drive's cache
+    if (fcntl(fd, F_FULLFSYNC) == 0)
+        return 0;
+#endif
+    return fsync(fd);
+}
+
+int ko_buffer_save(const ko_buffer* b, const char* path) {
+    size_t len = strlen(path);
+    char* tmp = malloc(len + 8);
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".XXXXXX", 8);
+
+    // next to the file, so the rename stays on one filesystem
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        free(tmp);
+        return -1;
+    }
+
+    // keep the file's permissions, or give a new one the usual ones
+    struct stat st;
+    mode_t mode;
+    if (stat(path, &st) == 0) {
+        mode = st.st_mode & 07777;
+    }
+    else {
+        mode_t mask = umask(0);
+        umask(mask);
+        mode = 0666 & ~mask;
+    }
+
+    ko_save sv = { .b = b, .fd = fd };
+    ko_buffer_spans(b, 0, ko_buffer_length(b), ko_save_span, &sv);
+    ko_save_flush(&sv);
+
+    if (!sv.failed && fchmod(fd, mode) < 0) sv.failed = errno;
+    if (!sv.failed && ko_save_sync(fd) < 0) sv.failed = errno;
+    if (close(fd) < 0 && !sv.failed) sv.failed = errno;
+    if (!sv.failed && rename(tmp, path) < 0) sv.failed = errno;
+
+    if (sv.failed) {
+        unlink(tmp);
+        free(tmp);
+        errno = sv.failed;
+        return -1;
+    }
+    free(tmp);
+
+    // and make the rename itself stick
+    char* dir = strdup(path);
+    char* slash = strrchr(dir, '/');
+    if (slash == dir)
+        slash[1] = 0;           // it's in /
+    else if (slash)
+        *slash = 0;
+    int dirfd = open(slash ? dir : ".", O_RDONLY);
+    if (dirfd >= 0) {
+        fsync(dirfd);
+        close(dirfd);
+    }
+    free(dir);
+
+    return 0;
+}
+
+ko_buffer_stats ko_buffer_getstats(const ko_buffer* b) {
+    const ko_journal* j = &b->journal;
+    return (ko_buffer_stats){
+        b->npieces, b->origlen, b->addlen, ko_buffer_indexed(b), b->mapped,
+        b->loader != NULL, b->loader ? __atomic_load_n(&b->loader->invalid, __ATOMIC_RELAXED) : b->invalid,
+        j->undo, j->redo, j->cap * sizeof(ko_edit) + j->spancap * sizeof(ko_span),
+    };
+}
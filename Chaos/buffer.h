@@ -0,0 +1,158 @@
+#ifndef KO_BUFFER_H
+#define KO_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A text buffer stored as a piece table: the original text is kept as-is and
+// never written to, everything typed goes onto the end of an append-only add
+// buffer, and the document is a sequence of pieces pointing into one or the
+// other. The pieces live in a treap ordered by position, where each node
+// knows how many bytes its subtree covers, so finding, inserting or deleting
+// at any offset is O(log pieces) however big the text is.
+//
+// Each node also counts the newlines in its subtree, and both the original
+// and the add buffer count their newlines per 4K chunk, so a piece's newline
+// count is two lookups plus scanning at most two chunks. That makes line ->
+// offset and offset -> line O(log pieces + log chunks), and keeps edits O(log) too.
+//
+// The original's chunks are counted lazily, from the start: a query that needs
+// more of them counts another megabyte at a time, and ko_buffer_index (or
+// ko_buffer_load, on another thread) gets ahead of that. With ko_buffer_open the original is the file
+// itself, mapped read-only, so opening a huge file costs nothing up front and
+// only the pages being looked at (plus the edits) take up memory. The file
+// mustn't be truncated while it's open.
+//
+// Offsets are 0-based byte offsets and lines are 0-based line numbers;
+// anything past the end is clamped.
+
+typedef struct ko_buffer ko_buffer;
+
+// copies text as the original
+ko_buffer* ko_buffer_new(const char* text, size_t len);
+void ko_buffer_free(ko_buffer* b);
+
+// maps the file as the original; returns NULL with errno set if it can't
+ko_buffer* ko_buffer_open(const char* path);
+
+size_t ko_buffer_length(const ko_buffer* b);
+
+// goes up with every change to the text (undo and redo included), so
+// anything worked out from the text can tell it's out of date
+size_t ko_buffer_version(const ko_buffer* b);
+
+// Whatever's kept alongside the text (highlighting, layout, marks) can follow
+// its changes instead of working everything out again: a watch function gets
+// called after every change, undo and redo included, with what it did.
+//
+// An edit made at many places at once (ko_buffer_insert_many) is reported
+// all at once, as n changes in the order they're made, each as of the text
+// with the ones before it done. By then the buffer has them all done, but
+// that only differs from the text right after a change past where it ended.
+
+#define KO_BUFFER_UNKNOWN ((size_t)-1)
+
+typedef struct ko_buffer_change {
+    size_t pos;
+    size_t removed, added;              // bytes taken out and put in at pos (one of them is 0)
+    size_t removedlines, addedlines;    // newlines in those, or KO_BUFFER_UNKNOWN if they aren't counted yet
+} ko_buffer_change;
+
+typedef void (*ko_buffer_watch_fn)(void* ctx, ko_buffer* b, const ko_buffer_change* c, size_t n);
+void ko_buffer_watch(ko_buffer* b, ko_buffer_watch_fn fn, void* ctx);
+void ko_buffer_unwatch(ko_buffer* b, ko_buffer_watch_fn fn, void* ctx);
+
+void ko_buffer_insert(ko_buffer* b, size_t pos, const char* str, size_t len);
+void ko_buffer_delete(ko_buffer* b, size_t pos, size_t len);
+
+// the same edit at each of n places, as one undo step. pos is ascending and
+// by the text as it is now; the places mustn't overlap. str goes in the add
+// buffer once however many places get it, and typing or backspacing that
+// carries on from the last batch at the same places grows or shrinks its
+// edits instead of adding n more.
+void ko_buffer_insert_many(ko_buffer* b, const size_t* pos, size_t n, const char* str, size_t len);
+void ko_buffer_delete_many(ko_buffer* b, const size_t* pos, const size_t* len, size_t n);
+
+// Every insert and delete also goes in an undo journal. Neither the original
+// nor the add buffer ever changes, so an edit is only where it happened, where
+// its inserted text is in the add buffer, and the pieces it took out: a few
+// dozen bytes however much text it moved. Typing (and backspacing) that
+// carries on from the last edit joins its undo step; ko_buffer_seal ends the
+// step, and everything between ko_buffer_begin and ko_buffer_end is one step.
+
+// undoes or redoes a step; returns 0 if there's nothing to undo/redo.
+// pos is set to where the step ended, for putting the cursor back.
+int ko_buffer_undo(ko_buffer* b, size_t* pos);
+int ko_buffer_redo(ko_buffer* b, size_t* pos);
+
+void ko_buffer_seal(ko_buffer* b);
+void ko_buffer_begin(ko_buffer* b);
+void ko_buffer_end(ko_buffer* b);
+
+// how many lines there are: one more than the number of newlines.
+// (on a file that isn't indexed yet, this has to count them all)
+size_t ko_buffer_lines(const ko_buffer* b);
+
+// the offset where a line starts
+size_t ko_buffer_line_offset(const ko_buffer* b, size_t line);
+
+// where a line starts and ends (not counting its newline), without needing
+// to know how many lines there are; returns 0 if there's no such line
+int ko_buffer_line_range(const ko_buffer* b, size_t line, size_t* start, size_t* end);
+
+// the line pos is on (a newline is on the line it ends)
+size_t ko_buffer_offset_line(const ko_buffer* b, size_t pos);
+
+// counts another bytes' worth of the original's newlines; returns 1 once they're all counted
+int ko_buffer_index(ko_buffer* b, size_t bytes);
+
+// Loading a file in the background: a worker thread reads the original
+// through, counting its newlines and checking it's valid UTF-8, while the
+// main thread carries on. Queries never wait for it; they take whatever it's
+// counted so far and count the rest themselves if they have to. The worker
+// calls the wake function (on its own thread) every so often and when it's
+// done; that should get the main thread to call ko_buffer_loading.
+
+// starts loading; returns 0, or -1 with errno set if there's no thread for it
+int ko_buffer_load(ko_buffer* b);
+
+// catches up with the loader; returns 1 while it's still going. fraction
+// (if not NULL) is set to how much of the original is counted.
+int ko_buffer_loading(ko_buffer* b, double* fraction);
+
+// what the loader calls when there's progress; NULL for nothing
+void ko_buffer_setwake(void (*wake)(void));
+
+// copies up to len bytes starting at pos into out; returns how many it copied
+size_t ko_buffer_copy(const ko_buffer* b, size_t pos, size_t len, char* out);
+
+// calls fn with each contiguous run of bytes in [pos, pos + len), in order.
+// fn returns 0 to stop early.
+typedef int (*ko_buffer_span_fn)(void* ctx, const char* bytes, size_t len);
+void ko_buffer_spans(const ko_buffer* b, size_t pos, size_t len, ko_buffer_span_fn fn, void* ctx);
+
+// the same, but the runs come last to first (each still forwards), for searching backwards
+void ko_buffer_rspans(const ko_buffer* b, size_t pos, size_t len, ko_buffer_span_fn fn, void* ctx);
+
+// writes the text to a temporary file next to path straight from the pieces,
+// a batch of them per writev, then syncs it and renames it over path. the
+// file never holds anything but the old or the new text, and it takes no
+// memory beyond the batch. a mapped original stays valid, since the old file
+// lives on until it's unmapped. returns 0, or -1 with errno set.
+int ko_buffer_save(const ko_buffer* b, const char* path);
+
+typedef struct ko_buffer_stats {
+    size_t pieces;
+    size_t original;            // bytes in the original
+    size_t added;               // bytes ever appended to the add buffer
+    size_t indexed;             // bytes of the original whose newlines are counted
+    int mapped;                 // the original is a mapped file
+    int loading;                // a loader is still going through it
+    size_t invalid;             // bad UTF-8 sequences the loader has found so far
+    size_t undo, redo;          // steps that can be undone/redone
+    size_t journal;             // bytes the undo journal has allocated
+} ko_buffer_stats;
+
+ko_buffer_stats ko_buffer_getstats(const ko_buffer* b);
+
+#endif
@@ -0,0 +1,528 @@
+// The `buffer` Lua module: a piece-table text buffer (buffer.c) as a userdata.
+// Positions are 1-based byte offsets, like string.sub.
+
+#include "bufferlib.h"
+#include "render.h"
+#include "search.h"
+
+#include <errno.h>
+#include <string.h>
+
+ko_buffer* ko_checkbuffer(lua_State* L, int idx) {
+    ko_buffer** ud = luaL_checkudata(L, idx, KO_BUFFER_META);
+    if (!*ud)
+        luaL_error(L, "buffer is closed");
+    return *ud;
+}
+
+// string.sub's rules: negative counts from the end, and the result is clamped to [0, len]
+static size_t ko_posrelat(lua_Integer pos, size_t len) {
+    if (pos >= 0) return (size_t)pos;
+    if ((size_t)-pos > len) return 0;
+    return len + (size_t)pos + 1;
+}
+
+// args: [str = ""]
+// returns: [buf]
+static int buffer_new(lua_State *L) {
+    size_t len;
+    const char* str = luaL_optlstring(L, 1, "", &len);
+    
+    ko_buffer** ud = lua_newuserdata(L, sizeof(ko_buffer*));
+    *ud = ko_buffer_new(str, len);
+    luaL_setmetatable(L, KO_BUFFER_META);
+    return 1;
+}
+
+// buffers still loading -> their progress functions (or false)
+static char ko_loading_key;
+
+// args: [path, progress = nil]
+// returns: [buf] or [nil, err]
+// maps the file instead of reading it, and loads it on another thread: the
+// buffer can be used straight away, and progress(buf, fraction, done) gets
+// called as the loading goes on
+static int buffer_open(lua_State *L) {
+    const char* path = luaL_checkstring(L, 1);
+    if (!lua_isnoneornil(L, 2))
+        luaL_checktype(L, 2, LUA_TFUNCTION);
+    
+    ko_buffer* b = ko_buffer_open(path);
+    if (!b) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "%s: %s", path, strerror(errno));
+        return 2;
+    }
+    
+    ko_buffer** ud = lua_newuserdata(L, sizeof(ko_buffer*));
+    *ud = b;
+    luaL_setmetatable(L, KO_BUFFER_META);                 // [path, progress, buf]
+    
+    // without a thread its lines just get counted as they're needed
+    if (ko_buffer_load(b) == 0 && ko_buffer_loading(b, NULL)) {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &ko_loading_key); // [path, progress, buf, loading]
+        lua_pushvalue(L, -2);                               // [path, progress, buf, loading, buf]
+        if (lua_isfunction(L, 2))
+            lua_pushvalue(L, 2);
+        else
+            lua_pushboolean(L, 0);                          // [path, progress, buf, loading, buf, progress]
+        lua_rawset(L, -3);                                  // [path, progress, buf, loading]
+        lua_pop(L, 1);                                      // [path, progress, buf]
+    }
+    return 1;
+}
+
+void ko_bufferlib_poll(lua_State* L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &ko_loading_key);  // [loading]
+    
+    // progress functions can open more files, so go through a list of them instead
+    lua_newtable(L);                                      // [loading, list]
+    int n = 0;
+    lua_pushnil(L);                                       // [loading, list, nil]
+    while (lua_next(L, -3)) {                             // [loading, list, buf, progress]
+        lua_pop(L, 1);                                    // [loading, list, buf]
+        lua_pushvalue(L, -1);                             // [loading, list, buf, buf]
+        lua_rawseti(L, -3, ++n);                          // [loading, list, buf]
+    }
+    
+    for (int i = 1; i <= n; i++) {
+        lua_rawgeti(L, -1, i);                            // [loading, list, buf]
+        lua_pushvalue(L, -1);                             // [loading, list, buf, buf]
+        lua_rawget(L, -4);                                // [loading, list, buf, progress]
+        
+        double fraction = 1.0;
+        ko_buffer* b = *(ko_buffer**)lua_touserdata(L, -2);
+        int loading = b && ko_buffer_loading(b, &fraction);
+        if (!loading) {
+            lua_pushvalue(L, -2);                         // [loading, list, buf, progress, buf]
+            lua_pushnil(L);                               // [loading, list, buf, progress, buf, nil]
+            lua_rawset(L, -6);                            // [loading, list, buf, progress]
+        }
+        
+        if (!b || !lua_isfunction(L, -1)) {
+            lua_pop(L, 2);                                // [loading, list]
+            continue;
+        }
+        
+        lua_insert(L, -2);                                // [loading, list, progress, buf]
+        lua_pushnumber(L, fraction);
+        lua_pushboolean(L, !loading);                     // [loading, list, progress, buf, fraction, done]
+        if (lua_pcall(L, 3, 0, 0))                        // [loading, list]
+            lua_pop(L, 1);
+    }
+    
+    lua_pop(L, 2);                                        // []
+}
+
+// args: [buf, pos, str]
+// str ends up starting at pos; pos = len + 1 appends
+static int buffer_insert(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    size_t blen = ko_buffer_length(b);
+    size_t pos = ko_posrelat(luaL_checkinteger(L, 2), blen);
+    size_t len;
+    const char* str = luaL_checklstring(L, 3, &len);
+    
+    if (pos < 1) pos = 1;
+    ko_buffer_insert(b, pos - 1, str, len);
+    return 0;
+}
+
+// args: [buf, pos, n = 1]
+// removes n bytes starting at pos
+static int buffer_delete(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    size_t pos = ko_posrelat(luaL_checkinteger(L, 2), ko_buffer_length(b));
+    lua_Integer n = luaL_optinteger(L, 3, 1);
+    
+    if (pos >= 1 && n > 0)
+        ko_buffer_delete(b, pos - 1, (size_t)n);
+    return 0;
+}
+
+// args: [buf]
+// returns: [pos] or [nil]
+// undoes the last step, returning where it was (for the cursor); nil if there's nothing to undo
+static int buffer_undo(lua_State *L) {
+    size_t pos;
+    if (!ko_buffer_undo(ko_checkbuffer(L, 1), &pos))
+        return 0;
+    lua_pushinteger(L, pos + 1);
+    return 1;
+}
+
+// args: [buf]
+// returns: [pos] or [nil]
+static int buffer_redo(lua_State *L) {
+    size_t pos;
+    if (!ko_buffer_redo(ko_checkbuffer(L, 1), &pos))
+        return 0;
+    lua_pushinteger(L, pos + 1);
+    return 1;
+}
+
+// args: [buf]
+// the next edit starts a new undo step, even if it carries on from the last one
+static int buffer_seal(lua_State *L) {
+    ko_buffer_seal(ko_checkbuffer(L, 1));
+    return 0;
+}
+
+// args: [buf, fn, ...]
+// returns: [fn's results]
+// calls fn(...), and every edit it makes is undone in one step
+static int buffer_transaction(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    
+    ko_buffer_begin(b);
+    int ok = lua_pcall(L, lua_gettop(L) - 2, LUA_MULTRET, 0) == LUA_OK;   // [buf, results...]
+    ko_buffer_end(b);
+    
+    if (!ok)
+        return lua_error(L);
+    return lua_gettop(L) - 1;
+}
+
+// args: [buf, path]
+// returns: [true] or [nil, err]
+// replaces the file at path with the text in one go, without making a string of it
+static int buffer_save(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    const char* path = luaL_checkstring(L, 2);
+    
+    if (ko_buffer_save(b, path) < 0) {
+        lua_pushnil(L);
+        lua_pushfstring(L, "%s: %s", path, strerror(errno));
+        return 2;
+    }
+    
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+// args: [buf, i = 1, j = -1]
+// returns: [str]
+// same as string.sub on the buffer's text
+static int buffer_sub(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    size_t len = ko_buffer_length(b);
+    size_t i = ko_posrelat(luaL_optinteger(L, 2, 1), len);
+    size_t j = ko_posrelat(luaL_optinteger(L, 3, -1), len);
+    
+    if (i < 1) i = 1;
+    if (j > len) j = len;
+    if (i > j) {
+        lua_pushliteral(L, "");
+        return 1;
+    }
+    
+    luaL_Buffer lb;
+    char* out = luaL_buffinitsize(L, &lb, j - i + 1);
+    luaL_pushresultsize(&lb, ko_buffer_copy(b, i - 1, j - i + 1, out));
+    return 1;
+}
+
+// args: [buf]
+// returns: [len]
+static int buffer_len(lua_State *L) {
+    lua_pushinteger(L, ko_buffer_length(ko_checkbuffer(L, 1)));
+    return 1;
+}
+
+// args: [buf]
+// returns: [n]
+static int buffer_linecount(lua_State *L) {
+    lua_pushinteger(L, ko_buffer_lines(ko_checkbuffer(L, 1)));
+    return 1;
+}
+
+// args: [buf, line]
+// returns: [pos, endpos] or [nil]
+// where the line starts, and where its newline (or the end of the text) is.
+// nil if there's no such line; unlike linecount, that doesn't need the whole file counted.
+static int buffer_linestart(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    lua_Integer line = luaL_checkinteger(L, 2);
+    size_t start, end;
+    
+    if (line < 1 || !ko_buffer_line_range(b, (size_t)line - 1, &start, &end)) {
+        lua_pushnil(L);
+        return 1;
+    }
+    
+    lua_pushinteger(L, start + 1);
+    lua_pushinteger(L, end + 1);
+    return 2;
+}
+
+// args: [buf, pos]
+// returns: [line]
+// the line pos is on; #buf + 1 is on the last line
+static int buffer_lineat(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    size_t len = ko_buffer_length(b);
+    size_t pos = ko_posrelat(luaL_checkinteger(L, 2), len);
+    
+    if (pos < 1) pos = 1;
+    if (pos > len + 1) pos = len + 1;
+    lua_pushinteger(L, ko_buffer_offset_line(b, pos - 1) + 1);
+    return 1;
+}
+
+// args: [buf, pos, tabwidth = 8]
+// returns: [col]
+// the display column pos is drawn at by pane:render, counting from 1
+static int buffer_column(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    size_t len = ko_buffer_length(b);
+    size_t pos = ko_posrelat(luaL_checkinteger(L, 2), len);
+    int tabwidth = luaL_optinteger(L, 3, 8);
+    
+    if (pos < 1) pos = 1;
+    if (pos > len + 1) pos = len + 1;
+    lua_pushinteger(L, ko_render_column(b, pos - 1, tabwidth) + 1);
+    return 1;
+}
+
+// args: [buf, bytes = 1048576]
+// returns: [done, fraction]
+// counts newlines in the next stretch of a file that hasn't been gone through yet,
+// for running a bit at a time while nothing else is happening
+static int buffer_index(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    lua_Integer bytes = luaL_optinteger(L, 2, 1 << 20);
+    
+    int done = ko_buffer_index(b, bytes > 0 ? (size_t)bytes : 0);
+    ko_buffer_stats stats = ko_buffer_getstats(b);
+    
+    lua_pushboolean(L, done);
+    lua_pushnumber(L, stats.original ? (double)stats.indexed / stats.original : 1.0);
+    return 2;
+}
+
+// pushes where a match of len bytes at at is, as [start, end]
+static int ko_pushmatch(lua_State* L, size_t at, size_t len) {
+    lua_pushinteger(L, at + 1);
+    lua_pushinteger(L, at + len);
+    return 2;
+}
+
+// args: [buf, query, init = 1, icase = false]
+// returns: [start, end] or [nil]
+// like string.find(text, query, init, true), but straight from the pieces
+static int buffer_find(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    size_t len;
+    const char* query = luaL_checklstring(L, 2, &len);
+    size_t init = ko_posrelat(luaL_optinteger(L, 3, 1), ko_buffer_length(b));
+    int icase = lua_toboolean(L, 4);
+    
+    if (init < 1) init = 1;
+    
+    ko_search* s = ko_search_new(query, len, icase ? KO_SEARCH_ICASE : 0);
+    size_t at;
+    int found = ko_search_find(s, b, init - 1, &at);
+    ko_search_free(s);
+    
+    if (!found) {
+        lua_pushnil(L);
+        return 1;
+    }
+    return ko_pushmatch(L, at, len);
+}
+
+// args: [buf, query, icase = false]
+// returns: [n]
+// how many times query is in the text, not counting overlapping ones
+static int buffer_count(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    size_t len;
+    const char* query = luaL_checklstring(L, 2, &len);
+    int icase = lua_toboolean(L, 3);
+    
+    ko_search* s = ko_search_new(query, len, icase ? KO_SEARCH_ICASE : 0);
+    lua_pushinteger(L, ko_search_count(s, b, 0, ko_buffer_length(b)));
+    ko_search_free(s);
+    return 1;
+}
+
+// args: [buf, icase = false]
+// returns: [finder]
+// for find-as-you-type: finder:set(query, init) as the query gets typed, finder:next() for the match after
+static int buffer_finder(lua_State *L) {
+    ko_checkbuffer(L, 1);
+    int icase = lua_toboolean(L, 2);
+    
+    ko_finder** ud = lua_newuserdata(L, sizeof(ko_finder*));   // [buf, icase, finder]
+    *ud = ko_finder_new(icase ? KO_SEARCH_ICASE : 0);
+    luaL_setmetatable(L, KO_FINDER_META);
+    
+    // keeps the buffer alive (a uservalue has to be a table)
+    lua_createtable(L, 1, 0);                                   // [buf, icase, finder, {}]
+    lua_pushvalue(L, 1);                                        // [buf, icase, finder, {}, buf]
+    lua_rawseti(L, -2, 1);                                      // [buf, icase, finder, {buf}]
+    lua_setuservalue(L, -2);                                    // [buf, icase, finder]
+    return 1;
+}
+
+// the finder at idx, and the buffer it's for
+static ko_finder* ko_checkfinder(lua_State* L, int idx, ko_buffer** b) {
+    ko_finder** ud = luaL_checkudata(L, idx, KO_FINDER_META);
+    lua_getuservalue(L, idx);                                   // [{buf}]
+    lua_rawgeti(L, -1, 1);                                      // [{buf}, buf]
+    *b = ko_checkbuffer(L, -1);
+    lua_pop(L, 2);                                              // []
+    return *ud;
+}
+
+// args: [finder, query, init = 1]
+// returns: [start, end] or [nil]
+// the first match of query from init on; when query just adds to the last
+// one, only the text from the last match on gets looked at
+static int finder_set(lua_State *L) {
+    ko_buffer* b;
+    ko_finder* f = ko_checkfinder(L, 1, &b);
+    size_t len;
+    const char* query = luaL_checklstring(L, 2, &len);
+    size_t init = ko_posrelat(luaL_optinteger(L, 3, 1), ko_buffer_length(b));
+    
+    if (init < 1) init = 1;
+    
+    size_t at;
+    if (!ko_finder_set(f, b, init - 1, query, len, &at)) {
+        lua_pushnil(L);
+        return 1;
+    }
+    return ko_pushmatch(L, at, len);
+}
+
+// args: [finder]
+// returns: [start, end] or [nil]
+static int finder_next(lua_State *L) {
+    ko_buffer* b;
+    ko_finder* f = ko_checkfinder(L, 1, &b);
+    
+    size_t at;
+    if (!ko_finder_next(f, b, &at)) {
+        lua_pushnil(L);
+        return 1;
+    }
+    return ko_pushmatch(L, at, ko_finder_length(f));
+}
+
+static int finder_gc(lua_State *L) {
+    ko_finder** ud = luaL_checkudata(L, 1, KO_FINDER_META);
+    ko_finder_free(*ud);
+    *ud = NULL;
+    return 0;
+}
+
+// args: [buf]
+// returns: [str]
+static int buffer_tostring(lua_State *L) {
+    lua_settop(L, 1);
+    return buffer_sub(L);
+}
+
+// args: [buf]
+// returns: [{pieces, original, added, indexed, mapped, loading, invalid, undo, redo, journal}]
+static int buffer_stats(lua_State *L) {
+    ko_buffer_stats stats = ko_buffer_getstats(ko_checkbuffer(L, 1));
+    
+    lua_createtable(L, 0, 10);
+    lua_pushnumber(L, stats.pieces);
+    lua_setfield(L, -2, "pieces");
+    lua_pushnumber(L, stats.original);
+    lua_setfield(L, -2, "original");
+    lua_pushnumber(L, stats.added);
+    lua_setfield(L, -2, "added");
+    lua_pushnumber(L, stats.indexed);
+    lua_setfield(L, -2, "indexed");
+    lua_pushboolean(L, stats.mapped);
+    lua_setfield(L, -2, "mapped");
+    lua_pushboolean(L, stats.loading);
+    lua_setfield(L, -2, "loading");
+    lua_pushnumber(L, stats.invalid);
+    lua_setfield(L, -2, "invalid");
+    lua_pushnumber(L, stats.undo);
+    lua_setfield(L, -2, "undo");
+    lua_pushnumber(L, stats.redo);
+    lua_setfield(L, -2, "redo");
+    lua_pushnumber(L, stats.journal);
+    lua_setfield(L, -2, "journal");
+    return 1;
+}
+
+static int buffer_gc(lua_State *L) {
+    ko_buffer** ud = luaL_checkudata(L, 1, KO_BUFFER_META);
+    ko_buffer_free(*ud);
+    *ud = NULL;
+    return 0;
+}
+
+static const luaL_Reg bufferlib_instance[] = {
+    {"insert", buffer_insert},
+    {"delete", buffer_delete},
+    {"sub", buffer_sub},
+    {"len", buffer_len},
+    {"linecount", buffer_linecount},
+    {"linestart", buffer_linestart},
+    {"lineat", buffer_lineat},
+    {"column", buffer_column},
+    {"index", buffer_index},
+    {"find", buffer_find},
+    {"count", buffer_count},
+    {"finder", buffer_finder},
+    {"undo", buffer_undo},
+    {"redo", buffer_redo},
+    {"seal", buffer_seal},
+    {"transaction", buffer_transaction},
+    {"save", buffer_save},
+    {"stats", buffer_stats},
+    {NULL, NULL}
+};
+
+static const luaL_Reg bufferlib_meta[] = {
+    {"__len", buffer_len},
+    {"__tostring", buffer_tostring},
+    {"__gc", buffer_gc},
+    {NULL, NULL}
+};
+
+static const luaL_Reg finderlib_instance[] = {
+    {"set", finder_set},
+    {"next", finder_next},
+    {NULL, NULL}
+};
+
+static const luaL_Reg finderlib_meta[] = {
+    {"__gc", finder_gc},
+    {NULL, NULL}
+};
+
+static const luaL_Reg bufferlib[] = {
+    {"new", buffer_new},
+    {"open", buffer_open},
+    {NULL, NULL}
+};
+
+int luaopen_buffer(lua_State* L) {
+    luaL_newmetatable(L, KO_BUFFER_META);             // [meta]
+    luaL_setfuncs(L, bufferlib_meta, 0);              // [meta]
+    luaL_newlib(L, bufferlib_instance);               // [meta, methods]
+    lua_setfield(L, -2, "__index");                   // [meta]
+    lua_pop(L, 1);                                    // []
+    
+    luaL_newmetatable(L, KO_FINDER_META);             // [meta]
+    luaL_setfuncs(L, finderlib_meta, 0);              // [meta]
+    luaL_newlib(L, finderlib_instance);               // [meta, methods]
+    lua_setfield(L, -2, "__index");                   // [meta]
+    lua_pop(L, 1);                                    // []
+    
+    lua_newtable(L);                                  // [loading]
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &ko_loading_key); // []
+    
+    luaL_newlib(L, bufferlib);
+    return 1;
+}
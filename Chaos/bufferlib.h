@@ -0,0 +1,20 @@
+#ifndef KO_BUFFERLIB_H
+#define KO_BUFFERLIB_H
+
+#include "lua/lua.h"
+#include "lua/lauxlib.h"
+#include "buffer.h"
+
+// The `buffer` Lua module (bufferlib.c), for other modules that take buffers as arguments.
+
+#define KO_BUFFER_META "chaos.buffer"
+#define KO_FINDER_META "chaos.finder"
+
+// a buffer argument; errors if it isn't one or it's been closed
+ko_buffer* ko_checkbuffer(lua_State* L, int idx);
+
+// catches up with buffers loading in the background and calls their progress
+// functions. the host calls it on the main thread when ko_buffer_setwake's function wakes it.
+void ko_bufferlib_poll(lua_State* L);
+
+#endif
@@ -0,0 +1,220 @@
+#include "cursors.h"
+#include "markers.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct ko_cursors {
+    ko_buffer* b;
+    ko_markers* m;
+
+    // where they were as of version, in order, and their markers
+    size_t* pos;
+    uint32_t* ids;
+
+    // for what an edit reads and takes out at each: len bytes from at
+    size_t* at;
+    size_t* len;
+    unsigned char* bytes;       // 4 for each
+    size_t n, dups, cap;
+    size_t version;
+    int fresh;
+};
+
+ko_cursors* ko_cursors_new(ko_buffer* b) {
+    ko_cursors* c = calloc(1, sizeof(ko_cursors));
+    c->b = b;
+    c->m = ko_markers_new(b);
+    return c;
+}
+
+void ko_cursors_free(ko_cursors* c) {
+    if (!c) return;
+    ko_markers_free(c->m);
+    free(c->pos);
+    free(c->ids);
+    free(c->at);
+    free(c->len);
+    free(c->bytes);
+    free(c);
+}
+
+void ko_cursors_add(ko_cursors* c, size_t pos) {
+    size_t total = ko_buffer_length(c->b);
+    if (pos > total)
+        pos = total;
+    ko_markers_add(c->m, pos, pos);
+    c->fresh = 0;
+}
+
+void ko_cursors_clear(ko_cursors* c) {
+    ko_markers_clear(c->m);
+    c->n = 0;
+    c->fresh = 0;
+}
+
+static int ko_cursors_collect(void* ctx, uint32_t id, size_t start, size_t end) {
+    ko_cursors* c = ctx;
+    (void)end;
+
+    // the ones an edit has pushed together are merged: the duplicates' ids
+    // fill ids from the back, to be removed once the walk's done
+    if (c->n > 0 && c->pos[c->n - 1] == start) {
+        c->ids[c->cap - ++c->dups] = id;
+        return 1;
+    }
+    c->pos[c->n] = start;
+    c->ids[c->n] = id;
+    c->n++;
+    return 1;
+}
+
+// reads the cursors back out of their markers, if anything's changed since
+static void ko_cursors_refresh(ko_cursors* c) {
+    size_t version = ko_buffer_version(c->b);
+    if (c->fresh && c->version == version)
+        return;
+
+    size_t count = ko_markers_count(c->m);
+    if (count > c->cap) {
+        c->cap = count;
+        c->pos = realloc(c->pos, c->cap * sizeof(size_t));
+        c->ids = realloc(c->ids, c->cap * sizeof(uint32_t));
+        c->at = realloc(c->at, c->cap * sizeof(size_t));
+        c->len = realloc(c->len, c->cap * sizeof(size_t));
+        c->bytes = realloc(c->bytes, c->cap * 4);
+    }
+
+    c->n = c->dups = 0;
+    ko_markers_find(c->m, 0, ko_buffer_length(c->b) + 1, ko_cursors_collect, c);
+    for (; c->dups > 0; c->dups--)
+        ko_markers_remove(c->m, c->ids[c->cap - c->dups]);
+
+    c->version = version;
+    c->fresh = 1;
+}
+
+size_t ko_cursors_positions(ko_cursors* c, const size_t** pos) {
+    ko_cursors_refresh(c);
+    *pos = c->pos;
+    return c->n;
+}
+
+void ko_cursors_type(ko_cursors* c, const char* str, size_t len) {
+    ko_cursors_refresh(c);
+    ko_buffer_insert_many(c->b, c->pos, c->n, str, len);
+}
+
+typedef struct ko_cursors_reading {
+    ko_cursors* c;
+    size_t i, off;
+} ko_cursors_reading;
+
+static int ko_cursors_copy(void* ctx, const char* bytes, size_t len) {
+    ko_cursors_reading* r = ctx;
+    ko_cursors* c = r->c;
+    size_t end = r->off + len;
+
+    // each reads the part of its bytes that's in this run
+    for (size_t j = r->i; j < c->n && c->at[j] < end; j++) {
+        size_t lo = c->at[j] > r->off ? c->at[j] : r->off;
+        size_t hi = c->at[j] + c->len[j] < end ? c->at[j] + c->len[j] : end;
+        if (lo < hi)
+            memcpy(c->bytes + 4 * j + (lo - c->at[j]), bytes + (lo - r->off), hi - lo);
+    }
+    while (r->i < c->n && c->at[r->i] + c->len[r->i] <= end)
+        r->i++;
+
+    r->off = end;
+    return r->i < c->n;
+}
+
+// reads the len[i] (up to 4) bytes from at[i] for each cursor, which are in
+// order. lots of them are read in one walk over the text, a few one by one.
+static void ko_cursors_read(ko_cursors* c) {
+    if (c->n == 0)
+        return;
+
+    if (c->n * 16 < ko_buffer_getstats(c->b).pieces) {
+        for (size_t i = 0; i < c->n; i++)
+            ko_buffer_copy(c->b, c->at[i], c->len[i], (char*)c->bytes + 4 * i);
+        return;
+    }
+
+    size_t from = c->at[0], to = c->at[c->n - 1] + c->len[c->n - 1];
+    ko_cursors_reading r = { c, 0, from };
+    ko_buffer_spans(c->b, from, to - from, ko_cursors_copy, &r);
+}
+
+// takes out len[i] bytes from at[i] at each cursor, if that's anything
+static void ko_cursors_cut(ko_cursors* c) {
+    size_t any = 0;
+    for (size_t i = 0; i < c->n; i++)
+        any |= c->len[i];
+    if (any)
+        ko_buffer_delete_many(c->b, c->at, c->len, c->n);
+}
+
+// how many bytes the character a lead byte starts has; a byte that can't start one is one on its own
+static inline size_t ko_cursors_charlen(unsigned char c) {
+    return c < 0xC0 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : c < 0xF8 ? 4 : 1;
+}
+
+void ko_cursors_backspace(ko_cursors* c) {
+    ko_cursors_refresh(c);
+
+    // the 4 bytes before each, or as many as there are back to the one before it
+    size_t lo = 0;
+    for (size_t i = 0; i < c->n; i++) {
+        size_t p = c->pos[i];
+        c->len[i] = p - lo < 4 ? p - lo : 4;
+        c->at[i] = p - c->len[i];
+        lo = p;
+    }
+    ko_cursors_read(c);
+
+    // back over continuation bytes to the one that starts the character, if
+    // it's a character that long; otherwise it's a stray byte on its own
+    for (size_t i = 0; i < c->n; i++) {
+        const unsigned char* s = c->bytes + 4 * i;
+        size_t k = c->len[i];
+        size_t n = k > 0;
+        while (n < k && (s[k - n] & 0xC0) == 0x80)
+            n++;
+        if (n > 1 && ko_cursors_charlen(s[k - n]) != n)
+            n = 1;
+
+        c->at[i] = c->pos[i] - n;
+        c->len[i] = n;
+    }
+    ko_cursors_cut(c);
+}
+
+void ko_cursors_delete(ko_cursors* c) {
+    ko_cursors_refresh(c);
+
+    // the 4 bytes after each, or as many as there are up to the one after it
+    size_t total = ko_buffer_length(c->b);
+    for (size_t i = 0; i < c->n; i++) {
+        size_t p = c->pos[i];
+        size_t hi = i + 1 < c->n ? c->pos[i + 1] : total;
+        c->at[i] = p;
+        c->len[i] = hi - p < 4 ? hi - p : 4;
+    }
+    ko_cursors_read(c);
+
+    // the lead byte says how long the character is, if all of it's there
+    for (size_t i = 0; i < c->n; i++) {
+        const unsigned char* s = c->bytes + 4 * i;
+        size_t k = c->len[i];
+        size_t n = k == 0 ? 0 : ko_cursors_charlen(s[0]);
+        for (size_t j = 1; j < n; j++) {
+            if (j >= k || (s[j] & 0xC0) != 0x80) {
+                n = 1;
+                break;
+            }
+        }
+        c->len[i] = n;
+    }
+    ko_cursors_cut(c);
+}
@@ -0,0 +1,35 @@
+#ifndef KO_CURSORS_H
+#define KO_CURSORS_H
+
+#include "buffer.h"
+
+// A set of cursors in a buffer, for typing at all of them at once.
+//
+// The cursors are empty markers (markers.c), so any edit to the buffer, an
+// undo included, moves them along with the text. Each keystroke is one batch
+// edit (ko_buffer_insert_many and friends): a single pass over the cursors in
+// order, one undo step however many there are, and typing that carries on
+// grows the same n edits rather than adding n more. Cursors that end up at
+// the same place are merged into one.
+
+typedef struct ko_cursors ko_cursors;
+
+// watches b for edits
+ko_cursors* ko_cursors_new(ko_buffer* b);
+void ko_cursors_free(ko_cursors* c);
+
+// adds a cursor just before byte pos (the end, if that's past it)
+void ko_cursors_add(ko_cursors* c, size_t pos);
+void ko_cursors_clear(ko_cursors* c);
+
+// where the cursors are now, in order, none the same; good until the next change
+size_t ko_cursors_positions(ko_cursors* c, const size_t** pos);
+
+// types str at every cursor
+void ko_cursors_type(ko_cursors* c, const char* str, size_t len);
+
+// deletes the UTF-8 character before (backspace) or after (delete) every cursor
+void ko_cursors_backspace(ko_cursors* c);
+void ko_cursors_delete(ko_cursors* c);
+
+#endif
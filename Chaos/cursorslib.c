@@ -0,0 +1,162 @@
+// The `cursors` Lua module: sets of cursors in a buffer that get typed at
+// all at once (cursors.c), as userdata. A cursor at pos sits just before
+// byte pos, so #buf + 1 is the end of the text.
+
+#include "bufferlib.h"
+#include "cursors.h"
+
+#define KO_CURSORS_META "chaos.cursors"
+
+// args: [buf]
+// returns: [set]
+static int cursors_new(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    
+    ko_cursors** ud = lua_newuserdata(L, sizeof(ko_cursors*));  // [buf, set]
+    *ud = ko_cursors_new(b);
+    luaL_setmetatable(L, KO_CURSORS_META);
+    
+    // keeps the buffer alive
+    lua_createtable(L, 1, 0);                         // [buf, set, {}]
+    lua_pushvalue(L, 1);                              // [buf, set, {}, buf]
+    lua_rawseti(L, -2, 1);                            // [buf, set, {buf}]
+    lua_setuservalue(L, -2);                          // [buf, set]
+    return 1;
+}
+
+static ko_cursors* ko_tocursors(lua_State* L) {
+    return *(ko_cursors**)luaL_checkudata(L, 1, KO_CURSORS_META);
+}
+
+// args: [set, pos]
+static int cursors_add(lua_State *L) {
+    ko_cursors* c = ko_tocursors(L);
+    lua_Integer pos = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, pos >= 1, 2, "has to be at least 1");
+    
+    ko_cursors_add(c, pos - 1);
+    return 0;
+}
+
+// args: [set]
+static int cursors_clear(lua_State *L) {
+    ko_cursors_clear(ko_tocursors(L));
+    return 0;
+}
+
+// args: [set]
+// returns: [n]
+// how many there are, once any that have run into each other are merged
+static int cursors_count(lua_State *L) {
+    const size_t* pos;
+    lua_pushinteger(L, ko_cursors_positions(ko_tocursors(L), &pos));
+    return 1;
+}
+
+// args: [set, i]
+// returns: [pos] or [nil]
+// where the i-th cursor is, in order; negative i count back from the last
+static int cursors_get(lua_State *L) {
+    const size_t* pos;
+    size_t n = ko_cursors_positions(ko_tocursors(L), &pos);
+    lua_Integer i = luaL_checkinteger(L, 2);
+    
+    if (i < 0) i += (lua_Integer)n + 1;
+    if (i < 1 || (size_t)i > n)
+        return 0;
+    lua_pushinteger(L, pos[i - 1] + 1);
+    return 1;
+}
+
+// args: [set, from?, to?]
+// returns: [found]
+// where the cursors are, in order; only the ones at from..to, if given
+static int cursors_positions(lua_State *L) {
+    const size_t* pos;
+    size_t n = ko_cursors_positions(ko_tocursors(L), &pos);
+    lua_Integer from = luaL_optinteger(L, 2, 1);
+    lua_Integer to = luaL_optinteger(L, 3, n ? pos[n - 1] + 1 : 0);
+    
+    // the first at from or after
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if ((lua_Integer)pos[mid] + 1 < from)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    
+    lua_newtable(L);                                  // [set, from, to, found]
+    int k = 0;
+    for (size_t i = lo; i < n && (lua_Integer)pos[i] + 1 <= to; i++) {
+        lua_pushinteger(L, pos[i] + 1);               // [set, from, to, found, pos]
+        lua_rawseti(L, -2, ++k);                      // [set, from, to, found]
+    }
+    return 1;
+}
+
+// args: [set, str]
+// types str at every cursor, as one undo step (and one edit per cursor, however long it's typed for)
+static int cursors_type(lua_State *L) {
+    ko_cursors* c = ko_tocursors(L);
+    size_t len;
+    const char* str = luaL_checklstring(L, 2, &len);
+    
+    ko_cursors_type(c, str, len);
+    return 0;
+}
+
+// args: [set]
+// deletes the character before every cursor
+static int cursors_backspace(lua_State *L) {
+    ko_cursors_backspace(ko_tocursors(L));
+    return 0;
+}
+
+// args: [set]
+// deletes the character after every cursor
+static int cursors_delete(lua_State *L) {
+    ko_cursors_delete(ko_tocursors(L));
+    return 0;
+}
+
+static int cursors_gc(lua_State *L) {
+    ko_cursors** ud = luaL_checkudata(L, 1, KO_CURSORS_META);
+    ko_cursors_free(*ud);
+    *ud = NULL;
+    return 0;
+}
+
+static const luaL_Reg cursorslib_instance[] = {
+    {"add", cursors_add},
+    {"clear", cursors_clear},
+    {"count", cursors_count},
+    {"get", cursors_get},
+    {"positions", cursors_positions},
+    {"type", cursors_type},
+    {"backspace", cursors_backspace},
+    {"delete", cursors_delete},
+    {NULL, NULL}
+};
+
+static const luaL_Reg cursorslib_meta[] = {
+    {"__gc", cursors_gc},
+    {NULL, NULL}
+};
+
+static const luaL_Reg cursorslib[] = {
+    {"new", cursors_new},
+    {NULL, NULL}
+};
+
+int luaopen_cursors(lua_State* L) {
+    luaL_newmetatable(L, KO_CURSORS_META);            // [meta]
+    luaL_setfuncs(L, cursorslib_meta, 0);             // [meta]
+    luaL_newlib(L, cursorslib_instance);              // [meta, methods]
+    lua_setfield(L, -2, "__index");                   // [meta]
+    lua_pop(L, 1);                                    // []
+    
+    luaL_newlib(L, cursorslib);
+    return 1;
+}
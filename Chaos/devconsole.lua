@@ -3,80 +3,79 @@ local devconsole = {}
 function devconsole.new()
    local win = window.new()
 
-   local fg = "00FF00"
-   local bg = "222222"
+   local fg = win:color("00FF00")
+   local bg = win:color("222222")
 
    win:settitle("Developer Console")
 
    local stdout = ""
    local stdin = ""
 
-   local function printstr(x, y, str)
-      local w, h = win:getsize()
-
-      for i = 1, #str do
-         if x == w + 1 then
-            x = 1
-            y = y + 1
-         end
-
-         if y == h + 1 then break end
-
-         local c = str:sub(i,i):byte()
-         if c == string.byte("\n") then
-            x = 1
-            y = y + 1
-         else
-            win:set(c, x, y, fg, bg)
-            x = x + 1
-         end
-      end
-   end
-
-   local function clearbottom()
-      local w, h = win:getsize()
-
-      for x = 1, w do
-         win:set(string.byte(" "), x, h, fg, bg)
-      end
-   end
-
-   local function printcursor(x, y)
-      win:set(string.byte(" "), x, y, bg, fg)
-   end
+   -- the output above a one-row prompt; typing only redraws the prompt
+   local output = win:pane(1, 1, 1, 1)
+   local prompt = win:pane(1, 1, 1, 1)
 
-   local function redraw()
+   local function layout()
       local w, h = win:getsize()
-
-      win:clear(bg)
-      printstr(1, 1, stdout)
-      clearbottom()
-      printstr(1, h, "> " .. stdin)
-      printcursor(3 + string.len(stdin), h)
+      output:move(1, 1, w, h - 1)
+      prompt:move(1, h, w, 1)
    end
 
-   win:resized(redraw)
+   output:redraw(function()
+         local w, h = output:getsize()
+         local y = 1
 
-   win:keydown(function(t)
-                  if t.key == "return" then
-                     local command = stdin
-                     stdin = ""
+         output:clear(bg)
 
-                     local fn = load(command)
-                     local success, result = pcall(fn)
-                     result = tostring(result)
-                     if not success then result = "error: " .. result end
+         for line in (stdout .. "\n"):gmatch("(.-)\n") do
+            if y > h then break end
 
-                     stdout = stdout .. "> " .. command .. "\n" .. result .. "\n"
-                  elseif t.key == "delete" then -- i.e. backspace
-                     stdin = stdin:sub(0, -2)
-                  else
-                     stdin = stdin .. t.key
-                  end
-                  redraw()
-               end)
+            -- one blit per row, wrapping long lines at the pane's width
+            local i = 1
+            repeat
+               local _
+               _, i = output:blit(line, 1, y, fg, bg, i)
+               y = y + 1
+            until i > #line or y > h
+         end
+   end)
+
+   prompt:redraw(function()
+         local str = "> " .. stdin
+         prompt:setrow(1, str, {#str, fg, bg, 1, bg, fg, 0, fg, bg})
+   end)
+
+   win:redraw(function()
+         win:clear(bg)
+   end)
+
+   win:resized(layout)
+
+   win:input(function(events)
+         for i = 1, events.n do
+            local t = events[i]
+            if t.text then
+               stdin = stdin .. t.text
+            elseif t.key == "return" then
+               local command = stdin
+               stdin = ""
+
+               local fn = load(command)
+               local success, result = pcall(fn)
+               result = tostring(result)
+               if not success then result = "error: " .. result end
+
+               stdout = stdout .. "> " .. command .. "\n" .. result .. "\n"
+               output:invalidate()
+            elseif t.key == "delete" then -- i.e. backspace
+               stdin = stdin:sub(0, -2)
+            end
+         end
+         prompt:invalidate()
+   end)
 
-   redraw()
+   layout()
+   win:invalidate()
 end
 
 return devconsole
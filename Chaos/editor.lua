@@ -1,71 +1,449 @@
 local win = window.new()
-win:settitle("Untitled")
 
-local fg = "839496"
-local bg = "002b36"
+local fg = win:color("839496")
+local bg = win:color("002b36")
 
-local contents = ""
+-- the document above a one-row status bar
+local doc = win:pane(1, 1, 1, 1)
+local status = win:pane(1, 1, 1, 1)
 
-local function printstr(str, x, y, fg, bg)
+local loading = nil      -- how much of the file is loaded, until it all is
+local message = nil      -- shown in the status bar until the next edit
+local finding = nil      -- {query, from, match} while typing a search
+
+-- a file named on the command line is mapped, not read, so even huge ones
+-- open at once; its lines get counted on another thread meanwhile
+local function progress(buf, fraction, done)
+   loading = not done and fraction or nil
+   if done and buf:stats().invalid > 0 then
+      message = string.format("(%d invalid UTF-8 sequences)", buf:stats().invalid)
+   end
+   status:invalidate()
+end
+
+local path = arg and arg[1]
+local text, err
+if path then text, err = buffer.open(path, progress) end
+text = text or buffer.new()
+
+local name = path or "<untitled file>"
+win:settitle(path or "Untitled")
+
+-- grammars by file extension; see highlightlib.c for how they work
+local luawords = {}
+for w in ("and break do else elseif end false for function goto if in local nil not or repeat return then true until while"):gmatch("%a+") do
+   luawords[w] = "keyword"
+end
+
+local cwords = {}
+for w in ("auto break case char const continue default do double else enum extern float for goto if inline int long register restrict return short signed sizeof static struct switch typedef union unsigned void volatile while"):gmatch("%a+") do
+   cwords[w] = "keyword"
+end
+
+local grammars = {
+   lua = {
+      main = {
+         {[[--\[\[]], "comment", "longcomment"},
+         {[[--.*]], "comment"},
+         {[[\[\[]], "string", "longstring"},
+         {[["(\\.|[^"\\])*"?]], "string"},
+         {[['(\\.|[^'\\])*'?]], "string"},
+         {[[0[xX][0-9a-fA-F]+|\d+(\.\d*)?([eE][-+]?\d+)?]], "number"},
+         {[[[A-Za-z_]\w*]], keywords = luawords},
+      },
+      longcomment = {style = "comment", {[=[\]\]]=], "comment", "main"}},
+      longstring = {style = "string", {[=[\]\]]=], "string", "main"}},
+   },
+   c = {
+      main = {
+         {[[//.*]], "comment"},
+         {[[/\*]], "comment", "blockcomment"},
+         {[[^\s*#\s*\w+]], "preprocessor"},
+         {[["(\\.|[^"\\])*"?]], "string"},
+         {[['(\\.|[^'\\])*'?]], "string"},
+         {[[0[xX][0-9a-fA-F]+|\d+(\.\d*)?([eE][-+]?\d+)?]], "number"},
+         {[[[A-Za-z_]\w*]], keywords = cwords},
+      },
+      blockcomment = {style = "comment", {[[\*/]], "comment", "main"}},
+   },
+}
+grammars.h = grammars.c
+grammars.m = grammars.c
+
+local hl = nil
+local grammar = path and grammars[path:match("%.(%w+)$") or ""]
+if grammar then
+   hl = highlight.new(text, highlight.grammar(grammar))
+   hl:setcolors{keyword = "859900", comment = "586e75", string = "2aa198", number = "d33682", preprocessor = "cb4b16"}
+end
+
+local top = 0            -- document lines scrolled off the top
+local sub = 0            -- and rows of the top line, when lines wrap
+local left = 0           -- columns scrolled off the left, when they don't
+local tabwidth = 4
+local exposed = nil      -- {from, to} when the last change was just a scroll
+
+-- lines wrap at the doc's width (alt-z turns it off and on). the layout only
+-- works out the lines it's asked about, so a resize costs what's on screen
+local wrapped = wrap.new(text, 80, tabwidth)
+
+-- every edit happens at each of the carets at once, as one undo step. there's
+-- one at the end to begin with; alt-return while finding puts one after
+-- every match, and escape goes back to just the last of them
+local carets = cursors.new(text)
+carets:add(#text + 1)
+
+local function layout()
    local w, h = win:getsize()
+   doc:move(1, 1, w, h - 1)
+   status:move(1, h, w, 1)
 
-   for i = 1, #str do
-      if x == w + 1 then break end
+   if wrapped then
+      wrapped:setwidth(w, tabwidth)
+      sub = math.min(sub, wrapped:rows(top + 1) - 1)
+   end
+end
 
-      local c = str:sub(i,i):byte()
-      win:set(c, x, y, fg, bg)
-      x = x + 1
+-- where the last caret is, as a line and display column. until it's moved
+-- that's the end, and finding its line means counting every line in the file first
+local function cursor()
+   local pos = carets:get(-1)
+   return text:lineat(pos), text:column(pos, tabwidth)
+end
+
+-- the doc row and column a line and display column are drawn at (rows above the screen are < 1)
+local function place(line, col)
+   if not wrapped then return line - top, col - left end
+
+   local w, h = doc:getsize()
+   local k = math.min(math.floor((col - 1) / w), wrapped:rows(line) - 1)
+   return wrapped:row(line) + k - wrapped:row(top + 1) - sub + 1, math.min(col - k * w, w)
+end
+
+-- moves the top of the screen down dy rows (up if negative), as far as the
+-- text goes. it goes a line at a time, so each line it passes gets laid out
+-- and the rows moved are exact; returns how many that was
+local function wrapby(dy)
+   local moved = 0
+   while moved < dy do
+      local below = wrapped:rows(top + 1) - 1 - sub
+      if below > 0 then
+         local k = math.min(below, dy - moved)
+         sub, moved = sub + k, moved + k
+      elseif text:linestart(top + 2) then
+         top, sub, moved = top + 1, 0, moved + 1
+      else
+         break
+      end
+   end
+   while moved > dy do
+      if sub > 0 then
+         local k = math.min(sub, moved - dy)
+         sub, moved = sub - k, moved - k
+      elseif top > 0 then
+         top = top - 1
+         sub, moved = wrapped:rows(top + 1) - 1, moved - 1
+      else
+         break
+      end
    end
+   return moved
 end
 
-local function printdoc()
-   local w, h = win:getsize()
+-- puts the row a line and display column are on at the top of the screen, then moves it down dy rows
+local function wrapto(line, col, dy)
+   local w, h = doc:getsize()
+   top = line - 1
+   sub = math.min(math.floor((col - 1) / w), wrapped:rows(line) - 1)
+   wrapby(-dy)
+end
 
-   local x = 1
-   local y = 1
+-- shows the match being found by swapping its colors (as far as it's plain ASCII)
+local function printmatch(y0, y1)
+   local from, to = finding.match[1], finding.match[2]
+   local y, col = place(text:lineat(from), text:column(from, tabwidth))
+   if y < y0 or y > y1 then return end
 
-   for i = 1, #contents do
-      if x == w + 1 then
-         x = 1
-         y = y + 1
+   local str = text:sub(from, to)
+   for i = 1, #str do
+      local c = str:byte(i)
+      if c < 32 or c > 126 then break end
+      doc:set(c, col + i - 1, y, bg, fg)
+   end
+end
+
+-- draws the doc rows y0..y1; the text itself is laid out (and highlighted) in C, only for those rows
+local function printdoc(y0, y1)
+   if wrapped then
+      doc:renderwrapped(text, wrapped, top + 1, sub + 1, fg, bg, y0, y1, hl)
+   else
+      doc:render(text, top + 1, left + 1, tabwidth, fg, bg, y0, y1, hl)
+   end
+   if finding and finding.match then printmatch(y0, y1) end
+
+   -- draw the carets on screen; asking where the line below the screen
+   -- starts doesn't need anything past it counted
+   local w, h = doc:getsize()
+   local from = text:linestart(top + 1) or #text + 1
+   local to = text:linestart(top + h + 1) or #text + 1
+   for _, pos in ipairs(carets:positions(from, to)) do
+      local y, x = place(text:lineat(pos), text:column(pos, tabwidth))
+      if y >= y0 and y <= y1 then
+         doc:set(string.byte(" "), x, y, bg, fg)
       end
+   end
+end
 
-      if y == h + 1 then break end
+doc:redraw(function()
+      local w, h = doc:getsize()
 
-      local c = contents:sub(i,i):byte()
-      if c == string.byte("\n") then
-         x = 1
-         y = y + 1
-      else
-         win:set(c, x, y, fg, bg)
-         x = x + 1
+      if exposed then
+         -- the rest of the rows were moved by doc:scroll and are still right
+         printdoc(exposed[1], exposed[2])
+         exposed = nil
+         return
+      end
+
+      printdoc(1, h)
+end)
+
+status:redraw(function()
+      local str = err or name
+      if finding then
+         str = "find: " .. finding.query
+         if not finding.match and #finding.query > 0 then str = str .. "  (not found)" end
       end
+      local n = carets:count()
+      if n > 1 then str = str .. string.format("  (%d carets)", n) end
+      if message then str = str .. "  " .. message end
+      if loading then
+         str = str .. string.format("  (loading, %d%%)", loading * 100)
+      end
+      status:setrow(1, str, {#str, bg, fg, 0, fg, bg})
+end)
+
+-- scrolls by dy rows, moving what's on screen so only the new rows get drawn
+local function scrollby(dy)
+   local w, h = doc:getsize()
+   if wrapped then
+      dy = wrapby(dy)
+   else
+      if not text:linestart(top + dy + 1) then dy = text:linecount() - 1 - top end
+      if top + dy < 0 then dy = -top end
+      top = top + dy
+   end
+   if dy == 0 then return end
+
+   doc:scroll(1, h, dy, bg)
+
+   local from, to
+   if dy > 0 then
+      from, to = math.max(1, h - dy + 1), h
+   else
+      from, to = 1, math.min(h, -dy)
    end
 
-   -- draw cursor
-   win:set(string.byte(" "), x, y, bg, "839496")
+   if exposed then
+      -- scrolled again before the frame ran; just grow what gets drawn
+      from, to = 1, h
+   end
+   exposed = {from, to}
+
+   doc:invalidate()
 end
 
-local function redraw()
-   local w, h = win:getsize()
+-- scrolls sideways by dx columns; the whole doc is redrawn, but the moved
+-- columns already match so only the new ones reach the screen
+local function hscrollby(dx)
+   local w, h = doc:getsize()
+   if wrapped then return end
+   if left + dx < 0 then dx = -left end
+   if dx == 0 then return end
+
+   left = left + dx
+   doc:hscroll(1, w, dx, bg)
+   exposed = nil
+   doc:invalidate()
+end
 
-   win:clear(bg)
-   printdoc()
+-- after an edit, scrolls just far enough to keep the cursor on screen
+local function follow()
+   local w, h = doc:getsize()
+   local line, col = cursor()
 
-   printstr("<untitled file>", 1, h, bg, fg)
+   if wrapped then
+      local y = place(line, col)
+      if y < 1 then wrapto(line, col, 0) end
+      if y > h then wrapto(line, col, h - 1) end
+      return
+   end
+
+   if line - 1 < top then top = line - 1 end
+   if line > top + h then top = line - h end
+   if col - 1 < left then left = col - 1 end
+   if col > left + w then left = col - w end
 end
 
-win:resized(redraw)
+-- scrolls to the match being found, if it's off screen
+local function showmatch()
+   status:invalidate()
+   exposed = nil
+   doc:invalidate()
+   if not finding.match then return end
+
+   local w, h = doc:getsize()
+   local line = text:lineat(finding.match[1])
+   if wrapped then
+      local col = text:column(finding.match[1], tabwidth)
+      local y = place(line, col)
+      if y < 1 or y > h then wrapto(line, col, math.floor(h / 2)) end
+      return
+   end
 
-win:keydown(function(t)
-               if t.key == "return" then
-                  contents = contents .. "\n"
-               elseif t.key == "delete" then -- i.e. backspace
-                  contents = contents:sub(0, -2)
-               else
-                  contents = contents .. t.key
-               end
-               redraw()
-            end)
+   if line <= top or line > top + h then
+      top = math.max(0, line - 1 - math.floor(h / 2))
+   end
+   local col = text:column(finding.match[1], tabwidth)
+   if col <= left or col > left + w then
+      left = math.max(0, col - 1 - math.floor(w / 2))
+   end
+end
+
+-- puts a caret just after every match of the search, and ends it
+local function caretmatches()
+   local query = finding.query
+   if #query == 0 or not finding.match then return end
+
+   carets:clear()
+   local init = 1
+   while true do
+      local from, to = text:find(query, init, true)
+      if not from then break end
+      carets:add(to + 1)
+      init = to + 1
+   end
+   finding = nil
+   status:invalidate()
+end
+
+-- find-as-you-type: each key narrows the search from where it had got to
+local function findkey(t)
+   if t.alt and t.key == "return" then
+      caretmatches()
+      exposed = nil
+      doc:invalidate()
+      return
+   elseif t.text then
+      finding.query = finding.query .. t.text
+   elseif t.key == "delete" then
+      -- back over one whole UTF-8 character
+      finding.query = finding.query:gsub("[^\128-\191][\128-\191]*$", "")
+   elseif t.key == "return" then
+      local from, to = finding.finder:next()
+      if from then finding.match = {from, to} end
+      showmatch()
+      return
+   else
+      return false
+   end
+
+   local from, to = finding.finder:set(finding.query, finding.from)
+   finding.match = from and {from, to}
+   showmatch()
+end
+
+-- everything gets redrawn after this, panes included
+win:redraw(function()
+      exposed = nil
+      win:clear(bg)
+end)
+
+win:resized(layout)
+
+-- keys arrive once per frame, with typed (or pasted) text already joined up
+win:input(function(events)
+      local w, h = doc:getsize()
+      local edited = false
+
+      for i = 1, events.n do
+         local t = events[i]
+         if finding and t.key == "escape" then
+            finding = nil
+            status:invalidate()
+            exposed = nil
+            doc:invalidate()
+         elseif finding and findkey(t) ~= false then
+            -- typed into the search
+         elseif (t.ctrl or t.cmd) and t.key == "f" then
+            -- searches from the top of the screen
+            finding = {query = "", from = text:linestart(top + 1) or 1, finder = text:finder(true)}
+            status:invalidate()
+         elseif t.key == "escape" and carets:count() > 1 then
+            local pos = carets:get(-1)
+            carets:clear()
+            carets:add(pos)
+            status:invalidate()
+            exposed = nil
+            doc:invalidate()
+         elseif t.text then
+            carets:type(t.text)
+            edited = true
+         elseif t.key == "return" then
+            -- typing joins one undo step until the end of the line
+            carets:type("\n")
+            text:seal()
+            edited = true
+         elseif t.key == "tab" then
+            carets:type("\t")
+            edited = true
+         elseif t.key == "delete" then -- i.e. backspace
+            carets:backspace()
+            edited = true
+         elseif (t.ctrl or t.cmd) and t.key == "s" then
+            if path then
+               local ok, saveerr = text:save(path)
+               message = ok and "(saved)" or saveerr
+            else
+               message = "(no file to save to)"
+            end
+            status:invalidate()
+         elseif (t.ctrl or t.cmd) and t.key == "z" then
+            if text:undo() then edited = true end
+         elseif (t.ctrl or t.cmd) and (t.key == "y" or t.key == "Z") then
+            if text:redo() then edited = true end
+         elseif t.key == "down" then
+            scrollby(1)
+         elseif t.key == "up" then
+            scrollby(-1)
+         elseif t.key == "pagedown" then
+            scrollby(h - 1)
+         elseif t.key == "pageup" then
+            scrollby(-(h - 1))
+         elseif t.alt and t.key == "z" then
+            if wrapped then
+               wrapped, sub = nil, 0
+            else
+               wrapped, left = wrap.new(text, w, tabwidth), 0
+            end
+            exposed = nil
+            doc:invalidate()
+         elseif t.key == "right" then
+            hscrollby(1)
+         elseif t.key == "left" then
+            hscrollby(-1)
+         end
+      end
+
+      if edited then
+         if message then
+            message = nil
+            status:invalidate()
+         end
+         follow()
+         exposed = nil
+         doc:invalidate()
+      end
+end)
 
-redraw()
+layout()
+win:invalidate()
@@ -0,0 +1,49 @@
+#include "frame.h"
+
+void ko_frame_init(ko_frame* f, double rate) {
+    f->last = -1e9;
+    f->due = 0;
+    f->dirty = 0;
+    f->stats = (ko_frame_stats){ 0, 0, 0, 0 };
+    ko_frame_setrate(f, rate);
+}
+
+void ko_frame_setrate(ko_frame* f, double rate) {
+    if (rate <= 0)
+        rate = KO_FRAME_DEFAULT_RATE;
+    f->interval = 1.0 / rate;
+}
+
+double ko_frame_invalidate(ko_frame* f, double now) {
+    f->stats.requests++;
+
+    if (f->dirty) {
+        f->stats.coalesced++;
+        return -1;
+    }
+
+    f->dirty = 1;
+    f->due = f->last + f->interval;
+    if (f->due < now)
+        f->due = now;
+
+    return f->due - now;
+}
+
+double ko_frame_delay(const ko_frame* f, double now) {
+    return f->due > now ? f->due - now : 0;
+}
+
+int ko_frame_tick(ko_frame* f, double now) {
+    if (!f->dirty || now < f->due)
+        return 0;
+
+    double late = now - f->due;
+    if (late >= f->interval)
+        f->stats.skipped += (unsigned long)(late / f->interval);
+
+    f->dirty = 0;
+    f->last = now;
+    f->stats.frames++;
+    return 1;
+}
@@ -0,0 +1,41 @@
+#ifndef KO_FRAME_H
+#define KO_FRAME_H
+
+// Decides when a window's redraw callback runs. Any number of invalidations
+// between two frames collapse into one redraw, and redraws never run closer
+// together than the frame interval.
+//
+// It never reads a clock itself: the host passes `now` (in seconds) to every
+// call and schedules the ticks, so it behaves the same under a fake clock.
+
+typedef struct ko_frame_stats {
+    unsigned long requests;     // invalidations
+    unsigned long frames;       // redraws actually run
+    unsigned long coalesced;    // invalidations folded into an already-pending frame
+    unsigned long skipped;      // frame slots missed because a tick came in late
+} ko_frame_stats;
+
+typedef struct ko_frame {
+    double interval;            // seconds between frames
+    double last;                // when the last redraw ran
+    double due;                 // when the pending redraw should run
+    int dirty;
+    ko_frame_stats stats;
+} ko_frame;
+
+#define KO_FRAME_DEFAULT_RATE 60
+
+void ko_frame_init(ko_frame* f, double rate);
+void ko_frame_setrate(ko_frame* f, double rate);
+
+// marks the window dirty. returns how many seconds from now the host should
+// call ko_frame_tick, or -1 if a tick is already scheduled.
+double ko_frame_invalidate(ko_frame* f, double now);
+
+// returns 1 if the redraw should run now. if it returns 0 and the frame is
+// still dirty (the tick came early), ko_frame_delay says when to try again.
+int ko_frame_tick(ko_frame* f, double now);
+
+double ko_frame_delay(const ko_frame* f, double now);
+
+#endif
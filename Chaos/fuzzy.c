@@ -0,0 +1,626 @@
+#include "fuzzy.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// fzf's scores: every character matched is worth KO_SCORE_MATCH, plus a
+// bonus for where it is (the first character's counts double); a gap costs
+// more to start than to go on with
+#define KO_SCORE_MATCH 16
+#define KO_SCORE_GAP_START (-3)
+#define KO_SCORE_GAP_EXTENSION (-1)
+#define KO_BONUS_BOUNDARY 8
+#define KO_BONUS_BOUNDARY_WHITE 10
+#define KO_BONUS_BOUNDARY_DELIMITER 9
+#define KO_BONUS_NONWORD 8
+#define KO_BONUS_CAMEL 7
+#define KO_BONUS_CONSECUTIVE 4
+#define KO_BONUS_FIRST_MULTIPLIER 2
+
+// the threads take turns at chunks this big; fewer candidates than
+// KO_FUZZY_ALONE aren't worth waking them for
+#define KO_FUZZY_CHUNK 4096
+#define KO_FUZZY_ALONE 16384
+#define KO_FUZZY_MAXTHREADS 15
+
+// candidates up to this long are matched a bit per byte, in one word;
+// the arena has this many readable bytes past its end so they can all be loaded whole
+#define KO_FUZZY_WORD 64
+
+enum { KO_CHAR_WHITE, KO_CHAR_NONWORD, KO_CHAR_DELIMITER, KO_CHAR_LOWER, KO_CHAR_UPPER, KO_CHAR_LETTER, KO_CHAR_NUMBER };
+
+// where each of the query's characters is in the 64 bytes at p, a bit per byte
+typedef void (*ko_fuzzy_bits_fn)(const unsigned char* p, const char* q, size_t qlen, uint64_t* bits);
+
+typedef struct ko_fuzzy_item {
+    size_t at;                  // where it is in the arena; its lowercased copy comes right after
+    uint32_t len;
+} ko_fuzzy_item;
+
+// the candidates a query matched, for the queries that carry on from it to look through
+typedef struct ko_fuzzy_level {
+    size_t qlen;
+    uint32_t* idx;
+    size_t n;
+} ko_fuzzy_level;
+
+// the caller's or a thread's best k so far, worst first
+typedef struct ko_fuzzy_slot {
+    struct ko_fuzzy* f;
+    pthread_t thread;
+    ko_fuzzy_result* heap;
+    size_t n, cap;
+} ko_fuzzy_slot;
+
+struct ko_fuzzy {
+    char* arena;
+    size_t used, cap;
+    ko_fuzzy_item* items;
+    uint64_t* masks;            // the characters each has
+    size_t n, itemcap;
+
+    char* query;                // the last one, lowercased; the levels' queries are how it started
+    size_t qcap;
+    ko_fuzzy_level* levels;
+    size_t nlevels, levelcap;
+    ko_fuzzy_bits_fn bits;
+
+    // the query being matched
+    const char* q;
+    size_t qlen, k;
+    uint64_t qmask;
+    const uint32_t* from;       // the candidates it's looking at, or NULL for all of them
+    size_t count;
+    uint32_t* found;            // each chunk's matches, where the chunk is
+    size_t* nfound;
+    size_t nchunks, next;       // next is taken atomically
+
+    // slots[0] is the caller's, the rest the threads'
+    ko_fuzzy_slot slots[KO_FUZZY_MAXTHREADS + 1];
+    size_t nthreads;
+    int started;
+    pthread_mutex_t lock;
+    pthread_cond_t go, done;
+    unsigned gen;
+    size_t busy;
+    int quit;
+};
+
+static inline int ko_fuzzy_class(unsigned char c) {
+    if (c >= 'a' && c <= 'z') return KO_CHAR_LOWER;
+    if (c >= 'A' && c <= 'Z') return KO_CHAR_UPPER;
+    if (c >= '0' && c <= '9') return KO_CHAR_NUMBER;
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r') return KO_CHAR_WHITE;
+    if (c == '/' || c == ',' || c == ':' || c == ';' || c == '|') return KO_CHAR_DELIMITER;
+    if (c >= 0x80) return KO_CHAR_LETTER;
+    return KO_CHAR_NONWORD;
+}
+
+// what a character's worth for coming after one of class prev
+static inline int ko_fuzzy_bonus(int prev, int class) {
+    if (class > KO_CHAR_NONWORD) {
+        if (prev == KO_CHAR_WHITE) return KO_BONUS_BOUNDARY_WHITE;
+        if (prev == KO_CHAR_DELIMITER) return KO_BONUS_BOUNDARY_DELIMITER;
+        if (prev == KO_CHAR_NONWORD) return KO_BONUS_BOUNDARY;
+    }
+    if ((prev == KO_CHAR_LOWER && class == KO_CHAR_UPPER) || (prev != KO_CHAR_NUMBER && class == KO_CHAR_NUMBER))
+        return KO_BONUS_CAMEL;
+    if (class == KO_CHAR_NONWORD || class == KO_CHAR_DELIMITER)
+        return KO_BONUS_NONWORD;
+    if (class == KO_CHAR_WHITE)
+        return KO_BONUS_BOUNDARY_WHITE;
+    return 0;
+}
+
+static inline unsigned char ko_fuzzy_lower(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+// a bit for each letter and digit, and the rest share what's left
+static inline uint64_t ko_fuzzy_bit(unsigned char c) {
+    if (c >= 'a' && c <= 'z') return 1ull << (c - 'a');
+    if (c >= '0' && c <= '9') return 1ull << (26 + c - '0');
+    return 1ull << (36 + c % 28);
+}
+
+#ifdef __SSE2__
+static void ko_fuzzy_bits_sse2(const unsigned char* p, const char* q, size_t qlen, uint64_t* bits) {
+    __m128i a = _mm_loadu_si128((const __m128i*)p), b = _mm_loadu_si128((const __m128i*)(p + 16));
+    __m128i c = _mm_loadu_si128((const __m128i*)(p + 32)), d = _mm_loadu_si128((const __m128i*)(p + 48));
+    for (size_t j = 0; j < qlen; j++) {
+        __m128i x = _mm_set1_epi8(q[j]);
+        bits[j] = (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, x))
+                | (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b, x)) << 16
+                | (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(c, x)) << 32
+                | (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(d, x)) << 48;
+    }
+}
+
+#else
+
+// eight bytes per word: a byte of z is zero where it's the character, and
+// multiplying gathers the top bits of those bytes into one byte, first byte lowest
+static void ko_fuzzy_bits_swar(const unsigned char* p, const char* q, size_t qlen, uint64_t* bits) {
+    const uint64_t ones = 0x0101010101010101ull, low = 0x7F7F7F7F7F7F7F7Full;
+    for (size_t j = 0; j < qlen; j++) {
+        const uint64_t x = (unsigned char)q[j] * ones;
+        uint64_t b = 0;
+        for (size_t i = 0; i < KO_FUZZY_WORD; i += 8) {
+            uint64_t w;
+            memcpy(&w, p + i, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            w = __builtin_bswap64(w);
+#endif
+            uint64_t z = w ^ x;
+            uint64_t hit = ~(((z & low) + low) | z) & ~low;
+            b |= (((hit >> 7) * 0x0102040810204080ull) >> 56) << i;
+        }
+        bits[j] = b;
+    }
+}
+
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void ko_fuzzy_bits_avx2(const unsigned char* p, const char* q, size_t qlen, uint64_t* bits) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)p), b = _mm256_loadu_si256((const __m256i*)(p + 32));
+    for (size_t j = 0; j < qlen; j++) {
+        __m256i x = _mm256_set1_epi8(q[j]);
+        bits[j] = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, x))
+                | (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, x)) << 32;
+    }
+}
+#endif
+
+static ko_fuzzy_bits_fn ko_fuzzy_pick(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2"))
+        return ko_fuzzy_bits_avx2;
+#endif
+#ifdef __SSE2__
+    return ko_fuzzy_bits_sse2;
+#else
+    return ko_fuzzy_bits_swar;
+#endif
+}
+
+ko_fuzzy* ko_fuzzy_new(void) {
+    ko_fuzzy* f = calloc(1, sizeof(ko_fuzzy));
+    f->bits = ko_fuzzy_pick();
+    pthread_mutex_init(&f->lock, NULL);
+    pthread_cond_init(&f->go, NULL);
+    pthread_cond_init(&f->done, NULL);
+    return f;
+}
+
+static void ko_fuzzy_forget(ko_fuzzy* f) {
+    for (size_t i = 0; i < f->nlevels; i++)
+        free(f->levels[i].idx);
+    f->nlevels = 0;
+}
+
+void ko_fuzzy_free(ko_fuzzy* f) {
+    if (!f) return;
+    pthread_mutex_lock(&f->lock);
+    f->quit = 1;
+    pthread_cond_broadcast(&f->go);
+    pthread_mutex_unlock(&f->lock);
+    for (size_t i = 1; i <= f->nthreads; i++)
+        pthread_join(f->slots[i].thread, NULL);
+
+    for (size_t i = 0; i <= KO_FUZZY_MAXTHREADS; i++)
+        free(f->slots[i].heap);
+    ko_fuzzy_forget(f);
+    pthread_mutex_destroy(&f->lock);
+    pthread_cond_destroy(&f->go);
+    pthread_cond_destroy(&f->done);
+    free(f->levels);
+    free(f->query);
+    free(f->arena);
+    free(f->items);
+    free(f->masks);
+    free(f);
+}
+
+void ko_fuzzy_add(ko_fuzzy* f, const char* s, size_t len) {
+    if (f->n == UINT32_MAX)
+        return;
+    if (len > UINT32_MAX)
+        len = UINT32_MAX;
+
+    if (f->used + 2 * len > f->cap) {
+        while (f->used + 2 * len > f->cap)
+            f->cap = f->cap ? 2 * f->cap : 65536;
+        f->arena = realloc(f->arena, f->cap + KO_FUZZY_WORD);
+    }
+    if (f->n == f->itemcap) {
+        f->itemcap = f->itemcap ? 2 * f->itemcap : 1024;
+        f->items = realloc(f->items, f->itemcap * sizeof(ko_fuzzy_item));
+        f->masks = realloc(f->masks, f->itemcap * sizeof(uint64_t));
+    }
+
+    char* text = f->arena + f->used;
+    memcpy(text, s, len);
+    uint64_t mask = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = ko_fuzzy_lower(s[i]);
+        text[len + i] = c;
+        mask |= ko_fuzzy_bit(c);
+    }
+
+    f->items[f->n] = (ko_fuzzy_item){ f->used, (uint32_t)len };
+    f->masks[f->n] = mask;
+    f->n++;
+    f->used += 2 * len;
+
+    // what's matched so far doesn't know about it
+    ko_fuzzy_forget(f);
+}
+
+void ko_fuzzy_clear(ko_fuzzy* f) {
+    f->n = f->used = 0;
+    ko_fuzzy_forget(f);
+}
+
+size_t ko_fuzzy_count(const ko_fuzzy* f) {
+    return f->n;
+}
+
+const char* ko_fuzzy_get(const ko_fuzzy* f, size_t i, size_t* len) {
+    if (i >= f->n)
+        return NULL;
+    *len = f->items[i].len;
+    return f->arena + f->items[i].at;
+}
+
+// the characters' places in a candidate of len bytes from where each of them
+// is, a word at a time: the first run of them in order ends as early as it can,
+// starts as late as it can for that end, and takes each one as early as it can
+// in between; returns 0 if they aren't all in it in order
+static int ko_fuzzy_place(const uint64_t* bits, size_t qlen, size_t len, size_t* at) {
+    uint64_t in = len < KO_FUZZY_WORD ? (1ull << len) - 1 : ~0ull;
+    uint64_t from = in;
+    for (size_t j = 0; j < qlen; j++) {
+        uint64_t m = bits[j] & from;
+        if (!m)
+            return 0;
+        at[j] = __builtin_ctzll(m);
+        from = ~1ull << at[j] & in;
+    }
+
+    uint64_t before = (2ull << at[qlen - 1]) - 1;
+    size_t start = 0;
+    for (size_t j = qlen; j-- > 0; ) {
+        start = 63 - __builtin_clzll(bits[j] & before);
+        before = (1ull << start) - 1;
+    }
+
+    from = ~0ull << start;
+    for (size_t j = 0; j < qlen; j++) {
+        at[j] = __builtin_ctzll(bits[j] & from);
+        from = ~1ull << at[j];
+    }
+    return 1;
+}
+
+// the same for longer candidates, with memchr
+static int ko_fuzzy_find(const unsigned char* lower, size_t len, const char* q, size_t qlen, size_t* at) {
+    size_t end = 0;
+    for (size_t j = 0; j < qlen; j++) {
+        const unsigned char* hit = memchr(lower + end, q[j], len - end);
+        if (!hit)
+            return 0;
+        end = hit - lower + 1;
+    }
+    size_t start = end;
+    for (size_t j = qlen; j-- > 0; )
+        while (lower[--start] != (unsigned char)q[j]) {}
+
+    for (size_t j = 0, k = start; j < qlen; j++) {
+        at[j] = (const unsigned char*)memchr(lower + k, q[j], end - k) - lower;
+        k = at[j] + 1;
+    }
+    return 1;
+}
+
+// what the characters are worth where they are; only they and their neighbours get classed
+static int32_t ko_fuzzy_tally(const unsigned char* text, const size_t* at, size_t qlen) {
+    int32_t total = 0;
+    int first = 0;
+    size_t run = 0, k = at[0];
+    for (size_t j = 0; j < qlen; j++) {
+        if (at[j] > k) {
+            total += KO_SCORE_GAP_START + (int32_t)(at[j] - k - 1) * KO_SCORE_GAP_EXTENSION;
+            run = 0;
+            first = 0;
+        }
+        int prev = at[j] > 0 ? ko_fuzzy_class(text[at[j] - 1]) : KO_CHAR_WHITE;
+        int bonus = ko_fuzzy_bonus(prev, ko_fuzzy_class(text[at[j]]));
+        if (run == 0) {
+            first = bonus;
+        }
+        else {
+            // a run keeps the bonus of the boundary it started on
+            if (bonus >= KO_BONUS_BOUNDARY && bonus > first)
+                first = bonus;
+            if (first > bonus)
+                bonus = first;
+            if (KO_BONUS_CONSECUTIVE > bonus)
+                bonus = KO_BONUS_CONSECUTIVE;
+        }
+        total += KO_SCORE_MATCH + (j == 0 ? bonus * KO_BONUS_FIRST_MULTIPLIER : bonus);
+        run++;
+        k = at[j] + 1;
+    }
+    return total;
+}
+
+// scores candidate i against a lowercased query, filling in pos (if not NULL)
+// with where its characters are; returns 0 if they aren't all in it in order
+static int ko_fuzzy_score(const ko_fuzzy* f, size_t i, const char* q, size_t qlen, int32_t* score, size_t* pos) {
+    const ko_fuzzy_item* it = &f->items[i];
+    const unsigned char* text = (const unsigned char*)f->arena + it->at;
+    const unsigned char* lower = text + it->len;
+    size_t len = it->len;
+    if (qlen > len)
+        return 0;
+
+    size_t here[KO_FUZZY_WORD];
+    size_t* at = pos ? pos : qlen <= KO_FUZZY_WORD ? here : malloc(qlen * sizeof(size_t));
+    int found;
+    if (len <= KO_FUZZY_WORD) {
+        uint64_t bits[KO_FUZZY_WORD];
+        f->bits(lower, q, qlen, bits);
+        found = ko_fuzzy_place(bits, qlen, len, at);
+    }
+    else {
+        found = ko_fuzzy_find(lower, len, q, qlen, at);
+    }
+
+    if (found)
+        *score = ko_fuzzy_tally(text, at, qlen);
+    if (at != pos && at != here)
+        free(at);
+    return found;
+}
+
+// whether a goes before b: a higher score, then shorter, then added first
+static inline int ko_fuzzy_beats(const ko_fuzzy* f, ko_fuzzy_result a, ko_fuzzy_result b) {
+    if (a.score != b.score)
+        return a.score > b.score;
+    if (f->items[a.index].len != f->items[b.index].len)
+        return f->items[a.index].len < f->items[b.index].len;
+    return a.index < b.index;
+}
+
+static void ko_fuzzy_down(const ko_fuzzy* f, ko_fuzzy_result* heap, size_t n, size_t i) {
+    for (;;) {
+        size_t worst = i, l = 2 * i + 1, r = l + 1;
+        if (l < n && ko_fuzzy_beats(f, heap[worst], heap[l]))
+            worst = l;
+        if (r < n && ko_fuzzy_beats(f, heap[worst], heap[r]))
+            worst = r;
+        if (worst == i)
+            return;
+        ko_fuzzy_result t = heap[i];
+        heap[i] = heap[worst];
+        heap[worst] = t;
+        i = worst;
+    }
+}
+
+// keeps r if it's one of the best k yet
+static void ko_fuzzy_offer(const ko_fuzzy* f, ko_fuzzy_slot* s, size_t k, ko_fuzzy_result r) {
+    if (s->n < k) {
+        size_t i = s->n++;
+        s->heap[i] = r;
+        while (i > 0 && ko_fuzzy_beats(f, s->heap[(i - 1) / 2], s->heap[i])) {
+            ko_fuzzy_result t = s->heap[i];
+            s->heap[i] = s->heap[(i - 1) / 2];
+            s->heap[(i - 1) / 2] = t;
+            i = (i - 1) / 2;
+        }
+    }
+    else if (k > 0 && ko_fuzzy_beats(f, r, s->heap[0])) {
+        s->heap[0] = r;
+        ko_fuzzy_down(f, s->heap, s->n, 0);
+    }
+}
+
+// matches the chunks nobody's taken yet
+static void ko_fuzzy_work(ko_fuzzy* f, ko_fuzzy_slot* s) {
+    uint64_t qmask = f->qmask;
+    size_t c;
+    while ((c = __atomic_fetch_add(&f->next, 1, __ATOMIC_RELAXED)) < f->nchunks) {
+        size_t lo = c * KO_FUZZY_CHUNK;
+        size_t hi = lo + KO_FUZZY_CHUNK < f->count ? lo + KO_FUZZY_CHUNK : f->count;
+        uint32_t* out = f->found + lo;
+
+        // the ones with every character the query has, without branching
+        size_t m = 0;
+        if (f->from) {
+            for (size_t i = lo; i < hi; i++) {
+                uint32_t idx = f->from[i];
+                out[m] = idx;
+                m += (f->masks[idx] & qmask) == qmask;
+            }
+        }
+        else {
+            for (size_t i = lo; i < hi; i++) {
+                out[m] = (uint32_t)i;
+                m += (f->masks[i] & qmask) == qmask;
+            }
+        }
+
+        // and of those, the ones that have them in order; they're scattered
+        // through the arena once a query's carried on from, so the next few are fetched ahead
+        size_t n = 0;
+        for (size_t i = 0; i < m; i++) {
+            if (i + 8 < m)
+                __builtin_prefetch(f->arena + f->items[out[i + 8]].at);
+            ko_fuzzy_result r = { out[i], 0 };
+            if (ko_fuzzy_score(f, r.index, f->q, f->qlen, &r.score, NULL)) {
+                out[n++] = r.index;
+                ko_fuzzy_offer(f, s, f->k, r);
+            }
+        }
+        f->nfound[c] = n;
+    }
+}
+
+static void* ko_fuzzy_thread(void* arg) {
+    ko_fuzzy_slot* s = arg;
+    ko_fuzzy* f = s->f;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&f->lock);
+    for (;;) {
+        while (f->gen == seen && !f->quit)
+            pthread_cond_wait(&f->go, &f->lock);
+        if (f->quit)
+            break;
+        seen = f->gen;
+        pthread_mutex_unlock(&f->lock);
+
+        ko_fuzzy_work(f, s);
+
+        pthread_mutex_lock(&f->lock);
+        if (--f->busy == 0)
+            pthread_cond_signal(&f->done);
+    }
+    pthread_mutex_unlock(&f->lock);
+    return NULL;
+}
+
+// a thread per core besides the caller's, the first time there's enough to share out
+static void ko_fuzzy_start(ko_fuzzy* f) {
+    f->started = 1;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t want = cpus <= 1 ? 0 : cpus - 1 > KO_FUZZY_MAXTHREADS ? KO_FUZZY_MAXTHREADS : (size_t)(cpus - 1);
+
+    for (size_t i = 1; i <= want; i++) {
+        f->slots[i].f = f;
+        if (pthread_create(&f->slots[i].thread, NULL, ko_fuzzy_thread, &f->slots[i]) != 0)
+            break;
+        f->nthreads = i;
+    }
+}
+
+size_t ko_fuzzy_match(ko_fuzzy* f, const char* query, size_t len, size_t k, ko_fuzzy_result* out, size_t* matched) {
+    if (len == 0) {
+        size_t n = k < f->n ? k : f->n;
+        for (size_t i = 0; i < n; i++)
+            out[i] = (ko_fuzzy_result){ (uint32_t)i, 0 };
+        if (matched)
+            *matched = f->n;
+        return n;
+    }
+
+    // the queries this one carries on from keep what they matched
+    char* q = malloc(len);
+    for (size_t i = 0; i < len; i++)
+        q[i] = ko_fuzzy_lower(query[i]);
+    while (f->nlevels > 0) {
+        ko_fuzzy_level* l = &f->levels[f->nlevels - 1];
+        if (l->qlen <= len && memcmp(f->query, q, l->qlen) == 0)
+            break;
+        free(l->idx);
+        f->nlevels--;
+    }
+    if (len > f->qcap)
+        f->query = realloc(f->query, f->qcap = len);
+    memcpy(f->query, q, len);
+    free(q);
+
+    f->q = f->query;
+    f->qlen = len;
+    f->k = k;
+    f->qmask = 0;
+    for (size_t i = 0; i < len; i++)
+        f->qmask |= ko_fuzzy_bit((unsigned char)f->query[i]);
+    f->from = f->nlevels ? f->levels[f->nlevels - 1].idx : NULL;
+    f->count = f->nlevels ? f->levels[f->nlevels - 1].n : f->n;
+    f->nchunks = (f->count + KO_FUZZY_CHUNK - 1) / KO_FUZZY_CHUNK;
+    f->next = 0;
+    f->found = malloc((f->count ? f->count : 1) * sizeof(uint32_t));
+    f->nfound = malloc((f->nchunks ? f->nchunks : 1) * sizeof(size_t));
+
+    if (f->count >= KO_FUZZY_ALONE && !f->started)
+        ko_fuzzy_start(f);
+    size_t helpers = f->count >= KO_FUZZY_ALONE ? f->nthreads : 0;
+    for (size_t i = 0; i <= helpers; i++) {
+        ko_fuzzy_slot* s = &f->slots[i];
+        s->n = 0;
+        if (k > s->cap)
+            s->heap = realloc(s->heap, (s->cap = k) * sizeof(ko_fuzzy_result));
+    }
+
+    // the threads and the caller all take chunks till they're gone
+    if (helpers) {
+        pthread_mutex_lock(&f->lock);
+        f->gen++;
+        f->busy = helpers;
+        pthread_cond_broadcast(&f->go);
+        pthread_mutex_unlock(&f->lock);
+    }
+    ko_fuzzy_work(f, &f->slots[0]);
+    if (helpers) {
+        pthread_mutex_lock(&f->lock);
+        while (f->busy > 0)
+            pthread_cond_wait(&f->done, &f->lock);
+        pthread_mutex_unlock(&f->lock);
+    }
+
+    // the chunks' matches, back to back, are what the next query carrying on from this one looks through
+    size_t total = 0;
+    for (size_t c = 0; c < f->nchunks; c++) {
+        memmove(f->found + total, f->found + c * KO_FUZZY_CHUNK, f->nfound[c] * sizeof(uint32_t));
+        total += f->nfound[c];
+    }
+    free(f->nfound);
+    if (f->nlevels > 0 && f->levels[f->nlevels - 1].qlen == len) {
+        free(f->levels[--f->nlevels].idx);
+    }
+    if (f->nlevels == f->levelcap) {
+        f->levelcap = f->levelcap ? 2 * f->levelcap : 16;
+        f->levels = realloc(f->levels, f->levelcap * sizeof(ko_fuzzy_level));
+    }
+    f->levels[f->nlevels++] = (ko_fuzzy_level){ len, realloc(f->found, (total ? total : 1) * sizeof(uint32_t)), total };
+    f->found = NULL;
+
+    // everyone's best k, down to the best k of all, best first
+    ko_fuzzy_slot* best = &f->slots[0];
+    for (size_t i = 1; i <= helpers; i++)
+        for (size_t j = 0; j < f->slots[i].n; j++)
+            ko_fuzzy_offer(f, best, k, f->slots[i].heap[j]);
+    size_t n = best->n;
+    for (size_t i = n; i-- > 0; ) {
+        out[i] = best->heap[0];
+        best->heap[0] = best->heap[i];
+        ko_fuzzy_down(f, best->heap, i, 0);
+    }
+
+    if (matched)
+        *matched = total;
+    return n;
+}
+
+size_t ko_fuzzy_positions(const ko_fuzzy* f, size_t i, const char* query, size_t len, size_t* pos) {
+    if (i >= f->n || len == 0)
+        return 0;
+
+    char* q = malloc(len);
+    for (size_t j = 0; j < len; j++)
+        q[j] = ko_fuzzy_lower(query[j]);
+    int32_t score;
+    int found = ko_fuzzy_score(f, i, q, len, &score, pos);
+    free(q);
+    return found ? len : 0;
+}
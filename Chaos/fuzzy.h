@@ -0,0 +1,49 @@
+#ifndef KO_FUZZY_H
+#define KO_FUZZY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fuzzy matching for quick-open: a query matches a candidate (a path, a
+// symbol) if its characters are in it in order, ignoring ASCII case. Matches
+// are scored fzf-style: points for each character, more for ones at the
+// start of a word or a path component, and for runs of them; less for gaps.
+//
+// The candidates are kept back to back in one arena, each followed by its
+// lowercased copy, and each has a 64-bit mask of which characters it has.
+// A query only looks at candidates whose masks have all its bits (a pass
+// over a flat array the compiler vectorises), then finds its characters in
+// those with memchr, and scores only the ones that match.
+//
+// A big list is split into chunks that a small pool of threads (and the
+// caller) take turns at, each keeping its best k in a bounded heap. Typing
+// more onto the query only ever narrows the matches down, so the candidates
+// that matched each query are kept, and a query that carries on from one
+// only looks at those. Backspacing goes back to the one before.
+
+typedef struct ko_fuzzy ko_fuzzy;
+
+typedef struct ko_fuzzy_result {
+    uint32_t index;             // the candidate, by the order they were added in
+    int32_t score;
+} ko_fuzzy_result;
+
+ko_fuzzy* ko_fuzzy_new(void);
+void ko_fuzzy_free(ko_fuzzy* f);
+
+void ko_fuzzy_add(ko_fuzzy* f, const char* s, size_t len);
+void ko_fuzzy_clear(ko_fuzzy* f);
+
+size_t ko_fuzzy_count(const ko_fuzzy* f);
+const char* ko_fuzzy_get(const ko_fuzzy* f, size_t i, size_t* len);
+
+// the best k matches of query (up to), best first: by score, then the
+// shortest, then the first added. matched (if not NULL) is set to how many
+// candidates matched at all. an empty query matches everything, in order.
+size_t ko_fuzzy_match(ko_fuzzy* f, const char* query, size_t len, size_t k, ko_fuzzy_result* out, size_t* matched);
+
+// where in candidate i query's characters matched, for highlighting them;
+// returns how many there are in pos (len of them), or 0 if it doesn't match
+size_t ko_fuzzy_positions(const ko_fuzzy* f, size_t i, const char* query, size_t len, size_t* pos);
+
+#endif
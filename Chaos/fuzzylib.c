@@ -0,0 +1,176 @@
+// The `fuzzy` Lua module: lists of candidates (paths, symbols) to pick from
+// by typing some of their characters in order (fuzzy.c), as userdata.
+// Indexes and positions are 1-based.
+
+#include <stdlib.h>
+#include "lua/lauxlib.h"
+#include "fuzzy.h"
+
+#define KO_FUZZY_META "chaos.fuzzy"
+
+// args: []
+// returns: [list]
+static int fuzzy_new(lua_State *L) {
+    ko_fuzzy** ud = lua_newuserdata(L, sizeof(ko_fuzzy*));  // [list]
+    *ud = ko_fuzzy_new();
+    luaL_setmetatable(L, KO_FUZZY_META);
+    return 1;
+}
+
+static ko_fuzzy* ko_tofuzzy(lua_State* L) {
+    return *(ko_fuzzy**)luaL_checkudata(L, 1, KO_FUZZY_META);
+}
+
+// args: [list, str or {str...}]
+static int fuzzy_add(lua_State *L) {
+    ko_fuzzy* f = ko_tofuzzy(L);
+    
+    if (lua_type(L, 2) == LUA_TTABLE) {
+        lua_Integer n = luaL_len(L, 2);
+        for (lua_Integer i = 1; i <= n; i++) {
+            lua_rawgeti(L, 2, i);                     // [list, strs, str]
+            size_t len;
+            const char* s = lua_tolstring(L, -1, &len);
+            if (!s)
+                return luaL_error(L, "item %d isn't a string", (int)i);
+            ko_fuzzy_add(f, s, len);
+            lua_pop(L, 1);                            // [list, strs]
+        }
+        return 0;
+    }
+    
+    size_t len;
+    const char* s = luaL_checklstring(L, 2, &len);
+    ko_fuzzy_add(f, s, len);
+    return 0;
+}
+
+// args: [list]
+static int fuzzy_clear(lua_State *L) {
+    ko_fuzzy_clear(ko_tofuzzy(L));
+    return 0;
+}
+
+// args: [list]
+// returns: [n]
+static int fuzzy_count(lua_State *L) {
+    lua_pushinteger(L, ko_fuzzy_count(ko_tofuzzy(L)));
+    return 1;
+}
+
+// args: [list, i]
+// returns: [str] or [nil]
+static int fuzzy_get(lua_State *L) {
+    ko_fuzzy* f = ko_tofuzzy(L);
+    lua_Integer i = luaL_checkinteger(L, 2);
+    
+    size_t len;
+    const char* s = i >= 1 ? ko_fuzzy_get(f, i - 1, &len) : NULL;
+    if (!s)
+        return 0;
+    lua_pushlstring(L, s, len);
+    return 1;
+}
+
+// args: [list, query, k = 50]
+// returns: [{{index, text, score}...}, matched]
+// the best k matches, best first; matched is how many matched at all
+static int fuzzy_match(lua_State *L) {
+    ko_fuzzy* f = ko_tofuzzy(L);
+    size_t len;
+    const char* query = luaL_checklstring(L, 2, &len);
+    lua_Integer k = luaL_optinteger(L, 3, 50);
+    luaL_argcheck(L, k >= 0, 3, "can't be negative");
+    
+    if ((size_t)k > ko_fuzzy_count(f))
+        k = ko_fuzzy_count(f);
+    ko_fuzzy_result* out = malloc((k ? k : 1) * sizeof(ko_fuzzy_result));
+    if (!out)
+        return luaL_error(L, "out of memory");
+    size_t matched;
+    size_t n = ko_fuzzy_match(f, query, len, k, out, &matched);
+    
+    lua_createtable(L, (int)n, 0);                    // [list, query, k, results]
+    for (size_t i = 0; i < n; i++) {
+        size_t textlen;
+        const char* text = ko_fuzzy_get(f, out[i].index, &textlen);
+        lua_createtable(L, 0, 3);                     // [..., results, result]
+        lua_pushinteger(L, out[i].index + 1);
+        lua_setfield(L, -2, "index");
+        lua_pushlstring(L, text, textlen);
+        lua_setfield(L, -2, "text");
+        lua_pushinteger(L, out[i].score);
+        lua_setfield(L, -2, "score");
+        lua_rawseti(L, -2, (int)i + 1);               // [..., results]
+    }
+    free(out);
+    
+    lua_pushinteger(L, matched);                      // [..., results, matched]
+    return 2;
+}
+
+// args: [list, i, query]
+// returns: [{pos...}] or [nil]
+// where in item i the query's characters are, or nil if it doesn't match
+static int fuzzy_positions(lua_State *L) {
+    ko_fuzzy* f = ko_tofuzzy(L);
+    lua_Integer i = luaL_checkinteger(L, 2);
+    size_t len;
+    const char* query = luaL_checklstring(L, 3, &len);
+    luaL_argcheck(L, i >= 1 && (size_t)i <= ko_fuzzy_count(f), 2, "out of range");
+    
+    size_t* pos = malloc((len ? len : 1) * sizeof(size_t));
+    if (!pos)
+        return luaL_error(L, "out of memory");
+    size_t n = ko_fuzzy_positions(f, i - 1, query, len, pos);
+    if (n == 0 && len > 0) {
+        free(pos);
+        return 0;
+    }
+    
+    lua_createtable(L, (int)n, 0);                    // [list, i, query, positions]
+    for (size_t j = 0; j < n; j++) {
+        lua_pushinteger(L, pos[j] + 1);
+        lua_rawseti(L, -2, (int)j + 1);
+    }
+    free(pos);
+    return 1;
+}
+
+static int fuzzy_gc(lua_State *L) {
+    ko_fuzzy** ud = luaL_checkudata(L, 1, KO_FUZZY_META);
+    ko_fuzzy_free(*ud);
+    *ud = NULL;
+    return 0;
+}
+
+static const luaL_Reg fuzzylib_instance[] = {
+    {"add", fuzzy_add},
+    {"clear", fuzzy_clear},
+    {"count", fuzzy_count},
+    {"get", fuzzy_get},
+    {"match", fuzzy_match},
+    {"positions", fuzzy_positions},
+    {NULL, NULL}
+};
+
+static const luaL_Reg fuzzylib_meta[] = {
+    {"__gc", fuzzy_gc},
+    {NULL, NULL}
+};
+
+static const luaL_Reg fuzzylib[] = {
+    {"new", fuzzy_new},
+    {NULL, NULL}
+};
+
+int luaopen_fuzzy(lua_State* L) {
+    luaL_newmetatable(L, KO_FUZZY_META);              // [meta]
+    luaL_setfuncs(L, fuzzylib_meta, 0);               // [meta]
+    luaL_newlib(L, fuzzylib_instance);                // [meta, methods]
+    lua_setfield(L, -2, "__index");                   // [meta]
+    lua_pop(L, 1);                                    // []
+    
+    luaL_newlib(L, fuzzylib);
+    return 1;
+}
@@ -0,0 +1,706 @@
+#include "grep.h"
+#include "regex.h"
+#include "search.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// how far into a file a zero byte makes it binary
+#define KO_GREP_SNIFF 8192
+
+// a worker hands its batch over once it has this many matches, or once it's
+// had the first of them this long (in seconds)
+#define KO_GREP_BATCH 256
+#define KO_GREP_BATCH_AGE 0.05
+
+// files smaller than this are read rather than mapped, since mapping a
+// file and taking the page faults costs more than copying a few pages
+#define KO_GREP_MAPMIN (256 << 10)
+
+#define KO_GREP_MAXWORKERS 64
+
+// ---- .gitignore
+
+typedef struct ko_ignore_rule {
+    char* glob;
+    int negate;                 // it takes a path back that a rule before it ignored
+    int dironly;                // it only applies to directories
+    int anchored;               // it's against the path from the .gitignore's directory, not just the name
+} ko_ignore_rule;
+
+// the rules from one directory's .gitignore, on top of those from the
+// directories above it. shared by everything under the directory.
+typedef struct ko_ignore {
+    struct ko_ignore* parent;
+    size_t refs;                // (atomic)
+    size_t base;                // how long the directory's path is
+    ko_ignore_rule* rules;
+    size_t n;
+} ko_ignore;
+
+static ko_ignore* ko_ignore_retain(ko_ignore* ig) {
+    if (ig)
+        __atomic_add_fetch(&ig->refs, 1, __ATOMIC_RELAXED);
+    return ig;
+}
+
+static void ko_ignore_release(ko_ignore* ig) {
+    while (ig && __atomic_sub_fetch(&ig->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+        ko_ignore* parent = ig->parent;
+        for (size_t i = 0; i < ig->n; i++)
+            free(ig->rules[i].glob);
+        free(ig->rules);
+        free(ig);
+        ig = parent;
+    }
+}
+
+// adds a line of a .gitignore to its rules
+static void ko_ignore_parse(ko_ignore* ig, char* line) {
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '\t'))
+        line[--len] = 0;
+    if (len == 0 || line[0] == '#')
+        return;
+
+    ko_ignore_rule r = { 0 };
+    if (line[0] == '!') {
+        r.negate = 1;
+        line++;
+        len--;
+    }
+    else if (line[0] == '\\') {
+        line++;
+        len--;
+    }
+    if (len > 0 && line[len - 1] == '/') {
+        r.dironly = 1;
+        line[--len] = 0;
+    }
+
+    // a / anywhere but the end anchors it, except in a **/ at the start.
+    // the ** of a /** at the end is everything in the directory, which is
+    // the same as the directory itself for what gets skipped.
+    r.anchored = memchr(line, '/', len) != NULL;
+    if (len >= 3 && strcmp(line + len - 3, "/**") == 0) {
+        len -= 3;
+        line[len] = 0;
+    }
+    if (strncmp(line, "**/", 3) == 0) {
+        r.anchored = 0;
+        line += 3;
+        len -= 3;
+    }
+    if (line[0] == '/') {
+        line++;
+        len--;
+    }
+    if (len == 0)
+        return;
+
+    r.glob = strdup(line);
+    ig->rules = realloc(ig->rules, (ig->n + 1) * sizeof(ko_ignore_rule));
+    ig->rules[ig->n++] = r;
+}
+
+// parent with the .gitignore in dir on top, if there is one (a new reference either way)
+static ko_ignore* ko_ignore_load(const char* dir, size_t base, ko_ignore* parent) {
+    char* path = malloc(base + sizeof("/.gitignore"));
+    memcpy(path, dir, base);
+    strcpy(path + base, "/.gitignore");
+    int fd = open(path, O_RDONLY);
+    free(path);
+    if (fd < 0)
+        return ko_ignore_retain(parent);
+
+    size_t len = 0, cap = 4096;
+    char* text = malloc(cap + 1);
+    ssize_t got;
+    while ((got = read(fd, text + len, cap - len)) > 0) {
+        len += got;
+        if (len == cap)
+            text = realloc(text, (cap *= 2) + 1);
+    }
+    close(fd);
+    text[len] = 0;
+
+    ko_ignore* ig = calloc(1, sizeof(ko_ignore));
+    ig->parent = ko_ignore_retain(parent);
+    ig->refs = 1;
+    ig->base = base;
+    for (char* line = text; line; ) {
+        char* next = strchr(line, '\n');
+        if (next)
+            *next++ = 0;
+        ko_ignore_parse(ig, line);
+        line = next;
+    }
+    free(text);
+    return ig;
+}
+
+// whether path (under every .gitignore's directory in ig) is to be skipped:
+// the last rule that matches it says, the deepest .gitignore's first
+static int ko_ignore_match(const ko_ignore* ig, const char* path, int dir) {
+    const char* name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+
+    for (; ig; ig = ig->parent) {
+        const char* rel = path + ig->base + 1;
+        for (size_t i = ig->n; i-- > 0; ) {
+            const ko_ignore_rule* r = &ig->rules[i];
+            if (r->dironly && !dir)
+                continue;
+
+            int hit = 0;
+            if (r->anchored) {
+                hit = fnmatch(r->glob, rel, FNM_PATHNAME) == 0;
+            }
+            else if (!strchr(r->glob, '/')) {
+                hit = fnmatch(r->glob, name, 0) == 0;
+            }
+            else {
+                // what a **/ started: any run of directories, then the rest
+                for (const char* s = rel; s && !hit; s = strchr(s, '/') ? strchr(s, '/') + 1 : NULL)
+                    hit = fnmatch(r->glob, s, FNM_PATHNAME) == 0;
+            }
+            if (hit)
+                return !r->negate;
+        }
+    }
+    return 0;
+}
+
+// ---- the workers
+
+typedef struct ko_grep_task {
+    char* path;
+    ko_ignore* ignore;          // for a directory, the rules from above it
+    int dir;
+} ko_grep_task;
+
+// a match, with its path and line as offsets into its batch's text until it's handed over
+typedef struct ko_grep_found {
+    size_t path, pathlen;
+    size_t text, len;
+    size_t line, start, end;
+} ko_grep_found;
+
+typedef struct ko_grep_batch {
+    struct ko_grep_batch* next;
+    char* text;
+    size_t used, cap;
+    ko_grep_found* found;
+    size_t n;
+    double since;               // when its first match went in
+} ko_grep_batch;
+
+typedef struct ko_grep_worker {
+    ko_grep* g;
+    pthread_t thread;
+
+    // a ring of tasks: the owner pushes and pops at the back, thieves take from the front
+    pthread_mutex_t lock;
+    ko_grep_task* tasks;
+    size_t head, count, cap;
+
+    ko_regex* regex;            // its own, since a regex's DFA gets built as it's used
+    char* buf;                  // for reading small files into
+    size_t bufcap;
+    ko_grep_batch* batch;
+    size_t pathat;              // where the file being searched's path is in the batch
+} ko_grep_worker;
+
+struct ko_grep {
+    int flags;
+    ko_search* search;          // shared, when it isn't a regex
+    size_t len;                 // how long its matches are
+    ko_grep_worker* workers;
+    size_t nworkers;
+    size_t running, exited;     // threads started and finished
+
+    // workers with nothing to take wait here for more work, or for there to be none
+    pthread_mutex_t idle;
+    pthread_cond_t more;
+    long queued;                // tasks in the deques (atomic; briefly below 0)
+    size_t pending;             // tasks not finished yet (atomic)
+    int stop;                   // (atomic)
+
+    // batches handed over, for the main thread
+    pthread_mutex_t lock;
+    ko_grep_batch* ready;
+    int woken, finished;
+
+    size_t files, bytes, binary, matches;   // (atomic)
+    ko_grep_match* out;
+    size_t outcap;
+};
+
+static void (*ko_grep_wake)(void);
+
+void ko_grep_setwake(void (*wake)(void)) {
+    __atomic_store_n(&ko_grep_wake, wake, __ATOMIC_RELEASE);
+}
+
+static void ko_grep_notify(void) {
+    void (*wake)(void) = __atomic_load_n(&ko_grep_wake, __ATOMIC_ACQUIRE);
+    if (wake)
+        wake();
+}
+
+static double ko_grep_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int ko_grep_stopped(const ko_grep* g) {
+    return __atomic_load_n(&g->stop, __ATOMIC_RELAXED);
+}
+
+// puts n tasks on the back of w's deque, and lets idle workers know
+static void ko_grep_push(ko_grep_worker* w, ko_grep_task* tasks, size_t n) {
+    ko_grep* g = w->g;
+    if (n == 0)
+        return;
+    __atomic_add_fetch(&g->pending, n, __ATOMIC_ACQ_REL);
+
+    pthread_mutex_lock(&w->lock);
+    if (w->count + n > w->cap) {
+        size_t cap = w->cap ? w->cap : 64;
+        while (cap < w->count + n)
+            cap *= 2;
+        ko_grep_task* grown = malloc(cap * sizeof(ko_grep_task));
+        for (size_t i = 0; i < w->count; i++)
+            grown[i] = w->tasks[(w->head + i) & (w->cap - 1)];
+        free(w->tasks);
+        w->tasks = grown;
+        w->cap = cap;
+        w->head = 0;
+    }
+    for (size_t i = 0; i < n; i++)
+        w->tasks[(w->head + w->count++) & (w->cap - 1)] = tasks[i];
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_mutex_lock(&g->idle);
+    __atomic_add_fetch(&g->queued, (long)n, __ATOMIC_ACQ_REL);
+    if (n > 1)
+        pthread_cond_broadcast(&g->more);
+    else
+        pthread_cond_signal(&g->more);
+    pthread_mutex_unlock(&g->idle);
+}
+
+// takes the newest of w's tasks (back) or the oldest (front)
+static int ko_grep_pop(ko_grep_worker* w, int back, ko_grep_task* t) {
+    pthread_mutex_lock(&w->lock);
+    int got = w->count > 0;
+    if (got) {
+        if (back) {
+            *t = w->tasks[(w->head + w->count - 1) & (w->cap - 1)];
+        }
+        else {
+            *t = w->tasks[w->head];
+            w->head = (w->head + 1) & (w->cap - 1);
+        }
+        w->count--;
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    if (got)
+        __atomic_sub_fetch(&w->g->queued, 1, __ATOMIC_ACQ_REL);
+    return got;
+}
+
+// its own newest task, or else the oldest of the next worker along that has any
+static int ko_grep_take(ko_grep_worker* w, ko_grep_task* t) {
+    ko_grep* g = w->g;
+    if (ko_grep_pop(w, 1, t))
+        return 1;
+
+    size_t self = w - g->workers;
+    for (size_t k = 1; k < g->nworkers; k++)
+        if (ko_grep_pop(&g->workers[(self + k) % g->nworkers], 0, t))
+            return 1;
+    return 0;
+}
+
+// hands w's batch to the main thread, waking it if it isn't already coming
+static void ko_grep_flush(ko_grep_worker* w) {
+    ko_grep* g = w->g;
+    ko_grep_batch* batch = w->batch;
+    if (!batch)
+        return;
+    w->batch = NULL;
+
+    pthread_mutex_lock(&g->lock);
+    batch->next = g->ready;
+    g->ready = batch;
+    int wake = !g->woken;
+    g->woken = 1;
+    pthread_mutex_unlock(&g->lock);
+
+    if (wake)
+        ko_grep_notify();
+}
+
+static size_t ko_grep_text(ko_grep_batch* batch, const char* s, size_t len) {
+    if (batch->used + len > batch->cap) {
+        while (batch->used + len > batch->cap)
+            batch->cap = batch->cap ? 2 * batch->cap : 16384;
+        batch->text = realloc(batch->text, batch->cap);
+    }
+    size_t at = batch->used;
+    memcpy(batch->text + at, s, len);
+    batch->used += len;
+    return at;
+}
+
+// adds a match on the line at [ls, le) of path to w's batch
+static void ko_grep_add(ko_grep_worker* w, const char* path, size_t pathlen, const char* p,
+                        size_t ls, size_t le, size_t line, size_t start, size_t end) {
+    ko_grep_batch* batch = w->batch;
+    if (!batch) {
+        batch = w->batch = calloc(1, sizeof(ko_grep_batch));
+        batch->found = malloc(KO_GREP_BATCH * sizeof(ko_grep_found));
+        batch->since = ko_grep_now();
+        w->pathat = (size_t)-1;
+    }
+    if (w->pathat == (size_t)-1)
+        w->pathat = ko_grep_text(batch, path, pathlen);
+
+    // a long line's cut short, and the match with it
+    size_t len = le - ls < KO_GREP_MAXLINE ? le - ls : KO_GREP_MAXLINE;
+    start -= ls;
+    end = (end < le ? end : le) - ls;
+    batch->found[batch->n++] = (ko_grep_found){
+        w->pathat, pathlen, ko_grep_text(batch, p + ls, len), len,
+        line, start < len ? start : len, end < len ? end : len,
+    };
+
+    if (batch->n == KO_GREP_BATCH)
+        ko_grep_flush(w);
+}
+
+static int ko_grep_find(ko_grep_worker* w, const char* p, size_t len, size_t pos, size_t* start, size_t* end) {
+    if (w->regex)
+        return ko_regex_find_string(w->regex, p, len, pos, start, end);
+    if (!ko_search_find_string(w->g->search, p, len, pos, start))
+        return 0;
+    *end = *start + w->g->len;
+    return 1;
+}
+
+// reports the lines of path (p, len bytes) with matches
+static void ko_grep_scan(ko_grep_worker* w, const char* path, const char* p, size_t len) {
+    ko_grep* g = w->g;
+    if (memchr(p, 0, len < KO_GREP_SNIFF ? len : KO_GREP_SNIFF)) {
+        __atomic_add_fetch(&g->binary, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // the lines are only counted up to each match, and each line's reported once
+    size_t pathlen = strlen(path);
+    size_t pos = 0, counted = 0, line = 0, ls = 0;
+    w->pathat = (size_t)-1;
+    size_t start, end;
+    while (pos < len && !ko_grep_stopped(g) && ko_grep_find(w, p, len, pos, &start, &end)) {
+        for (const char* nl; (nl = memchr(p + counted, '\n', start - counted)); ) {
+            line++;
+            counted = ls = nl - p + 1;
+        }
+
+        const char* nl = memchr(p + start, '\n', len - start);
+        size_t le = nl ? (size_t)(nl - p) : len;
+        ko_grep_add(w, path, pathlen, p, ls, le, line, start, end);
+
+        pos = counted = ls = le + 1;
+        line++;
+    }
+
+    __atomic_add_fetch(&g->files, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g->bytes, len, __ATOMIC_RELAXED);
+    if (w->batch && ko_grep_now() - w->batch->since >= KO_GREP_BATCH_AGE)
+        ko_grep_flush(w);
+}
+
+// a big file is mapped; a small one is quicker to read, into the worker's buffer
+static void ko_grep_file(ko_grep_worker* w, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return;
+    }
+    size_t len = st.st_size;
+
+    if (len >= KO_GREP_MAPMIN) {
+        void* map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+            return;
+        madvise(map, len, MADV_SEQUENTIAL);
+        ko_grep_scan(w, path, map, len);
+        munmap(map, len);
+        return;
+    }
+
+    if (len > w->bufcap) {
+        w->bufcap = len;
+        w->buf = realloc(w->buf, w->bufcap);
+    }
+    size_t got = 0;
+    ssize_t n;
+    while (got < len && (n = read(fd, w->buf + got, len - got)) > 0)
+        got += n;
+    close(fd);
+    if (got > 0)
+        ko_grep_scan(w, path, w->buf, got);
+}
+
+// pushes what's in a directory (that isn't skipped) for searching
+static void ko_grep_list(ko_grep_worker* w, const ko_grep_task* t) {
+    DIR* d = opendir(t->path);
+    if (!d)
+        return;
+
+    size_t base = strlen(t->path);
+    ko_ignore* ig = ko_ignore_load(t->path, base, t->ignore);
+
+    ko_grep_task* tasks = NULL;
+    size_t n = 0, cap = 0;
+    struct dirent* e;
+    while ((e = readdir(d)) && !ko_grep_stopped(w->g)) {
+        // hidden ones, . and .. included
+        if (e->d_name[0] == '.')
+            continue;
+
+        size_t namelen = strlen(e->d_name);
+        char* path = malloc(base + namelen + 2);
+        memcpy(path, t->path, base);
+        path[base] = '/';
+        memcpy(path + base + 1, e->d_name, namelen + 1);
+
+        int dir;
+        if (e->d_type == DT_DIR || e->d_type == DT_REG) {
+            dir = e->d_type == DT_DIR;
+        }
+        else {
+            struct stat st;
+            if (e->d_type != DT_UNKNOWN || lstat(path, &st) < 0 || !(S_ISDIR(st.st_mode) || S_ISREG(st.st_mode))) {
+                free(path);
+                continue;
+            }
+            dir = S_ISDIR(st.st_mode);
+        }
+
+        if (ko_ignore_match(ig, path, dir)) {
+            free(path);
+            continue;
+        }
+
+        if (n == cap)
+            tasks = realloc(tasks, (cap = cap ? 2 * cap : 64) * sizeof(ko_grep_task));
+        tasks[n++] = (ko_grep_task){ path, dir ? ko_ignore_retain(ig) : NULL, dir };
+    }
+    closedir(d);
+
+    ko_grep_push(w, tasks, n);
+    free(tasks);
+    ko_ignore_release(ig);
+}
+
+static void* ko_grep_run(void* arg) {
+    ko_grep_worker* w = arg;
+    ko_grep* g = w->g;
+
+    for (;;) {
+        ko_grep_task t;
+        if (ko_grep_take(w, &t)) {
+            // once it's stopped, what's left just gets thrown away
+            if (!ko_grep_stopped(g)) {
+                if (t.dir)
+                    ko_grep_list(w, &t);
+                else
+                    ko_grep_file(w, t.path);
+            }
+            free(t.path);
+            ko_ignore_release(t.ignore);
+
+            if (__atomic_sub_fetch(&g->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+                pthread_mutex_lock(&g->idle);
+                pthread_cond_broadcast(&g->more);
+                pthread_mutex_unlock(&g->idle);
+            }
+            continue;
+        }
+
+        // nothing to take: hand over what it's found, and wait for more
+        ko_grep_flush(w);
+        pthread_mutex_lock(&g->idle);
+        while (__atomic_load_n(&g->queued, __ATOMIC_ACQUIRE) <= 0 &&
+               __atomic_load_n(&g->pending, __ATOMIC_ACQUIRE) > 0)
+            pthread_cond_wait(&g->more, &g->idle);
+        int done = __atomic_load_n(&g->pending, __ATOMIC_ACQUIRE) == 0;
+        pthread_mutex_unlock(&g->idle);
+        if (done)
+            break;
+    }
+
+    // the last one out says it's over
+    ko_grep_flush(w);
+    pthread_mutex_lock(&g->lock);
+    int last = ++g->exited == g->running;
+    if (last) {
+        g->finished = 1;
+        g->woken = 1;
+    }
+    pthread_mutex_unlock(&g->lock);
+    if (last)
+        ko_grep_notify();
+    return NULL;
+}
+
+// ---- the search
+
+ko_grep* ko_grep_start(const char* root, const char* pattern, size_t len, int flags, const char** err) {
+    ko_regex* regex = NULL;
+    if (flags & KO_GREP_REGEX) {
+        regex = ko_regex_new(pattern, len, (flags & KO_GREP_ICASE) ? KO_REGEX_ICASE : 0, err);
+        if (!regex)
+            return NULL;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t n = cpus < 1 ? 1 : cpus > KO_GREP_MAXWORKERS ? KO_GREP_MAXWORKERS : (size_t)cpus;
+
+    ko_grep* g = calloc(1, sizeof(ko_grep));
+    g->flags = flags;
+    g->len = len;
+    if (!regex)
+        g->search = ko_search_new(pattern, len, (flags & KO_GREP_ICASE) ? KO_SEARCH_ICASE : 0);
+    g->workers = calloc(n, sizeof(ko_grep_worker));
+    g->nworkers = n;
+    pthread_mutex_init(&g->idle, NULL);
+    pthread_cond_init(&g->more, NULL);
+    pthread_mutex_init(&g->lock, NULL);
+
+    for (size_t i = 0; i < n; i++) {
+        ko_grep_worker* w = &g->workers[i];
+        w->g = g;
+        pthread_mutex_init(&w->lock, NULL);
+        if (regex)
+            w->regex = i == 0 ? regex : ko_regex_new(pattern, len, (flags & KO_GREP_ICASE) ? KO_REGEX_ICASE : 0, err);
+    }
+
+    // the root's the first worker's first task; a / on the end would double up in paths
+    size_t rootlen = strlen(root);
+    while (rootlen > 1 && root[rootlen - 1] == '/')
+        rootlen--;
+    ko_grep_task t = { strndup(root, rootlen), NULL, 1 };
+    ko_grep_push(&g->workers[0], &t, 1);
+
+    // none of them can finish till they've all been started and counted
+    pthread_mutex_lock(&g->lock);
+    while (g->running < n && pthread_create(&g->workers[g->running].thread, NULL, ko_grep_run, &g->workers[g->running]) == 0)
+        g->running++;
+    pthread_mutex_unlock(&g->lock);
+
+    if (g->running == 0) {
+        ko_grep_free(g);
+        *err = "there's no thread to search on";
+        return NULL;
+    }
+    return g;
+}
+
+void ko_grep_free(ko_grep* g) {
+    if (!g) return;
+    __atomic_store_n(&g->stop, 1, __ATOMIC_RELAXED);
+
+    for (size_t i = 0; i < g->running; i++)
+        pthread_join(g->workers[i].thread, NULL);
+
+    // whatever's left is what nobody was there to take
+    for (size_t i = 0; i < g->nworkers; i++) {
+        ko_grep_worker* w = &g->workers[i];
+        ko_grep_task t;
+        while (ko_grep_pop(w, 1, &t)) {
+            free(t.path);
+            ko_ignore_release(t.ignore);
+        }
+        ko_regex_free(w->regex);
+        pthread_mutex_destroy(&w->lock);
+        free(w->tasks);
+        free(w->buf);
+    }
+
+    while (g->ready) {
+        ko_grep_batch* next = g->ready->next;
+        free(g->ready->text);
+        free(g->ready->found);
+        free(g->ready);
+        g->ready = next;
+    }
+
+    ko_search_free(g->search);
+    pthread_mutex_destroy(&g->idle);
+    pthread_cond_destroy(&g->more);
+    pthread_mutex_destroy(&g->lock);
+    free(g->workers);
+    free(g->out);
+    free(g);
+}
+
+int ko_grep_poll(ko_grep* g, ko_grep_fn fn, void* ctx) {
+    pthread_mutex_lock(&g->lock);
+    ko_grep_batch* batch = g->ready;
+    g->ready = NULL;
+    g->woken = 0;
+    int going = !g->finished;
+    pthread_mutex_unlock(&g->lock);
+
+    while (batch) {
+        if (batch->n > g->outcap) {
+            g->outcap = KO_GREP_BATCH;
+            g->out = realloc(g->out, g->outcap * sizeof(ko_grep_match));
+        }
+        for (size_t i = 0; i < batch->n; i++) {
+            const ko_grep_found* f = &batch->found[i];
+            g->out[i] = (ko_grep_match){
+                batch->text + f->path, batch->text + f->text, f->pathlen, f->len,
+                f->line, f->start, f->end,
+            };
+        }
+        __atomic_add_fetch(&g->matches, batch->n, __ATOMIC_RELAXED);
+        fn(ctx, g->out, batch->n);
+
+        ko_grep_batch* next = batch->next;
+        free(batch->text);
+        free(batch->found);
+        free(batch);
+        batch = next;
+    }
+    return going;
+}
+
+ko_grep_stats ko_grep_getstats(const ko_grep* g) {
+    ko_grep_stats stats;
+    stats.files = __atomic_load_n(&g->files, __ATOMIC_RELAXED);
+    stats.bytes = __atomic_load_n(&g->bytes, __ATOMIC_RELAXED);
+    stats.binary = __atomic_load_n(&g->binary, __ATOMIC_RELAXED);
+    stats.matches = __atomic_load_n(&g->matches, __ATOMIC_RELAXED);
+    stats.workers = g->running;
+    return stats;
+}
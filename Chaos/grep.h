@@ -0,0 +1,70 @@
+#ifndef KO_GREP_H
+#define KO_GREP_H
+
+#include <stddef.h>
+
+// Searching every file under a directory, on a pool of worker threads.
+//
+// Each worker has a deque of things to do (a directory to list or a file to
+// search). It takes the newest of its own, and when it runs out it steals the
+// oldest of someone else's, so however the tree is shaped the work spreads
+// out: listing a directory pushes its entries on the lister's deque, and the
+// idle workers take whole subtrees off the other end.
+//
+// Hidden files and directories, symlinks, and whatever the .gitignore files
+// from the root down say (the usual patterns: globs, a leading or middle /
+// to anchor, a trailing / for directories, ! to take one back, and **/ at the
+// start) are skipped. A big file is mapped; a small one is read, which is
+// quicker than mapping it. One with a zero byte in its first 8K is skipped as
+// binary. Each is searched as a whole, with ko_search's vectorised literal
+// search or a regex's DFA, and a line with matches is reported once, at its
+// first. (So a regex match can run on past the end of its line.)
+//
+// The matches come back in batches: a worker fills one as it goes and hands
+// it over once it's full, once it's been going a while, or when the worker
+// runs out of things to do. Handing one over calls the wake function (on
+// the worker's thread), which should get the main thread to call ko_grep_poll.
+
+#define KO_GREP_REGEX 1
+#define KO_GREP_ICASE 2
+
+// a line longer than this only has its start reported, and a match past
+// that is reported as at the end of it
+#define KO_GREP_MAXLINE 512
+
+typedef struct ko_grep ko_grep;
+
+typedef struct ko_grep_match {
+    const char* path;
+    const char* text;           // the line it's on, without its newline
+    size_t pathlen, len;
+    size_t line;                // 0-based
+    size_t start, end;          // where the match is in text, as byte offsets (no further than len)
+} ko_grep_match;
+
+// starts searching everything under root; returns NULL and points err at a
+// message if the pattern is no good or there's no thread to search on
+ko_grep* ko_grep_start(const char* root, const char* pattern, size_t len, int flags, const char** err);
+
+// stops the search if it's still going, waiting for the workers to notice
+void ko_grep_free(ko_grep* g);
+
+// calls fn with each batch handed over since the last call, in no particular
+// order; they're only good until it returns. returns 1 while it's still going.
+typedef void (*ko_grep_fn)(void* ctx, const ko_grep_match* m, size_t n);
+int ko_grep_poll(ko_grep* g, ko_grep_fn fn, void* ctx);
+
+// what the workers call when there's a batch, or they're done; NULL for nothing
+void ko_grep_setwake(void (*wake)(void));
+
+typedef struct ko_grep_stats {
+    size_t files;               // searched so far
+    size_t bytes;               // in those
+    size_t binary;              // skipped for having a zero byte
+    size_t matches;             // handed over by ko_grep_poll
+    size_t workers;
+} ko_grep_stats;
+
+ko_grep_stats ko_grep_getstats(const ko_grep* g);
+
+#endif
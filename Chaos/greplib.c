@@ -0,0 +1,188 @@
+// The `grep` Lua module: searching every file under a directory on a pool
+// of threads (grep.c), with the matches handed to a Lua function in batches
+// as they're found. Lines and positions are 1-based, like string.find.
+
+#include "lua/lauxlib.h"
+#include "greplib.h"
+#include "grep.h"
+
+#define KO_GREP_META "chaos.grep"
+
+// searches still going -> their found functions
+static char ko_searches_key;
+
+// args: [dir, query, found, regex = false, icase = false]
+// returns: [search] or [nil, err]
+// found(matches, done) gets called on the main thread with each lot of
+// matches found, as {path, line, from, to, text} tables (the match is
+// text:sub(from, to)), and once more with done true when it's over
+static int grep_start(lua_State *L) {
+    const char* dir = luaL_checkstring(L, 1);
+    size_t len;
+    const char* query = luaL_checklstring(L, 2, &len);
+    luaL_checktype(L, 3, LUA_TFUNCTION);
+    int flags = (lua_toboolean(L, 4) ? KO_GREP_REGEX : 0) | (lua_toboolean(L, 5) ? KO_GREP_ICASE : 0);
+    
+    const char* err;
+    ko_grep* g = ko_grep_start(dir, query, len, flags, &err);
+    if (!g) {
+        lua_pushnil(L);
+        lua_pushstring(L, err);
+        return 2;
+    }
+    
+    ko_grep** ud = lua_newuserdata(L, sizeof(ko_grep*));  // [dir, query, found, regex, icase, search]
+    *ud = g;
+    luaL_setmetatable(L, KO_GREP_META);
+    
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &ko_searches_key);  // [..., search, searches]
+    lua_pushvalue(L, -2);                                 // [..., search, searches, search]
+    lua_pushvalue(L, 3);                                  // [..., search, searches, search, found]
+    lua_rawset(L, -3);                                    // [..., search, searches]
+    lua_pop(L, 1);                                        // [..., search]
+    return 1;
+}
+
+static void ko_grep_pushmatches(void* ctx, const ko_grep_match* m, size_t n) {
+    lua_State* L = ctx;
+    int k = (int)lua_rawlen(L, -1);
+    
+    for (size_t i = 0; i < n; i++) {
+        lua_createtable(L, 0, 5);                         // [matches, match]
+        lua_pushlstring(L, m[i].path, m[i].pathlen);
+        lua_setfield(L, -2, "path");
+        lua_pushinteger(L, m[i].line + 1);
+        lua_setfield(L, -2, "line");
+        lua_pushinteger(L, m[i].start + 1);
+        lua_setfield(L, -2, "from");
+        lua_pushinteger(L, m[i].end);
+        lua_setfield(L, -2, "to");
+        lua_pushlstring(L, m[i].text, m[i].len);
+        lua_setfield(L, -2, "text");
+        lua_rawseti(L, -2, ++k);                          // [matches]
+    }
+}
+
+void ko_greplib_poll(lua_State* L) {
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &ko_searches_key);  // [searches]
+    
+    // found functions can start or stop searches, so go through a list of them instead
+    lua_newtable(L);                                      // [searches, list]
+    int n = 0;
+    lua_pushnil(L);                                       // [searches, list, nil]
+    while (lua_next(L, -3)) {                             // [searches, list, search, found]
+        lua_pop(L, 1);                                    // [searches, list, search]
+        lua_pushvalue(L, -1);                             // [searches, list, search, search]
+        lua_rawseti(L, -3, ++n);                          // [searches, list, search]
+    }
+    
+    for (int i = 1; i <= n; i++) {
+        lua_rawgeti(L, -1, i);                            // [searches, list, search]
+        lua_pushvalue(L, -1);                             // [searches, list, search, search]
+        lua_rawget(L, -4);                                // [searches, list, search, found]
+        
+        // stopped by an earlier found function
+        ko_grep* g = *(ko_grep**)lua_touserdata(L, -2);
+        if (!g || lua_isnil(L, -1)) {
+            lua_pop(L, 2);                                // [searches, list]
+            continue;
+        }
+        
+        lua_newtable(L);                                  // [searches, list, search, found, matches]
+        int going = ko_grep_poll(g, ko_grep_pushmatches, L);
+        if (!going) {
+            lua_pushvalue(L, -3);                         // [searches, list, search, found, matches, search]
+            lua_pushnil(L);                               // [searches, list, search, found, matches, search, nil]
+            lua_rawset(L, -7);                            // [searches, list, search, found, matches]
+        }
+        if (going && lua_rawlen(L, -1) == 0) {
+            lua_pop(L, 3);                                // [searches, list]
+            continue;
+        }
+        
+        lua_pushboolean(L, !going);                       // [searches, list, search, found, matches, done]
+        if (lua_pcall(L, 2, 0, 0))                        // [searches, list, search]
+            lua_pop(L, 1);
+        lua_pop(L, 1);                                    // [searches, list]
+    }
+    
+    lua_pop(L, 2);                                        // []
+}
+
+static ko_grep** ko_togrep(lua_State* L) {
+    return luaL_checkudata(L, 1, KO_GREP_META);
+}
+
+// args: [search]
+// stops it; found won't be called again
+static int grep_stop(lua_State *L) {
+    ko_grep** ud = ko_togrep(L);
+    ko_grep_free(*ud);
+    *ud = NULL;
+    
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &ko_searches_key);  // [search, searches]
+    lua_pushvalue(L, 1);                                  // [search, searches, search]
+    lua_pushnil(L);                                       // [search, searches, search, nil]
+    lua_rawset(L, -3);                                    // [search, searches]
+    return 0;
+}
+
+// args: [search]
+// returns: [{files, bytes, binary, matches, workers}]
+// files and bytes searched so far, files skipped as binary, and matches handed to found
+static int grep_stats(lua_State *L) {
+    ko_grep* g = *ko_togrep(L);
+    if (!g)
+        return luaL_error(L, "search is stopped");
+    ko_grep_stats stats = ko_grep_getstats(g);
+    
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, stats.files);
+    lua_setfield(L, -2, "files");
+    lua_pushinteger(L, stats.bytes);
+    lua_setfield(L, -2, "bytes");
+    lua_pushinteger(L, stats.binary);
+    lua_setfield(L, -2, "binary");
+    lua_pushinteger(L, stats.matches);
+    lua_setfield(L, -2, "matches");
+    lua_pushinteger(L, stats.workers);
+    lua_setfield(L, -2, "workers");
+    return 1;
+}
+
+static int grep_gc(lua_State *L) {
+    ko_grep** ud = ko_togrep(L);
+    ko_grep_free(*ud);
+    *ud = NULL;
+    return 0;
+}
+
+static const luaL_Reg greplib_instance[] = {
+    {"stop", grep_stop},
+    {"stats", grep_stats},
+    {NULL, NULL}
+};
+
+static const luaL_Reg greplib_meta[] = {
+    {"__gc", grep_gc},
+    {NULL, NULL}
+};
+
+static const luaL_Reg greplib[] = {
+    {"start", grep_start},
+    {NULL, NULL}
+};
+
+int luaopen_grep(lua_State* L) {
+    luaL_newmetatable(L, KO_GREP_META);               // [meta]
+    luaL_setfuncs(L, greplib_meta, 0);                // [meta]
+    luaL_newlib(L, greplib_instance);                 // [meta, methods]
+    lua_setfield(L, -2, "__index");                   // [meta]
+    lua_pop(L, 1);                                    // []
+    
+    lua_newtable(L);                                  // [searches]
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &ko_searches_key); // []
+    
+    luaL_newlib(L, greplib);
+    return 1;
+}
@@ -0,0 +1,12 @@
+#ifndef KO_GREPLIB_H
+#define KO_GREPLIB_H
+
+#include "lua/lua.h"
+
+// The `grep` Lua module (greplib.c), for the hosts.
+
+// hands the matches searches have found since the last call to their found
+// functions. the host calls it on the main thread when ko_grep_setwake's function wakes it.
+void ko_greplib_poll(lua_State* L);
+
+#endif
@@ -0,0 +1,527 @@
+#include "grid.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define KO_GRID_DEFAULT_FG KO_COLOR_BLACK
+#define KO_GRID_DEFAULT_BG KO_COLOR_WHITE
+
+// clean gaps up to this long get folded into the surrounding span, since
+// one slightly wider repaint is cheaper than two separate ones
+#define KO_GRID_SPAN_GAP 4
+
+static struct {
+    uint32_t* rgb;        // handle -> rgb
+    ko_color count;
+    ko_color cap;
+    uint32_t* slots;      // open-addressed rgb -> handle + 1 (0 is empty)
+    uint32_t nslots;
+} palette;
+
+static uint32_t ko_palette_hash(uint32_t rgb) {
+    rgb ^= rgb >> 16;
+    rgb *= 0x7feb352d;
+    rgb ^= rgb >> 15;
+    return rgb;
+}
+
+static void ko_palette_rehash(uint32_t nslots) {
+    free(palette.slots);
+    palette.slots = calloc(nslots, sizeof(uint32_t));
+    palette.nslots = nslots;
+
+    for (ko_color c = 0; c < palette.count; c++) {
+        uint32_t i = ko_palette_hash(palette.rgb[c]) & (nslots - 1);
+        while (palette.slots[i])
+            i = (i + 1) & (nslots - 1);
+        palette.slots[i] = c + 1;
+    }
+}
+
+ko_color ko_color_intern(uint32_t rgb) {
+    rgb &= 0xFFFFFF;
+
+    if (!palette.rgb) {
+        palette.cap = 64;
+        palette.rgb = malloc(palette.cap * sizeof(uint32_t));
+        palette.rgb[KO_COLOR_BLACK] = 0x000000;
+        palette.rgb[KO_COLOR_WHITE] = 0xFFFFFF;
+        palette.count = 2;
+        ko_palette_rehash(128);
+    }
+
+    uint32_t mask = palette.nslots - 1;
+    uint32_t i = ko_palette_hash(rgb) & mask;
+    for (; palette.slots[i]; i = (i + 1) & mask) {
+        if (palette.rgb[palette.slots[i] - 1] == rgb)
+            return palette.slots[i] - 1;
+    }
+
+    if (palette.count == palette.cap) {
+        palette.cap *= 2;
+        palette.rgb = realloc(palette.rgb, palette.cap * sizeof(uint32_t));
+    }
+
+    ko_color c = palette.count++;
+    palette.rgb[c] = rgb;
+    palette.slots[i] = c + 1;
+
+    if (palette.count * 2 > palette.nslots)
+        ko_palette_rehash(palette.nslots * 2);
+
+    return c;
+}
+
+ko_color ko_color_parse(const char* hex, size_t len) {
+    uint32_t rgb = 0;
+
+    for (size_t i = 0; i < len && i < 6; i++) {
+        char c = hex[i];
+        uint32_t d = 0;
+        if (c >= '0' && c <= '9')      d = c - '0';
+        else if (c >= 'a' && c <= 'f') d = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') d = c - 'A' + 10;
+        rgb = (rgb << 4) | d;
+    }
+
+    return ko_color_intern(rgb);
+}
+
+uint32_t ko_color_rgb(ko_color c) {
+    if (!palette.rgb)
+        ko_color_intern(0);
+    return c < palette.count ? palette.rgb[c] : 0;
+}
+
+ko_color ko_color_count(void) {
+    if (!palette.rgb)
+        ko_color_intern(0);
+    return palette.count;
+}
+
+static ko_cell* ko_cells_alloc(size_t n) {
+    void* p = NULL;
+    if (posix_memalign(&p, 64, (n ? n : 1) * sizeof(ko_cell)) != 0)
+        abort();
+    return p;
+}
+
+static void ko_cells_blank(ko_cell* c, size_t n, ko_color fg, ko_color bg) {
+    for (size_t i = 0; i < n; i++) {
+        c[i].ch = ' ';
+        c[i].fg = fg;
+        c[i].bg = bg;
+        c[i].flags = 0;
+    }
+}
+
+// what the front buffer holds where a scroll exposed cells the renderer hasn't drawn yet.
+// it never equals a real cell, so the diff always repaints it.
+static const ko_cell ko_unknown_cell = { ' ', (ko_color)-1, (ko_color)-1, (uint32_t)-1 };
+
+static inline int ko_cell_eq(const ko_cell* a, const ko_cell* b) {
+    return a->ch == b->ch && a->fg == b->fg && a->bg == b->bg && a->flags == b->flags;
+}
+
+static inline void ko_grid_touch(ko_grid* g, int y, int h) {
+    memset(g->touched + y, 1, h);
+}
+
+ko_grid* ko_grid_new(int cols, int rows) {
+    ko_grid* g = calloc(1, sizeof(ko_grid));
+    if (cols < 0) cols = 0;
+    if (rows < 0) rows = 0;
+
+    g->cols = cols;
+    g->rows = rows;
+    g->cells = ko_cells_alloc((size_t)cols * rows);
+    g->front = ko_cells_alloc((size_t)cols * rows);
+    g->touched = calloc(rows ? rows : 1, 1);
+    ko_cells_blank(g->cells, (size_t)cols * rows, KO_GRID_DEFAULT_FG, KO_GRID_DEFAULT_BG);
+    ko_grid_damage_all(g);
+    return g;
+}
+
+void ko_grid_free(ko_grid* g) {
+    if (!g) return;
+    free(g->cells);
+    free(g->front);
+    free(g->touched);
+    free(g);
+}
+
+void ko_grid_resize(ko_grid* g, int cols, int rows) {
+    if (cols < 0) cols = 0;
+    if (rows < 0) rows = 0;
+    if (cols == g->cols && rows == g->rows)
+        return;
+
+    ko_cell* cells = ko_cells_alloc((size_t)cols * rows);
+    ko_cells_blank(cells, (size_t)cols * rows, KO_GRID_DEFAULT_FG, KO_GRID_DEFAULT_BG);
+
+    int keepcols = cols < g->cols ? cols : g->cols;
+    int keeprows = rows < g->rows ? rows : g->rows;
+    for (int y = 0; y < keeprows; y++)
+        memcpy(cells + (size_t)y * cols, ko_grid_row(g, y), keepcols * sizeof(ko_cell));
+
+    free(g->cells);
+    free(g->front);
+    free(g->touched);
+    g->cells = cells;
+    g->front = ko_cells_alloc((size_t)cols * rows);
+    g->touched = calloc(rows ? rows : 1, 1);
+    g->cols = cols;
+    g->rows = rows;
+    g->nmoves = 0;
+    ko_grid_damage_all(g);
+}
+
+void ko_grid_set(ko_grid* g, int x, int y, uint32_t ch, ko_color fg, ko_color bg) {
+    if (x < 0 || y < 0 || x >= g->cols || y >= g->rows)
+        return;
+
+    ko_cell* c = ko_grid_row(g, y) + x;
+    c->ch = ch;
+    c->fg = fg;
+    c->bg = bg;
+    g->touched[y] = 1;
+}
+
+uint32_t ko_utf8_next(const char* str, size_t len, size_t* i) {
+    const unsigned char* s = (const unsigned char*)str;
+    size_t p = *i;
+    unsigned char c = s[p++];
+    uint32_t cp;
+    int extra;
+
+    if (c < 0x80)                { *i = p; return c; }
+    else if ((c & 0xE0) == 0xC0) { cp = c & 0x1F; extra = 1; }
+    else if ((c & 0xF0) == 0xE0) { cp = c & 0x0F; extra = 2; }
+    else if ((c & 0xF8) == 0xF0) { cp = c & 0x07; extra = 3; }
+    else                         { *i = p; return 0xFFFD; }
+
+    int k = 0;
+    for (; k < extra && p < len && (s[p] & 0xC0) == 0x80; k++)
+        cp = (cp << 6) | (s[p++] & 0x3F);
+
+    *i = p;
+    if (k < extra || cp > 0x10FFFF)
+        return 0xFFFD;
+    return cp;
+}
+
+int ko_grid_blit(ko_grid* g, int x, int y, const char* str, size_t len, size_t* i, ko_color fg, ko_color bg) {
+    return ko_grid_blitn(g, x, y, g->cols, str, len, i, fg, bg);
+}
+
+int ko_grid_blitn(ko_grid* g, int x, int y, int right, const char* str, size_t len, size_t* i, ko_color fg, ko_color bg) {
+    int n = 0;
+
+    if (right > g->cols)
+        right = g->cols;
+
+    // skip what hangs off the left edge without writing it
+    for (; x < 0 && *i < len; x++)
+        ko_utf8_next(str, len, i);
+
+    // rows scrolled off the grid still take their share of the string
+    if (y < 0 || y >= g->rows) {
+        for (; x < right && *i < len; x++, n++)
+            ko_utf8_next(str, len, i);
+        return n;
+    }
+
+    ko_cell* row = ko_grid_row(g, y);
+    g->touched[y] = 1;
+
+    for (; x < right && *i < len; x++, n++) {
+        unsigned char b = str[*i];
+        ko_cell* c = row + x;
+        if (b < 0x80) {
+            c->ch = b;
+            (*i)++;
+        }
+        else {
+            c->ch = ko_utf8_next(str, len, i);
+        }
+        c->fg = fg;
+        c->bg = bg;
+    }
+
+    return n;
+}
+
+void ko_grid_fill(ko_grid* g, int x, int y, int w, int h, uint32_t ch, ko_color fg, ko_color bg) {
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > g->cols) w = g->cols - x;
+    if (y + h > g->rows) h = g->rows - y;
+    if (w <= 0 || h <= 0)
+        return;
+
+    ko_grid_touch(g, y, h);
+    for (int r = y; r < y + h; r++) {
+        ko_cell* c = ko_grid_row(g, r) + x;
+        for (int k = 0; k < w; k++) {
+            c[k].ch = ch;
+            c[k].fg = fg;
+            c[k].bg = bg;
+        }
+    }
+}
+
+void ko_grid_paint(ko_grid* g, int x, int y, int w, ko_color fg, ko_color bg) {
+    if (y < 0 || y >= g->rows)
+        return;
+    if (x < 0) { w += x; x = 0; }
+    if (x + w > g->cols) w = g->cols - x;
+    if (w <= 0)
+        return;
+
+    g->touched[y] = 1;
+    ko_cell* c = ko_grid_row(g, y) + x;
+    for (int k = 0; k < w; k++) {
+        c[k].fg = fg;
+        c[k].bg = bg;
+    }
+}
+
+void ko_grid_clear(ko_grid* g, ko_color bg) {
+    ko_cells_blank(g->cells, (size_t)g->cols * g->rows, bg, bg);
+    ko_grid_touch(g, 0, g->rows);
+}
+
+// shifts the cells of m inside a cols-wide buffer, leaving the exposed ones as they were
+static void ko_cells_move(ko_cell* cells, int cols, const ko_grid_move* m) {
+    int w = m->w - abs(m->dx);
+    int h = m->h - abs(m->dy);
+    int dstx = m->x + (m->dx < 0 ? -m->dx : 0);
+    int srcx = dstx + m->dx;
+
+    for (int k = 0; k < h; k++) {
+        int y = m->dy >= 0 ? m->y + k : m->y + m->h - 1 - k;
+        memmove(cells + (size_t)y * cols + dstx, cells + (size_t)(y + m->dy) * cols + srcx, w * sizeof(ko_cell));
+    }
+}
+
+// sets the cells of m that nothing was moved into
+static void ko_cells_expose(ko_cell* cells, int cols, const ko_grid_move* m, const ko_cell* with) {
+    int ey0 = m->dy > 0 ? m->y + m->h - m->dy : m->y;
+    int ey1 = m->dy > 0 ? m->y + m->h : m->y - m->dy;
+    int ex0 = m->dx > 0 ? m->x + m->w - m->dx : m->x;
+    int ex1 = m->dx > 0 ? m->x + m->w : m->x - m->dx;
+
+    for (int y = m->y; y < m->y + m->h; y++) {
+        ko_cell* row = cells + (size_t)y * cols;
+        int x0 = ex0, x1 = ex1;
+        if (y >= ey0 && y < ey1) {
+            x0 = m->x;
+            x1 = m->x + m->w;
+        }
+        for (int x = x0; x < x1; x++)
+            row[x] = *with;
+    }
+}
+
+void ko_grid_scroll(ko_grid* g, int x, int y, int w, int h, int dx, int dy, ko_color bg) {
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > g->cols) w = g->cols - x;
+    if (y + h > g->rows) h = g->rows - y;
+    if (w <= 0 || h <= 0 || (dx == 0 && dy == 0))
+        return;
+
+    if (abs(dx) >= w || abs(dy) >= h) {
+        ko_grid_fill(g, x, y, w, h, ' ', bg, bg);
+        return;
+    }
+
+    ko_grid_move m = { x, y, w, h, dx, dy };
+    ko_cell blank = { ' ', bg, bg, 0 };
+    ko_cells_move(g->cells, g->cols, &m);
+    ko_cells_expose(g->cells, g->cols, &m, &blank);
+
+    // rows written since the last commit stay marked wherever they end up
+    if (dx != 0) {
+        ko_grid_touch(g, y, h);
+    }
+    else {
+        for (int k = 0; k < h - abs(dy); k++) {
+            int r = dy > 0 ? y + k : y + h - 1 - k;
+            g->touched[r] |= g->touched[r + dy];
+        }
+        ko_grid_touch(g, dy > 0 ? y + h - dy : y, abs(dy));
+    }
+
+    if (g->full)
+        return;
+
+    // scrolling the same region the same way again just adds up
+    if (g->nmoves > 0) {
+        ko_grid_move* last = &g->moves[g->nmoves - 1];
+        if (last->x == x && last->y == y && last->w == w && last->h == h &&
+            ((dx == 0 && last->dx == 0 && (dy > 0) == (last->dy > 0) && abs(dy + last->dy) < h) ||
+             (dy == 0 && last->dy == 0 && (dx > 0) == (last->dx > 0) && abs(dx + last->dx) < w))) {
+            last->dx += dx;
+            last->dy += dy;
+            return;
+        }
+    }
+
+    if (g->nmoves == KO_GRID_MAX_MOVES) {
+        // front can't follow anymore; forget the moves and diff every row
+        g->nmoves = 0;
+        ko_grid_touch(g, 0, g->rows);
+        return;
+    }
+
+    g->moves[g->nmoves++] = m;
+}
+
+int ko_grid_commit_scrolls(ko_grid* g, ko_grid_scroll_fn fn, void* ctx) {
+    int accepted = 0;
+
+    for (int i = 0; i < g->nmoves && !g->full; i++) {
+        const ko_grid_move* m = &g->moves[i];
+
+        if (fn && fn(ctx, m)) {
+            ko_cells_move(g->front, g->cols, m);
+            ko_cells_expose(g->front, g->cols, m, &ko_unknown_cell);
+            accepted++;
+        }
+        else {
+            // what's on screen didn't move, so the moved rows no longer match front
+            ko_grid_touch(g, 0, g->rows);
+        }
+    }
+
+    g->nmoves = 0;
+    g->stats.scrolls = accepted;
+    return accepted;
+}
+
+void ko_grid_damage_all(ko_grid* g) {
+    g->full = 1;
+}
+
+unsigned long ko_grid_commit(ko_grid* g, ko_grid_span_fn fn, void* ctx) {
+    unsigned long dirty = 0;
+    unsigned long spans = 0;
+    int cols = g->cols;
+
+    if (g->nmoves)
+        ko_grid_commit_scrolls(g, NULL, NULL);
+
+    for (int y = 0; y < g->rows; y++) {
+        if (!g->full && !g->touched[y])
+            continue;
+
+        g->touched[y] = 0;
+
+        ko_cell* back = ko_grid_row(g, y);
+        ko_cell* front = g->front + (size_t)y * cols;
+
+        if (g->full) {
+            memcpy(front, back, cols * sizeof(ko_cell));
+            dirty += cols;
+            spans++;
+            if (fn && cols) fn(ctx, y, 0, cols);
+            continue;
+        }
+
+        if (memcmp(front, back, cols * sizeof(ko_cell)) == 0)
+            continue;
+
+        int x = 0;
+        while (x < cols) {
+            if (ko_cell_eq(front + x, back + x)) {
+                x++;
+                continue;
+            }
+
+            int start = x;
+            int end = x + 1;
+            dirty++;
+
+            for (x = end; x < cols && x - end < KO_GRID_SPAN_GAP; x++) {
+                if (!ko_cell_eq(front + x, back + x)) {
+                    end = x + 1;
+                    dirty++;
+                }
+            }
+
+            memcpy(front + start, back + start, (end - start) * sizeof(ko_cell));
+            spans++;
+            if (fn) fn(ctx, y, start, end - start);
+            x = end;
+        }
+    }
+
+    g->full = 0;
+    g->stats.frames++;
+    g->stats.dirty = dirty;
+    g->stats.spans = spans;
+    return dirty;
+}
+
+typedef struct ko_run {
+    int x;
+    int w;
+    int y;          // first row of the rect this run is growing
+    ko_color color;
+} ko_run;
+
+int ko_grid_bgrects(const ko_grid* g, int y0, int y1, ko_color skip, ko_grid_rect_fn fn, void* ctx) {
+    if (y0 < 0) y0 = 0;
+    if (y1 > g->rows) y1 = g->rows;
+    if (y0 >= y1 || g->cols == 0)
+        return 0;
+
+    // runs still open from the previous row, and the ones being built for this row
+    ko_run* open = malloc(g->cols * sizeof(ko_run));
+    ko_run* next = malloc(g->cols * sizeof(ko_run));
+    int nopen = 0;
+    int fills = 0;
+
+    for (int y = y0; y <= y1; y++) {
+        int nnext = 0;
+
+        if (y < y1) {
+            const ko_cell* row = ko_grid_front_row(g, y);
+            for (int x = 0; x < g->cols; ) {
+                ko_color c = row[x].bg;
+                int start = x;
+                while (x < g->cols && row[x].bg == c)
+                    x++;
+                if (c != skip)
+                    next[nnext++] = (ko_run){ start, x - start, y, c };
+            }
+        }
+
+        // both lists are sorted by x, so one merge pass pairs up identical runs.
+        // a run that matches one above just keeps growing; anything left unmatched is done.
+        int i = 0, j = 0;
+        while (i < nopen) {
+            while (j < nnext && next[j].x < open[i].x)
+                j++;
+
+            if (j < nnext && next[j].x == open[i].x && next[j].w == open[i].w && next[j].color == open[i].color) {
+                next[j].y = open[i].y;
+            }
+            else {
+                fn(ctx, open[i].x, open[i].y, open[i].w, y - open[i].y, open[i].color);
+                fills++;
+            }
+            i++;
+        }
+
+        ko_run* tmp = open;
+        open = next;
+        next = tmp;
+        nopen = nnext;
+    }
+
+    free(open);
+    free(next);
+    return fills;
+}
@@ -0,0 +1,142 @@
+#ifndef KO_GRID_H
+#define KO_GRID_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The screen is a flat row-major array of fixed-size cells. Everything that
+// draws (Lua or native) writes into a grid; renderers only ever read from it.
+// Nothing in here knows about Cocoa, so it builds anywhere with a C compiler.
+//
+// There are two buffers: writes land in `cells` (the back buffer), and
+// `front` holds what the renderer last showed. ko_grid_commit diffs them and
+// reports only the spans that really changed, so repainting the same
+// content every frame costs the renderer nothing.
+//
+// Scrolling moves cells around inside the back buffer. The move is also
+// remembered, so a renderer that can shift what's already on screen (a bitmap
+// copy, a terminal scroll region) gets told about it before the diff, and the
+// diff then only finds the newly exposed cells.
+
+// Colors are handles into one process-wide palette. Parsing and interning
+// happen once, when a color is first seen; cells and renderers only ever
+// deal in small integers.
+typedef uint32_t ko_color;
+
+#define KO_COLOR_BLACK 0
+#define KO_COLOR_WHITE 1
+
+ko_color ko_color_intern(uint32_t rgb);                 // 0xRRGGBB -> handle
+ko_color ko_color_parse(const char* hex, size_t len);   // "839496" -> handle
+uint32_t ko_color_rgb(ko_color c);                      // handle -> 0xRRGGBB
+ko_color ko_color_count(void);
+
+typedef struct ko_cell {
+    uint32_t ch;      // unicode codepoint
+    ko_color fg;
+    ko_color bg;
+    uint32_t flags;   // reserved for attributes (bold, underline...)
+} ko_cell;            // 16 bytes, so four cells share a cache line
+
+typedef struct ko_grid_stats {
+    unsigned long frames;       // commits so far
+    unsigned long dirty;        // cells that changed in the last commit
+    unsigned long spans;        // spans handed to the renderer in the last commit
+    unsigned long scrolls;      // scrolls the renderer did itself in the last commit
+} ko_grid_stats;
+
+// a pending move of the cells in [x, x + w) x [y, y + h) by (-dx, -dy)
+typedef struct ko_grid_move {
+    int x, y, w, h;
+    int dx, dy;
+} ko_grid_move;
+
+// more scrolls than this between two commits and we just diff everything
+#define KO_GRID_MAX_MOVES 8
+
+typedef struct ko_grid {
+    int cols;
+    int rows;
+    ko_cell* cells;             // back buffer, where writes go
+    ko_cell* front;             // what's on screen
+    unsigned char* touched;     // per row: written since the last commit?
+    int full;                   // front is stale (e.g. after a resize)
+    ko_grid_move moves[KO_GRID_MAX_MOVES];  // scrolls since the last commit, oldest first
+    int nmoves;
+    ko_grid_stats stats;
+} ko_grid;
+
+// called for each changed span [x, x + n) on row y
+typedef void (*ko_grid_span_fn)(void* ctx, int y, int x, int n);
+
+ko_grid* ko_grid_new(int cols, int rows);
+void ko_grid_free(ko_grid* g);
+
+// keeps whatever overlaps the old size, anchored at the top-left
+void ko_grid_resize(ko_grid* g, int cols, int rows);
+
+static inline ko_cell* ko_grid_row(ko_grid* g, int y) {
+    return g->cells + (size_t)y * g->cols;
+}
+
+// renderers read from here
+static inline const ko_cell* ko_grid_front_row(const ko_grid* g, int y) {
+    return g->front + (size_t)y * g->cols;
+}
+
+// all coordinates are 0-based; anything outside the grid is clipped
+
+void ko_grid_set(ko_grid* g, int x, int y, uint32_t ch, ko_color fg, ko_color bg);
+
+// draws UTF-8 text from str[*i] on row y until the right edge or the end of the string.
+// advances *i past the bytes it used and returns the number of cells written.
+// rows outside the grid aren't drawn, but *i still advances as if they were,
+// so wrapped text can skip rows that are scrolled out of view.
+int ko_grid_blit(ko_grid* g, int x, int y, const char* str, size_t len, size_t* i, ko_color fg, ko_color bg);
+
+// same, but stops at column `right` instead of the grid's edge
+int ko_grid_blitn(ko_grid* g, int x, int y, int right, const char* str, size_t len, size_t* i, ko_color fg, ko_color bg);
+
+void ko_grid_fill(ko_grid* g, int x, int y, int w, int h, uint32_t ch, ko_color fg, ko_color bg);
+
+// recolors cells without touching their characters
+void ko_grid_paint(ko_grid* g, int x, int y, int w, ko_color fg, ko_color bg);
+
+void ko_grid_clear(ko_grid* g, ko_color bg);
+
+// scrolls the cells in [x, x + w) x [y, y + h) by dy rows and dx columns:
+// positive dy moves them up and positive dx moves them left, the way content
+// moves when you scroll down or right. cells that scroll out of the rect are
+// dropped, and the exposed ones are blanked with bg.
+void ko_grid_scroll(ko_grid* g, int x, int y, int w, int h, int dx, int dy, ko_color bg);
+
+// called for each pending scroll, oldest first. returns nonzero if the renderer
+// moved what's on screen the same way; otherwise the cells just get diffed.
+typedef int (*ko_grid_scroll_fn)(void* ctx, const ko_grid_move* move);
+
+// replays pending scrolls on the front buffer and hands them to fn.
+// renderers that can scroll call this right before ko_grid_commit; if they
+// don't, the commit falls back to repainting whatever moved.
+// returns the number of scrolls fn accepted.
+int ko_grid_commit_scrolls(ko_grid* g, ko_grid_scroll_fn fn, void* ctx);
+
+// copies changed cells to the front buffer, calling fn for each changed span.
+// returns the number of cells that changed.
+unsigned long ko_grid_commit(ko_grid* g, ko_grid_span_fn fn, void* ctx);
+
+// forces the next commit to report everything
+void ko_grid_damage_all(ko_grid* g);
+
+// called for each background rectangle of cells [x, x + w) x [y, y + h)
+typedef void (*ko_grid_rect_fn)(void* ctx, int x, int y, int w, int h, ko_color color);
+
+// walks the front buffer's rows [y0, y1) and merges same-colored backgrounds into
+// per-row runs, then stacks identical runs on consecutive rows into taller rects.
+// cells in `skip` (whatever the window already paints) are left out.
+// returns the number of rects handed to fn.
+int ko_grid_bgrects(const ko_grid* g, int y0, int y1, ko_color skip, ko_grid_rect_fn fn, void* ctx);
+
+// returns the codepoint at str[*i] and advances *i; malformed input becomes U+FFFD
+uint32_t ko_utf8_next(const char* str, size_t len, size_t* i);
+
+#endif
@@ -0,0 +1,425 @@
+#include "highlight.h"
+#include "regex.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// ---- grammars
+
+typedef struct ko_hlword {
+    char* word;
+    size_t len;
+    int style;
+} ko_hlword;
+
+typedef struct ko_hlrule {
+    ko_regex* re;
+    int style;
+    int next;
+
+    // keywords, in a hash table of indexes + 1 into words
+    ko_hlword* words;
+    size_t nwords, wordcap;
+    uint32_t* slots;
+    size_t nslots;
+} ko_hlrule;
+
+typedef struct ko_hlstate {
+    int style;
+    ko_hlrule* rules;
+    int nrules, cap;
+} ko_hlstate;
+
+struct ko_grammar {
+    ko_hlstate* states;
+    int n, cap;
+    int maxrules;               // in any one state
+};
+
+ko_grammar* ko_grammar_new(void) {
+    return calloc(1, sizeof(ko_grammar));
+}
+
+void ko_grammar_free(ko_grammar* g) {
+    if (!g) return;
+    for (int i = 0; i < g->n; i++) {
+        ko_hlstate* st = &g->states[i];
+        for (int k = 0; k < st->nrules; k++) {
+            ko_hlrule* r = &st->rules[k];
+            ko_regex_free(r->re);
+            for (size_t w = 0; w < r->nwords; w++)
+                free(r->words[w].word);
+            free(r->words);
+            free(r->slots);
+        }
+        free(st->rules);
+    }
+    free(g->states);
+    free(g);
+}
+
+int ko_grammar_state(ko_grammar* g, int style) {
+    if (g->n == g->cap) {
+        g->cap = g->cap ? g->cap * 2 : 8;
+        g->states = realloc(g->states, g->cap * sizeof(ko_hlstate));
+    }
+    g->states[g->n] = (ko_hlstate){ style, NULL, 0, 0 };
+    return g->n++;
+}
+
+int ko_grammar_rule(ko_grammar* g, int state, const char* pattern, size_t len, int flags, int style, int next, const char** err) {
+    ko_regex* re = ko_regex_new(pattern, len, flags, err);
+    if (!re)
+        return -1;
+
+    ko_hlstate* st = &g->states[state];
+    if (st->nrules == st->cap) {
+        st->cap = st->cap ? st->cap * 2 : 8;
+        st->rules = realloc(st->rules, st->cap * sizeof(ko_hlrule));
+    }
+    st->rules[st->nrules++] = (ko_hlrule){ .re = re, .style = style, .next = next };
+    if (st->nrules > g->maxrules)
+        g->maxrules = st->nrules;
+    return 0;
+}
+
+static uint32_t ko_hlword_hash(const char* s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+static void ko_hlrule_slot(ko_hlrule* r, size_t w) {
+    size_t mask = r->nslots - 1;
+    size_t i = ko_hlword_hash(r->words[w].word, r->words[w].len) & mask;
+    while (r->slots[i])
+        i = (i + 1) & mask;
+    r->slots[i] = (uint32_t)w + 1;
+}
+
+void ko_grammar_keyword(ko_grammar* g, int state, const char* word, size_t len, int style) {
+    ko_hlstate* st = &g->states[state];
+    if (st->nrules == 0)
+        return;
+    ko_hlrule* r = &st->rules[st->nrules - 1];
+
+    if (r->nwords == r->wordcap) {
+        r->wordcap = r->wordcap ? r->wordcap * 2 : 16;
+        r->words = realloc(r->words, r->wordcap * sizeof(ko_hlword));
+    }
+    char* copy = malloc(len ? len : 1);
+    memcpy(copy, word, len);
+    r->words[r->nwords++] = (ko_hlword){ copy, len, style };
+
+    // kept at most half full
+    if (r->nwords * 2 > r->nslots) {
+        free(r->slots);
+        r->nslots = r->nslots ? r->nslots * 2 : 32;
+        r->slots = calloc(r->nslots, sizeof(uint32_t));
+        for (size_t w = 0; w < r->nwords; w++)
+            ko_hlrule_slot(r, w);
+    }
+    else {
+        ko_hlrule_slot(r, r->nwords - 1);
+    }
+}
+
+// the style for a match of r
+static int ko_hlrule_style(const ko_hlrule* r, const char* s, size_t len) {
+    if (!r->nwords)
+        return r->style;
+
+    size_t mask = r->nslots - 1;
+    for (size_t i = ko_hlword_hash(s, len) & mask; r->slots[i]; i = (i + 1) & mask) {
+        const ko_hlword* w = &r->words[r->slots[i] - 1];
+        if (w->len == len && !memcmp(w->word, s, len))
+            return w->style;
+    }
+    return r->style;
+}
+
+// ---- highlighters
+
+// a rule's next match in the line being lexed
+typedef struct ko_hlmatch {
+    size_t start, end;          // start is KO_HL_NONE before it's looked for, and past the line if there isn't one
+} ko_hlmatch;
+
+#define KO_HL_NONE ((size_t)-1)
+
+struct ko_highlight {
+    ko_buffer* b;
+    ko_grammar* g;
+
+    // the state each of lines [0, n) starts in, with a gap at gap
+    uint16_t* states;
+    size_t n, cap, gap;
+
+    // lines from dirty on might start in the wrong state. lexing again from
+    // there is done once a line starts in the state it did before, as long as
+    // it's after edited, the last line any edit since touched.
+    size_t dirty;
+    size_t edited;
+
+    char* text;                 // the line being lexed
+    size_t textcap;
+    ko_hlmatch* matches;        // by rule, in the current state
+    int nmatches;
+    ko_hlrun* runs;
+    size_t nruns, runcap;
+    size_t lexed;
+};
+
+static inline uint16_t* ko_hl_state(ko_highlight* h, size_t line) {
+    return &h->states[line < h->gap ? line : line + (h->cap - h->n)];
+}
+
+// moves the gap to line
+static void ko_hl_gapto(ko_highlight* h, size_t line) {
+    size_t gaplen = h->cap - h->n;
+    if (line < h->gap)
+        memmove(h->states + line + gaplen, h->states + line, (h->gap - line) * sizeof(uint16_t));
+    else if (line > h->gap)
+        memmove(h->states + h->gap, h->states + h->gap + gaplen, (line - h->gap) * sizeof(uint16_t));
+    h->gap = line;
+}
+
+// takes out the states of lines [line, line + removed) and puts in added copies of state there
+static void ko_hl_splice(ko_highlight* h, size_t line, size_t removed, size_t added, uint16_t state) {
+    ko_hl_gapto(h, line);
+    h->n -= removed;
+
+    if (h->cap - h->n < added) {
+        size_t cap = h->cap * 2 > h->n + added ? h->cap * 2 : h->n + added + 64;
+        uint16_t* states = malloc(cap * sizeof(uint16_t));
+        size_t tail = h->n - h->gap;
+        memcpy(states, h->states, h->gap * sizeof(uint16_t));
+        memcpy(states + cap - tail, h->states + h->cap - tail, tail * sizeof(uint16_t));
+        free(h->states);
+        h->states = states;
+        h->cap = cap;
+    }
+
+    for (size_t i = 0; i < added; i++)
+        h->states[h->gap++] = state;
+    h->n += added;
+}
+
+static void ko_highlight_change(ko_highlight* h, ko_buffer* b, const ko_buffer_change* c) {
+
+    // nothing's kept for the lines after the one it's on
+    size_t start, end;
+    if (h->n < 2 || (ko_buffer_line_range(b, h->n - 1, &start, &end) && c->pos >= start))
+        return;
+
+    size_t line = ko_buffer_offset_line(b, c->pos);
+    size_t after = h->n - line - 1;
+    int dirty = h->dirty < h->n;
+
+    if (c->removedlines == KO_BUFFER_UNKNOWN || c->addedlines == KO_BUFFER_UNKNOWN || c->removedlines >= after) {
+        // it took out everything that was kept below it (or can't tell what it did)
+        ko_hl_splice(h, line + 1, after, 0, 0);
+        if (h->dirty > h->n)
+            h->dirty = h->n;
+        return;
+    }
+
+    // the lines it added get a guess each: the state their line started in
+    ko_hl_splice(h, line + 1, c->removedlines, c->addedlines, *ko_hl_state(h, line));
+
+    size_t edited = line + c->addedlines;
+    if (dirty && h->edited >= line + c->removedlines) {
+        size_t moved = h->edited - c->removedlines + c->addedlines;
+        if (moved > edited)
+            edited = moved;
+    }
+
+    // and the lines from where the last lexing stopped on were never checked
+    // after the edits before, so it can't settle before them either
+    if (dirty && h->dirty > line) {
+        size_t stopped = h->dirty > line + c->removedlines ? h->dirty - c->removedlines + c->addedlines : line + c->addedlines;
+        if (stopped > edited)
+            edited = stopped;
+    }
+    h->edited = edited;
+    if (h->dirty > line + 1)
+        h->dirty = line + 1;
+}
+
+static void ko_highlight_changed(void* ctx, ko_buffer* b, const ko_buffer_change* c, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        ko_highlight_change(ctx, b, &c[i]);
+}
+
+ko_highlight* ko_highlight_new(ko_buffer* b, ko_grammar* g) {
+    ko_highlight* h = calloc(1, sizeof(ko_highlight));
+    h->b = b;
+    h->g = g;
+
+    h->cap = 1024;
+    h->states = malloc(h->cap * sizeof(uint16_t));
+    h->states[0] = 0;
+    h->n = 1;
+    h->gap = 1;
+    h->dirty = 1;
+
+    ko_buffer_watch(b, ko_highlight_changed, h);
+    return h;
+}
+
+void ko_highlight_free(ko_highlight* h) {
+    if (!h) return;
+    ko_buffer_unwatch(h->b, ko_highlight_changed, h);
+    free(h->states);
+    free(h->text);
+    free(h->matches);
+    free(h->runs);
+    free(h);
+}
+
+static void ko_hl_emit(ko_highlight* h, size_t len, int style) {
+    if (!len)
+        return;
+    if (h->nruns && h->runs[h->nruns - 1].style == (uint32_t)style) {
+        h->runs[h->nruns - 1].len += len;
+        return;
+    }
+    if (h->nruns == h->runcap) {
+        h->runcap = h->runcap ? h->runcap * 2 : 64;
+        h->runs = realloc(h->runs, h->runcap * sizeof(ko_hlrun));
+    }
+    h->runs[h->nruns++] = (ko_hlrun){ (uint32_t)len, (uint32_t)style };
+}
+
+static void ko_hl_forget(ko_highlight* h) {
+    for (int i = 0; i < h->g->maxrules; i++)
+        h->matches[i].start = KO_HL_NONE;
+}
+
+// lexes line from state into h->runs; returns the state the next line starts
+// in, or -1 if there isn't a next line (or this one)
+static int ko_highlight_lex(ko_highlight* h, size_t line, int state) {
+    size_t start, end;
+    h->nruns = 0;
+    if (!ko_buffer_line_range(h->b, line, &start, &end))
+        return -1;
+    int last = end == ko_buffer_length(h->b);
+    h->lexed++;
+
+    const ko_grammar* g = h->g;
+    size_t len = end - start;
+    if (len > KO_HIGHLIGHT_LONG_LINE) {
+        ko_hl_emit(h, len, g->states[state].style);
+        return last ? -1 : state;
+    }
+
+    if (len > h->textcap) {
+        h->textcap = len * 2;
+        h->text = realloc(h->text, h->textcap);
+    }
+    ko_buffer_copy(h->b, start, len, h->text);
+    if (h->nmatches < g->maxrules) {
+        h->nmatches = g->maxrules;
+        h->matches = realloc(h->matches, h->nmatches * sizeof(ko_hlmatch));
+    }
+    ko_hl_forget(h);
+
+    // rules matching nothing and going round the states can't go on for ever
+    int empty = 0;
+    size_t p = 0;
+
+    while (p <= len) {
+        const ko_hlstate* st = &g->states[state];
+
+        int best = -1;
+        for (int i = 0; i < st->nrules; i++) {
+            ko_hlmatch* m = &h->matches[i];
+            if (m->start == KO_HL_NONE || (m->start < p && m->start <= len)) {
+                if (!ko_regex_find_string(st->rules[i].re, h->text, len, p, &m->start, &m->end))
+                    m->start = len + 1;
+            }
+            if (m->start <= len && (best < 0 || m->start < h->matches[best].start))
+                best = i;
+        }
+
+        if (best < 0) {
+            ko_hl_emit(h, len - p, st->style);
+            break;
+        }
+
+        const ko_hlrule* r = &st->rules[best];
+        size_t from = h->matches[best].start, to = h->matches[best].end;
+        ko_hl_emit(h, from - p, st->style);
+        ko_hl_emit(h, to - from, ko_hlrule_style(r, h->text + from, to - from));
+
+        int moved = r->next >= 0 && r->next != state;
+        if (moved) {
+            state = r->next;
+            ko_hl_forget(h);
+        }
+
+        if (to > from) {
+            p = to;
+            empty = 0;
+        }
+        else if (moved && empty++ < g->n) {
+            p = to;
+        }
+        else if (to == len) {
+            break;
+        }
+        else {
+            // nothing got matched, so step over a character
+            size_t n = 1;
+            while (to + n < len && ((unsigned char)h->text[to + n] & 0xC0) == 0x80)
+                n++;
+            ko_hl_emit(h, n, g->states[state].style);
+            p = to + n;
+            empty = 0;
+        }
+    }
+
+    return last ? -1 : state;
+}
+
+// makes sure the state line starts in is right, lexing what it has to
+static void ko_highlight_reach(ko_highlight* h, size_t line) {
+    while (h->dirty <= line) {
+        size_t k = h->dirty - 1;
+        int next = ko_highlight_lex(h, k, *ko_hl_state(h, k));
+
+        if (next < 0) {
+            // the text ends at line k
+            ko_hl_splice(h, k + 1, h->n - k - 1, 0, 0);
+            h->dirty = h->n;
+            return;
+        }
+
+        if (h->dirty < h->n) {
+            uint16_t* s = ko_hl_state(h, h->dirty);
+            if (h->dirty > h->edited && *s == next) {
+                h->dirty = h->n;
+                continue;
+            }
+            *s = (uint16_t)next;
+        }
+        else {
+            ko_hl_splice(h, h->n, 0, 1, (uint16_t)next);
+        }
+        h->dirty++;
+    }
+}
+
+size_t ko_highlight_line(ko_highlight* h, size_t line, const ko_hlrun** runs) {
+    ko_highlight_reach(h, line);
+    h->nruns = 0;
+    if (line < h->n)
+        ko_highlight_lex(h, line, *ko_hl_state(h, line));
+    *runs = h->runs;
+    return h->nruns;
+}
+
+ko_highlight_stats ko_highlight_getstats(const ko_highlight* h) {
+    return (ko_highlight_stats){ h->n, h->lexed };
+}
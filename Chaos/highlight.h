@@ -0,0 +1,65 @@
+#ifndef KO_HIGHLIGHT_H
+#define KO_HIGHLIGHT_H
+
+#include "buffer.h"
+
+// Syntax highlighting that only lexes what an edit changed.
+//
+// A grammar is a state machine. Each state has rules, and each rule is a
+// regex with a style and maybe a state to go to next. At every point the rule
+// whose match starts soonest wins (the one added first, on a tie), and text
+// that no rule matches gets the state's own style. Lines longer than
+// KO_HIGHLIGHT_LONG_LINE aren't lexed at all: they're left in the state's
+// style and don't change the state.
+//
+// A highlighter remembers the state each line starts in, as far down as it's
+// been asked about. An edit marks its line. The next query lexes from there,
+// but only until a line past the edit starts in the same state it did
+// before; everything below that is still right. So typing costs the lines it
+// actually changed, however long the file is. The states are kept in a gap
+// array, so an edit that adds or removes lines only moves the states between
+// it and the last edit.
+
+#define KO_HIGHLIGHT_LONG_LINE 100000
+
+typedef struct ko_grammar ko_grammar;
+
+ko_grammar* ko_grammar_new(void);
+void ko_grammar_free(ko_grammar* g);
+
+// adds a state, with the style for text none of its rules match; returns its
+// number. files start in the first one.
+int ko_grammar_state(ko_grammar* g, int style);
+
+// adds a rule to a state, after the ones already there (flags are
+// KO_REGEX_*). next is the state to go to after it, or -1 to stay put.
+// returns 0, or -1 with err set if the pattern is no good.
+int ko_grammar_rule(ko_grammar* g, int state, const char* pattern, size_t len, int flags, int style, int next, const char** err);
+
+// gives the last rule added to a state a different style when what it matched is exactly word
+void ko_grammar_keyword(ko_grammar* g, int state, const char* word, size_t len, int style);
+
+typedef struct ko_hlrun {
+    uint32_t len;               // bytes
+    uint32_t style;
+} ko_hlrun;
+
+typedef struct ko_highlight ko_highlight;
+
+// watches b for edits; g has to outlive it
+ko_highlight* ko_highlight_new(ko_buffer* b, ko_grammar* g);
+void ko_highlight_free(ko_highlight* h);
+
+// a line's text (not its newline) as runs of styles, from the start of it.
+// they're valid until the next call. returns how many there are: 0 if
+// there's no such line (or it's empty).
+size_t ko_highlight_line(ko_highlight* h, size_t line, const ko_hlrun** runs);
+
+typedef struct ko_highlight_stats {
+    size_t lines;               // lines whose starting state is kept
+    size_t lexed;               // lines lexed so far, all told
+} ko_highlight_stats;
+
+ko_highlight_stats ko_highlight_getstats(const ko_highlight* h);
+
+#endif
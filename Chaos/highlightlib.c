@@ -0,0 +1,317 @@
+// The `highlight` Lua module: grammars and incremental highlighters
+// (highlight.c) as userdata. A grammar is declared as a table of states; files
+// start in the one called main:
+//
+//     highlight.grammar{
+//        main = {
+//           {"--\\[\\[", "comment", "longcomment"},   -- pattern, style, state to go to
+//           {"--.*", "comment"},
+//           {"[A-Za-z_]\\w*", keywords = {["local"] = "keyword", ["end"] = "keyword"}},
+//        },
+//        longcomment = {style = "comment", {"\\]\\]", "comment", "main"}},
+//     }
+//
+// A rule without a style leaves its match plain, and icase = true makes its
+// pattern case-insensitive. Styles are just names; hl:setcolors says how to draw them.
+
+#include "highlightlib.h"
+#include "bufferlib.h"
+#include "winlib.h"
+#include "regex.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct ko_hlud {
+    ko_highlight* h;
+    ko_color* colors;           // by style
+    size_t ncolors;
+} ko_hlud;
+
+// the style called the string at idx, numbering it if it's new; nil is plain (0).
+// names is at names_idx, both ways round: name -> number and number -> name
+static int ko_hlstyle(lua_State* L, int idx, int names_idx) {
+    if (lua_isnoneornil(L, idx))
+        return 0;
+    idx = lua_absindex(L, idx);
+    luaL_checktype(L, idx, LUA_TSTRING);
+    
+    lua_pushvalue(L, idx);                            // [name]
+    lua_rawget(L, names_idx);                         // [style]
+    int style = (int)lua_tointeger(L, -1);
+    lua_pop(L, 1);                                    // []
+    if (style)
+        return style;
+    
+    style = (int)lua_rawlen(L, names_idx) + 1;
+    lua_pushvalue(L, idx);                            // [name]
+    lua_rawseti(L, names_idx, style);                 // []
+    lua_pushvalue(L, idx);                            // [name]
+    lua_pushinteger(L, style);                        // [name, style]
+    lua_rawset(L, names_idx);                         // []
+    return style;
+}
+
+// the number of the state called the string at idx
+static int ko_hlstatenum(lua_State* L, int idx, int states_idx) {
+    idx = lua_absindex(L, idx);
+    lua_pushvalue(L, idx);                            // [name]
+    lua_rawget(L, states_idx);                        // [state]
+    if (lua_isnil(L, -1))
+        luaL_error(L, "no state called %s", lua_tostring(L, idx));
+    int state = (int)lua_tointeger(L, -1);
+    lua_pop(L, 1);                                    // []
+    return state;
+}
+
+// args: [states]
+// returns: [grammar]
+static int highlight_grammar(lua_State *L) {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    lua_getfield(L, 1, "main");                       // [states, main]
+    luaL_argcheck(L, lua_istable(L, -1), 1, "needs a main state");
+    lua_pop(L, 1);                                    // [states]
+    
+    // made first, so an error part way through still frees it
+    ko_grammar** ud = lua_newuserdata(L, sizeof(ko_grammar*));  // [states, grammar]
+    *ud = ko_grammar_new();
+    luaL_setmetatable(L, KO_GRAMMAR_META);
+    ko_grammar* g = *ud;
+    
+    lua_newtable(L);                                  // [states, grammar, names]
+    lua_newtable(L);                                  // [states, grammar, names, nums]
+    lua_newtable(L);                                  // [states, grammar, names, nums, order]
+    int names = 3, nums = 4, order = 5;
+    
+    // number the states, main first
+    lua_pushstring(L, "main");                        // [..., "main"]
+    lua_rawseti(L, order, 1);                         // [...]
+    lua_pushnil(L);
+    while (lua_next(L, 1)) {                          // [..., name, state]
+        lua_pop(L, 1);                                // [..., name]
+        luaL_argcheck(L, lua_type(L, -1) == LUA_TSTRING, 1, "states have to be named");
+        if (strcmp(lua_tostring(L, -1), "main") != 0) {
+            lua_pushvalue(L, -1);                     // [..., name, name]
+            lua_rawseti(L, order, (int)lua_rawlen(L, order) + 1);
+        }
+    }
+    
+    int n = (int)lua_rawlen(L, order);
+    luaL_argcheck(L, n <= UINT16_MAX, 1, "too many states");
+    for (int i = 1; i <= n; i++) {
+        lua_rawgeti(L, order, i);                     // [..., name]
+        lua_pushinteger(L, i - 1);                    // [..., name, i - 1]
+        lua_rawset(L, nums);                          // [...]
+    }
+    
+    for (int i = 1; i <= n; i++) {
+        lua_rawgeti(L, order, i);                     // [..., name]
+        lua_rawget(L, 1);                             // [..., state]
+        luaL_argcheck(L, lua_istable(L, -1), 1, "a state has to be a table of rules");
+        int state_idx = lua_gettop(L);
+        
+        lua_getfield(L, state_idx, "style");          // [..., state, style]
+        int state = ko_grammar_state(g, ko_hlstyle(L, -1, names));
+        lua_pop(L, 1);                                // [..., state]
+        
+        int nrules = (int)lua_rawlen(L, state_idx);
+        for (int k = 1; k <= nrules; k++) {
+            lua_rawgeti(L, state_idx, k);             // [..., state, rule]
+            luaL_argcheck(L, lua_istable(L, -1), 1, "a rule has to be a table");
+            int rule_idx = lua_gettop(L);
+            
+            lua_rawgeti(L, rule_idx, 1);              // [..., state, rule, pattern]
+            size_t len;
+            const char* pattern = luaL_checklstring(L, -1, &len);
+            lua_rawgeti(L, rule_idx, 2);              // [..., state, rule, pattern, style]
+            int style = ko_hlstyle(L, -1, names);
+            lua_rawgeti(L, rule_idx, 3);              // [..., state, rule, pattern, style, next]
+            int next = lua_isnil(L, -1) ? -1 : ko_hlstatenum(L, -1, nums);
+            lua_getfield(L, rule_idx, "icase");       // [..., state, rule, pattern, style, next, icase]
+            int flags = lua_toboolean(L, -1) ? KO_REGEX_ICASE : 0;
+            
+            const char* err;
+            if (ko_grammar_rule(g, state, pattern, len, flags, style, next, &err) < 0)
+                return luaL_error(L, "bad pattern %s: %s", pattern, err);
+            lua_settop(L, rule_idx);                  // [..., state, rule]
+            
+            lua_getfield(L, rule_idx, "keywords");    // [..., state, rule, keywords]
+            if (lua_istable(L, -1)) {
+                lua_pushnil(L);
+                while (lua_next(L, -2)) {             // [..., keywords, word, style]
+                    luaL_argcheck(L, lua_type(L, -2) == LUA_TSTRING, 1, "keywords have to be strings");
+                    size_t wlen;
+                    const char* word = lua_tolstring(L, -2, &wlen);
+                    ko_grammar_keyword(g, state, word, wlen, ko_hlstyle(L, -1, names));
+                    lua_pop(L, 1);                    // [..., keywords, word]
+                }
+            }
+            lua_settop(L, state_idx);                 // [..., state]
+        }
+        lua_pop(L, 1);                                // [...]
+    }
+    
+    // the grammar keeps its style names, for hl:setcolors and hl:runs
+    lua_pushvalue(L, names);                          // [states, grammar, names, nums, order, names]
+    lua_setuservalue(L, 2);                           // [states, grammar, names, nums, order]
+    lua_settop(L, 2);                                 // [states, grammar]
+    return 1;
+}
+
+static int grammar_gc(lua_State *L) {
+    ko_grammar** ud = luaL_checkudata(L, 1, KO_GRAMMAR_META);
+    ko_grammar_free(*ud);
+    *ud = NULL;
+    return 0;
+}
+
+// args: [buf, grammar]
+// returns: [hl]
+static int highlight_new(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    ko_grammar* g = *(ko_grammar**)luaL_checkudata(L, 2, KO_GRAMMAR_META);
+    
+    ko_hlud* ud = lua_newuserdata(L, sizeof(ko_hlud));  // [buf, grammar, hl]
+    ud->h = ko_highlight_new(b, g);
+    ud->colors = NULL;
+    ud->ncolors = 0;
+    luaL_setmetatable(L, KO_HIGHLIGHT_META);
+    
+    // keeps the buffer and the grammar alive
+    lua_createtable(L, 2, 0);                         // [buf, grammar, hl, {}]
+    lua_pushvalue(L, 1);                              // [buf, grammar, hl, {}, buf]
+    lua_rawseti(L, -2, 1);                            // [buf, grammar, hl, {buf}]
+    lua_pushvalue(L, 2);                              // [buf, grammar, hl, {buf}, grammar]
+    lua_rawseti(L, -2, 2);                            // [buf, grammar, hl, {buf, grammar}]
+    lua_setuservalue(L, -2);                          // [buf, grammar, hl]
+    return 1;
+}
+
+// pushes the style names of hl's grammar
+static void ko_pushnames(lua_State* L, int idx) {
+    lua_getuservalue(L, idx);                         // [{buf, grammar}]
+    lua_rawgeti(L, -1, 2);                            // [{buf, grammar}, grammar]
+    lua_getuservalue(L, -1);                          // [{buf, grammar}, grammar, names]
+    lua_replace(L, -3);                               // [names, grammar]
+    lua_pop(L, 1);                                    // [names]
+}
+
+// args: [hl, colors]
+// colors maps style names to colors; styles it leaves out are drawn plain
+static int highlight_setcolors(lua_State *L) {
+    ko_hlud* ud = luaL_checkudata(L, 1, KO_HIGHLIGHT_META);
+    luaL_checktype(L, 2, LUA_TTABLE);
+    
+    ko_pushnames(L, 1);                               // [hl, colors, names]
+    size_t n = lua_rawlen(L, 3) + 1;
+    ud->colors = realloc(ud->colors, n * sizeof(ko_color));
+    ud->ncolors = n;
+    
+    ud->colors[0] = KO_RENDER_PLAIN;
+    for (size_t i = 1; i < n; i++) {
+        lua_rawgeti(L, 3, (int)i);                    // [hl, colors, names, name]
+        lua_rawget(L, 2);                             // [hl, colors, names, color]
+        ud->colors[i] = lua_isnil(L, -1) ? KO_RENDER_PLAIN : ko_checkcolor(L, -1);
+        lua_pop(L, 1);                                // [hl, colors, names]
+    }
+    return 0;
+}
+
+// args: [hl, line]
+// returns: [runs] or [nil]
+// line's styles, as {len, style, len, style, ...}: lengths in bytes, plain text's style false
+static int highlight_runs(lua_State *L) {
+    ko_hlud* ud = luaL_checkudata(L, 1, KO_HIGHLIGHT_META);
+    lua_Integer line = luaL_checkinteger(L, 2);
+    
+    const ko_hlrun* runs;
+    size_t n = line >= 1 ? ko_highlight_line(ud->h, line - 1, &runs) : 0;
+    
+    ko_pushnames(L, 1);                               // [hl, line, names]
+    lua_createtable(L, (int)n * 2, 0);                // [hl, line, names, runs]
+    for (size_t i = 0; i < n; i++) {
+        lua_pushinteger(L, runs[i].len);              // [..., runs, len]
+        lua_rawseti(L, -2, (int)i * 2 + 1);           // [..., runs]
+        if (runs[i].style)
+            lua_rawgeti(L, 3, runs[i].style);         // [..., runs, name]
+        else
+            lua_pushboolean(L, 0);                    // [..., runs, false]
+        lua_rawseti(L, -2, (int)i * 2 + 2);           // [..., runs]
+    }
+    return 1;
+}
+
+// args: [hl]
+// returns: [stats]
+static int highlight_stats(lua_State *L) {
+    ko_hlud* ud = luaL_checkudata(L, 1, KO_HIGHLIGHT_META);
+    ko_highlight_stats stats = ko_highlight_getstats(ud->h);
+    
+    lua_createtable(L, 0, 2);
+    lua_pushnumber(L, stats.lines);
+    lua_setfield(L, -2, "lines");
+    lua_pushnumber(L, stats.lexed);
+    lua_setfield(L, -2, "lexed");
+    return 1;
+}
+
+static int highlight_gc(lua_State *L) {
+    ko_hlud* ud = luaL_checkudata(L, 1, KO_HIGHLIGHT_META);
+    ko_highlight_free(ud->h);
+    free(ud->colors);
+    ud->h = NULL;
+    ud->colors = NULL;
+    return 0;
+}
+
+void ko_checkhighlight(lua_State* L, int idx, const ko_buffer* b, ko_render_style* style) {
+    ko_hlud* ud = luaL_checkudata(L, idx, KO_HIGHLIGHT_META);
+    
+    lua_getuservalue(L, idx);                         // [{buf, grammar}]
+    lua_rawgeti(L, -1, 1);                            // [{buf, grammar}, buf]
+    int same = ko_checkbuffer(L, -1) == b;
+    lua_pop(L, 2);                                    // []
+    luaL_argcheck(L, same, idx, "highlighter is for another buffer");
+    
+    style->h = ud->h;
+    style->colors = ud->colors;
+    style->ncolors = ud->ncolors;
+}
+
+static const luaL_Reg grammarlib_meta[] = {
+    {"__gc", grammar_gc},
+    {NULL, NULL}
+};
+
+static const luaL_Reg highlightlib_instance[] = {
+    {"setcolors", highlight_setcolors},
+    {"runs", highlight_runs},
+    {"stats", highlight_stats},
+    {NULL, NULL}
+};
+
+static const luaL_Reg highlightlib_meta[] = {
+    {"__gc", highlight_gc},
+    {NULL, NULL}
+};
+
+static const luaL_Reg highlightlib[] = {
+    {"grammar", highlight_grammar},
+    {"new", highlight_new},
+    {NULL, NULL}
+};
+
+int luaopen_highlight(lua_State* L) {
+    luaL_newmetatable(L, KO_GRAMMAR_META);            // [meta]
+    luaL_setfuncs(L, grammarlib_meta, 0);             // [meta]
+    lua_pop(L, 1);                                    // []
+    
+    luaL_newmetatable(L, KO_HIGHLIGHT_META);          // [meta]
+    luaL_setfuncs(L, highlightlib_meta, 0);           // [meta]
+    luaL_newlib(L, highlightlib_instance);            // [meta, methods]
+    lua_setfield(L, -2, "__index");                   // [meta]
+    lua_pop(L, 1);                                    // []
+    
+    luaL_newlib(L, highlightlib);
+    return 1;
+}
@@ -0,0 +1,16 @@
+#ifndef KO_HIGHLIGHTLIB_H
+#define KO_HIGHLIGHTLIB_H
+
+#include "lua/lua.h"
+#include "lua/lauxlib.h"
+#include "render.h"
+
+// The `highlight` Lua module (highlightlib.c), for other modules that draw with highlighters.
+
+#define KO_GRAMMAR_META "chaos.grammar"
+#define KO_HIGHLIGHT_META "chaos.highlighter"
+
+// a highlighter argument, with the colors hl:setcolors gave it; errors if it isn't one, or it's for a buffer other than b
+void ko_checkhighlight(lua_State* L, int idx, const ko_buffer* b, ko_render_style* style);
+
+#endif
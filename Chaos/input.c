@@ -0,0 +1,65 @@
+#include "input.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void ko_input_init(ko_input* in) {
+    memset(in, 0, sizeof(ko_input));
+}
+
+void ko_input_free(ko_input* in) {
+    free(in->keys);
+    free(in->bytes);
+    memset(in, 0, sizeof(ko_input));
+}
+
+static size_t ko_input_append(ko_input* in, const char* str, size_t len) {
+    if (in->len + len > in->bytescap) {
+        size_t cap = in->bytescap ? in->bytescap : 256;
+        while (in->len + len > cap)
+            cap *= 2;
+        in->bytes = realloc(in->bytes, cap);
+        in->bytescap = cap;
+    }
+
+    size_t off = in->len;
+    memcpy(in->bytes + off, str, len);
+    in->len += len;
+    return off;
+}
+
+static void ko_input_push(ko_input* in, size_t off, size_t len, int mods, int text) {
+    if (in->n == in->cap) {
+        in->cap = in->cap ? in->cap * 2 : 32;
+        in->keys = realloc(in->keys, in->cap * sizeof(ko_key));
+    }
+    in->keys[in->n++] = (ko_key){ off, len, mods, text };
+}
+
+void ko_input_key(ko_input* in, const char* name, size_t len, int mods) {
+    in->stats.keys++;
+    ko_input_push(in, ko_input_append(in, name, len), len, mods, 0);
+}
+
+void ko_input_text(ko_input* in, const char* str, size_t len) {
+    in->stats.keys++;
+
+    // bytes are appended in order, so a text event that's still last can just grow
+    ko_key* last = in->n ? &in->keys[in->n - 1] : NULL;
+    if (last && last->text && last->off + last->len == in->len) {
+        ko_input_append(in, str, len);
+        last->len += len;
+        return;
+    }
+
+    ko_input_push(in, ko_input_append(in, str, len), len, 0, 1);
+}
+
+void ko_input_clear(ko_input* in) {
+    if (in->n) {
+        in->stats.events += in->n;
+        in->stats.batches++;
+    }
+    in->n = 0;
+    in->len = 0;
+}
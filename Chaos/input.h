@@ -0,0 +1,54 @@
+#ifndef KO_INPUT_H
+#define KO_INPUT_H
+
+#include <stddef.h>
+
+// Keys that arrive between two frames wait here and get handed to Lua in one
+// go at the start of the next frame. Plain typed characters (no modifiers)
+// that arrive back to back are merged into a single text event, so a paste or
+// a held-down key is one string instead of thousands of events.
+//
+// Everything lives in two growable arrays that are cleared, not freed, after
+// each frame, so a steady stream of keys doesn't allocate.
+
+#define KO_KEY_CTRL 1
+#define KO_KEY_ALT  2
+#define KO_KEY_CMD  4
+
+typedef struct ko_key {
+    size_t off, len;        // the key's name, or the text, in ko_input.bytes
+    int mods;               // KO_KEY_* flags
+    int text;               // 1 if this is a run of typed characters rather than a named key
+} ko_key;
+
+typedef struct ko_input_stats {
+    unsigned long keys;     // key presses queued so far
+    unsigned long events;   // events delivered so far, after merging
+    unsigned long batches;  // frames that delivered any
+} ko_input_stats;
+
+typedef struct ko_input {
+    ko_key* keys;
+    size_t n, cap;
+    char* bytes;
+    size_t len, bytescap;
+    ko_input_stats stats;
+} ko_input;
+
+void ko_input_init(ko_input* in);
+void ko_input_free(ko_input* in);
+
+// a named key ("return", "up") or a character typed with modifiers
+void ko_input_key(ko_input* in, const char* name, size_t len, int mods);
+
+// characters typed without modifiers
+void ko_input_text(ko_input* in, const char* str, size_t len);
+
+static inline const char* ko_input_str(const ko_input* in, const ko_key* k) {
+    return in->bytes + k->off;
+}
+
+// forgets the queued keys after they've been delivered, keeping the memory
+void ko_input_clear(ko_input* in);
+
+#endif
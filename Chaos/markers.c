@@ -0,0 +1,384 @@
+#include "markers.h"
+
+#include <stdlib.h>
+
+// a marker, in a treap ordered by where it starts. its offsets (and its
+// subtree's) are relative to shift, which is relative to its parent's, and
+// so on up; only the root's are relative to nothing.
+typedef struct ko_marker {
+    uint32_t left, right, parent, prio;
+    int64_t start, end;
+    int64_t maxend;             // the furthest end in the subtree
+    int64_t shift;              // still to be added to everything in the subtree
+} ko_marker;
+
+#define KO_MARKER_FREE ((uint32_t)-1)   // the parent of a node nothing's using
+
+struct ko_markers {
+    ko_buffer* b;
+    ko_marker* nodes;           // nodes[0] is the empty tree
+    uint32_t nnodes, cap, freelist, root;
+    uint32_t seed;
+    size_t count;
+};
+
+static uint32_t ko_markers_random(ko_markers* m) {
+    uint32_t x = m->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return m->seed = x;
+}
+
+// hands the shift down to the children
+static inline void ko_marker_push(ko_markers* m, uint32_t t) {
+    ko_marker* n = &m->nodes[t];
+    if (!n->shift)
+        return;
+
+    n->start += n->shift;
+    n->end += n->shift;
+    n->maxend += n->shift;
+    if (n->left) m->nodes[n->left].shift += n->shift;
+    if (n->right) m->nodes[n->right].shift += n->shift;
+    n->shift = 0;
+}
+
+static inline void ko_marker_update(ko_markers* m, uint32_t t) {
+    ko_marker* n = &m->nodes[t];
+    n->maxend = n->end;
+    if (n->left) {
+        ko_marker* l = &m->nodes[n->left];
+        if (l->maxend + l->shift > n->maxend)
+            n->maxend = l->maxend + l->shift;
+        l->parent = t;
+    }
+    if (n->right) {
+        ko_marker* r = &m->nodes[n->right];
+        if (r->maxend + r->shift > n->maxend)
+            n->maxend = r->maxend + r->shift;
+        r->parent = t;
+    }
+}
+
+static uint32_t ko_marker_merge(ko_markers* m, uint32_t l, uint32_t r) {
+    if (!l) return r;
+    if (!r) return l;
+
+    if (m->nodes[l].prio > m->nodes[r].prio) {
+        ko_marker_push(m, l);
+        m->nodes[l].right = ko_marker_merge(m, m->nodes[l].right, r);
+        ko_marker_update(m, l);
+        return l;
+    }
+    else {
+        ko_marker_push(m, r);
+        m->nodes[r].left = ko_marker_merge(m, l, m->nodes[r].left);
+        ko_marker_update(m, r);
+        return r;
+    }
+}
+
+// splits t into the markers that start before pos and the rest
+static void ko_marker_split(ko_markers* m, uint32_t t, int64_t pos, uint32_t* l, uint32_t* r) {
+    if (!t) {
+        *l = *r = 0;
+        return;
+    }
+
+    ko_marker_push(m, t);
+    uint32_t a, c;
+    if (m->nodes[t].start < pos) {
+        ko_marker_split(m, m->nodes[t].right, pos, &a, &c);
+        m->nodes[t].right = a;
+        ko_marker_update(m, t);
+        *l = t;
+        *r = c;
+    }
+    else {
+        ko_marker_split(m, m->nodes[t].left, pos, &a, &c);
+        m->nodes[t].left = c;
+        ko_marker_update(m, t);
+        *l = a;
+        *r = t;
+    }
+}
+
+static void ko_markers_setroot(ko_markers* m, uint32_t t) {
+    m->root = t;
+    m->nodes[t].parent = 0;
+}
+
+// moves the ends in t that are past pos along by n (they all start before pos)
+static void ko_markers_stretch(ko_markers* m, uint32_t t, int64_t pos, int64_t n) {
+    if (!t) return;
+    ko_marker_push(m, t);
+    if (m->nodes[t].maxend <= pos)
+        return;
+
+    if (m->nodes[t].end > pos)
+        m->nodes[t].end += n;
+    ko_markers_stretch(m, m->nodes[t].left, pos, n);
+    ko_markers_stretch(m, m->nodes[t].right, pos, n);
+    ko_marker_update(m, t);
+}
+
+// takes the n bytes at pos out of the markers in t that reach past pos. if
+// inside, they all start in those bytes, and end up starting at pos.
+static void ko_markers_cut(ko_markers* m, uint32_t t, int64_t pos, int64_t n, int inside) {
+    if (!t) return;
+    ko_marker_push(m, t);
+    if (!inside && m->nodes[t].maxend <= pos)
+        return;
+
+    ko_marker* k = &m->nodes[t];
+    if (inside)
+        k->start = pos;
+    if (k->end > pos)
+        k->end = k->end >= pos + n ? k->end - n : pos;
+    ko_markers_cut(m, k->left, pos, n, inside);
+    ko_markers_cut(m, m->nodes[t].right, pos, n, inside);
+    ko_marker_update(m, t);
+}
+
+static void ko_markers_change(ko_markers* m, const ko_buffer_change* c) {
+    int64_t pos = (int64_t)c->pos;
+    uint32_t l, mid, r;
+
+    if (c->removed) {
+        int64_t n = (int64_t)c->removed;
+        ko_marker_split(m, m->root, pos, &l, &mid);
+        ko_marker_split(m, mid, pos + n, &mid, &r);
+        if (r) m->nodes[r].shift -= n;
+        ko_markers_cut(m, mid, pos, n, 1);
+        ko_markers_cut(m, l, pos, n, 0);
+        ko_markers_setroot(m, ko_marker_merge(m, ko_marker_merge(m, l, mid), r));
+    }
+
+    if (c->added) {
+        int64_t n = (int64_t)c->added;
+        ko_marker_split(m, m->root, pos, &l, &r);
+        if (r) m->nodes[r].shift += n;
+        ko_markers_stretch(m, l, pos, n);
+        ko_markers_setroot(m, ko_marker_merge(m, l, r));
+    }
+}
+
+// a batch of changes, with where each was as of before any of them and how
+// far the ones before it had moved the text after them
+typedef struct ko_markers_batch {
+    const ko_buffer_change* c;
+    size_t n;
+    int64_t* at;
+    int64_t* before;            // n + 1 of them: the last is the whole batch's
+} ko_markers_batch;
+
+// how many of the changes are at or before pos, given that at least lo are
+static size_t ko_markers_upto(const ko_markers_batch* s, int64_t pos, size_t lo) {
+    size_t hi = s->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (s->at[mid] <= pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// where pos (as of before the batch) ends up after it, given that lo of the
+// changes are at or before it. if pushed, text inserted right at pos goes
+// before it rather than after.
+static int64_t ko_markers_map(const ko_markers_batch* s, int64_t pos, int pushed, size_t lo) {
+    // everything up to pos moves it, except what's right at it: inserts
+    // there only move it if pushed, and deletes there don't
+    int64_t moved = pos + s->before[lo];
+    size_t k = lo;
+    for (; k > 0 && s->at[k - 1] == pos; k--) {
+        const ko_buffer_change* c = &s->c[k - 1];
+        if (!pushed)
+            moved -= (int64_t)c->added;
+        moved += (int64_t)c->removed;
+    }
+
+    // and a delete it's inside only takes it back to where that starts
+    if (k > 0 && s->at[k - 1] + (int64_t)s->c[k - 1].removed > pos)
+        moved += s->at[k - 1] + (int64_t)s->c[k - 1].removed - pos;
+    return moved;
+}
+
+// moves every marker in t through the batch. nothing changes order, so the
+// tree stays as it is. they're visited in order, so the changes at or before
+// each start are the ones before the last one's, and then some: *seen of them.
+static void ko_markers_sweep(ko_markers* m, uint32_t t, const ko_markers_batch* s, size_t* seen) {
+    if (!t) return;
+    ko_marker_push(m, t);
+    ko_markers_sweep(m, m->nodes[t].left, s, seen);
+
+    ko_marker* k = &m->nodes[t];
+    while (*seen < s->n && s->at[*seen] <= k->start)
+        ++*seen;
+    int64_t start = ko_markers_map(s, k->start, 1, *seen);
+    k->end = k->end == k->start ? start : ko_markers_map(s, k->end, 0, ko_markers_upto(s, k->end, *seen));
+    k->start = start;
+
+    ko_markers_sweep(m, k->right, s, seen);
+    ko_marker_update(m, t);
+}
+
+static void ko_markers_changed(void* ctx, ko_buffer* b, const ko_buffer_change* c, size_t n) {
+    ko_markers* m = ctx;
+    (void)b;
+
+    // a few changes are quicker one at a time, each touching O(log) nodes;
+    // a batch of as many as there are markers goes over them all once
+    if (n * 16 < m->count) {
+        for (size_t i = 0; i < n; i++)
+            ko_markers_change(m, &c[i]);
+        return;
+    }
+
+    ko_markers_batch s = { c, n, malloc((2 * n + 1) * sizeof(int64_t)), NULL };
+    s.before = s.at + n;
+    int64_t moved = 0;
+    for (size_t i = 0; i < n; i++) {
+        s.at[i] = (int64_t)c[i].pos - moved;
+        s.before[i] = moved;
+        moved += (int64_t)c[i].added - (int64_t)c[i].removed;
+    }
+    s.before[n] = moved;
+
+    size_t seen = 0;
+    ko_markers_sweep(m, m->root, &s, &seen);
+    free(s.at);
+}
+
+ko_markers* ko_markers_new(ko_buffer* b) {
+    ko_markers* m = calloc(1, sizeof(ko_markers));
+    m->b = b;
+    m->seed = 0x2545F491;
+    m->cap = 64;
+    m->nodes = malloc(m->cap * sizeof(ko_marker));
+    m->nodes[0] = (ko_marker){ 0 };
+    m->nnodes = 1;
+
+    ko_buffer_watch(b, ko_markers_changed, m);
+    return m;
+}
+
+void ko_markers_free(ko_markers* m) {
+    if (!m) return;
+    ko_buffer_unwatch(m->b, ko_markers_changed, m);
+    free(m->nodes);
+    free(m);
+}
+
+uint32_t ko_markers_add(ko_markers* m, size_t start, size_t end) {
+    uint32_t i = m->freelist;
+    if (i) {
+        m->freelist = m->nodes[i].right;
+    }
+    else {
+        if (m->nnodes == m->cap) {
+            m->cap *= 2;
+            m->nodes = realloc(m->nodes, m->cap * sizeof(ko_marker));
+        }
+        i = m->nnodes++;
+    }
+
+    if (end < start)
+        end = start;
+    m->nodes[i] = (ko_marker){ 0, 0, 0, ko_markers_random(m), (int64_t)start, (int64_t)end, (int64_t)end, 0 };
+    m->count++;
+
+    // after the ones that start at the same place
+    uint32_t l, r;
+    ko_marker_split(m, m->root, (int64_t)start + 1, &l, &r);
+    ko_markers_setroot(m, ko_marker_merge(m, ko_marker_merge(m, l, i), r));
+    return i;
+}
+
+static int ko_markers_valid(const ko_markers* m, uint32_t id) {
+    return id && id < m->nnodes && m->nodes[id].parent != KO_MARKER_FREE;
+}
+
+int ko_markers_get(const ko_markers* m, uint32_t id, size_t* start, size_t* end) {
+    if (!ko_markers_valid(m, id))
+        return 0;
+
+    int64_t shift = 0;
+    for (uint32_t t = id; t; t = m->nodes[t].parent)
+        shift += m->nodes[t].shift;
+    *start = (size_t)(m->nodes[id].start + shift);
+    *end = (size_t)(m->nodes[id].end + shift);
+    return 1;
+}
+
+// pushes every shift on the way down to t, so its offsets are its own
+static void ko_markers_pushto(ko_markers* m, uint32_t t) {
+    if (m->nodes[t].parent)
+        ko_markers_pushto(m, m->nodes[t].parent);
+    ko_marker_push(m, t);
+}
+
+void ko_markers_remove(ko_markers* m, uint32_t id) {
+    if (!ko_markers_valid(m, id))
+        return;
+
+    ko_markers_pushto(m, id);
+    uint32_t parent = m->nodes[id].parent;
+    uint32_t child = ko_marker_merge(m, m->nodes[id].left, m->nodes[id].right);
+
+    if (!parent) {
+        ko_markers_setroot(m, child);
+    }
+    else {
+        if (m->nodes[parent].left == id)
+            m->nodes[parent].left = child;
+        else
+            m->nodes[parent].right = child;
+        for (uint32_t t = parent; t; t = m->nodes[t].parent)
+            ko_marker_update(m, t);
+    }
+
+    m->nodes[id].parent = KO_MARKER_FREE;
+    m->nodes[id].right = m->freelist;
+    m->freelist = id;
+    m->count--;
+}
+
+void ko_markers_clear(ko_markers* m) {
+    m->nnodes = 1;
+    m->freelist = 0;
+    m->root = 0;
+    m->count = 0;
+}
+
+size_t ko_markers_count(const ko_markers* m) {
+    return m->count;
+}
+
+static int ko_markers_visit(const ko_markers* m, uint32_t t, int64_t shift, int64_t start, int64_t end,
+                            ko_markers_fn fn, void* ctx) {
+    if (!t) return 1;
+    const ko_marker* n = &m->nodes[t];
+    shift += n->shift;
+
+    // nothing in here reaches the range
+    if (n->maxend + shift < start)
+        return 1;
+    if (!ko_markers_visit(m, n->left, shift, start, end, fn, ctx))
+        return 0;
+
+    // nor does anything from here on start in it
+    int64_t s = n->start + shift, e = n->end + shift;
+    if (s >= end)
+        return 1;
+    if ((e > start || s >= start) && !fn(ctx, t, (size_t)s, (size_t)e))
+        return 0;
+    return ko_markers_visit(m, n->right, shift, start, end, fn, ctx);
+}
+
+void ko_markers_find(const ko_markers* m, size_t start, size_t end, ko_markers_fn fn, void* ctx) {
+    ko_markers_visit(m, m->root, 0, (int64_t)start, (int64_t)end, fn, ctx);
+}
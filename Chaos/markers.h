@@ -0,0 +1,43 @@
+#ifndef KO_MARKERS_H
+#define KO_MARKERS_H
+
+#include "buffer.h"
+
+// Ranges of a buffer's text that stay on the same text as it's edited:
+// selections, search hits, diagnostics and the like.
+//
+// A set keeps its markers in a treap ordered by where they start, with each
+// subtree's furthest end. Every node's offsets are relative to a shift that
+// applies to its whole subtree, so an edit moves everything after it by
+// changing one number on each of O(log n) nodes, whatever the number of
+// markers. Only the markers that straddle the edit (or are inside text it
+// deletes) get touched one by one. Finding the markers in a range costs
+// O(log n + k) for the k found.
+//
+// Text inserted where a marker starts goes before it; text inserted where
+// one ends doesn't go in it. An empty marker moves with the text after it.
+// Deleting a marker's text leaves it empty where the text was.
+
+typedef struct ko_markers ko_markers;
+
+// watches b for edits
+ko_markers* ko_markers_new(ko_buffer* b);
+void ko_markers_free(ko_markers* m);
+
+// adds the marker [start, end) and returns its id, which is never 0. an id
+// is only good until its marker is removed: after that it can be given out again.
+uint32_t ko_markers_add(ko_markers* m, size_t start, size_t end);
+
+// where a marker is now; returns 0 if there's no such marker
+int ko_markers_get(const ko_markers* m, uint32_t id, size_t* start, size_t* end);
+
+void ko_markers_remove(ko_markers* m, uint32_t id);
+void ko_markers_clear(ko_markers* m);
+size_t ko_markers_count(const ko_markers* m);
+
+// calls fn on the markers that overlap [start, end), and the empty ones in it,
+// in the order they start; stops early if fn returns 0
+typedef int (*ko_markers_fn)(void* ctx, uint32_t id, size_t start, size_t end);
+void ko_markers_find(const ko_markers* m, size_t start, size_t end, ko_markers_fn fn, void* ctx);
+
+#endif
@@ -0,0 +1,155 @@
+// The `markers` Lua module: sets of ranges that stay on the same text as
+// their buffer is edited (markers.c), as userdata. A marker from..to covers
+// the bytes from through to, like buf:sub(from, to); to = from - 1 makes an
+// empty one, which sits just before from.
+
+#include "bufferlib.h"
+#include "markers.h"
+
+#define KO_MARKERS_META "chaos.markers"
+
+// args: [buf]
+// returns: [set]
+static int markers_new(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    
+    ko_markers** ud = lua_newuserdata(L, sizeof(ko_markers*));  // [buf, set]
+    *ud = ko_markers_new(b);
+    luaL_setmetatable(L, KO_MARKERS_META);
+    
+    // keeps the buffer alive
+    lua_createtable(L, 1, 0);                         // [buf, set, {}]
+    lua_pushvalue(L, 1);                              // [buf, set, {}, buf]
+    lua_rawseti(L, -2, 1);                            // [buf, set, {buf}]
+    lua_setuservalue(L, -2);                          // [buf, set]
+    return 1;
+}
+
+static ko_markers* ko_tomarkers(lua_State* L) {
+    return *(ko_markers**)luaL_checkudata(L, 1, KO_MARKERS_META);
+}
+
+// args: [set, from, to]
+// returns: [id]
+static int markers_add(lua_State *L) {
+    ko_markers* m = ko_tomarkers(L);
+    lua_Integer from = luaL_checkinteger(L, 2);
+    lua_Integer to = luaL_checkinteger(L, 3);
+    luaL_argcheck(L, from >= 1, 2, "has to be at least 1");
+    luaL_argcheck(L, to >= from - 1, 3, "can't be before from - 1");
+    
+    lua_pushinteger(L, ko_markers_add(m, from - 1, to));
+    return 1;
+}
+
+// args: [set, id]
+// returns: [from, to] or [nil]
+// where the marker is now; nil if it's been removed
+static int markers_get(lua_State *L) {
+    ko_markers* m = ko_tomarkers(L);
+    lua_Integer id = luaL_checkinteger(L, 2);
+    
+    size_t start, end;
+    if (id < 1 || id > UINT32_MAX || !ko_markers_get(m, (uint32_t)id, &start, &end)) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_pushinteger(L, start + 1);
+    lua_pushinteger(L, end);
+    return 2;
+}
+
+// args: [set, id]
+static int markers_remove(lua_State *L) {
+    ko_markers* m = ko_tomarkers(L);
+    lua_Integer id = luaL_checkinteger(L, 2);
+    
+    if (id >= 1 && id <= UINT32_MAX)
+        ko_markers_remove(m, (uint32_t)id);
+    return 0;
+}
+
+// args: [set]
+static int markers_clear(lua_State *L) {
+    ko_markers_clear(ko_tomarkers(L));
+    return 0;
+}
+
+// args: [set]
+// returns: [n]
+static int markers_count(lua_State *L) {
+    lua_pushinteger(L, ko_markers_count(ko_tomarkers(L)));
+    return 1;
+}
+
+typedef struct ko_markers_found {
+    lua_State* L;
+    int n;
+} ko_markers_found;
+
+static int ko_markers_push(void* ctx, uint32_t id, size_t start, size_t end) {
+    ko_markers_found* f = ctx;
+    lua_pushinteger(f->L, id);                        // [..., found, id]
+    lua_rawseti(f->L, -2, ++f->n);                    // [..., found]
+    lua_pushinteger(f->L, start + 1);                 // [..., found, from]
+    lua_rawseti(f->L, -2, ++f->n);                    // [..., found]
+    lua_pushinteger(f->L, end);                       // [..., found, to]
+    lua_rawseti(f->L, -2, ++f->n);                    // [..., found]
+    return 1;
+}
+
+// args: [set, from, to]
+// returns: [found]
+// the markers with any of bytes from..to in them (and the empty ones in
+// there), in the order they start, as {id, from, to, id, from, to, ...}
+static int markers_find(lua_State *L) {
+    ko_markers* m = ko_tomarkers(L);
+    lua_Integer from = luaL_checkinteger(L, 2);
+    lua_Integer to = luaL_checkinteger(L, 3);
+    
+    lua_newtable(L);                                  // [set, from, to, found]
+    if (from < 1) from = 1;
+    if (to >= from) {
+        ko_markers_found f = { L, 0 };
+        ko_markers_find(m, from - 1, to, ko_markers_push, &f);
+    }
+    return 1;
+}
+
+static int markers_gc(lua_State *L) {
+    ko_markers** ud = luaL_checkudata(L, 1, KO_MARKERS_META);
+    ko_markers_free(*ud);
+    *ud = NULL;
+    return 0;
+}
+
+static const luaL_Reg markerslib_instance[] = {
+    {"add", markers_add},
+    {"get", markers_get},
+    {"remove", markers_remove},
+    {"clear", markers_clear},
+    {"count", markers_count},
+    {"find", markers_find},
+    {NULL, NULL}
+};
+
+static const luaL_Reg markerslib_meta[] = {
+    {"__gc", markers_gc},
+    {NULL, NULL}
+};
+
+static const luaL_Reg markerslib[] = {
+    {"new", markers_new},
+    {NULL, NULL}
+};
+
+int luaopen_markers(lua_State* L) {
+    luaL_newmetatable(L, KO_MARKERS_META);            // [meta]
+    luaL_setfuncs(L, markerslib_meta, 0);             // [meta]
+    luaL_newlib(L, markerslib_instance);              // [meta, methods]
+    lua_setfield(L, -2, "__index");                   // [meta]
+    lua_pop(L, 1);                                    // []
+    
+    luaL_newlib(L, markerslib);
+    return 1;
+}
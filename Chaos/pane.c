@@ -0,0 +1,90 @@
+#include "pane.h"
+
+#include <string.h>
+
+// clips a pane-local rect to the pane and then to the grid, turning it into grid coordinates.
+// returns 0 if nothing is left.
+static int ko_pane_clip(const ko_pane* p, int* x, int* y, int* w, int* h) {
+    if (*x < 0) { *w += *x; *x = 0; }
+    if (*y < 0) { *h += *y; *y = 0; }
+    if (*x + *w > p->w) *w = p->w - *x;
+    if (*y + *h > p->h) *h = p->h - *y;
+
+    *x += p->x;
+    *y += p->y;
+
+    if (*x < 0) { *w += *x; *x = 0; }
+    if (*y < 0) { *h += *y; *y = 0; }
+    if (*x + *w > p->grid->cols) *w = p->grid->cols - *x;
+    if (*y + *h > p->grid->rows) *h = p->grid->rows - *y;
+
+    return *w > 0 && *h > 0;
+}
+
+void ko_pane_set(const ko_pane* p, int x, int y, uint32_t ch, ko_color fg, ko_color bg) {
+    int w = 1, h = 1;
+    if (ko_pane_clip(p, &x, &y, &w, &h))
+        ko_grid_set(p->grid, x, y, ch, fg, bg);
+}
+
+int ko_pane_blit(const ko_pane* p, int x, int y, const char* str, size_t len, size_t* i, ko_color fg, ko_color bg) {
+    ko_grid* g = p->grid;
+    int n = 0;
+
+    // skip what hangs off the pane's left edge
+    for (; x < 0 && *i < len; x++)
+        ko_utf8_next(str, len, i);
+
+    // the pane's columns [x, w) take cells from the string, but only [left, right) are on the grid
+    int gy = p->y + y;
+    int left = -p->x;
+    int right = g->cols - p->x;
+    if (right > p->w)
+        right = p->w;
+    if (y < 0 || y >= p->h || gy < 0 || gy >= g->rows)
+        left = right = p->w;
+
+    for (; x < left && x < p->w && *i < len; x++, n++)
+        ko_utf8_next(str, len, i);
+
+    if (x < right && *i < len) {
+        int drawn = ko_grid_blitn(g, p->x + x, gy, p->x + right, str, len, i, fg, bg);
+        x += drawn;
+        n += drawn;
+    }
+
+    for (; x < p->w && *i < len; x++, n++)
+        ko_utf8_next(str, len, i);
+
+    return n;
+}
+
+void ko_pane_put(const ko_pane* p, int x, int y, const ko_cell* cells, int n) {
+    int x0 = x, h = 1;
+    if (!ko_pane_clip(p, &x, &y, &n, &h))
+        return;
+
+    // clipping the left edge drops that many cells off the front
+    memcpy(ko_grid_row(p->grid, y) + x, cells + (x - p->x - x0), n * sizeof(ko_cell));
+    p->grid->touched[y] = 1;
+}
+
+void ko_pane_fill(const ko_pane* p, int x, int y, int w, int h, uint32_t ch, ko_color fg, ko_color bg) {
+    if (ko_pane_clip(p, &x, &y, &w, &h))
+        ko_grid_fill(p->grid, x, y, w, h, ch, fg, bg);
+}
+
+void ko_pane_paint(const ko_pane* p, int x, int y, int w, ko_color fg, ko_color bg) {
+    int h = 1;
+    if (ko_pane_clip(p, &x, &y, &w, &h))
+        ko_grid_paint(p->grid, x, y, w, fg, bg);
+}
+
+void ko_pane_clear(const ko_pane* p, ko_color bg) {
+    ko_pane_fill(p, 0, 0, p->w, p->h, ' ', bg, bg);
+}
+
+void ko_pane_scroll(const ko_pane* p, int x, int y, int w, int h, int dx, int dy, ko_color bg) {
+    if (ko_pane_clip(p, &x, &y, &w, &h))
+        ko_grid_scroll(p->grid, x, y, w, h, dx, dy, bg);
+}
@@ -0,0 +1,33 @@
+#ifndef KO_PANE_H
+#define KO_PANE_H
+
+#include "grid.h"
+
+// A pane is a rectangle of a grid with its own coordinate system. Drawing
+// uses pane-local 0-based coordinates and is clipped to the pane (and to the
+// grid, if the pane hangs off it), so splits can draw without knowing where
+// they are or checking bounds themselves. Clipping happens once per call,
+// not per cell, so N panes cost the same per cell as one full-grid draw.
+
+typedef struct ko_pane {
+    ko_grid* grid;
+    int x, y;           // origin in the grid
+    int w, h;
+} ko_pane;
+
+void ko_pane_set(const ko_pane* p, int x, int y, uint32_t ch, ko_color fg, ko_color bg);
+
+// like ko_grid_blit, but wraps at the pane's right edge. rows outside the pane are only measured.
+int ko_pane_blit(const ko_pane* p, int x, int y, const char* str, size_t len, size_t* i, ko_color fg, ko_color bg);
+
+// copies n ready-made cells onto row y starting at column x
+void ko_pane_put(const ko_pane* p, int x, int y, const ko_cell* cells, int n);
+
+void ko_pane_fill(const ko_pane* p, int x, int y, int w, int h, uint32_t ch, ko_color fg, ko_color bg);
+void ko_pane_paint(const ko_pane* p, int x, int y, int w, ko_color fg, ko_color bg);
+void ko_pane_clear(const ko_pane* p, ko_color bg);
+
+// see ko_grid_scroll; cells never move across the pane's edges
+void ko_pane_scroll(const ko_pane* p, int x, int y, int w, int h, int dx, int dy, ko_color bg);
+
+#endif
@@ -0,0 +1,992 @@
+#include "regex.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ---- parsing, into a tree
+
+enum { KO_RE_CLASS, KO_RE_CAT, KO_RE_ALT, KO_RE_REPEAT, KO_RE_EMPTY, KO_RE_BOL, KO_RE_EOL };
+
+#define KO_RE_INF (-1)
+#define KO_RE_MAX_REPEAT 1000
+#define KO_RE_MAX_DEPTH 200
+#define KO_RE_MAX_PROG 200000
+
+typedef struct ko_renode {
+    int type;
+    int a, b;                   // children
+    int min, max;               // KO_RE_REPEAT; max can be KO_RE_INF
+    int greedy;
+    int cls;                    // KO_RE_CLASS: which bytes it takes
+} ko_renode;
+
+typedef struct ko_reclass {
+    uint8_t bits[32];
+} ko_reclass;
+
+typedef struct ko_reparse {
+    const unsigned char* p;
+    const unsigned char* end;
+    int icase;
+    int depth;
+    ko_renode* nodes;
+    int nnodes, nodecap;
+    ko_reclass* classes;
+    int nclasses, classcap;
+    const char* err;
+} ko_reparse;
+
+static inline void ko_class_set(ko_reclass* c, int byte) {
+    c->bits[byte >> 3] |= 1 << (byte & 7);
+}
+
+static inline int ko_class_has(const ko_reclass* c, int byte) {
+    return (c->bits[byte >> 3] >> (byte & 7)) & 1;
+}
+
+static int ko_re_node(ko_reparse* ps, int type, int a, int b) {
+    if (ps->nnodes == ps->nodecap) {
+        ps->nodecap = ps->nodecap ? ps->nodecap * 2 : 64;
+        ps->nodes = realloc(ps->nodes, ps->nodecap * sizeof(ko_renode));
+    }
+    ps->nodes[ps->nnodes] = (ko_renode){ type, a, b, 0, 0, 1, -1 };
+    return ps->nnodes++;
+}
+
+// a new, empty class, and the node that takes it
+static int ko_re_class(ko_reparse* ps, ko_reclass** c) {
+    if (ps->nclasses == ps->classcap) {
+        ps->classcap = ps->classcap ? ps->classcap * 2 : 16;
+        ps->classes = realloc(ps->classes, ps->classcap * sizeof(ko_reclass));
+    }
+    memset(&ps->classes[ps->nclasses], 0, sizeof(ko_reclass));
+
+    int n = ko_re_node(ps, KO_RE_CLASS, -1, -1);
+    ps->nodes[n].cls = ps->nclasses++;
+    *c = &ps->classes[ps->nodes[n].cls];
+    return n;
+}
+
+static int ko_re_range(ko_reparse* ps, int lo, int hi) {
+    ko_reclass* c;
+    int n = ko_re_class(ps, &c);
+    for (int i = lo; i <= hi; i++)
+        ko_class_set(c, i);
+    return n;
+}
+
+static int ko_re_cat(ko_reparse* ps, int a, int b) {
+    return a < 0 ? b : ko_re_node(ps, KO_RE_CAT, a, b);
+}
+
+static int ko_re_alt(ko_reparse* ps, int a, int b) {
+    return a < 0 ? b : ko_re_node(ps, KO_RE_ALT, a, b);
+}
+
+// any one character that isn't ASCII: a whole UTF-8 sequence if there is one, or else a stray byte
+static int ko_re_nonascii(ko_reparse* ps) {
+    int n = ko_re_cat(ps, ko_re_range(ps, 0xC2, 0xDF), ko_re_range(ps, 0x80, 0xBF));
+
+    int three = ko_re_range(ps, 0xE0, 0xEF);
+    for (int i = 0; i < 2; i++)
+        three = ko_re_cat(ps, three, ko_re_range(ps, 0x80, 0xBF));
+
+    int four = ko_re_range(ps, 0xF0, 0xF4);
+    for (int i = 0; i < 3; i++)
+        four = ko_re_cat(ps, four, ko_re_range(ps, 0x80, 0xBF));
+
+    n = ko_re_alt(ps, n, three);
+    n = ko_re_alt(ps, n, four);
+    return ko_re_alt(ps, n, ko_re_range(ps, 0x80, 0xFF));
+}
+
+static void ko_re_fold(ko_reparse* ps, ko_reclass* c) {
+    if (!ps->icase)
+        return;
+    for (int i = 'a'; i <= 'z'; i++) {
+        if (ko_class_has(c, i) || ko_class_has(c, i - 32)) {
+            ko_class_set(c, i);
+            ko_class_set(c, i - 32);
+        }
+    }
+}
+
+// one character (however many bytes) as a literal
+static int ko_re_literal(ko_reparse* ps, const unsigned char* s, size_t n) {
+    int node = -1;
+    for (size_t i = 0; i < n; i++) {
+        ko_reclass* c;
+        int b = ko_re_class(ps, &c);
+        ko_class_set(c, s[i]);
+        ko_re_fold(ps, c);
+        node = ko_re_cat(ps, node, b);
+    }
+    return node;
+}
+
+static size_t ko_re_charlen(const ko_reparse* ps) {
+    unsigned char c = *ps->p;
+    size_t n = c < 0xC0 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+    size_t left = ps->end - ps->p;
+    return n < left ? n : left;
+}
+
+// \d, \w and \s into c; returns 0 if e isn't one of them
+static int ko_re_named(ko_reclass* c, int e) {
+    switch (e | 0x20) {
+        case 'd':
+            for (int i = '0'; i <= '9'; i++) ko_class_set(c, i);
+            return 1;
+        case 'w':
+            for (int i = '0'; i <= '9'; i++) ko_class_set(c, i);
+            for (int i = 'a'; i <= 'z'; i++) ko_class_set(c, i);
+            for (int i = 'A'; i <= 'Z'; i++) ko_class_set(c, i);
+            ko_class_set(c, '_');
+            return 1;
+        case 's':
+            ko_class_set(c, ' ');
+            for (int i = '\t'; i <= '\r'; i++) ko_class_set(c, i);
+            return 1;
+    }
+    return 0;
+}
+
+static int ko_re_hex(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') return (c | 0x20) - 'a' + 10;
+    return -1;
+}
+
+// the byte a single-byte escape stands for (p is past the backslash), or -1
+static int ko_re_escape(ko_reparse* ps) {
+    int e = *ps->p++;
+    switch (e) {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        case 'x': {
+            int hi = ps->p < ps->end ? ko_re_hex(ps->p[0]) : -1;
+            int lo = ps->p + 1 < ps->end ? ko_re_hex(ps->p[1]) : -1;
+            if (hi < 0 || lo < 0) {
+                ps->err = "\\x needs two hex digits";
+                return -1;
+            }
+            ps->p += 2;
+            return hi << 4 | lo;
+        }
+    }
+    if ((e >= 'a' && e <= 'z') || (e >= 'A' && e <= 'Z') || (e >= '0' && e <= '9')) {
+        ps->err = "unknown escape";
+        return -1;
+    }
+    return e;
+}
+
+static int ko_re_bracket(ko_reparse* ps) {
+    ps->p++;
+    int neg = ps->p < ps->end && *ps->p == '^';
+    if (neg) ps->p++;
+
+    ko_reclass* c;
+    int node = ko_re_class(ps, &c);
+    int cls = ps->nodes[node].cls;
+    int nonascii = 0;           // \D and friends take every non-ASCII character too
+    int others = -1;            // non-ASCII characters, as alternatives
+
+    for (int first = 1; ; first = 0) {
+        if (ps->p == ps->end) {
+            ps->err = "missing ]";
+            return -1;
+        }
+        if (*ps->p == ']' && !first)
+            break;
+
+        int lo;
+        if (*ps->p == '\\' && ps->p + 1 < ps->end) {
+            ps->p++;
+            ko_reclass named = { { 0 } };
+            if (ko_re_named(&named, *ps->p)) {
+                int upper = *ps->p++ < 'a';
+                c = &ps->classes[cls];
+                for (int i = 0; i < 128; i++)
+                    if (ko_class_has(&named, i) != upper)
+                        ko_class_set(c, i);
+                nonascii |= upper;
+                continue;
+            }
+            if ((lo = ko_re_escape(ps)) < 0)
+                return -1;
+        }
+        else if (*ps->p >= 0x80) {
+            size_t n = ko_re_charlen(ps);
+            if (neg) {
+                ps->err = "a negated class can only leave out ASCII";
+                return -1;
+            }
+            if (n == 1) {
+                // a stray byte stands for itself
+                lo = *ps->p++;
+            }
+            else {
+                others = ko_re_alt(ps, others, ko_re_literal(ps, ps->p, n));
+                ps->p += n;
+                continue;
+            }
+        }
+        else {
+            lo = *ps->p++;
+        }
+
+        int hi = lo;
+        if (ps->p + 1 < ps->end && ps->p[0] == '-' && ps->p[1] != ']') {
+            ps->p++;
+            if (*ps->p == '\\' && ps->p + 1 < ps->end) {
+                ps->p++;
+                if ((hi = ko_re_escape(ps)) < 0)
+                    return -1;
+            }
+            else {
+                hi = *ps->p++;
+            }
+            if (lo >= 0x80 || hi >= 0x80) {
+                ps->err = "ranges have to be ASCII";
+                return -1;
+            }
+            if (hi < lo) {
+                ps->err = "range out of order";
+                return -1;
+            }
+        }
+
+        c = &ps->classes[cls];
+        for (int i = lo; i <= hi; i++)
+            ko_class_set(c, i);
+    }
+    ps->p++;
+
+    c = &ps->classes[cls];
+    ko_re_fold(ps, c);
+
+    if (neg) {
+        for (int i = 0; i < 32; i++)
+            c->bits[i] = i < 16 ? ~c->bits[i] : 0;
+        nonascii = !nonascii;
+    }
+    if (nonascii)
+        node = ko_re_alt(ps, node, ko_re_nonascii(ps));
+    if (others >= 0)
+        node = ko_re_alt(ps, node, others);
+    return node;
+}
+
+static int ko_re_parse_alt(ko_reparse* ps);
+
+static int ko_re_atom(ko_reparse* ps) {
+    unsigned char c = *ps->p;
+
+    switch (c) {
+        case '(': {
+            if (++ps->depth > KO_RE_MAX_DEPTH) {
+                ps->err = "groups nested too deep";
+                return -1;
+            }
+            ps->p++;
+            if (ps->end - ps->p >= 2 && ps->p[0] == '?' && ps->p[1] == ':')
+                ps->p += 2;
+            int n = ko_re_parse_alt(ps);
+            if (n < 0)
+                return -1;
+            if (ps->p == ps->end || *ps->p != ')') {
+                ps->err = "missing )";
+                return -1;
+            }
+            ps->p++;
+            ps->depth--;
+            return n;
+        }
+        case '[':
+            return ko_re_bracket(ps);
+        case '.': {
+            ps->p++;
+            ko_reclass* cls;
+            int n = ko_re_class(ps, &cls);
+            for (int i = 0; i < 128; i++)
+                if (i != '\n')
+                    ko_class_set(cls, i);
+            return ko_re_alt(ps, n, ko_re_nonascii(ps));
+        }
+        case '^':
+            ps->p++;
+            return ko_re_node(ps, KO_RE_BOL, -1, -1);
+        case '$':
+            ps->p++;
+            return ko_re_node(ps, KO_RE_EOL, -1, -1);
+        case '*': case '+': case '?':
+            ps->err = "nothing to repeat";
+            return -1;
+        case '\\': {
+            if (ps->p + 1 == ps->end) {
+                ps->err = "trailing \\";
+                return -1;
+            }
+            ps->p++;
+            ko_reclass named = { { 0 } };
+            if (ko_re_named(&named, *ps->p)) {
+                int upper = *ps->p++ < 'a';
+                ko_reclass* cls;
+                int n = ko_re_class(ps, &cls);
+                for (int i = 0; i < 128; i++)
+                    if (ko_class_has(&named, i) != upper)
+                        ko_class_set(cls, i);
+                return upper ? ko_re_alt(ps, n, ko_re_nonascii(ps)) : n;
+            }
+            int e = ko_re_escape(ps);
+            if (e < 0)
+                return -1;
+            unsigned char b = e;
+            return ko_re_literal(ps, &b, 1);
+        }
+    }
+
+    size_t n = ko_re_charlen(ps);
+    int node = ko_re_literal(ps, ps->p, n);
+    ps->p += n;
+    return node;
+}
+
+// reads {m}, {m,} or {m,n}; returns 0 (and reads nothing) if it isn't one, so the { is a literal
+static int ko_re_braces(ko_reparse* ps, int* min, int* max) {
+    const unsigned char* p = ps->p + 1;
+    long m = 0, n;
+    int digits = 0;
+
+    while (p < ps->end && *p >= '0' && *p <= '9' && m <= KO_RE_MAX_REPEAT)
+        m = m * 10 + (*p++ - '0'), digits++;
+    if (!digits)
+        return 0;
+
+    n = m;
+    if (p < ps->end && *p == ',') {
+        p++;
+        if (p < ps->end && *p >= '0' && *p <= '9') {
+            n = 0;
+            while (p < ps->end && *p >= '0' && *p <= '9' && n <= KO_RE_MAX_REPEAT)
+                n = n * 10 + (*p++ - '0');
+        }
+        else {
+            n = KO_RE_INF;
+        }
+    }
+    if (p == ps->end || *p != '}')
+        return 0;
+
+    ps->p = p + 1;
+    *min = (int)m;
+    *max = (int)n;
+    return 1;
+}
+
+static int ko_re_repeat(ko_reparse* ps) {
+    int node = ko_re_atom(ps);
+
+    while (node >= 0 && ps->p < ps->end) {
+        int min, max;
+        unsigned char c = *ps->p;
+        if (c == '*') { min = 0; max = KO_RE_INF; ps->p++; }
+        else if (c == '+') { min = 1; max = KO_RE_INF; ps->p++; }
+        else if (c == '?') { min = 0; max = 1; ps->p++; }
+        else if (c == '{' && ko_re_braces(ps, &min, &max)) {
+            if (min > KO_RE_MAX_REPEAT || max > KO_RE_MAX_REPEAT) {
+                ps->err = "repeat count too big";
+                return -1;
+            }
+            if (max != KO_RE_INF && max < min) {
+                ps->err = "repeat counts out of order";
+                return -1;
+            }
+        }
+        else break;
+
+        int greedy = 1;
+        if (ps->p < ps->end && *ps->p == '?') {
+            greedy = 0;
+            ps->p++;
+        }
+
+        node = ko_re_node(ps, KO_RE_REPEAT, node, -1);
+        ps->nodes[node].min = min;
+        ps->nodes[node].max = max;
+        ps->nodes[node].greedy = greedy;
+    }
+    return node;
+}
+
+static int ko_re_parse_cat(ko_reparse* ps) {
+    int node = -1;
+    while (ps->p < ps->end && *ps->p != '|' && *ps->p != ')') {
+        int n = ko_re_repeat(ps);
+        if (n < 0)
+            return -1;
+        node = ko_re_cat(ps, node, n);
+    }
+    return node < 0 ? ko_re_node(ps, KO_RE_EMPTY, -1, -1) : node;
+}
+
+static int ko_re_parse_alt(ko_reparse* ps) {
+    int node = ko_re_parse_cat(ps);
+    while (node >= 0 && ps->p < ps->end && *ps->p == '|') {
+        ps->p++;
+        int n = ko_re_parse_cat(ps);
+        if (n < 0)
+            return -1;
+        node = ko_re_node(ps, KO_RE_ALT, node, n);
+    }
+    return node;
+}
+
+// ---- compiling the tree into an NFA
+
+enum { KO_OP_BYTE, KO_OP_SPLIT, KO_OP_MATCH, KO_OP_BOL, KO_OP_EOL };
+
+// BYTE goes to x if the byte's in cls; SPLIT goes to x, or failing that y;
+// BOL and EOL go to x if they're at the start/end of a line
+typedef struct ko_reinst {
+    uint32_t op;
+    uint32_t x, y;
+    uint32_t cls;
+} ko_reinst;
+
+typedef struct ko_reprog {
+    ko_reinst* insts;
+    uint32_t n, cap;
+    uint32_t start;
+} ko_reprog;
+
+static uint32_t ko_prog_emit(ko_reprog* prog, uint32_t op, uint32_t x, uint32_t y, uint32_t cls) {
+    if (prog->n == prog->cap) {
+        prog->cap = prog->cap ? prog->cap * 2 : 64;
+        prog->insts = realloc(prog->insts, prog->cap * sizeof(ko_reinst));
+    }
+    prog->insts[prog->n] = (ko_reinst){ op, x, y, cls };
+    return prog->n++;
+}
+
+// compiles node so that it carries on to next, and returns where it starts.
+// building back to front like this means every jump's target is known when it's emitted.
+// reversed, it matches the same text backwards.
+static uint32_t ko_re_compile(ko_reparse* ps, ko_reprog* prog, int node, uint32_t next, int reversed) {
+    if (prog->n > KO_RE_MAX_PROG) {
+        ps->err = "pattern too big";
+        return next;
+    }
+
+    const ko_renode* n = &ps->nodes[node];
+    switch (n->type) {
+        case KO_RE_CLASS:
+            return ko_prog_emit(prog, KO_OP_BYTE, next, 0, n->cls);
+        case KO_RE_CAT:
+            if (reversed)
+                return ko_re_compile(ps, prog, n->b, ko_re_compile(ps, prog, n->a, next, reversed), reversed);
+            return ko_re_compile(ps, prog, n->a, ko_re_compile(ps, prog, n->b, next, reversed), reversed);
+        case KO_RE_ALT: {
+            uint32_t a = ko_re_compile(ps, prog, n->a, next, reversed);
+            uint32_t b = ko_re_compile(ps, prog, n->b, next, reversed);
+            return ko_prog_emit(prog, KO_OP_SPLIT, a, b, 0);
+        }
+        case KO_RE_REPEAT: {
+            int a = n->a, min = n->min, max = n->max, greedy = n->greedy;
+            uint32_t t = next;
+
+            if (max == KO_RE_INF) {
+                uint32_t loop = ko_prog_emit(prog, KO_OP_SPLIT, 0, 0, 0);
+                uint32_t body = ko_re_compile(ps, prog, a, loop, reversed);
+                prog->insts[loop].x = greedy ? body : next;
+                prog->insts[loop].y = greedy ? next : body;
+                t = loop;
+            }
+            else {
+                // a{0,2} is (a(a)?)?
+                for (int i = 0; i < max - min && !ps->err; i++) {
+                    uint32_t body = ko_re_compile(ps, prog, a, t, reversed);
+                    t = greedy ? ko_prog_emit(prog, KO_OP_SPLIT, body, next, 0) : ko_prog_emit(prog, KO_OP_SPLIT, next, body, 0);
+                }
+            }
+
+            for (int i = 0; i < min && !ps->err; i++)
+                t = ko_re_compile(ps, prog, a, t, reversed);
+            return t;
+        }
+        case KO_RE_BOL:
+            return ko_prog_emit(prog, reversed ? KO_OP_EOL : KO_OP_BOL, next, 0, 0);
+        case KO_RE_EOL:
+            return ko_prog_emit(prog, reversed ? KO_OP_BOL : KO_OP_EOL, next, 0, 0);
+    }
+    return next;
+}
+
+// ---- running it as a DFA
+
+// how many DFA states a search can have before the cache is emptied (at most)
+#define KO_DFA_STATES 1024
+
+#define KO_DFA_DEAD 0
+
+typedef struct ko_dstate {
+    int32_t next[256];          // -1 until the transition's worked out
+    size_t at;                  // its NFA states, in the pool, in order of preference
+    uint32_t n;
+    uint32_t hash;
+    uint8_t bol;                // the byte before it was a newline (or there wasn't one)
+    uint8_t match[2];           // a match ends before the next byte, if it isn't/is a newline (or there isn't one)
+    uint8_t idle;               // nothing's under way: it's just waiting for a match to start
+} ko_dstate;
+
+typedef struct ko_dfa {
+    const ko_reprog* prog;
+    const ko_reclass* classes;
+    int leftmost;               // finding the end of the leftmost match, rather than the longest
+
+    ko_dstate* states;
+    uint32_t nstates, cap;
+    uint32_t limit;             // emptied when it gets to this many
+    size_t resets;
+    uint32_t* pool;
+    size_t npool, poolcap;
+    int32_t* table;             // hash -> state, open addressed
+    uint32_t tablesize;
+
+    // scratch for working out a transition
+    uint32_t* stack;
+    uint32_t* list;
+    uint32_t* pending;
+    uint32_t* mark;
+    uint32_t gen;
+} ko_dfa;
+
+// the NFA state standing for "a match could start here": only there while
+// looking for the leftmost match and none has been seen yet
+#define KO_DFA_START(d) ((d)->prog->n)
+
+static void ko_dfa_visit(ko_dfa* d) {
+    if (++d->gen == 0) {
+        memset(d->mark, 0, (d->prog->n + 1) * sizeof(uint32_t));
+        d->gen = 1;
+    }
+}
+
+// follows the splits and assertions from the NFA states in in, in order of
+// preference, into the BYTE states they get to. sets *matched if one gets to
+// a match; looking for the leftmost match, nothing less preferred counts after that.
+static uint32_t ko_dfa_closure(ko_dfa* d, const uint32_t* in, uint32_t nin, int bol, int eol, uint32_t* out, int* matched, int* started) {
+    const ko_reinst* insts = d->prog->insts;
+    uint32_t nout = 0, sp = 0;
+    *matched = 0;
+    if (started) *started = 0;
+
+    ko_dfa_visit(d);
+    for (uint32_t i = 0; i < nin; i++) {
+        d->stack[sp++] = in[i];
+        while (sp) {
+            uint32_t pc = d->stack[--sp];
+            if (d->mark[pc] == d->gen)
+                continue;
+            d->mark[pc] = d->gen;
+
+            if (pc == KO_DFA_START(d)) {
+                if (started) *started = 1;
+                d->stack[sp++] = d->prog->start;
+                continue;
+            }
+
+            const ko_reinst* inst = &insts[pc];
+            switch (inst->op) {
+                case KO_OP_BYTE:
+                    out[nout++] = pc;
+                    break;
+                case KO_OP_MATCH:
+                    *matched = 1;
+                    if (d->leftmost)
+                        return nout;
+                    break;
+                case KO_OP_SPLIT:
+                    d->stack[sp++] = inst->y;
+                    d->stack[sp++] = inst->x;
+                    break;
+                case KO_OP_BOL:
+                    if (bol) d->stack[sp++] = inst->x;
+                    break;
+                case KO_OP_EOL:
+                    if (eol) d->stack[sp++] = inst->x;
+                    break;
+            }
+        }
+    }
+    return nout;
+}
+
+static void ko_dfa_reset(ko_dfa* d) {
+    d->nstates = 1;
+    d->npool = 0;
+    memset(d->table, 0xFF, d->tablesize * sizeof(int32_t));
+
+    ko_dstate* dead = &d->states[KO_DFA_DEAD];
+    memset(dead->next, 0, sizeof(dead->next));
+    dead->at = dead->n = 0;
+    dead->bol = dead->match[0] = dead->match[1] = 0;
+}
+
+static void ko_dfa_init(ko_dfa* d, const ko_reprog* prog, const ko_reclass* classes, int leftmost) {
+    memset(d, 0, sizeof(ko_dfa));
+    d->prog = prog;
+    d->classes = classes;
+    d->leftmost = leftmost;
+
+    d->cap = 16;
+    d->states = malloc(d->cap * sizeof(ko_dstate));
+    d->limit = KO_DFA_STATES;
+    d->tablesize = 2 * KO_DFA_STATES;
+    d->table = malloc(d->tablesize * sizeof(int32_t));
+
+    uint32_t n = prog->n + 1;
+    d->stack = malloc(3 * (n + 1) * sizeof(uint32_t));
+    d->list = malloc(n * sizeof(uint32_t));
+    d->pending = malloc(n * sizeof(uint32_t));
+    d->mark = calloc(n, sizeof(uint32_t));
+
+    ko_dfa_reset(d);
+}
+
+static void ko_dfa_free(ko_dfa* d) {
+    free(d->states);
+    free(d->pool);
+    free(d->table);
+    free(d->stack);
+    free(d->list);
+    free(d->pending);
+    free(d->mark);
+}
+
+// the state for these NFA states, made if it's new (which can empty the cache first)
+static uint32_t ko_dfa_state(ko_dfa* d, const uint32_t* pcs, uint32_t n, int bol) {
+    if (!n)
+        return KO_DFA_DEAD;
+
+    uint32_t h = 2166136261u ^ (uint32_t)bol;
+    for (uint32_t i = 0; i < n; i++)
+        h = (h ^ pcs[i]) * 16777619u;
+
+    uint32_t mask = d->tablesize - 1;
+    for (uint32_t i = h & mask; d->table[i] >= 0; i = (i + 1) & mask) {
+        const ko_dstate* s = &d->states[d->table[i]];
+        if (s->hash == h && s->n == n && s->bol == bol && !memcmp(d->pool + s->at, pcs, n * sizeof(uint32_t)))
+            return d->table[i];
+    }
+
+    if (d->nstates >= d->limit) {
+        ko_dfa_reset(d);
+        d->resets++;
+    }
+    else if (d->nstates == d->cap) {
+        d->cap *= 2;
+        d->states = realloc(d->states, d->cap * sizeof(ko_dstate));
+    }
+
+    if (d->npool + n > d->poolcap) {
+        d->poolcap = (d->npool + n) * 2;
+        d->pool = realloc(d->pool, d->poolcap * sizeof(uint32_t));
+    }
+    memcpy(d->pool + d->npool, pcs, n * sizeof(uint32_t));
+
+    uint32_t idx = d->nstates++;
+    ko_dstate* s = &d->states[idx];
+    memset(s->next, 0xFF, sizeof(s->next));
+    s->at = d->npool;
+    s->n = n;
+    s->hash = h;
+    s->bol = bol;
+    s->idle = d->leftmost && n == 1 && pcs[0] == KO_DFA_START(d);
+    d->npool += n;
+
+    int matched;
+    ko_dfa_closure(d, d->pool + s->at, n, bol, 0, d->list, &matched, NULL);
+    s->match[0] = matched;
+    ko_dfa_closure(d, d->pool + s->at, n, bol, 1, d->list, &matched, NULL);
+    s->match[1] = matched;
+
+    uint32_t i = h & mask;
+    while (d->table[i] >= 0)
+        i = (i + 1) & mask;
+    d->table[i] = idx;
+    return idx;
+}
+
+// works out (and remembers) where state s goes on byte c
+static uint32_t ko_dfa_step(ko_dfa* d, uint32_t s, unsigned char c) {
+    const ko_reinst* insts = d->prog->insts;
+    int matched, started;
+
+    uint32_t n = ko_dfa_closure(d, d->pool + d->states[s].at, d->states[s].n, d->states[s].bol, c == '\n', d->list, &matched, &started);
+
+    uint32_t np = 0;
+    ko_dfa_visit(d);
+    for (uint32_t i = 0; i < n; i++) {
+        const ko_reinst* inst = &insts[d->list[i]];
+        if (ko_class_has(&d->classes[inst->cls], c) && d->mark[inst->x] != d->gen) {
+            d->mark[inst->x] = d->gen;
+            d->pending[np++] = inst->x;
+        }
+    }
+
+    // until there's a match, one could start at the next byte too, least preferred
+    if (started && !matched)
+        d->pending[np++] = KO_DFA_START(d);
+
+    size_t resets = d->resets;
+    uint32_t next = ko_dfa_state(d, d->pending, np, c == '\n');
+
+    // unless that emptied the cache, s is still there
+    if (d->resets == resets)
+        d->states[s].next[c] = next;
+    return next;
+}
+
+// ---- searching
+
+struct ko_regex {
+    ko_reclass* classes;
+    ko_reprog forward, backward;
+    ko_dfa fdfa, bdfa;
+
+    // the bytes a match can start with, so the forward pass can skip the
+    // rest with a plain loop (or memchr, if there's just one); NULL if a
+    // match can be empty, or start with almost anything
+    uint8_t* first;
+    int only;
+};
+
+ko_regex* ko_regex_new(const char* pattern, size_t len, int flags, const char** err) {
+    ko_reparse ps = { 0 };
+    ps.p = (const unsigned char*)pattern;
+    ps.end = ps.p + len;
+    ps.icase = (flags & KO_REGEX_ICASE) != 0;
+
+    int root = ko_re_parse_alt(&ps);
+    if (!ps.err && ps.p < ps.end)
+        ps.err = "unmatched )";
+
+    ko_regex* re = NULL;
+    if (!ps.err) {
+        re = calloc(1, sizeof(ko_regex));
+
+        uint32_t match = ko_prog_emit(&re->forward, KO_OP_MATCH, 0, 0, 0);
+        re->forward.start = ko_re_compile(&ps, &re->forward, root, match, 0);
+        match = ko_prog_emit(&re->backward, KO_OP_MATCH, 0, 0, 0);
+        re->backward.start = ko_re_compile(&ps, &re->backward, root, match, 1);
+
+        if (ps.err) {
+            free(re->forward.insts);
+            free(re->backward.insts);
+            free(re);
+            re = NULL;
+        }
+    }
+
+    free(ps.nodes);
+    if (!re) {
+        free(ps.classes);
+        *err = ps.err;
+        return NULL;
+    }
+
+    re->classes = ps.classes;
+    ko_dfa_init(&re->fdfa, &re->forward, re->classes, 1);
+    ko_dfa_init(&re->bdfa, &re->backward, re->classes, 0);
+
+    int matched;
+    uint32_t n = ko_dfa_closure(&re->fdfa, &re->forward.start, 1, 1, 1, re->fdfa.list, &matched, NULL);
+    if (!matched) {
+        re->first = calloc(256, 1);
+        for (uint32_t i = 0; i < n; i++) {
+            const ko_reclass* c = &re->classes[re->forward.insts[re->fdfa.list[i]].cls];
+            for (int byte = 0; byte < 256; byte++)
+                re->first[byte] |= ko_class_has(c, byte);
+        }
+
+        int count = 0;
+        for (int byte = 0; byte < 256; byte++)
+            if (re->first[byte])
+                re->only = byte, count++;
+        if (count != 1)
+            re->only = -1;
+        if (count > 128) {
+            free(re->first);
+            re->first = NULL;
+        }
+    }
+    return re;
+}
+
+void ko_regex_free(ko_regex* re) {
+    if (!re) return;
+    ko_dfa_free(&re->fdfa);
+    ko_dfa_free(&re->bdfa);
+    free(re->forward.insts);
+    free(re->backward.insts);
+    free(re->classes);
+    free(re->first);
+    free(re);
+}
+
+// the text being searched: a buffer or a string
+typedef struct ko_retext {
+    const ko_buffer* b;
+    const char* s;
+    size_t len;
+} ko_retext;
+
+static int ko_retext_nl(const ko_retext* t, size_t i) {
+    char c;
+    if (t->b)
+        ko_buffer_copy(t->b, i, 1, &c);
+    else
+        c = t->s[i];
+    return c == '\n';
+}
+
+#define KO_REGEX_NONE ((size_t)-1)
+
+typedef struct ko_rerun {
+    ko_dfa* d;
+    uint32_t s;
+    size_t at;                  // where the next byte is (going backwards: the one before it)
+    size_t found;               // where the last match seen ended (or started)
+    const ko_regex* skip;       // going forwards: skips what can't start a match
+} ko_rerun;
+
+// the first byte in p[i, n) a match could start with (or n)
+static size_t ko_rerun_skip(const ko_regex* re, const unsigned char* p, size_t i, size_t n) {
+    if (re->only >= 0) {
+        const unsigned char* q = memchr(p + i, re->only, n - i);
+        return q ? (size_t)(q - p) : n;
+    }
+    while (i < n && !re->first[p[i]])
+        i++;
+    return i;
+}
+
+static int ko_rerun_forward(void* ctx, const char* bytes, size_t n) {
+    ko_rerun* r = ctx;
+    ko_dfa* d = r->d;
+    const unsigned char* p = (const unsigned char*)bytes;
+    uint32_t s = r->s;
+
+    for (size_t i = 0; i < n; i++) {
+        if (r->skip && d->states[s].idle) {
+            size_t j = ko_rerun_skip(r->skip, p, i, n);
+            if (j > i) {
+                // nothing started in those, so only whether the last was a newline matters
+                int bol = p[j - 1] == '\n';
+                if (d->states[s].bol != bol) {
+                    uint32_t start = KO_DFA_START(d);
+                    s = ko_dfa_state(d, &start, 1, bol);
+                }
+                if ((i = j) == n)
+                    break;
+            }
+        }
+
+        const ko_dstate* st = &d->states[s];
+        unsigned char c = p[i];
+        if (st->match[c == '\n'])
+            r->found = r->at + i;
+        int32_t next = st->next[c];
+        s = next >= 0 ? (uint32_t)next : ko_dfa_step(d, s, c);
+        if (s == KO_DFA_DEAD) {
+            r->s = s;
+            return 0;
+        }
+    }
+
+    r->s = s;
+    r->at += n;
+    return 1;
+}
+
+static int ko_rerun_backward(void* ctx, const char* bytes, size_t n) {
+    ko_rerun* r = ctx;
+    ko_dfa* d = r->d;
+    const unsigned char* p = (const unsigned char*)bytes;
+    uint32_t s = r->s;
+
+    for (size_t i = n; i-- > 0; r->at--) {
+        const ko_dstate* st = &d->states[s];
+        unsigned char c = p[i];
+        if (st->match[c == '\n'])
+            r->found = r->at;
+        int32_t next = st->next[c];
+        s = next >= 0 ? (uint32_t)next : ko_dfa_step(d, s, c);
+        if (s == KO_DFA_DEAD) {
+            r->s = s;
+            return 0;
+        }
+    }
+
+    r->s = s;
+    return 1;
+}
+
+static int ko_regex_search(ko_regex* re, const ko_retext* t, size_t pos, size_t* start, size_t* end) {
+    if (pos > t->len)
+        return 0;
+    int bol = pos == 0 || ko_retext_nl(t, pos - 1);
+
+    // forwards, for where the leftmost match ends
+    uint32_t begin = KO_DFA_START(&re->fdfa);
+    ko_rerun r = { &re->fdfa, 0, pos, KO_REGEX_NONE, re->first ? re : NULL };
+    r.s = ko_dfa_state(&re->fdfa, &begin, 1, bol);
+    if (t->b)
+        ko_buffer_spans(t->b, pos, t->len - pos, ko_rerun_forward, &r);
+    else if (pos < t->len)
+        ko_rerun_forward(&r, t->s + pos, t->len - pos);
+    if (r.s != KO_DFA_DEAD && re->fdfa.states[r.s].match[1])
+        r.found = t->len;
+    if (r.found == KO_REGEX_NONE)
+        return 0;
+
+    // then backwards from there, for the furthest back any match ending there starts
+    size_t e = r.found;
+    ko_rerun back = { &re->bdfa, 0, e, KO_REGEX_NONE, NULL };
+    back.s = ko_dfa_state(&re->bdfa, &re->backward.start, 1, e == t->len || ko_retext_nl(t, e));
+    if (t->b)
+        ko_buffer_rspans(t->b, pos, e - pos, ko_rerun_backward, &back);
+    else if (pos < e)
+        ko_rerun_backward(&back, t->s + pos, e - pos);
+    if (back.s != KO_DFA_DEAD && re->bdfa.states[back.s].match[bol])
+        back.found = pos;
+
+    *start = back.found != KO_REGEX_NONE ? back.found : e;
+    *end = e;
+    return 1;
+}
+
+int ko_regex_find(ko_regex* re, const ko_buffer* b, size_t pos, size_t* start, size_t* end) {
+    ko_retext t = { b, NULL, ko_buffer_length(b) };
+    return ko_regex_search(re, &t, pos, start, end);
+}
+
+int ko_regex_find_string(ko_regex* re, const char* s, size_t len, size_t pos, size_t* start, size_t* end) {
+    ko_retext t = { NULL, s, len };
+    return ko_regex_search(re, &t, pos, start, end);
+}
+
+void ko_regex_setcache(ko_regex* re, size_t states) {
+    uint32_t limit = states < 2 ? 2 : states > KO_DFA_STATES ? KO_DFA_STATES : (uint32_t)states;
+    re->fdfa.limit = re->bdfa.limit = limit;
+}
+
+ko_regex_stats ko_regex_getstats(const ko_regex* re) {
+    return (ko_regex_stats){ re->fdfa.nstates + re->bdfa.nstates, re->fdfa.resets + re->bdfa.resets };
+}
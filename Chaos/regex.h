@@ -0,0 +1,50 @@
+#ifndef KO_REGEX_H
+#define KO_REGEX_H
+
+#include "buffer.h"
+
+// Regular expressions, compiled once into an NFA and run as a DFA that's
+// built lazily as the text calls for it: a DFA state is a set of NFA states,
+// worked out the first time it's reached, and its transitions are filled in
+// the first time they're taken. So a search looks at each byte once and
+// never backtracks, whatever the pattern. The states are kept in a cache of
+// bounded size, which is emptied and started over when a search fills it.
+//
+// A search goes forwards to find where the leftmost match ends (with | and
+// the quantifiers preferring what Perl's would), then backwards from there
+// over the reversed pattern to find where it starts. Both read straight from
+// the buffer's pieces. Until something's under way, the forward pass skips
+// bytes no match can start with without going through the DFA at all.
+//
+// Syntax: literals, ., [...] and [^...] with ASCII ranges, \d \w \s and
+// their negations, \n \t \r \f \v \xHH, escaped punctuation, ^ and $ (at line
+// breaks too), (...) and (?:...), |, and * + ? {m} {m,} {m,n}, each with a
+// trailing ? to be lazy. There are no captures or backreferences. Where a
+// loop's body can match nothing, which match it prefers can differ from
+// Perl. The text is taken to be UTF-8: . and negated classes match whole
+// characters.
+
+#define KO_REGEX_ICASE 1
+
+typedef struct ko_regex ko_regex;
+
+// returns NULL and points err at a message if the pattern is no good
+ko_regex* ko_regex_new(const char* pattern, size_t len, int flags, const char** err);
+void ko_regex_free(ko_regex* re);
+
+// the leftmost match starting at or after pos, as [start, end); returns 0 if there isn't one
+int ko_regex_find(ko_regex* re, const ko_buffer* b, size_t pos, size_t* start, size_t* end);
+int ko_regex_find_string(ko_regex* re, const char* s, size_t len, size_t pos, size_t* start, size_t* end);
+
+// how many DFA states each direction's cache holds before it's emptied: 1024,
+// unless this lowers it (to as few as 2). only matters for speed.
+void ko_regex_setcache(ko_regex* re, size_t states);
+
+typedef struct ko_regex_stats {
+    size_t states;              // in the caches now
+    size_t resets;              // times a cache has been emptied
+} ko_regex_stats;
+
+ko_regex_stats ko_regex_getstats(const ko_regex* re);
+
+#endif
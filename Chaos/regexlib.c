@@ -0,0 +1,101 @@
+// The `regex` Lua module: compiled regular expressions (regex.c) as a
+// userdata, searching strings or buffers. Positions are 1-based, like string.find.
+
+#include "lua/lua.h"
+#include "lua/lauxlib.h"
+#include "bufferlib.h"
+#include "regex.h"
+
+#define KO_REGEX_META "chaos.regex"
+
+// args: [pattern, icase = false]
+// returns: [re] or [nil, err]
+static int regex_new(lua_State *L) {
+    size_t len;
+    const char* pattern = luaL_checklstring(L, 1, &len);
+    int icase = lua_toboolean(L, 2);
+    
+    const char* err;
+    ko_regex* re = ko_regex_new(pattern, len, icase ? KO_REGEX_ICASE : 0, &err);
+    if (!re) {
+        lua_pushnil(L);
+        lua_pushstring(L, err);
+        return 2;
+    }
+    
+    ko_regex** ud = lua_newuserdata(L, sizeof(ko_regex*));   // [pattern, icase, re]
+    *ud = re;
+    luaL_setmetatable(L, KO_REGEX_META);
+    return 1;
+}
+
+// args: [re, subject, init = 1]
+// returns: [start, end] or [nil]
+// the leftmost match in subject (a string or a buffer) from init on
+static int regex_find(lua_State *L) {
+    ko_regex* re = *(ko_regex**)luaL_checkudata(L, 1, KO_REGEX_META);
+    lua_Integer init = luaL_optinteger(L, 3, 1);
+    
+    ko_buffer* b = NULL;
+    const char* s = NULL;
+    size_t len;
+    if (lua_type(L, 2) == LUA_TSTRING) {
+        s = lua_tolstring(L, 2, &len);
+    }
+    else {
+        b = ko_checkbuffer(L, 2);
+        len = ko_buffer_length(b);
+    }
+    
+    // string.find's rules for init
+    if (init < 0) init = (size_t)-init > len ? 1 : (lua_Integer)len + init + 1;
+    if (init < 1) init = 1;
+    if ((size_t)init > len + 1) {
+        lua_pushnil(L);
+        return 1;
+    }
+    
+    size_t start, end;
+    int found = b ? ko_regex_find(re, b, init - 1, &start, &end)
+                  : ko_regex_find_string(re, s, len, init - 1, &start, &end);
+    if (!found) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_pushinteger(L, start + 1);
+    lua_pushinteger(L, end);
+    return 2;
+}
+
+static int regex_gc(lua_State *L) {
+    ko_regex** ud = luaL_checkudata(L, 1, KO_REGEX_META);
+    ko_regex_free(*ud);
+    *ud = NULL;
+    return 0;
+}
+
+static const luaL_Reg regexlib_instance[] = {
+    {"find", regex_find},
+    {NULL, NULL}
+};
+
+static const luaL_Reg regexlib_meta[] = {
+    {"__gc", regex_gc},
+    {NULL, NULL}
+};
+
+static const luaL_Reg regexlib[] = {
+    {"new", regex_new},
+    {NULL, NULL}
+};
+
+int luaopen_regex(lua_State* L) {
+    luaL_newmetatable(L, KO_REGEX_META);              // [meta]
+    luaL_setfuncs(L, regexlib_meta, 0);               // [meta]
+    luaL_newlib(L, regexlib_instance);                // [meta, methods]
+    lua_setfield(L, -2, "__index");                   // [meta]
+    lua_pop(L, 1);                                    // []
+    
+    luaL_newlib(L, regexlib);
+    return 1;
+}
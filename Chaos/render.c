@@ -0,0 +1,228 @@
+#include "render.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// lays out one line's codepoints into display columns, writing the ones in
+// [left, left + w) into cells (if there are any)
+typedef struct ko_render_row {
+    ko_cell* cells;
+    int w;
+    size_t left;
+    size_t col;
+    int tabwidth;
+    ko_color fg, bg;
+    unsigned char carry[4];     // a UTF-8 sequence cut off at the end of a piece
+    int ncarry;
+
+    // the line's style runs, if it's highlighted: the one the next byte is in, and what's left of it
+    const ko_render_style* style;
+    const ko_hlrun* runs;
+    size_t nruns, run, left_in_run;
+    ko_color plain;
+} ko_render_row;
+
+// colors the next character, which is n bytes long, by the run it starts in
+static void ko_render_runs(ko_render_row* r, size_t n) {
+    while (r->left_in_run == 0 && r->run < r->nruns) {
+        const ko_hlrun* run = &r->runs[r->run++];
+        r->left_in_run = run->len;
+        r->fg = run->style < r->style->ncolors && r->style->colors[run->style] != KO_RENDER_PLAIN ? r->style->colors[run->style] : r->plain;
+    }
+
+    // one that straddles runs takes up the rest of the ones it's in
+    while (n) {
+        size_t k = n < r->left_in_run ? n : r->left_in_run;
+        r->left_in_run -= k;
+        n -= k;
+        if (n == 0 || r->run == r->nruns)
+            break;
+        r->left_in_run = r->runs[r->run++].len;
+    }
+}
+
+static void ko_render_cell(ko_render_row* r, uint32_t ch) {
+    if (r->cells && r->col >= r->left && r->col < r->left + r->w)
+        r->cells[r->col - r->left] = (ko_cell){ ch, r->fg, r->bg, 0 };
+    r->col++;
+}
+
+static void ko_render_char(ko_render_row* r, uint32_t ch) {
+    if (ch == '\t') {
+        size_t n = r->tabwidth - r->col % r->tabwidth;
+        while (n--)
+            ko_render_cell(r, ' ');
+    }
+    else if (ch < 0x20 || ch == 0x7F) {
+        ko_render_cell(r, '^');
+        ko_render_cell(r, ch ^ 0x40);
+    }
+    else {
+        ko_render_cell(r, ch);
+    }
+}
+
+static inline int ko_utf8_length(unsigned char c) {
+    if (c < 0x80) return 1;
+    if ((c & 0xE0) == 0xC0) return 2;
+    if ((c & 0xF0) == 0xE0) return 3;
+    if ((c & 0xF8) == 0xF0) return 4;
+    return 1;
+}
+
+static int ko_render_span(void* ctx, const char* bytes, size_t len) {
+    ko_render_row* r = ctx;
+    const unsigned char* s = (const unsigned char*)bytes;
+    size_t i = 0;
+
+    // finish the sequence the last piece cut off
+    if (r->ncarry) {
+        int need = ko_utf8_length(r->carry[0]);
+        while (r->ncarry < need && i < len && (s[i] & 0xC0) == 0x80)
+            r->carry[r->ncarry++] = s[i++];
+        if (r->ncarry < need && i == len)
+            return 1;
+
+        size_t k = 0;
+        if (r->runs) ko_render_runs(r, r->ncarry);
+        ko_render_char(r, ko_utf8_next((const char*)r->carry, r->ncarry, &k));
+        r->ncarry = 0;
+    }
+
+    while (i < len) {
+        if (r->cells && r->col >= r->left + r->w)
+            return 0;
+
+        if (s[i] < 0x80) {
+            if (r->runs) ko_render_runs(r, 1);
+            ko_render_char(r, s[i++]);
+            continue;
+        }
+
+        int need = ko_utf8_length(s[i]);
+        if (i + need > len) {
+            for (; i < len; i++)
+                r->carry[r->ncarry++] = s[i];
+            return 1;
+        }
+        size_t at = i;
+        uint32_t ch = ko_utf8_next(bytes, len, &i);
+        if (r->runs) ko_render_runs(r, i - at);
+        ko_render_char(r, ch);
+    }
+
+    return !r->cells || r->col < r->left + r->w;
+}
+
+// a truncated sequence at the very end of the line
+static void ko_render_flush(ko_render_row* r) {
+    if (r->ncarry) {
+        ko_render_char(r, 0xFFFD);
+        r->ncarry = 0;
+    }
+}
+
+void ko_render_text(const ko_pane* p, const ko_buffer* b, size_t top, size_t left, int tabwidth,
+                    ko_color fg, ko_color bg, int y0, int y1, const ko_render_style* style) {
+    if (y0 < 0) y0 = 0;
+    if (y1 >= p->h) y1 = p->h - 1;
+    if (p->w <= 0 || y0 > y1)
+        return;
+    if (tabwidth < 1)
+        tabwidth = 1;
+
+    ko_cell* cells = malloc(p->w * sizeof(ko_cell));
+    size_t start, end;
+
+    for (int y = y0; y <= y1; y++) {
+        size_t line = top + y;
+        ko_render_row r = { cells, p->w, left, 0, tabwidth, fg, bg, {0}, 0, NULL, NULL, 0, 0, 0, fg };
+
+        for (int x = 0; x < p->w; x++)
+            cells[x] = (ko_cell){ ' ', fg, bg, 0 };
+
+        if (style && style->h) {
+            r.style = style;
+            r.nruns = ko_highlight_line(style->h, line, &r.runs);
+        }
+
+        if (ko_buffer_line_range(b, line, &start, &end)) {
+            ko_buffer_spans(b, start, end - start, ko_render_span, &r);
+            ko_render_flush(&r);
+        }
+
+        ko_pane_put(p, 0, y, cells, p->w);
+    }
+
+    free(cells);
+}
+
+void ko_render_wrapped(const ko_pane* p, const ko_buffer* b, ko_wrap* w, size_t line, size_t sub,
+                       ko_color fg, ko_color bg, int y0, int y1, const ko_render_style* style) {
+    if (y0 < 0) y0 = 0;
+    if (y1 >= p->h) y1 = p->h - 1;
+    if (p->w <= 0 || y0 > y1)
+        return;
+
+    // walks down to the row y0 shows
+    int y = 0;
+    size_t rows = ko_wrap_rows(w, line);
+    if (sub >= rows)
+        sub = rows - 1;
+    while ((size_t)(y0 - y) >= rows - sub) {
+        y += rows - sub;
+        rows = ko_wrap_rows(w, ++line);
+        sub = 0;
+    }
+    sub += y0 - y;
+    y = y0;
+
+    size_t width = ko_wrap_width(w);
+    int tabwidth = ko_wrap_tabwidth(w);
+    int shown = width < (size_t)p->w ? (int)width : p->w;
+    ko_cell* cells = malloc((y1 - y0 + 1) * width * sizeof(ko_cell));
+    ko_cell* row = malloc(p->w * sizeof(ko_cell));
+    size_t start, end;
+
+    // each line is laid out once, for all its rows that show
+    while (y <= y1) {
+        int n = rows - sub < (size_t)(y1 - y + 1) ? (int)(rows - sub) : y1 - y + 1;
+        ko_render_row r = { cells, (int)(n * width), sub * width, 0, tabwidth, fg, bg, {0}, 0, NULL, NULL, 0, 0, 0, fg };
+
+        for (size_t x = 0; x < n * width; x++)
+            cells[x] = (ko_cell){ ' ', fg, bg, 0 };
+
+        if (style && style->h) {
+            r.style = style;
+            r.nruns = ko_highlight_line(style->h, line, &r.runs);
+        }
+
+        if (ko_buffer_line_range(b, line, &start, &end)) {
+            ko_buffer_spans(b, start, end - start, ko_render_span, &r);
+            ko_render_flush(&r);
+        }
+
+        for (int i = 0; i < n; i++) {
+            for (int x = shown; x < p->w; x++)
+                row[x] = (ko_cell){ ' ', fg, bg, 0 };
+            memcpy(row, cells + i * width, shown * sizeof(ko_cell));
+            ko_pane_put(p, 0, y + i, row, p->w);
+        }
+
+        y += n;
+        rows = ko_wrap_rows(w, ++line);
+        sub = 0;
+    }
+
+    free(cells);
+    free(row);
+}
+
+size_t ko_render_column(const ko_buffer* b, size_t pos, int tabwidth) {
+    ko_render_row r = { NULL, 0, 0, 0, tabwidth < 1 ? 1 : tabwidth, 0, 0, {0}, 0, NULL, NULL, 0, 0, 0, 0 };
+    size_t start = ko_buffer_line_offset(b, ko_buffer_offset_line(b, pos));
+
+    ko_buffer_spans(b, start, pos - start, ko_render_span, &r);
+    ko_render_flush(&r);
+    return r.col;
+}
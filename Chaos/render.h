@@ -0,0 +1,44 @@
+#ifndef KO_RENDER_H
+#define KO_RENDER_H
+
+#include <stddef.h>
+#include "buffer.h"
+#include "highlight.h"
+#include "pane.h"
+#include "wrap.h"
+
+// Draws a buffer's text into a pane, for exactly the rows being drawn.
+//
+// Row y shows line top + y, starting at display column left; lines don't
+// wrap, unless they're drawn with ko_render_wrapped. Each row costs one
+// O(log) line lookup and reads only as many bytes as it takes to get to the
+// pane's right edge, so a redraw costs about the same at line 1 of a small
+// file as at line 10,000,000 of a huge one.
+//
+// Tabs go to the next multiple of tabwidth, other control characters show
+// as ^X, and everything else takes one cell, like the grid.
+//
+// With a highlighter, each row's text is colored by its style runs: colors
+// has a color for each style, or KO_RENDER_PLAIN to leave it in fg. Only the
+// rows being drawn get lexed (plus whatever an edit changed above them).
+
+#define KO_RENDER_PLAIN ((ko_color)-1)
+
+typedef struct ko_render_style {
+    ko_highlight* h;
+    const ko_color* colors;     // by style
+    size_t ncolors;
+} ko_render_style;
+
+void ko_render_text(const ko_pane* p, const ko_buffer* b, size_t top, size_t left, int tabwidth,
+                    ko_color fg, ko_color bg, int y0, int y1, const ko_render_style* style);
+
+// the same, but soft-wrapped by w (and with its tab width): row 0 is row sub
+// of line, and each line after goes on as many rows as w says it takes
+void ko_render_wrapped(const ko_pane* p, const ko_buffer* b, ko_wrap* w, size_t line, size_t sub,
+                       ko_color fg, ko_color bg, int y0, int y1, const ko_render_style* style);
+
+// the display column pos ends up in, counted from the start of its line
+size_t ko_render_column(const ko_buffer* b, size_t pos, int tabwidth);
+
+#endif
@@ -0,0 +1,390 @@
+#include "search.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#define KO_SEARCH_NONE ((size_t)-1)
+
+// the first candidate start in [from, to) of p that really matches, or KO_SEARCH_NONE.
+// p has to have len - 1 readable bytes past to.
+typedef size_t (*ko_search_block_fn)(const ko_search* s, const unsigned char* p, size_t from, size_t to);
+
+struct ko_search {
+    unsigned char* needle;      // lowercased, if case is ignored
+    size_t len;
+    int icase;
+    unsigned char first, last;  // the needle's ends
+    unsigned char fmask, lmask; // or'd into a byte before comparing it with first/last: 0x20 for a letter whose case doesn't matter
+    unsigned char* window;      // the end of one piece and the start of the next, for matches across them
+    ko_search_block_fn block;
+};
+
+static inline unsigned char ko_fold(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+static inline int ko_search_match(const ko_search* s, const unsigned char* p) {
+    if (!s->icase)
+        return memcmp(p, s->needle, s->len) == 0;
+    for (size_t i = 0; i < s->len; i++)
+        if (ko_fold(p[i]) != s->needle[i])
+            return 0;
+    return 1;
+}
+
+static inline int ko_search_candidate(const ko_search* s, const unsigned char* p) {
+    return (p[0] | s->fmask) == s->first && (p[s->len - 1] | s->lmask) == s->last;
+}
+
+static size_t ko_search_scalar(const ko_search* s, const unsigned char* p, size_t from, size_t to) {
+    for (size_t i = from; i < to; i++)
+        if (ko_search_candidate(s, p + i) && ko_search_match(s, p + i))
+            return i;
+    return KO_SEARCH_NONE;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#ifdef __SSE2__
+static size_t ko_search_sse2(const ko_search* s, const unsigned char* p, size_t from, size_t to) {
+    const __m128i f = _mm_set1_epi8(s->first), l = _mm_set1_epi8(s->last);
+    const __m128i fm = _mm_set1_epi8(s->fmask), lm = _mm_set1_epi8(s->lmask);
+
+    size_t i = from;
+    for (; i + 16 <= to; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + i + s->len - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(a, fm), f),
+                                                        _mm_cmpeq_epi8(_mm_or_si128(b, lm), l)));
+        for (; mask; mask &= mask - 1) {
+            size_t j = i + __builtin_ctz(mask);
+            if (ko_search_match(s, p + j))
+                return j;
+        }
+    }
+    return ko_search_scalar(s, p, i, to);
+}
+#endif
+
+__attribute__((target("avx2")))
+static size_t ko_search_avx2(const ko_search* s, const unsigned char* p, size_t from, size_t to) {
+    const __m256i f = _mm256_set1_epi8(s->first), l = _mm256_set1_epi8(s->last);
+    const __m256i fm = _mm256_set1_epi8(s->fmask), lm = _mm256_set1_epi8(s->lmask);
+
+    size_t i = from;
+    for (; i + 32 <= to; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p + i + s->len - 1));
+        unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(_mm256_or_si256(a, fm), f),
+                                                              _mm256_cmpeq_epi8(_mm256_or_si256(b, lm), l)));
+        for (; mask; mask &= mask - 1) {
+            size_t j = i + __builtin_ctz(mask);
+            if (ko_search_match(s, p + j))
+                return j;
+        }
+    }
+    return ko_search_scalar(s, p, i, to);
+}
+
+#else
+
+// eight positions per word: a byte of x | y is zero where both ends match
+static size_t ko_search_swar(const ko_search* s, const unsigned char* p, size_t from, size_t to) {
+    const uint64_t ones = 0x0101010101010101ull, low = 0x7F7F7F7F7F7F7F7Full;
+    const uint64_t f = s->first * ones, l = s->last * ones;
+    const uint64_t fm = s->fmask * ones, lm = s->lmask * ones;
+
+    size_t i = from;
+    for (; i + 8 <= to; i += 8) {
+        uint64_t a, b;
+        memcpy(&a, p + i, 8);
+        memcpy(&b, p + i + s->len - 1, 8);
+        uint64_t z = ((a | fm) ^ f) | ((b | lm) ^ l);
+        uint64_t t = ((z & low) + low) | z;
+        if (~t & ~low) {
+            size_t j = ko_search_scalar(s, p, i, i + 8);
+            if (j != KO_SEARCH_NONE)
+                return j;
+        }
+    }
+    return ko_search_scalar(s, p, i, to);
+}
+
+#endif
+
+static ko_search_block_fn ko_search_pick(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2"))
+        return ko_search_avx2;
+#ifdef __SSE2__
+    return ko_search_sse2;
+#else
+    return ko_search_scalar;
+#endif
+#else
+    return ko_search_swar;
+#endif
+}
+
+ko_search* ko_search_new(const char* needle, size_t len, int flags) {
+    ko_search* s = calloc(1, sizeof(ko_search));
+    s->len = len;
+    s->icase = (flags & KO_SEARCH_ICASE) != 0;
+    s->needle = malloc(len ? len : 1);
+    s->window = malloc(len ? 2 * len : 1);
+    s->block = ko_search_pick();
+
+    for (size_t i = 0; i < len; i++)
+        s->needle[i] = s->icase ? ko_fold(needle[i]) : (unsigned char)needle[i];
+
+    if (len) {
+        s->first = s->needle[0];
+        s->last = s->needle[len - 1];
+        if (s->icase) {
+            s->fmask = s->first >= 'a' && s->first <= 'z' ? 0x20 : 0;
+            s->lmask = s->last >= 'a' && s->last <= 'z' ? 0x20 : 0;
+        }
+    }
+    return s;
+}
+
+void ko_search_free(ko_search* s) {
+    if (!s) return;
+    free(s->needle);
+    free(s->window);
+    free(s);
+}
+
+// goes through the pieces in order, keeping the last len - 1 bytes seen in the
+// window so a match that starts in one piece and ends in a later one is found too
+typedef struct ko_scan {
+    ko_search* s;
+    size_t off;                 // where the piece being looked at starts
+    size_t scanned;             // no match can start before this
+    size_t ntail;               // bytes at the start of the window
+    int counting;               // counting them all, rather than stopping at the first
+    size_t found, count;
+} ko_scan;
+
+// looks for matches starting in [from, to) of p, which starts at off
+static int ko_scan_block(ko_scan* sc, const unsigned char* p, size_t off, size_t from, size_t to) {
+    while (from < to) {
+        size_t i = sc->s->block(sc->s, p, from, to);
+        if (i == KO_SEARCH_NONE)
+            break;
+
+        sc->found = off + i;
+        sc->scanned = off + i + sc->s->len;
+        if (!sc->counting)
+            return 0;
+        sc->count++;
+        from = i + sc->s->len;
+    }
+    return 1;
+}
+
+static int ko_scan_span(void* ctx, const char* bytes, size_t n) {
+    ko_scan* sc = ctx;
+    ko_search* s = sc->s;
+    const unsigned char* p = (const unsigned char*)bytes;
+    size_t len = s->len;
+
+    // matches starting in the tail of what came before, finished in here
+    if (sc->ntail) {
+        size_t m = n < len - 1 ? n : len - 1;
+        memcpy(s->window + sc->ntail, p, m);
+
+        size_t start = sc->off - sc->ntail;
+        size_t from = sc->scanned > start ? sc->scanned - start : 0;
+        size_t to = sc->ntail + m >= len ? sc->ntail + m - len + 1 : 0;
+        if (to > sc->ntail)
+            to = sc->ntail;
+        if (!ko_scan_block(sc, s->window, start, from, to))
+            return 0;
+    }
+
+    // matches all in here
+    size_t from = sc->scanned > sc->off ? sc->scanned - sc->off : 0;
+    size_t to = n >= len ? n - len + 1 : 0;
+    if (!ko_scan_block(sc, p, sc->off, from, to))
+        return 0;
+
+    // anything starting before the last len - 1 bytes has been looked at
+    if (sc->off + n + 1 > len && sc->scanned < sc->off + n + 1 - len)
+        sc->scanned = sc->off + n + 1 - len;
+
+    // and those bytes are the next tail
+    size_t keep = sc->ntail + n < len - 1 ? sc->ntail + n : len - 1;
+    if (n >= keep) {
+        memcpy(s->window, p + n - keep, keep);
+    }
+    else {
+        memmove(s->window, s->window + sc->ntail - (keep - n), keep - n);
+        memcpy(s->window + keep - n, p, n);
+    }
+    sc->ntail = keep;
+    sc->off += n;
+    return 1;
+}
+
+static void ko_scan_run(ko_scan* sc, const ko_buffer* b, size_t pos, size_t len) {
+    sc->off = sc->scanned = pos;
+    sc->found = KO_SEARCH_NONE;
+    ko_buffer_spans(b, pos, len, ko_scan_span, sc);
+}
+
+int ko_search_find(ko_search* s, const ko_buffer* b, size_t pos, size_t* at) {
+    size_t blen = ko_buffer_length(b);
+    if (pos > blen)
+        return 0;
+    if (!s->len) {
+        *at = pos;
+        return 1;
+    }
+
+    ko_scan sc = { .s = s };
+    ko_scan_run(&sc, b, pos, blen - pos);
+    if (sc.found == KO_SEARCH_NONE)
+        return 0;
+    *at = sc.found;
+    return 1;
+}
+
+size_t ko_search_count(ko_search* s, const ko_buffer* b, size_t pos, size_t len) {
+    if (!s->len)
+        return 0;
+
+    ko_scan sc = { .s = s, .counting = 1 };
+    ko_scan_run(&sc, b, pos, len);
+    return sc.count;
+}
+
+int ko_search_find_string(const ko_search* s, const char* str, size_t len, size_t pos, size_t* at) {
+    if (pos > len)
+        return 0;
+    if (!s->len) {
+        *at = pos;
+        return 1;
+    }
+    if (len - pos < s->len)
+        return 0;
+
+    size_t i = s->block(s, (const unsigned char*)str, pos, len - s->len + 1);
+    if (i == KO_SEARCH_NONE)
+        return 0;
+    *at = i;
+    return 1;
+}
+
+// ---- find-as-you-type
+
+// where a query that was typed matched (or KO_SEARCH_NONE)
+typedef struct ko_hit {
+    size_t len, at;
+} ko_hit;
+
+struct ko_finder {
+    int flags;
+    ko_search* s;               // the current query
+    char* query;
+    size_t qlen, qcap;
+    ko_hit* hits;               // for each shorter query typed on the way to this one, then this one
+    size_t nhits, hitcap;
+    const ko_buffer* b;
+    size_t from;
+    size_t version;             // the buffer's, when the hits were found
+};
+
+ko_finder* ko_finder_new(int flags) {
+    ko_finder* f = calloc(1, sizeof(ko_finder));
+    f->flags = flags;
+    return f;
+}
+
+void ko_finder_free(ko_finder* f) {
+    if (!f) return;
+    ko_search_free(f->s);
+    free(f->query);
+    free(f->hits);
+    free(f);
+}
+
+int ko_finder_set(ko_finder* f, const ko_buffer* b, size_t from, const char* query, size_t len, size_t* at) {
+    if (b != f->b || from != f->from || ko_buffer_version(b) != f->version) {
+        f->b = b;
+        f->from = from;
+        f->version = ko_buffer_version(b);
+        f->nhits = 0;
+        f->qlen = 0;
+    }
+
+    // the hits of queries this one starts with still hold
+    size_t common = 0;
+    while (common < f->qlen && common < len && f->query[common] == query[common])
+        common++;
+    while (f->nhits && f->hits[f->nhits - 1].len > common)
+        f->nhits--;
+
+    if (len > f->qcap) {
+        f->qcap = len * 2;
+        f->query = realloc(f->query, f->qcap);
+    }
+    memcpy(f->query, query, len);
+    f->qlen = len;
+
+    ko_search_free(f->s);
+    f->s = ko_search_new(query, len, f->flags);
+
+    if (!len) {
+        f->nhits = 0;
+        return 0;
+    }
+
+    ko_hit* top = f->nhits ? &f->hits[f->nhits - 1] : NULL;
+    size_t found = KO_SEARCH_NONE;
+
+    if (top && top->len == len) {
+        found = top->at;
+    }
+    else {
+        // nothing matched a shorter query, so nothing longer can
+        size_t start = top ? top->at : from;
+        if (start != KO_SEARCH_NONE && !ko_search_find(f->s, b, start, &found))
+            found = KO_SEARCH_NONE;
+
+        if (f->nhits == f->hitcap) {
+            f->hitcap = f->hitcap ? f->hitcap * 2 : 16;
+            f->hits = realloc(f->hits, f->hitcap * sizeof(ko_hit));
+        }
+        f->hits[f->nhits++] = (ko_hit){ len, found };
+    }
+
+    if (found == KO_SEARCH_NONE)
+        return 0;
+    *at = found;
+    return 1;
+}
+
+int ko_finder_next(ko_finder* f, const ko_buffer* b, size_t* at) {
+    if (!f->nhits || b != f->b || f->hits[f->nhits - 1].at == KO_SEARCH_NONE)
+        return 0;
+
+    ko_hit* top = &f->hits[f->nhits - 1];
+    size_t found;
+    if (!ko_search_find(f->s, b, top->at + 1, &found))
+        return 0;
+
+    // a longer query carries on from here now
+    top->at = found;
+    *at = found;
+    return 1;
+}
+
+size_t ko_finder_length(const ko_finder* f) {
+    return f->qlen;
+}
@@ -0,0 +1,47 @@
+#ifndef KO_SEARCH_H
+#define KO_SEARCH_H
+
+#include "buffer.h"
+
+// Plain substring search over a buffer's pieces, without copying the text
+// out. Candidates are found by comparing the needle's first and last bytes
+// against a whole vector of positions at once (AVX2 or SSE2 where there is
+// one, eight bytes per word otherwise), and only those get compared in full.
+// Matches can straddle pieces. Case-insensitive means ASCII letters only.
+
+#define KO_SEARCH_ICASE 1
+
+typedef struct ko_search ko_search;
+
+ko_search* ko_search_new(const char* needle, size_t len, int flags);
+void ko_search_free(ko_search* s);
+
+// the first match starting at or after pos; returns 0 if there isn't one
+int ko_search_find(ko_search* s, const ko_buffer* b, size_t pos, size_t* at);
+
+// how many matches there are in [pos, pos + len), not counting overlapping ones
+size_t ko_search_count(ko_search* s, const ko_buffer* b, size_t pos, size_t len);
+
+// the same over a string; this doesn't change s, so threads can share one
+int ko_search_find_string(const ko_search* s, const char* str, size_t len, size_t pos, size_t* at);
+
+// Find-as-you-type: every match of a query is also a match of anything it
+// starts with, so when the query grows the search picks up from where the
+// shorter one matched instead of from the start, and going back to a shorter
+// query is free. Editing the buffer starts it over.
+
+typedef struct ko_finder ko_finder;
+
+ko_finder* ko_finder_new(int flags);
+void ko_finder_free(ko_finder* f);
+
+// the first match of query at or after from; returns 0 if there isn't one
+int ko_finder_set(ko_finder* f, const ko_buffer* b, size_t from, const char* query, size_t len, size_t* at);
+
+// the match after the last one found; returns 0 if there isn't one
+int ko_finder_next(ko_finder* f, const ko_buffer* b, size_t* at);
+
+// how long the current query is
+size_t ko_finder_length(const ko_finder* f);
+
+#endif
@@ -0,0 +1,227 @@
+#include "term.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// reprinting this many cells is the most we'll consider instead of a cursor move
+#define KO_TERM_MAX_REPRINT 8
+
+void ko_term_init(ko_term* t, int fd) {
+    memset(t, 0, sizeof(ko_term));
+    t->fd = fd;
+    t->cap = 4096;
+    t->buf = malloc(t->cap);
+    ko_term_reset(t);
+}
+
+void ko_term_free(ko_term* t) {
+    free(t->buf);
+    t->buf = NULL;
+}
+
+void ko_term_reset(ko_term* t) {
+    t->cx = t->cy = -1;
+    t->fg = t->bg = -1;
+}
+
+static void ko_term_write(ko_term* t, const char* s, size_t n) {
+    if (t->len + n > t->cap) {
+        while (t->len + n > t->cap)
+            t->cap *= 2;
+        t->buf = realloc(t->buf, t->cap);
+    }
+    memcpy(t->buf + t->len, s, n);
+    t->len += n;
+}
+
+void ko_term_puts(ko_term* t, const char* s) {
+    ko_term_write(t, s, strlen(s));
+}
+
+void ko_term_flush(ko_term* t) {
+    size_t off = 0;
+    while (off < t->len) {
+        ssize_t n = write(t->fd, t->buf + off, t->len - off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        off += n;
+    }
+    t->stats.total += t->len;
+    t->len = 0;
+}
+
+static int ko_utf8_encode(uint32_t cp, char* out) {
+    if (cp < 0x80) { out[0] = cp; return 1; }
+    if (cp < 0x800) { out[0] = 0xC0 | (cp >> 6); out[1] = 0x80 | (cp & 0x3F); return 2; }
+    if (cp < 0x10000) { out[0] = 0xE0 | (cp >> 12); out[1] = 0x80 | ((cp >> 6) & 0x3F); out[2] = 0x80 | (cp & 0x3F); return 3; }
+    out[0] = 0xF0 | (cp >> 18); out[1] = 0x80 | ((cp >> 12) & 0x3F); out[2] = 0x80 | ((cp >> 6) & 0x3F); out[3] = 0x80 | (cp & 0x3F);
+    return 4;
+}
+
+// appends a horizontal move on the current row from x to tx.
+// if the cells in between already show the right thing in the current colors,
+// printing them again is often shorter than an escape sequence.
+static int ko_term_hmove(ko_term* t, int y, int x, int tx, char* out) {
+    int n = 0;
+
+    if (tx == x)
+        return 0;
+
+    if (tx < x) {
+        if (x - tx <= 3) {
+            for (; x > tx; x--) out[n++] = '\b';
+            return n;
+        }
+        return sprintf(out, "\x1b[%dD", x - tx);
+    }
+
+    n = sprintf(out, tx - x == 1 ? "\x1b[C" : "\x1b[%dC", tx - x);
+
+    if (tx - x <= KO_TERM_MAX_REPRINT && t->fg >= 0 && t->bg >= 0) {
+        const ko_cell* row = ko_grid_front_row(t->grid, y);
+        char reprint[KO_TERM_MAX_REPRINT * 4];
+        int m = 0;
+        for (int k = x; k < tx; k++) {
+            if ((int)row[k].fg != t->fg || (int)row[k].bg != t->bg)
+                return n;
+            m += ko_utf8_encode(row[k].ch, reprint + m);
+        }
+        if (m < n) {
+            memcpy(out, reprint, m);
+            n = m;
+        }
+    }
+
+    return n;
+}
+
+static void ko_term_move(ko_term* t, int tx, int ty) {
+    if (t->cx == tx && t->cy == ty)
+        return;
+
+    char best[64], cand[64];
+    int nbest, n;
+
+    // absolute is always possible
+    if (tx == 0)
+        nbest = ty == 0 ? sprintf(best, "\x1b[H") : sprintf(best, "\x1b[%dH", ty + 1);
+    else
+        nbest = sprintf(best, "\x1b[%d;%dH", ty + 1, tx + 1);
+
+    if (t->cy >= 0 && t->cx >= 0) {
+        int dy = ty - t->cy;
+
+        // relative: vertical, then horizontal from where we are
+        n = 0;
+        if (dy > 0 && dy <= 4) { memset(cand, '\n', dy); n = dy; }
+        else if (dy > 0) n = sprintf(cand, "\x1b[%dB", dy);
+        else if (dy < 0) n = sprintf(cand, dy == -1 ? "\x1b[A" : "\x1b[%dA", -dy);
+        n += ko_term_hmove(t, ty, t->cx, tx, cand + n);
+        if (n < nbest) { memcpy(best, cand, n); nbest = n; }
+    }
+
+    if (t->cy >= 0) {
+        // carriage return, vertical, then forward from column 0
+        int dy = ty - t->cy;
+        n = 0;
+        cand[n++] = '\r';
+        if (dy > 0 && dy <= 4) { memset(cand + n, '\n', dy); n += dy; }
+        else if (dy > 0) n += sprintf(cand + n, "\x1b[%dB", dy);
+        else if (dy < 0) n += sprintf(cand + n, dy == -1 ? "\x1b[A" : "\x1b[%dA", -dy);
+        n += ko_term_hmove(t, ty, 0, tx, cand + n);
+        if (n < nbest) { memcpy(best, cand, n); nbest = n; }
+    }
+
+    ko_term_write(t, best, nbest);
+    t->cx = tx;
+    t->cy = ty;
+}
+
+static void ko_term_color(ko_term* t, ko_color fg, ko_color bg) {
+    char seq[64];
+    int n = 0;
+    uint32_t f = ko_color_rgb(fg), b = ko_color_rgb(bg);
+
+    if ((int)fg != t->fg && (int)bg != t->bg)
+        n = sprintf(seq, "\x1b[38;2;%u;%u;%u;48;2;%u;%u;%um", f >> 16, (f >> 8) & 0xFF, f & 0xFF, b >> 16, (b >> 8) & 0xFF, b & 0xFF);
+    else if ((int)fg != t->fg)
+        n = sprintf(seq, "\x1b[38;2;%u;%u;%um", f >> 16, (f >> 8) & 0xFF, f & 0xFF);
+    else if ((int)bg != t->bg)
+        n = sprintf(seq, "\x1b[48;2;%u;%u;%um", b >> 16, (b >> 8) & 0xFF, b & 0xFF);
+
+    ko_term_write(t, seq, n);
+    t->fg = fg;
+    t->bg = bg;
+}
+
+static void ko_term_span(void* ctx, int y, int x, int n) {
+    ko_term* t = ctx;
+    const ko_cell* row = ko_grid_front_row(t->grid, y);
+    char ch[4];
+
+    ko_term_move(t, x, y);
+
+    for (int k = x; k < x + n; k++) {
+        ko_term_color(t, row[k].fg, row[k].bg);
+        ko_term_write(t, ch, ko_utf8_encode(row[k].ch, ch));
+    }
+
+    t->cx = x + n;
+
+    // after the last column the cursor sits in a "pending wrap" state that
+    // terminals don't agree on, so make the next move absolute
+    if (t->cx >= t->grid->cols)
+        t->cx = t->cy = -1;
+}
+
+// full-width vertical scrolls become a scroll region plus SU/SD, and horizontal
+// ones that reach the right edge become per-row DCH/ICH. anything else (a
+// region with both left and right margins) is left to the diff.
+static int ko_term_scroll(void* ctx, const ko_grid_move* m) {
+    ko_term* t = ctx;
+    char seq[64];
+
+    if (m->dx == 0 && m->x == 0 && m->w == t->grid->cols) {
+        int region = m->y != 0 || m->h != t->grid->rows;
+        if (region) {
+            sprintf(seq, "\x1b[%d;%dr", m->y + 1, m->y + m->h);
+            ko_term_puts(t, seq);
+        }
+        sprintf(seq, m->dy > 0 ? "\x1b[%dS" : "\x1b[%dT", abs(m->dy));
+        ko_term_puts(t, seq);
+        if (region) {
+            // resetting the region homes the cursor
+            ko_term_puts(t, "\x1b[r");
+            t->cx = t->cy = 0;
+        }
+        return 1;
+    }
+
+    if (m->dy == 0 && m->x + m->w == t->grid->cols) {
+        for (int y = m->y; y < m->y + m->h; y++) {
+            ko_term_move(t, m->x, y);
+            sprintf(seq, m->dx > 0 ? "\x1b[%dP" : "\x1b[%d@", abs(m->dx));
+            ko_term_puts(t, seq);
+        }
+        return 1;
+    }
+
+    return 0;
+}
+
+void ko_term_present(ko_term* t, ko_grid* g) {
+    size_t before = t->stats.total + t->len;
+
+    t->grid = g;
+    ko_grid_commit_scrolls(g, ko_term_scroll, t);
+    ko_grid_commit(g, ko_term_span, t);
+    ko_term_flush(t);
+
+    t->stats.frames++;
+    t->stats.bytes = t->stats.total - before;
+}
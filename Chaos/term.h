@@ -0,0 +1,48 @@
+#ifndef KO_TERM_H
+#define KO_TERM_H
+
+#include <stddef.h>
+#include "grid.h"
+
+// Draws a grid on a VT100/xterm-style terminal with 24-bit color.
+//
+// The grid's front buffer is exactly what the terminal shows, so a commit's
+// changed spans are the diff. For each span this picks the cheapest way to
+// get the cursor there (absolute, relative, CR/LF, or just reprinting cells
+// that are already right), and only emits SGR when the colors change. Scrolls
+// use the terminal's own scrolling where it has one. All output for a frame
+// goes out in one write().
+//
+// It assumes output post-processing is off (raw mode), so "\n" moves straight
+// down without returning the carriage.
+
+typedef struct ko_term_stats {
+    unsigned long frames;
+    unsigned long bytes;        // written for the last frame
+    unsigned long total;        // written since startup
+} ko_term_stats;
+
+typedef struct ko_term {
+    int fd;
+    int cx, cy;                 // the terminal's cursor, or -1 when we can't be sure
+    int fg, bg;                 // the terminal's current colors as handles, or -1
+    const ko_grid* grid;        // the grid being presented
+    char* buf;
+    size_t len, cap;
+    ko_term_stats stats;
+} ko_term;
+
+void ko_term_init(ko_term* t, int fd);
+void ko_term_free(ko_term* t);
+
+// forget everything we think we know about the terminal's state
+void ko_term_reset(ko_term* t);
+
+// commits the grid and writes whatever changed
+void ko_term_present(ko_term* t, ko_grid* g);
+
+// buffered raw output, for things like titles and mode switches
+void ko_term_puts(ko_term* t, const char* s);
+void ko_term_flush(ko_term* t);
+
+#endif
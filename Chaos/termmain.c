@@ -0,0 +1,103 @@
+// Runs Chaos in a terminal instead of a Cocoa window, e.g. on Linux or over ssh.
+//
+// It isn't part of the Xcode target (it has its own main and its own
+// luaopen_window). Build it with everything except the Objective-C files:
+//
+//     cc -std=gnu99 -O2 -DLUA_USE_POSIX -pthread -o chaos Chaos/*.c Chaos/lua/*.c -lm
+//
+// The Lua files are looked up next to the executable, or in $CHAOS_HOME.
+// Command line arguments go in the global `arg`, like the standalone lua's
+// (so `chaos some.log` opens some.log in the editor).
+
+#include "lua/lauxlib.h"
+#include "lua/lualib.h"
+#include "termwindow.h"
+#include "buffer.h"
+#include "grep.h"
+
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int luaopen_buffer(lua_State* L);
+int luaopen_regex(lua_State* L);
+int luaopen_highlight(lua_State* L);
+int luaopen_wrap(lua_State* L);
+int luaopen_markers(lua_State* L);
+int luaopen_cursors(lua_State* L);
+int luaopen_grep(lua_State* L);
+int luaopen_fuzzy(lua_State* L);
+
+int main(int argc, const char * argv[]) {
+    char exe[4096];
+    strncpy(exe, argv[0], sizeof(exe) - 1);
+    exe[sizeof(exe) - 1] = 0;
+
+    const char* home = getenv("CHAOS_HOME");
+    const char* core_dir = home ? home : dirname(exe);
+    const char* user_home = getenv("HOME");
+
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+
+    luaopen_window(L);               // [window]
+    lua_setglobal(L, "window");      // []
+
+    luaopen_buffer(L);               // [buffer]
+    lua_setglobal(L, "buffer");      // []
+    ko_buffer_setwake(ko_termwindow_wake);
+
+    luaopen_regex(L);                // [regex]
+    lua_setglobal(L, "regex");       // []
+
+    luaopen_highlight(L);            // [highlight]
+    lua_setglobal(L, "highlight");   // []
+
+    luaopen_wrap(L);                 // [wrap]
+    lua_setglobal(L, "wrap");        // []
+
+    luaopen_markers(L);              // [markers]
+    lua_setglobal(L, "markers");     // []
+
+    luaopen_cursors(L);              // [cursors]
+    lua_setglobal(L, "cursors");     // []
+
+    luaopen_grep(L);                 // [grep]
+    lua_setglobal(L, "grep");        // []
+    ko_grep_setwake(ko_termwindow_wake);
+
+    luaopen_fuzzy(L);                // [fuzzy]
+    lua_setglobal(L, "fuzzy");       // []
+
+    lua_createtable(L, argc, 0);     // [arg]
+    for (int i = 0; i < argc; i++) {
+        lua_pushstring(L, argv[i]);  // [arg, argv[i]]
+        lua_rawseti(L, -2, i);       // [arg]
+    }
+    lua_setglobal(L, "arg");         // []
+
+    lua_getglobal(L, "package");     // [package]
+    lua_getfield(L, -1, "path");     // [package, path]
+    lua_pushfstring(L, ";%s/?.lua;%s/.hydra/?.lua", core_dir, user_home ? user_home : ".");
+    lua_concat(L, 2);                // [package, newpath]
+    lua_setfield(L, -2, "path");     // [package]
+
+    lua_pop(L, 1);                   // []
+
+    // like the Cocoa app, keep running whatever windows init.lua managed to
+    // open; the error is reported once the terminal is back to normal
+    char err[1024] = "";
+    if (luaL_dostring(L, "require('init')")) {
+        snprintf(err, sizeof(err), "%s", lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+
+    ko_termwindow_run();
+
+    if (*err)
+        fprintf(stderr, "chaos: %s\n", err);
+
+    lua_close(L);
+    return 0;
+}
@@ -0,0 +1,431 @@
+// The `window` module for terminals: the same API as window.m, drawn with
+// escape sequences instead of Cocoa. A terminal only has one screen, so
+// there's only ever one window.
+
+#include "winlib.h"
+#include "bufferlib.h"
+#include "greplib.h"
+#include "term.h"
+#include "termwindow.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct ko_termwin {
+    ko_window base;
+    ko_grid* grid;
+    ko_frame frame;
+    ko_term term;
+    int resized;        // since the last frame
+    int changed;        // written to outside of a frame
+    int closed;
+} ko_termwin;
+
+static ko_termwin* active;
+static struct termios saved_termios;
+static int wake_pipe[2] = {-1, -1};
+
+static double ko_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void ko_term_size(int* cols, int* rows) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col && ws.ws_row) {
+        *cols = ws.ws_col;
+        *rows = ws.ws_row;
+    }
+    else {
+        *cols = 80;
+        *rows = 24;
+    }
+}
+
+// the loop polls one pipe for both resizes ('w') and work on other threads:
+// buffers' loaders and searches ('b')
+static void ko_on_winch(int sig) {
+    (void)sig;
+    int saved = errno;
+    if (write(wake_pipe[1], "w", 1) < 0) {}
+    errno = saved;
+}
+
+void ko_termwindow_wake(void) {
+    if (write(wake_pipe[1], "b", 1) < 0) {}
+}
+
+static void ko_restore_terminal(void) {
+    if (!active)
+        return;
+    ko_term_puts(&active->term, "\x1b[0m\x1b[?25h\x1b[?1049l");
+    ko_term_flush(&active->term);
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved_termios);
+}
+
+static void ko_setup_terminal(void) {
+    tcgetattr(STDIN_FILENO, &saved_termios);
+    struct termios raw = saved_termios;
+    cfmakeraw(&raw);
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+
+    if (pipe(wake_pipe) == 0) {
+        fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+        signal(SIGWINCH, ko_on_winch);
+    }
+
+    atexit(ko_restore_terminal);
+}
+
+static void ko_termwin_changed(ko_window* w) {
+    ((ko_termwin*)w)->changed = 1;
+}
+
+static void ko_termwin_invalidate(ko_window* w) {
+    ko_termwin* tw = (ko_termwin*)w;
+    ko_frame_invalidate(&tw->frame, ko_now());
+}
+
+static void ko_termwin_stats(ko_window* w, lua_State* L) {
+    ko_termwin* tw = (ko_termwin*)w;
+    lua_pushnumber(L, tw->term.stats.bytes);
+    lua_setfield(L, -2, "bytes");
+    lua_pushnumber(L, tw->term.stats.total);
+    lua_setfield(L, -2, "totalbytes");
+}
+
+static ko_termwin* ko_totermwin(lua_State* L) {
+    return lua_touserdata(L, lua_upvalueindex(1));
+}
+
+// args: [win, w, h]
+// the terminal decides how big we are, so this does nothing
+static int win_resize(lua_State *L) {
+    (void)L;
+    return 0;
+}
+
+// args: [win, name, size]
+static int win_usefont(lua_State *L) {
+    (void)L;
+    return 0;
+}
+
+// args: [win]
+// returns: [name, size]
+static int win_getfont(lua_State *L) {
+    lua_pushstring(L, "terminal");
+    lua_pushnumber(L, 0);
+    return 2;
+}
+
+// args: [win, title]
+static int win_settitle(lua_State *L) {
+    ko_termwin* tw = ko_totermwin(L);
+    ko_term_puts(&tw->term, "\x1b]2;");
+    ko_term_puts(&tw->term, luaL_checkstring(L, 2));
+    ko_term_puts(&tw->term, "\x07");
+    ko_term_flush(&tw->term);
+    return 0;
+}
+
+// args: [win]
+static int win_close(lua_State *L) {
+    ko_totermwin(L)->closed = 1;
+    return 0;
+}
+
+static const luaL_Reg winlib_instance[] = {
+    // methods
+    {"close", win_close},
+
+    {"resize", win_resize},
+
+    {"usefont", win_usefont},
+    {"getfont", win_getfont},
+
+    {"settitle", win_settitle},
+
+    // drawing, panes, keydown, input, redraw, resized, invalidate, framerate and stats come from winlib.c
+
+    {NULL, NULL}
+};
+
+static int win_gc(lua_State *L) {
+    ko_termwin* tw = lua_touserdata(L, 1);
+    if (active == tw) {
+        ko_restore_terminal();
+        active = NULL;
+    }
+    ko_term_free(&tw->term);
+    ko_grid_free(tw->grid);
+    ko_input_free(&tw->base.input);
+    return 0;
+}
+
+// args: []
+// returns: [win]
+static int win_new(lua_State *L) {
+    if (active)
+        return luaL_error(L, "the terminal only has room for one window");
+
+    lua_newtable(L);                                  // [win]
+    lua_newtable(L);                                  // [win, {}]
+    luaL_newlibtable(L, winlib_instance);             // [win, {}, methods]
+
+    ko_termwin* tw = lua_newuserdata(L, sizeof(ko_termwin));  // [win, {}, methods, ud]
+    memset(tw, 0, sizeof(ko_termwin));
+
+    int cols, rows;
+    ko_term_size(&cols, &rows);
+
+    tw->grid = ko_grid_new(cols, rows);
+    ko_frame_init(&tw->frame, KO_FRAME_DEFAULT_RATE);
+    ko_term_init(&tw->term, STDOUT_FILENO);
+    tw->base = (ko_window){
+        .grid = tw->grid,
+        .frame = &tw->frame,
+        .impl = tw,
+        .changed = ko_termwin_changed,
+        .invalidate = ko_termwin_invalidate,
+        .stats = ko_termwin_stats,
+    };
+
+    ko_setup_terminal();
+    active = tw;
+    ko_term_puts(&tw->term, "\x1b[?1049h\x1b[?25l\x1b[2J");
+    ko_term_flush(&tw->term);
+
+    lua_newtable(L);                                  // [win, {}, methods, ud, {}]
+    lua_pushcfunction(L, win_gc);                     // [win, {}, methods, ud, {}, gc]
+    lua_setfield(L, -2, "__gc");                      // [win, {}, methods, ud, {...}]
+    lua_setmetatable(L, -2);                          // [win, {}, methods, ud]
+
+    // keep the userdata alive for as long as the window is open
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, "chaos.termwindow");
+
+    ko_winlib_setfuncs(L);                            // [win, {}, methods, ud]
+    luaL_setfuncs(L, winlib_instance, 1);             // [win, {}, methods]
+
+    lua_setfield(L, -2, "__index");                   // [win, {...}]
+    lua_setmetatable(L, -2);                          // [win]
+
+    return 1;
+}
+
+static const luaL_Reg winlib[] = {
+    {"new", win_new},
+    {"color", ko_winlib_color},
+    {NULL, NULL}
+};
+
+int luaopen_window(lua_State* L) {
+    luaL_newlib(L, winlib);
+    return 1;
+}
+
+// ---- input
+
+static void ko_keydown(ko_termwin* tw, const char* key, size_t len, int ctrl, int alt) {
+    ko_winlib_key(&tw->base, key, len, (ctrl ? KO_KEY_CTRL : 0) | (alt ? KO_KEY_ALT : 0));
+}
+
+// turns CSI/SS3 sequences (arrows, home/end, page up/down, forward delete) into key names.
+// returns how many bytes it used, or 0 if the sequence is incomplete.
+static size_t ko_parse_escape(ko_termwin* tw, const char* s, size_t len) {
+    size_t i = 2;
+    int params[2] = {0, 0};
+    int np = 0;
+
+    while (i < len && ((s[i] >= '0' && s[i] <= '9') || s[i] == ';')) {
+        if (s[i] == ';') { if (np < 1) np++; }
+        else params[np] = params[np] * 10 + (s[i] - '0');
+        i++;
+    }
+
+    if (i >= len)
+        return 0;
+
+    const char* key = NULL;
+    switch (s[i]) {
+        case 'A': key = "up"; break;
+        case 'B': key = "down"; break;
+        case 'C': key = "right"; break;
+        case 'D': key = "left"; break;
+        case 'H': key = "home"; break;
+        case 'F': key = "end"; break;
+        case '~':
+            switch (params[0]) {
+                case 1: case 7: key = "home"; break;
+                case 4: case 8: key = "end"; break;
+                case 3: key = "forwarddelete"; break;
+                case 5: key = "pageup"; break;
+                case 6: key = "pagedown"; break;
+            }
+            break;
+    }
+
+    // xterm puts modifiers in the second parameter, as 1 + (shift | alt << 1 | ctrl << 2)
+    int mods = params[1] > 0 ? params[1] - 1 : 0;
+
+    if (key)
+        ko_keydown(tw, key, strlen(key), (mods & 4) != 0, (mods & 2) != 0);
+
+    return i + 1;
+}
+
+static void ko_handle_input(ko_termwin* tw, const char* s, size_t len) {
+    size_t i = 0;
+
+    while (i < len && tw == active) {
+        unsigned char c = s[i];
+
+        if (c == 0x1b) {
+            if (i + 1 == len) {
+                ko_keydown(tw, "escape", 6, 0, 0);
+                i++;
+            }
+            else if (s[i + 1] == '[' || s[i + 1] == 'O') {
+                size_t used = ko_parse_escape(tw, s + i, len - i);
+                i += used ? used : len - i;
+            }
+            else {
+                // ESC followed by a key is how terminals send alt
+                size_t start = i + 1, j = start;
+                ko_utf8_next(s, len, &j);
+                if (s[start] == '\r' || s[start] == '\n')
+                    ko_keydown(tw, "return", 6, 0, 1);
+                else
+                    ko_keydown(tw, s + start, j - start, 0, 1);
+                i = j;
+            }
+        }
+        else if (c == 0x7f || c == 0x08) {
+            ko_keydown(tw, "delete", 6, 0, 0);
+            i++;
+        }
+        else if (c == '\r' || c == '\n') {
+            ko_keydown(tw, "return", 6, 0, 0);
+            i++;
+        }
+        else if (c == '\t') {
+            ko_keydown(tw, "tab", 3, 0, 0);
+            i++;
+        }
+        else if (c < 0x20) {
+            char key = 'a' + c - 1;
+            ko_keydown(tw, &key, 1, 1, 0);
+            i++;
+        }
+        else {
+            // everything printable up to the next control byte is one run of text
+            size_t start = i;
+            while (i < len && (unsigned char)s[i] >= 0x20 && s[i] != 0x7f)
+                i++;
+            ko_winlib_text(&tw->base, s + start, i - start);
+        }
+    }
+}
+
+// ---- event loop
+
+static void ko_run_frame(ko_termwin* tw) {
+    if (tw->resized) {
+        tw->resized = 0;
+        ko_winlib_resized(&tw->base);
+    }
+
+    ko_winlib_redraw(&tw->base);
+
+    if (tw == active) {
+        ko_term_present(&tw->term, tw->grid);
+        tw->changed = 0;
+    }
+}
+
+static void ko_handle_resize(ko_termwin* tw) {
+    int cols, rows;
+    ko_term_size(&cols, &rows);
+    if (cols == tw->grid->cols && rows == tw->grid->rows)
+        return;
+
+    ko_grid_resize(tw->grid, cols, rows);
+    ko_term_reset(&tw->term);
+    ko_term_puts(&tw->term, "\x1b[0m\x1b[2J");
+
+    tw->resized = 1;
+    ko_frame_invalidate(&tw->frame, ko_now());
+}
+
+int ko_termwindow_run(void) {
+    while (active && !active->closed) {
+        ko_termwin* tw = active;
+        double now = ko_now();
+
+        int timeout = -1;
+        if (tw->changed)
+            timeout = 0;
+        else if (tw->frame.dirty)
+            timeout = (int)ceil(ko_frame_delay(&tw->frame, now) * 1000);
+
+        struct pollfd fds[2] = {
+            { STDIN_FILENO, POLLIN, 0 },
+            { wake_pipe[0], POLLIN, 0 },
+        };
+
+        int ready = poll(fds, wake_pipe[0] >= 0 ? 2 : 1, timeout);
+        if (ready < 0 && errno != EINTR)
+            break;
+
+        if (ready > 0 && (fds[1].revents & POLLIN)) {
+            char drain[64];
+            int winch = 0, load = 0;
+            ssize_t n;
+            while ((n = read(wake_pipe[0], drain, sizeof(drain))) > 0) {
+                winch |= memchr(drain, 'w', n) != NULL;
+                load |= memchr(drain, 'b', n) != NULL;
+            }
+            if (winch)
+                ko_handle_resize(tw);
+            if (load) {
+                ko_bufferlib_poll(tw->base.L);
+                ko_greplib_poll(tw->base.L);
+            }
+        }
+
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            char buf[4096];
+            ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n == 0)
+                break;
+            if (n > 0)
+                ko_handle_input(tw, buf, n);
+        }
+
+        if (tw != active)
+            continue;
+
+        if (ko_frame_tick(&tw->frame, ko_now()))
+            ko_run_frame(tw);
+        else if (tw->changed && !tw->frame.dirty) {
+            ko_term_present(&tw->term, tw->grid);
+            tw->changed = 0;
+        }
+    }
+
+    ko_restore_terminal();
+    active = NULL;
+    return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef KO_TERMWINDOW_H
+#define KO_TERMWINDOW_H
+
+#include "lua/lua.h"
+
+int luaopen_window(lua_State* L);
+
+// handles input, resizes and frames until the window is closed or stdin ends
+int ko_termwindow_run(void);
+
+// makes ko_termwindow_run call ko_bufferlib_poll and ko_greplib_poll; safe to call from any thread
+void ko_termwindow_wake(void);
+
+#endif
@@ -0,0 +1,720 @@
+#include "winlib.h"
+#include "bufferlib.h"
+#include "highlightlib.h"
+#include "wraplib.h"
+#include "render.h"
+
+#include <string.h>
+
+// colors are either palette handles (from window.color) or hex strings.
+// lua interns short strings, so the same literal keeps hitting the same cache slot
+// and skips parsing; the contents are still compared in case the address got reused.
+ko_color ko_checkcolor(lua_State* L, int idx) {
+    if (lua_type(L, idx) == LUA_TNUMBER) {
+        lua_Integer c = lua_tointeger(L, idx);
+        return (c >= 0 && c < ko_color_count()) ? (ko_color)c : KO_COLOR_BLACK;
+    }
+    
+    static struct { const char* str; char hex[8]; ko_color color; } cache[64];
+    
+    size_t len;
+    const char* hex = lua_tolstring(L, idx, &len);
+    if (!hex)
+        return KO_COLOR_BLACK;
+    
+    if (len > 7)
+        return ko_color_parse(hex, len);
+    
+    unsigned slot = ((uintptr_t)hex >> 4) & 63;
+    if (cache[slot].str == hex && memcmp(cache[slot].hex, hex, len + 1) == 0)
+        return cache[slot].color;
+    
+    ko_color c = ko_color_parse(hex, len);
+    cache[slot].str = hex;
+    memcpy(cache[slot].hex, hex, len + 1);
+    cache[slot].color = c;
+    return c;
+}
+
+static ko_window* ko_towindow(lua_State* L) {
+    return lua_touserdata(L, lua_upvalueindex(1));
+}
+
+static ko_winpane* ko_towinpane(lua_State* L) {
+    return lua_touserdata(L, lua_upvalueindex(1));
+}
+
+// the drawing methods work on windows and panes alike
+static ko_view* ko_toview(lua_State* L) {
+    ko_view* v = lua_touserdata(L, lua_upvalueindex(1));
+    
+    // a window's own view always covers the whole grid, whatever size it is now
+    if (v == &v->win->view) {
+        v->pane.w = v->pane.grid->cols;
+        v->pane.h = v->pane.grid->rows;
+    }
+    
+    return v;
+}
+
+static void ko_view_changed(ko_view* v) {
+    v->win->changed(v->win);
+}
+
+// asks the backend for a frame, unless we're already in one that hasn't drawn yet
+static void ko_window_schedule(ko_window* w) {
+    if (!w->delivering)
+        w->invalidate(w);
+}
+
+static void ko_winlib_call(lua_State* L, int ref) {
+    if (ref == LUA_NOREF)
+        return;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+    if (lua_pcall(L, 0, 0, 0))
+        lua_pop(L, 1);
+}
+
+// args: [win]
+static int win_getsize(lua_State *L) {
+    ko_view* v = ko_toview(L);
+    lua_pushnumber(L, v->pane.w);
+    lua_pushnumber(L, v->pane.h);
+    return 2;
+}
+
+// args: [win, char, x, y, fg, bg]
+static int win_set(lua_State *L) {
+    ko_view* v = ko_toview(L);
+    
+    uint32_t c = lua_tonumber(L, 2);
+    int x = lua_tonumber(L, 3) - 1;
+    int y = lua_tonumber(L, 4) - 1;
+    ko_color fg = ko_checkcolor(L, 5);
+    ko_color bg = ko_checkcolor(L, 6);
+    
+    ko_pane_set(&v->pane, x, y, c, fg, bg);
+    ko_view_changed(v);
+    
+    return 0;
+}
+
+// args: [win, str, x, y, fg, bg, i = 1]
+// returns: [cells written, index of the first byte that didn't fit]
+// draws str (starting at byte i) on row y, clipped at the right edge.
+// rows outside the window are only measured.
+static int win_blit(lua_State *L) {
+    ko_view* v = ko_toview(L);
+    
+    size_t len;
+    const char* str = luaL_checklstring(L, 2, &len);
+    int x = lua_tonumber(L, 3) - 1;
+    int y = lua_tonumber(L, 4) - 1;
+    ko_color fg = ko_checkcolor(L, 5);
+    ko_color bg = ko_checkcolor(L, 6);
+    size_t i = luaL_optinteger(L, 7, 1) - 1;
+    
+    if (i > len) i = len;
+    
+    int n = ko_pane_blit(&v->pane, x, y, str, len, &i, fg, bg);
+    ko_view_changed(v);
+    
+    lua_pushnumber(L, n);
+    lua_pushnumber(L, i + 1);
+    return 2;
+}
+
+// args: [win, y, str, runs]
+// runs: {n1, fg1, bg1, n2, fg2, bg2, ...}
+// replaces the whole row y; the row is padded with spaces, and cells past the last run take its colors
+static int win_setrow(lua_State *L) {
+    ko_view* v = ko_toview(L);
+    ko_pane* pane = &v->pane;
+    
+    int y = lua_tonumber(L, 2) - 1;
+    size_t len;
+    const char* str = luaL_checklstring(L, 3, &len);
+    luaL_checktype(L, 4, LUA_TTABLE);
+    
+    size_t i = 0;
+    int n = ko_pane_blit(pane, 0, y, str, len, &i, 0, 0);
+    ko_pane_fill(pane, n, y, pane->w - n, 1, ' ', 0, 0);
+    
+    int nruns = (int)lua_rawlen(L, 4) / 3;
+    int x = 0;
+    
+    for (int r = 0; r < nruns && x < pane->w; r++) {
+        lua_rawgeti(L, 4, r * 3 + 1);
+        lua_rawgeti(L, 4, r * 3 + 2);
+        lua_rawgeti(L, 4, r * 3 + 3);
+        
+        int count = lua_tonumber(L, -3);
+        if (count < 0) count = 0;
+        if (r == nruns - 1)
+            count = pane->w - x;
+        
+        ko_pane_paint(pane, x, y, count, ko_checkcolor(L, -2), ko_checkcolor(L, -1));
+        lua_pop(L, 3);
+        
+        x += count;
+    }
+    
+    ko_view_changed(v);
+    
+    return 0;
+}
+
+// args: [win, bg]
+// on a pane, only clears the pane
+static int win_clear(lua_State *L) {
+    ko_view* v = ko_toview(L);
+    ko_window* w = v->win;
+    ko_color bg = ko_checkcolor(L, 2);
+    
+    if (v == &w->view) {
+        if (w->background)
+            w->background(w, bg);
+        ko_grid_clear(w->grid, bg);
+    }
+    else {
+        ko_pane_clear(&v->pane, bg);
+    }
+    
+    ko_view_changed(v);
+    
+    return 0;
+}
+
+// args: [win, top, bottom, dy, bg]
+// moves rows top..bottom up by dy (down if negative); the rows that scroll in are blanked with bg.
+// renderers shift what's already on screen, so only the exposed rows get redrawn.
+static int win_scroll(lua_State *L) {
+    ko_view* v = ko_toview(L);
+    int top = luaL_checkinteger(L, 2) - 1;
+    int bottom = luaL_checkinteger(L, 3);
+    int dy = luaL_checkinteger(L, 4);
+    ko_color bg = ko_checkcolor(L, 5);
+    
+    ko_pane_scroll(&v->pane, 0, top, v->pane.w, bottom - top, 0, dy, bg);
+    ko_view_changed(v);
+    
+    return 0;
+}
+
+// args: [win, left, right, dx, bg, top = 1, bottom = height]
+// moves columns left..right (on rows top..bottom) left by dx (right if negative)
+static int win_hscroll(lua_State *L) {
+    ko_view* v = ko_toview(L);
+    int left = luaL_checkinteger(L, 2) - 1;
+    int right = luaL_checkinteger(L, 3);
+    int dx = luaL_checkinteger(L, 4);
+    ko_color bg = ko_checkcolor(L, 5);
+    int top = luaL_optinteger(L, 6, 1) - 1;
+    int bottom = luaL_optinteger(L, 7, v->pane.h);
+    
+    ko_pane_scroll(&v->pane, left, top, right - left, bottom - top, dx, 0, bg);
+    ko_view_changed(v);
+    
+    return 0;
+}
+
+// args: [win, buf, line, col, tabwidth, fg, bg, top = 1, bottom = height, hl = nil]
+// draws buf's text on rows top..bottom, with line at row 1 and col at the left edge,
+// colored by hl (a highlighter for buf) if there is one.
+// it all happens in C and only touches the rows asked for, so it costs the same
+// wherever in the document it is; cursors and the like get drawn on top afterwards.
+static int win_render(lua_State *L) {
+    ko_view* v = ko_toview(L);
+    ko_buffer* b = ko_checkbuffer(L, 2);
+    lua_Integer line = luaL_checkinteger(L, 3);
+    lua_Integer col = luaL_checkinteger(L, 4);
+    int tabwidth = luaL_checkinteger(L, 5);
+    ko_color fg = ko_checkcolor(L, 6);
+    ko_color bg = ko_checkcolor(L, 7);
+    int top = luaL_optinteger(L, 8, 1) - 1;
+    int bottom = luaL_optinteger(L, 9, v->pane.h) - 1;
+    
+    ko_render_style style, *hl = NULL;
+    if (!lua_isnoneornil(L, 10)) {
+        ko_checkhighlight(L, 10, b, &style);
+        hl = &style;
+    }
+    
+    ko_render_text(&v->pane, b, line > 1 ? line - 1 : 0, col > 1 ? col - 1 : 0, tabwidth, fg, bg, top, bottom, hl);
+    ko_view_changed(v);
+    
+    return 0;
+}
+
+// args: [win, buf, wrap, line, sub, fg, bg, top = 1, bottom = height, hl = nil]
+// like win:render, but soft-wrapped by wrap (a layout for buf), with row sub of line at row 1
+static int win_renderwrapped(lua_State *L) {
+    ko_view* v = ko_toview(L);
+    ko_buffer* b = ko_checkbuffer(L, 2);
+    ko_wrap* w = ko_checkwrap(L, 3, b);
+    lua_Integer line = luaL_checkinteger(L, 4);
+    lua_Integer sub = luaL_checkinteger(L, 5);
+    ko_color fg = ko_checkcolor(L, 6);
+    ko_color bg = ko_checkcolor(L, 7);
+    int top = luaL_optinteger(L, 8, 1) - 1;
+    int bottom = luaL_optinteger(L, 9, v->pane.h) - 1;
+    
+    ko_render_style style, *hl = NULL;
+    if (!lua_isnoneornil(L, 10)) {
+        ko_checkhighlight(L, 10, b, &style);
+        hl = &style;
+    }
+    
+    ko_render_wrapped(&v->pane, b, w, line > 1 ? line - 1 : 0, sub > 1 ? sub - 1 : 0, fg, bg, top, bottom, hl);
+    ko_view_changed(v);
+    
+    return 0;
+}
+
+// args: [win, hex]
+// returns: [color]
+// parses a color once, so drawing code can pass the handle around instead of the string
+static int win_color(lua_State *L) {
+    lua_pushinteger(L, ko_checkcolor(L, 2));
+    return 1;
+}
+
+// args: [hex]
+// returns: [color]
+int ko_winlib_color(lua_State *L) {
+    lua_pushinteger(L, ko_checkcolor(L, 1));
+    return 1;
+}
+
+// args: [win]
+// the window's redraw (and then every pane's) runs on the next frame
+static int win_invalidate(lua_State *L) {
+    ko_window* w = ko_towindow(L);
+    w->dirty = 1;
+    ko_window_schedule(w);
+    return 0;
+}
+
+// args: [win, fn]
+// fn draws the whole window; it runs at most once per frame, after win:invalidate()
+static int win_redraw(lua_State *L) {
+    ko_window* w = ko_towindow(L);
+    luaL_unref(L, LUA_REGISTRYINDEX, w->redraw_ref);
+    lua_settop(L, 2);
+    w->redraw_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    return 0;
+}
+
+// args: [win, fn]
+// fn runs at the start of the first frame after the window changes size
+static int win_resized(lua_State *L) {
+    ko_window* w = ko_towindow(L);
+    luaL_unref(L, LUA_REGISTRYINDEX, w->resized_ref);
+    lua_settop(L, 2);
+    w->resized_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    return 0;
+}
+
+// args: [win, fn(t)]
+// fn gets one call per key. t is {key, ctrl, alt, cmd}, and the same table is reused for every key.
+static int win_keydown(lua_State *L) {
+    ko_window* w = ko_towindow(L);
+    luaL_unref(L, LUA_REGISTRYINDEX, w->keydown_ref);
+    lua_settop(L, 2);
+    w->keydown_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    return 0;
+}
+
+// args: [win, fn(events)]
+// fn gets every key since the last frame in one call, instead of win:keydown's fn.
+// events is {n = count, ...}; each event is {key, ctrl, alt, cmd}, or {text} for a run of typed characters.
+// events and their tables are reused on the next frame, so copy out anything you want to keep.
+static int win_input(lua_State *L) {
+    ko_window* w = ko_towindow(L);
+    luaL_unref(L, LUA_REGISTRYINDEX, w->input_ref);
+    lua_settop(L, 2);
+    w->input_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    return 0;
+}
+
+// args: [win, fps]
+static int win_framerate(lua_State *L) {
+    ko_window* w = ko_towindow(L);
+    ko_frame_setrate(w->frame, luaL_checknumber(L, 2));
+    return 0;
+}
+
+// args: [win]
+// returns: [{frames, dirty, spans, scrolls, requests, redraws, coalesced, skipped, keys, events, batches, ...}]
+// dirty is the number of cells that actually changed on screen in the last frame
+static int win_stats(lua_State *L) {
+    ko_window* w = ko_towindow(L);
+    ko_grid_stats stats = w->grid->stats;
+    ko_frame_stats fstats = w->frame->stats;
+    
+    lua_createtable(L, 0, 12);
+    lua_pushnumber(L, stats.frames);
+    lua_setfield(L, -2, "frames");
+    lua_pushnumber(L, stats.dirty);
+    lua_setfield(L, -2, "dirty");
+    lua_pushnumber(L, stats.spans);
+    lua_setfield(L, -2, "spans");
+    lua_pushnumber(L, stats.scrolls);
+    lua_setfield(L, -2, "scrolls");
+    lua_pushnumber(L, fstats.requests);
+    lua_setfield(L, -2, "requests");
+    lua_pushnumber(L, fstats.frames);
+    lua_setfield(L, -2, "redraws");
+    lua_pushnumber(L, fstats.coalesced);
+    lua_setfield(L, -2, "coalesced");
+    lua_pushnumber(L, fstats.skipped);
+    lua_setfield(L, -2, "skipped");
+    lua_pushnumber(L, w->input.stats.keys);
+    lua_setfield(L, -2, "keys");
+    lua_pushnumber(L, w->input.stats.events);
+    lua_setfield(L, -2, "events");
+    lua_pushnumber(L, w->input.stats.batches);
+    lua_setfield(L, -2, "batches");
+    
+    if (w->stats)
+        w->stats(w, L);
+    
+    return 1;
+}
+
+// ---- panes
+
+// args: [pane]
+// only this pane's redraw runs on the next frame
+static int pane_invalidate(lua_State *L) {
+    ko_winpane* p = ko_towinpane(L);
+    p->dirty = 1;
+    ko_window_schedule(p->view.win);
+    return 0;
+}
+
+// args: [pane, fn]
+// fn draws the pane; it runs at most once per frame, after pane:invalidate() or win:invalidate()
+static int pane_redraw(lua_State *L) {
+    ko_winpane* p = ko_towinpane(L);
+    luaL_unref(L, LUA_REGISTRYINDEX, p->redraw_ref);
+    lua_settop(L, 2);
+    p->redraw_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    return 0;
+}
+
+// args: [pane]
+// returns: [x, y, w, h]
+static int pane_getframe(lua_State *L) {
+    ko_pane* pane = &ko_towinpane(L)->view.pane;
+    lua_pushnumber(L, pane->x + 1);
+    lua_pushnumber(L, pane->y + 1);
+    lua_pushnumber(L, pane->w);
+    lua_pushnumber(L, pane->h);
+    return 4;
+}
+
+static void ko_pane_checkframe(lua_State* L, ko_pane* pane) {
+    pane->x = luaL_checkinteger(L, 2) - 1;
+    pane->y = luaL_checkinteger(L, 3) - 1;
+    pane->w = luaL_checkinteger(L, 4);
+    pane->h = luaL_checkinteger(L, 5);
+    if (pane->w < 0) pane->w = 0;
+    if (pane->h < 0) pane->h = 0;
+}
+
+// args: [pane, x, y, w, h]
+// whatever the pane covered before is left for the window (or other panes) to redraw
+static int pane_move(lua_State *L) {
+    ko_winpane* p = ko_towinpane(L);
+    ko_pane_checkframe(L, &p->view.pane);
+    p->dirty = 1;
+    ko_window_schedule(p->view.win);
+    return 0;
+}
+
+// args: [pane]
+// detaches the pane; drawing on it afterwards does nothing
+static int pane_close(lua_State *L) {
+    ko_winpane* p = ko_towinpane(L);
+    ko_window* w = p->view.win;
+    
+    for (ko_winpane** link = &w->panes; *link; link = &(*link)->next) {
+        if (*link == p) {
+            *link = p->next;
+            break;
+        }
+    }
+    
+    p->view.pane.w = p->view.pane.h = 0;
+    p->dirty = 0;
+    luaL_unref(L, LUA_REGISTRYINDEX, p->redraw_ref);
+    p->redraw_ref = LUA_NOREF;
+    
+    // the window no longer needs to keep it alive
+    lua_rawgeti(L, LUA_REGISTRYINDEX, w->panes_ref);
+    lua_pushnil(L);
+    lua_rawsetp(L, -2, p);
+    lua_pop(L, 1);
+    
+    return 0;
+}
+
+static const luaL_Reg winlib_draw[] = {
+    {"getsize", win_getsize},
+    
+    {"clear", win_clear},
+    {"set", win_set},
+    {"blit", win_blit},
+    {"setrow", win_setrow},
+    {"scroll", win_scroll},
+    {"hscroll", win_hscroll},
+    {"render", win_render},
+    {"renderwrapped", win_renderwrapped},
+    {"color", win_color},
+    
+    {NULL, NULL}
+};
+
+static const luaL_Reg winlib_pane[] = {
+    {"redraw", pane_redraw},
+    {"invalidate", pane_invalidate},
+    {"getframe", pane_getframe},
+    {"move", pane_move},
+    {"close", pane_close},
+    
+    {NULL, NULL}
+};
+
+// args: [win, x, y, w, h]
+// returns: [pane]
+// a rectangle of the window with its own coordinates, clipping and redraw callback.
+// panes draw on top of the window (and of the panes made before them) in every frame they're redrawn in.
+static int win_pane(lua_State *L) {
+    ko_window* w = ko_towindow(L);
+    ko_pane frame = { .grid = w->grid };
+    ko_pane_checkframe(L, &frame);
+    lua_settop(L, 1);
+    
+    lua_newtable(L);                                  // [win, pane]
+    lua_newtable(L);                                  // [win, pane, {}]
+    lua_createtable(L, 0, 14);                        // [win, pane, {}, methods]
+    
+    ko_winpane* p = lua_newuserdata(L, sizeof(ko_winpane));  // [win, pane, {}, methods, ud]
+    *p = (ko_winpane){
+        .view = { .pane = frame, .win = w },
+        .redraw_ref = LUA_NOREF,
+    };
+    
+    // the pane keeps its window alive, and the window keeps its panes until they're closed
+    lua_pushvalue(L, lua_upvalueindex(1));            // [win, pane, {}, methods, ud, winud]
+    lua_setuservalue(L, -2);                          // [win, pane, {}, methods, ud]
+    lua_rawgeti(L, LUA_REGISTRYINDEX, w->panes_ref);  // [win, pane, {}, methods, ud, panes]
+    lua_pushvalue(L, -2);                             // [win, pane, {}, methods, ud, panes, ud]
+    lua_rawsetp(L, -2, p);                            // [win, pane, {}, methods, ud, panes]
+    lua_pop(L, 1);                                    // [win, pane, {}, methods, ud]
+    
+    lua_pushvalue(L, -2);                             // [win, pane, {}, methods, ud, methods]
+    lua_pushvalue(L, -2);                             // [win, pane, {}, methods, ud, methods, ud]
+    luaL_setfuncs(L, winlib_draw, 1);                 // [win, pane, {}, methods, ud, methods]
+    lua_pop(L, 1);                                    // [win, pane, {}, methods, ud]
+    luaL_setfuncs(L, winlib_pane, 1);                 // [win, pane, {}, methods]
+    
+    lua_setfield(L, -2, "__index");                   // [win, pane, {...}]
+    lua_setmetatable(L, -2);                          // [win, pane]
+    
+    ko_winpane** tail = &w->panes;
+    while (*tail)
+        tail = &(*tail)->next;
+    *tail = p;
+    
+    p->dirty = 1;
+    ko_window_schedule(w);
+    
+    return 1;
+}
+
+static const luaL_Reg winlib_window[] = {
+    {"keydown", win_keydown},
+    {"input", win_input},
+    {"invalidate", win_invalidate},
+    {"redraw", win_redraw},
+    {"resized", win_resized},
+    {"framerate", win_framerate},
+    {"stats", win_stats},
+    {"pane", win_pane},
+    
+    {NULL, NULL}
+};
+
+void ko_winlib_setfuncs(lua_State* L) {
+    ko_window* w = lua_touserdata(L, -1);
+    w->view = (ko_view){ .pane = { .grid = w->grid }, .win = w };
+    w->L = L;
+    w->redraw_ref = LUA_NOREF;
+    w->resized_ref = LUA_NOREF;
+    w->dirty = 0;
+    w->panes = NULL;
+    w->keydown_ref = LUA_NOREF;
+    w->input_ref = LUA_NOREF;
+    w->delivering = 0;
+    ko_input_init(&w->input);
+    
+    lua_newtable(L);
+    w->panes_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_newtable(L);
+    w->events_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    
+    lua_pushvalue(L, -2);                   // [methods, ud, methods]
+    lua_pushvalue(L, -2);                   // [methods, ud, methods, ud]
+    luaL_setfuncs(L, winlib_draw, 1);       // [methods, ud, methods]
+    lua_pushvalue(L, -2);                   // [methods, ud, methods, ud]
+    luaL_setfuncs(L, winlib_window, 1);     // [methods, ud, methods]
+    lua_pop(L, 1);                          // [methods, ud]
+}
+
+void ko_winlib_resized(ko_window* w) {
+    w->dirty = 1;
+    ko_winlib_call(w->L, w->resized_ref);
+}
+
+void ko_winlib_key(ko_window* w, const char* name, size_t len, int mods) {
+    if (w->input.n == 0)
+        w->invalidate(w);
+    ko_input_key(&w->input, name, len, mods);
+}
+
+void ko_winlib_text(ko_window* w, const char* str, size_t len) {
+    if (w->input.n == 0)
+        w->invalidate(w);
+    ko_input_text(&w->input, str, len);
+}
+
+// fills the event table on top of the stack
+static void ko_winlib_setevent(lua_State* L, const char* key, size_t len, int mods, int text) {
+    if (text) {
+        lua_pushnil(L);
+        lua_setfield(L, -2, "key");
+        lua_pushlstring(L, key, len);
+        lua_setfield(L, -2, "text");
+    }
+    else {
+        lua_pushlstring(L, key, len);
+        lua_setfield(L, -2, "key");
+        lua_pushnil(L);
+        lua_setfield(L, -2, "text");
+    }
+    lua_pushboolean(L, mods & KO_KEY_CTRL);
+    lua_setfield(L, -2, "ctrl");
+    lua_pushboolean(L, mods & KO_KEY_ALT);
+    lua_setfield(L, -2, "alt");
+    lua_pushboolean(L, mods & KO_KEY_CMD);
+    lua_setfield(L, -2, "cmd");
+}
+
+// hands the queued keys to Lua before anything gets drawn, so whatever they invalidate is drawn in this frame
+static void ko_winlib_deliver(ko_window* w) {
+    ko_input* in = &w->input;
+    lua_State* L = w->L;
+    
+    if (in->n == 0)
+        return;
+    
+    w->delivering = 1;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, w->events_ref);           // [events]
+    
+    if (w->input_ref != LUA_NOREF) {
+        for (size_t k = 0; k < in->n; k++) {
+            const ko_key* key = &in->keys[k];
+            
+            lua_rawgeti(L, -1, (int)k + 1);                     // [events, t]
+            if (!lua_istable(L, -1)) {
+                lua_pop(L, 1);
+                lua_createtable(L, 0, 5);
+                lua_pushvalue(L, -1);
+                lua_rawseti(L, -3, (int)k + 1);
+            }
+            ko_winlib_setevent(L, ko_input_str(in, key), key->len, key->mods, key->text);
+            lua_pop(L, 1);                                      // [events]
+        }
+        lua_pushinteger(L, in->n);
+        lua_setfield(L, -2, "n");
+        
+        lua_rawgeti(L, LUA_REGISTRYINDEX, w->input_ref);        // [events, fn]
+        lua_pushvalue(L, -2);                                   // [events, fn, events]
+        if (lua_pcall(L, 1, 0, 0))
+            lua_pop(L, 1);
+    }
+    else if (w->keydown_ref != LUA_NOREF) {
+        // one call per key, the way they came in: text runs are split back into characters
+        lua_rawgeti(L, -1, 1);                                  // [events, t]
+        if (!lua_istable(L, -1)) {
+            lua_pop(L, 1);
+            lua_createtable(L, 0, 5);
+            lua_pushvalue(L, -1);
+            lua_rawseti(L, -3, 1);
+        }
+        
+        for (size_t k = 0; k < in->n; k++) {
+            const ko_key* key = &in->keys[k];
+            const char* str = ko_input_str(in, key);
+            
+            for (size_t i = 0; i < key->len; ) {
+                size_t start = i;
+                if (key->text)
+                    ko_utf8_next(str, key->len, &i);
+                else
+                    i = key->len;
+                
+                ko_winlib_setevent(L, str + start, i - start, key->mods, 0);
+                lua_rawgeti(L, LUA_REGISTRYINDEX, w->keydown_ref);  // [events, t, fn]
+                lua_pushvalue(L, -2);                               // [events, t, fn, t]
+                if (lua_pcall(L, 1, 0, 0))
+                    lua_pop(L, 1);
+            }
+        }
+        
+        lua_pop(L, 1);                                          // [events]
+    }
+    
+    lua_pop(L, 1);                                              // []
+    ko_input_clear(in);
+    w->delivering = 0;
+}
+
+void ko_winlib_redraw(ko_window* w) {
+    lua_State* L = w->L;
+    int top = lua_gettop(L);
+    
+    ko_winlib_deliver(w);
+    
+    // redrawing the window redraws everything on it
+    if (w->dirty) {
+        for (ko_winpane* p = w->panes; p; p = p->next)
+            p->dirty = 1;
+    }
+    
+    // hold on to the panes being redrawn, so callbacks can close or add panes as they like
+    lua_rawgeti(L, LUA_REGISTRYINDEX, w->panes_ref);
+    for (ko_winpane* p = w->panes; p; p = p->next) {
+        if (p->dirty) {
+            luaL_checkstack(L, 1, NULL);
+            lua_rawgetp(L, top + 1, p);
+        }
+    }
+    
+    if (w->dirty) {
+        w->dirty = 0;
+        ko_winlib_call(L, w->redraw_ref);
+    }
+    
+    for (int k = top + 2; k <= lua_gettop(L); k++) {
+        ko_winpane* p = lua_touserdata(L, k);
+        if (p->dirty) {
+            p->dirty = 0;
+            ko_winlib_call(L, p->redraw_ref);
+        }
+    }
+    
+    lua_settop(L, top);
+}
@@ -0,0 +1,86 @@
+#ifndef KO_WINLIB_H
+#define KO_WINLIB_H
+
+#include "lua/lua.h"
+#include "lua/lauxlib.h"
+#include "grid.h"
+#include "frame.h"
+#include "pane.h"
+#include "input.h"
+
+// The part of the `window` Lua API that only touches the grid, shared by every
+// backend (Cocoa in window.m, the terminal in termwindow.c). Each backend's
+// window userdata starts with a ko_window; the shared methods get it as their
+// first upvalue, just like the backend's own methods do.
+//
+// Panes (win:pane) get the same drawing methods, in their own coordinates,
+// plus their own redraw callback. Each frame, the window's redraw runs if
+// win:invalidate() was called, and each pane's runs only if that pane was
+// invalidated, so redrawing one pane leaves the others alone.
+//
+// Key presses are queued (input.c) and delivered at the start of the next
+// frame: all at once to win:input's callback, or one by one to win:keydown's.
+
+typedef struct ko_window ko_window;
+typedef struct ko_winpane ko_winpane;
+
+// what the drawing methods see: a window or one of its panes
+typedef struct ko_view {
+    ko_pane pane;
+    ko_window* win;
+} ko_view;
+
+struct ko_winpane {
+    ko_view view;
+    int redraw_ref;
+    int dirty;                                          // invalidated since the last frame
+    ko_winpane* next;
+};
+
+struct ko_window {
+    ko_view view;                                       // covers the whole grid; filled in by ko_winlib_setfuncs
+    ko_grid* grid;
+    ko_frame* frame;
+    void* impl;                                         // whatever the backend needs
+
+    void (*changed)(ko_window* w);                      // the grid was written to
+    void (*invalidate)(ko_window* w);                   // schedule a frame
+    void (*background)(ko_window* w, ko_color bg);      // optional: win:clear picked a background
+    void (*stats)(ko_window* w, lua_State* L);          // optional: add fields to the stats table on top
+
+    // owned by winlib.c
+    lua_State* L;
+    int redraw_ref;
+    int resized_ref;
+    int dirty;                                          // win:invalidate() since the last frame
+    ko_winpane* panes;                                  // in the order they draw
+    int panes_ref;                                      // keeps the panes' userdata alive
+    ko_input input;                                     // keys waiting for the next frame
+    int keydown_ref;
+    int input_ref;
+    int events_ref;                                     // the event tables handed to Lua, reused every frame
+    int delivering;                                     // inside the input callbacks
+};
+
+// expects [methods, ud] on top of the stack; adds the shared methods to the
+// table with ud as their upvalue, sets up the shared part of the ko_window,
+// and leaves the stack as it was
+void ko_winlib_setfuncs(lua_State* L);
+
+// backends call these from their frame: resized first (if the grid changed size), then redraw,
+// which delivers the queued keys before running the redraw callbacks
+void ko_winlib_resized(ko_window* w);
+void ko_winlib_redraw(ko_window* w);
+
+// backends call these as keys come in; they queue the key and schedule a frame.
+// mods are KO_KEY_* flags.
+void ko_winlib_key(ko_window* w, const char* name, size_t len, int mods);
+void ko_winlib_text(ko_window* w, const char* str, size_t len);
+
+// window.color(hex) for the module table
+int ko_winlib_color(lua_State* L);
+
+// a palette handle or hex string argument
+ko_color ko_checkcolor(lua_State* L, int idx);
+
+#endif
@@ -0,0 +1,503 @@
+#include "wrap.h"
+#include "render.h"
+
+#include <stdlib.h>
+
+// a run of lines that each take rows rows, in a treap ordered by line
+typedef struct ko_wraprun {
+    uint32_t left, right, prio;
+    uint32_t gen;               // the layout rows was worked out for; it's a guess if that isn't the current one
+    size_t count;
+    size_t rows;
+    size_t lines, total;        // the subtree's lines and rows
+} ko_wraprun;
+
+struct ko_wrap {
+    ko_buffer* b;
+    int width, tabwidth;
+    uint32_t gen;               // goes up every time the width does anything; 0 is never current
+
+    ko_wraprun* nodes;          // nodes[0] is the empty tree
+    uint32_t nnodes, cap, freelist, root;
+    uint32_t seed;
+    size_t nruns;
+    size_t measured;
+};
+
+static uint32_t ko_wrap_random(ko_wrap* w) {
+    uint32_t x = w->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return w->seed = x;
+}
+
+static uint32_t ko_wraprun_new(ko_wrap* w, size_t count, size_t rows, uint32_t gen) {
+    uint32_t i = w->freelist;
+    if (i) {
+        w->freelist = w->nodes[i].right;
+    }
+    else {
+        if (w->nnodes == w->cap) {
+            w->cap *= 2;
+            w->nodes = realloc(w->nodes, w->cap * sizeof(ko_wraprun));
+        }
+        i = w->nnodes++;
+    }
+
+    w->nodes[i] = (ko_wraprun){ 0, 0, ko_wrap_random(w), gen, count, rows, count, count * rows };
+    w->nruns++;
+    return i;
+}
+
+static void ko_wraprun_release(ko_wrap* w, uint32_t t) {
+    if (!t) return;
+    ko_wraprun_release(w, w->nodes[t].left);
+    ko_wraprun_release(w, w->nodes[t].right);
+    w->nodes[t].right = w->freelist;
+    w->freelist = t;
+    w->nruns--;
+}
+
+static inline void ko_wraprun_update(ko_wrap* w, uint32_t t) {
+    ko_wraprun* n = &w->nodes[t];
+    n->lines = w->nodes[n->left].lines + n->count + w->nodes[n->right].lines;
+    n->total = w->nodes[n->left].total + n->count * n->rows + w->nodes[n->right].total;
+}
+
+static uint32_t ko_wraprun_merge(ko_wrap* w, uint32_t l, uint32_t r) {
+    if (!l) return r;
+    if (!r) return l;
+
+    if (w->nodes[l].prio > w->nodes[r].prio) {
+        w->nodes[l].right = ko_wraprun_merge(w, w->nodes[l].right, r);
+        ko_wraprun_update(w, l);
+        return l;
+    }
+    else {
+        w->nodes[r].left = ko_wraprun_merge(w, l, w->nodes[r].left);
+        ko_wraprun_update(w, r);
+        return r;
+    }
+}
+
+// splits t into its first k lines and the rest, cutting a run in two if k falls inside one
+static void ko_wraprun_split(ko_wrap* w, uint32_t t, size_t k, uint32_t* l, uint32_t* r) {
+    if (!t) {
+        *l = *r = 0;
+        return;
+    }
+
+    size_t before = w->nodes[w->nodes[t].left].lines;
+    size_t count = w->nodes[t].count;
+
+    if (k <= before) {
+        uint32_t a, c;
+        ko_wraprun_split(w, w->nodes[t].left, k, &a, &c);
+        w->nodes[t].left = c;
+        ko_wraprun_update(w, t);
+        *l = a;
+        *r = t;
+    }
+    else if (k >= before + count) {
+        uint32_t a, c;
+        ko_wraprun_split(w, w->nodes[t].right, k - before - count, &a, &c);
+        w->nodes[t].right = a;
+        ko_wraprun_update(w, t);
+        *l = t;
+        *r = c;
+    }
+    else {
+        size_t n = k - before;
+        uint32_t tail = ko_wraprun_new(w, count - n, w->nodes[t].rows, w->nodes[t].gen);
+        uint32_t right = w->nodes[t].right;
+
+        w->nodes[t].count = n;
+        w->nodes[t].right = 0;
+        ko_wraprun_update(w, t);
+        *l = t;
+        *r = ko_wraprun_merge(w, tail, right);
+    }
+}
+
+// if the run at the far end of t (its last if last, else its first) takes rows
+// rows as of gen, makes it a line longer and returns 1
+static int ko_wraprun_grow(ko_wrap* w, uint32_t t, int last, size_t rows, uint32_t gen) {
+    if (!t) return 0;
+
+    uint32_t end = t;
+    while (last ? w->nodes[end].right : w->nodes[end].left)
+        end = last ? w->nodes[end].right : w->nodes[end].left;
+    if (w->nodes[end].rows != rows || w->nodes[end].gen != gen)
+        return 0;
+
+    for (uint32_t k = t; k; k = last ? w->nodes[k].right : w->nodes[k].left) {
+        w->nodes[k].lines++;
+        w->nodes[k].total += rows;
+    }
+    w->nodes[end].count++;
+    return 1;
+}
+
+// the run line is in, with the line it starts at and the row it starts on; line has to be kept
+static uint32_t ko_wraprun_at(ko_wrap* w, size_t line, size_t* first, size_t* row) {
+    uint32_t t = w->root;
+    *first = 0;
+    *row = 0;
+
+    for (;;) {
+        ko_wraprun* n = &w->nodes[t];
+        size_t before = w->nodes[n->left].lines;
+        if (line < before) {
+            t = n->left;
+        }
+        else if (line < before + n->count) {
+            *first += before;
+            *row += w->nodes[n->left].total;
+            return t;
+        }
+        else {
+            line -= before + n->count;
+            *first += before + n->count;
+            *row += w->nodes[n->left].total + n->count * n->rows;
+            t = n->right;
+        }
+    }
+}
+
+// gives line rows rows as of now, joining it onto a run next to it if that's the same
+static void ko_wrap_set(ko_wrap* w, size_t line, size_t rows) {
+    uint32_t a, m, c;
+    ko_wraprun_split(w, w->root, line, &a, &m);
+    ko_wraprun_split(w, m, 1, &m, &c);
+
+    w->nodes[m].rows = rows;
+    w->nodes[m].gen = w->gen;
+    ko_wraprun_update(w, m);
+
+    if (ko_wraprun_grow(w, a, 1, rows, w->gen) || ko_wraprun_grow(w, c, 0, rows, w->gen)) {
+        ko_wraprun_release(w, m);
+        m = 0;
+    }
+    w->root = ko_wraprun_merge(w, ko_wraprun_merge(w, a, m), c);
+}
+
+static void ko_wrap_change(ko_wrap* w, ko_buffer* b, const ko_buffer_change* c) {
+    size_t n = w->nodes[w->root].lines;
+
+    // nothing's kept for the lines from the one it's on
+    size_t start, end;
+    if (n == 0 || (ko_buffer_line_range(b, n, &start, &end) && c->pos >= start))
+        return;
+
+    size_t line = ko_buffer_offset_line(b, c->pos);
+    uint32_t a, m, rest;
+    ko_wraprun_split(w, w->root, line, &a, &m);
+
+    if (c->removedlines == KO_BUFFER_UNKNOWN || c->addedlines == KO_BUFFER_UNKNOWN) {
+        // can't tell which lines below it are which any more
+        ko_wraprun_release(w, m);
+        w->root = a;
+        return;
+    }
+
+    // the lines it touched become guesses: the edited line what it took before, new ones a row each
+    ko_wraprun_split(w, m, c->removedlines + 1, &m, &rest);
+    uint32_t first = m;
+    while (w->nodes[first].left)
+        first = w->nodes[first].left;
+    uint32_t guess = ko_wraprun_new(w, 1, first ? w->nodes[first].rows : 1, 0);
+    if (c->addedlines)
+        guess = ko_wraprun_merge(w, guess, ko_wraprun_new(w, c->addedlines, 1, 0));
+    ko_wraprun_release(w, m);
+    w->root = ko_wraprun_merge(w, ko_wraprun_merge(w, a, guess), rest);
+}
+
+// lists t's runs in order
+static void ko_wraprun_list(ko_wrap* w, uint32_t t, uint32_t* list, size_t* n) {
+    if (!t) return;
+    ko_wraprun_list(w, w->nodes[t].left, list, n);
+    list[(*n)++] = t;
+    ko_wraprun_list(w, w->nodes[t].right, list, n);
+}
+
+// makes a treap of the runs in list, in that order, in one pass: each one
+// goes on the end of the right spine, under the last node there that outranks it
+static uint32_t ko_wraprun_build(ko_wrap* w, const uint32_t* list, size_t n, uint32_t* spine) {
+    size_t depth = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint32_t t = list[i], last = 0;
+        while (depth > 0 && w->nodes[spine[depth - 1]].prio < w->nodes[t].prio) {
+            last = spine[--depth];
+            ko_wraprun_update(w, last);
+        }
+        w->nodes[t].left = last;
+        w->nodes[t].right = 0;
+        if (depth > 0)
+            w->nodes[spine[depth - 1]].right = t;
+        spine[depth++] = t;
+    }
+    while (depth > 1)
+        ko_wraprun_update(w, spine[--depth]);
+    if (depth == 0)
+        return 0;
+    ko_wraprun_update(w, spine[0]);
+    return spine[0];
+}
+
+// releases the next drop lines of the runs listed in spine from k on,
+// starting with whatever's left of the one at k
+static void ko_wraprun_drop(ko_wrap* w, const uint32_t* spine, size_t* k, size_t drop) {
+    while (drop > 0) {
+        uint32_t t = spine[*k];
+        if (drop >= w->nodes[t].count) {
+            drop -= w->nodes[t].count;
+            w->nodes[t].left = w->nodes[t].right = 0;
+            ko_wraprun_release(w, t);
+            (*k)++;
+        }
+        else {
+            w->nodes[t].count -= drop;
+            drop = 0;
+        }
+    }
+}
+
+// the same as ko_wrap_change for each of a batch, in one pass over the runs
+static void ko_wrap_sweep(ko_wrap* w, ko_buffer* b, const ko_buffer_change* c, size_t n) {
+    size_t kept = w->nodes[w->root].lines;
+    size_t cap = w->nruns + 3 * n;
+    uint32_t* list = malloc(cap * sizeof(uint32_t));
+    uint32_t* spine = malloc(cap * sizeof(uint32_t));
+
+    // the runs as they were go in spine (which isn't needed till they're all
+    // listed again); whatever's left of the one at k is the next line along.
+    // the new lines after the last guess (at guessed) aren't listed yet, since
+    // later changes on the same lines can still add to them or take them away.
+    size_t np = 0, k = 0, out = 0, line = 0, pending = 0, guessed = 0;
+    ko_wraprun_list(w, w->root, spine, &np);
+    for (size_t i = 0; i < n && line < kept; i++) {
+        // nothing's kept for the lines from the one it's on
+        size_t at = ko_buffer_offset_line(b, c[i].pos);
+        if (at >= kept)
+            break;
+
+        int unknown = c[i].removedlines == KO_BUFFER_UNKNOWN || c[i].addedlines == KO_BUFFER_UNKNOWN;
+
+        if (at < line) {
+            // on the guessed line again, or one of the new lines after it
+            if (unknown) {
+                if (at == guessed) {
+                    ko_wraprun_release(w, list[--out]);
+                    pending = 0;
+                }
+                else {
+                    pending = at - guessed - 1;
+                }
+                line = kept = at;
+                break;
+            }
+
+            // the lines it takes out are new ones first, then the ones after those
+            size_t after = line - 1 - at;
+            size_t mine = c[i].removedlines < after ? c[i].removedlines : after;
+            size_t theirs = c[i].removedlines - mine;
+            if (theirs > kept - line)
+                theirs = kept - line;
+            ko_wraprun_drop(w, spine, &k, theirs);
+
+            pending = pending - mine + c[i].addedlines;
+            line = line - mine + c[i].addedlines;
+            kept = kept - mine - theirs + c[i].addedlines;
+            continue;
+        }
+
+        if (pending) {
+            list[out++] = ko_wraprun_new(w, pending, 1, 0);
+            pending = 0;
+        }
+
+        // the lines before it stay as they are
+        while (line < at) {
+            uint32_t t = spine[k];
+            size_t take = at - line;
+            if (take >= w->nodes[t].count) {
+                take = w->nodes[t].count;
+                list[out++] = t;
+                k++;
+            }
+            else {
+                list[out++] = ko_wraprun_new(w, take, w->nodes[t].rows, w->nodes[t].gen);
+                w->nodes[t].count -= take;
+            }
+            line += take;
+        }
+
+        if (unknown) {
+            // can't tell which lines below it are which any more
+            kept = line;
+            break;
+        }
+
+        // the lines it touched become guesses: the edited line what it took before, new ones a row each
+        size_t rows = w->nodes[spine[k]].rows;
+        size_t drop = c[i].removedlines + 1;
+        if (drop > kept - line)
+            drop = kept - line;
+        kept -= drop;
+        ko_wraprun_drop(w, spine, &k, drop);
+
+        list[out++] = ko_wraprun_new(w, 1, rows, 0);
+        guessed = at;
+        pending = c[i].addedlines;
+        line += 1 + c[i].addedlines;
+        kept += 1 + c[i].addedlines;
+    }
+
+    if (pending)
+        list[out++] = ko_wraprun_new(w, pending, 1, 0);
+
+    // the rest stay as they are, unless they're past what's kept now
+    for (; k < np; k++) {
+        uint32_t t = spine[k];
+        if (line < kept) {
+            list[out++] = t;
+            line += w->nodes[t].count;
+        }
+        else {
+            w->nodes[t].left = w->nodes[t].right = 0;
+            ko_wraprun_release(w, t);
+        }
+    }
+
+    w->root = ko_wraprun_build(w, list, out, spine);
+    free(list);
+    free(spine);
+}
+
+static void ko_wrap_changed(void* ctx, ko_buffer* b, const ko_buffer_change* c, size_t n) {
+    ko_wrap* w = ctx;
+
+    // lots at once are done in one pass, a few one by one
+    if (n > 1 && n * 16 >= w->nruns) {
+        ko_wrap_sweep(w, b, c, n);
+        return;
+    }
+    for (size_t i = 0; i < n; i++)
+        ko_wrap_change(w, b, &c[i]);
+}
+
+ko_wrap* ko_wrap_new(ko_buffer* b, int width, int tabwidth) {
+    ko_wrap* w = calloc(1, sizeof(ko_wrap));
+    w->b = b;
+    w->gen = 1;
+    w->seed = 0x9E3779B9;
+    w->cap = 64;
+    w->nodes = malloc(w->cap * sizeof(ko_wraprun));
+    w->nodes[0] = (ko_wraprun){ 0 };
+    w->nnodes = 1;
+    ko_wrap_setwidth(w, width, tabwidth);
+
+    ko_buffer_watch(b, ko_wrap_changed, w);
+    return w;
+}
+
+void ko_wrap_free(ko_wrap* w) {
+    if (!w) return;
+    ko_buffer_unwatch(w->b, ko_wrap_changed, w);
+    free(w->nodes);
+    free(w);
+}
+
+void ko_wrap_setwidth(ko_wrap* w, int width, int tabwidth) {
+    if (width < 1) width = 1;
+    if (tabwidth < 1) tabwidth = 1;
+    if (width == w->width && tabwidth == w->tabwidth)
+        return;
+
+    // every count becomes a guess, to be worked out again when it's asked about
+    w->width = width;
+    w->tabwidth = tabwidth;
+    w->gen++;
+}
+
+int ko_wrap_width(const ko_wrap* w) {
+    return w->width;
+}
+
+int ko_wrap_tabwidth(const ko_wrap* w) {
+    return w->tabwidth;
+}
+
+size_t ko_wrap_rows(ko_wrap* w, size_t line) {
+    size_t start, end;
+    if (!ko_buffer_line_range(w->b, line, &start, &end))
+        return 1;
+
+    size_t n = w->nodes[w->root].lines;
+    if (line >= n)
+        w->root = ko_wraprun_merge(w, w->root, ko_wraprun_new(w, line + 1 - n, 1, 0));
+
+    size_t first, row;
+    uint32_t t = ko_wraprun_at(w, line, &first, &row);
+    if (w->nodes[t].gen == w->gen)
+        return w->nodes[t].rows;
+
+    size_t cols = end > start ? ko_render_column(w->b, end, w->tabwidth) : 0;
+    size_t rows = cols ? (cols + w->width - 1) / w->width : 1;
+    ko_wrap_set(w, line, rows);
+    w->measured++;
+    return rows;
+}
+
+size_t ko_wrap_row(ko_wrap* w, size_t line) {
+    size_t n = w->nodes[w->root].lines;
+    if (line >= n)
+        return w->nodes[w->root].total + (line - n);
+
+    size_t first, row;
+    uint32_t t = ko_wraprun_at(w, line, &first, &row);
+    return row + (line - first) * w->nodes[t].rows;
+}
+
+int ko_wrap_find(ko_wrap* w, size_t row, size_t* line, size_t* sub) {
+    uint32_t t = w->root;
+    size_t start, end;
+
+    if (row >= w->nodes[t].total) {
+        *line = w->nodes[t].lines + (row - w->nodes[t].total);
+        *sub = 0;
+        return ko_buffer_line_range(w->b, *line, &start, &end);
+    }
+
+    *line = 0;
+    for (;;) {
+        ko_wraprun* n = &w->nodes[t];
+        size_t before = w->nodes[n->left].total;
+        size_t here = n->count * n->rows;
+        if (row < before) {
+            t = n->left;
+        }
+        else if (row < before + here) {
+            row -= before;
+            *line += w->nodes[n->left].lines + row / n->rows;
+            *sub = row % n->rows;
+            return 1;
+        }
+        else {
+            row -= before + here;
+            *line += w->nodes[n->left].lines + n->count;
+            t = n->right;
+        }
+    }
+}
+
+size_t ko_wrap_total(ko_wrap* w) {
+    size_t n = w->nodes[w->root].lines;
+    size_t lines = ko_buffer_lines(w->b);
+    return w->nodes[w->root].total + (lines > n ? lines - n : 0);
+}
+
+ko_wrap_stats ko_wrap_getstats(const ko_wrap* w) {
+    return (ko_wrap_stats){ w->nodes[w->root].lines, w->nruns, w->measured };
+}
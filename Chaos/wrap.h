@@ -0,0 +1,55 @@
+#ifndef KO_WRAP_H
+#define KO_WRAP_H
+
+#include "buffer.h"
+
+// Soft-wrap layout: how many screen rows each line takes at a given width,
+// kept up to date as the buffer changes.
+//
+// A line of c display columns (counted like the renderer does) takes
+// max(1, ceil(c / width)) rows; row k of it shows columns [k * width,
+// (k + 1) * width). The counts live in a treap of runs of lines that take the
+// same number of rows, summed both ways, so going between a visual row and a
+// line is O(log) however long the file is, and a file of short lines is only
+// a handful of nodes.
+//
+// Nothing is worked out until it's asked for. An edit only forgets the lines
+// it touched. Changing the width forgets nothing: every count is kept as a
+// guess and worked out again (as one line) the next time that line is asked
+// about, so a resize costs the lines on screen. Until then, and for lines
+// past the last one asked about (which count as one row each), the row
+// numbers are estimates; a view should keep its place as a line and a row
+// within it rather than as a row number.
+
+typedef struct ko_wrap ko_wrap;
+
+// watches b for edits
+ko_wrap* ko_wrap_new(ko_buffer* b, int width, int tabwidth);
+void ko_wrap_free(ko_wrap* w);
+
+void ko_wrap_setwidth(ko_wrap* w, int width, int tabwidth);
+int ko_wrap_width(const ko_wrap* w);
+int ko_wrap_tabwidth(const ko_wrap* w);
+
+// the rows line takes, working it out if it has to (1 if there's no such line)
+size_t ko_wrap_rows(ko_wrap* w, size_t line);
+
+// the visual row line starts on, by what's known so far
+size_t ko_wrap_row(ko_wrap* w, size_t line);
+
+// the line visual row is in, and which of its rows it is, by what's known so
+// far. returns 0 if it's past the end of the buffer.
+int ko_wrap_find(ko_wrap* w, size_t row, size_t* line, size_t* sub);
+
+// all the rows, by what's known so far
+size_t ko_wrap_total(ko_wrap* w);
+
+typedef struct ko_wrap_stats {
+    size_t lines;               // lines counts are kept for
+    size_t runs;                // the runs they're kept in
+    size_t measured;            // lines worked out so far, all told
+} ko_wrap_stats;
+
+ko_wrap_stats ko_wrap_getstats(const ko_wrap* w);
+
+#endif
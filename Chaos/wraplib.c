@@ -0,0 +1,145 @@
+// The `wrap` Lua module: soft-wrap layouts (wrap.c) as userdata. Lines are
+// numbered from 1 like everywhere else, and so are visual rows and the rows
+// within a line. Row numbers are only as good as what's been laid out so far
+// (see wrap.h), so views keep their place as a line and a row within it.
+
+#include "wraplib.h"
+#include "bufferlib.h"
+
+// args: [buf, width, tabwidth]
+// returns: [wrap]
+static int wrap_new(lua_State *L) {
+    ko_buffer* b = ko_checkbuffer(L, 1);
+    int width = luaL_checkinteger(L, 2);
+    int tabwidth = luaL_checkinteger(L, 3);
+    
+    ko_wrap** ud = lua_newuserdata(L, sizeof(ko_wrap*));  // [buf, width, tabwidth, wrap]
+    *ud = ko_wrap_new(b, width, tabwidth);
+    luaL_setmetatable(L, KO_WRAP_META);
+    
+    // keeps the buffer alive
+    lua_createtable(L, 1, 0);                         // [buf, width, tabwidth, wrap, {}]
+    lua_pushvalue(L, 1);                              // [buf, width, tabwidth, wrap, {}, buf]
+    lua_rawseti(L, -2, 1);                            // [buf, width, tabwidth, wrap, {buf}]
+    lua_setuservalue(L, -2);                          // [buf, width, tabwidth, wrap]
+    return 1;
+}
+
+static ko_wrap* ko_towrap(lua_State* L) {
+    return *(ko_wrap**)luaL_checkudata(L, 1, KO_WRAP_META);
+}
+
+// args: [wrap, width, tabwidth]
+// only the lines asked about from now on get laid out again
+static int wrap_setwidth(lua_State *L) {
+    ko_wrap* w = ko_towrap(L);
+    ko_wrap_setwidth(w, luaL_checkinteger(L, 2), luaL_checkinteger(L, 3));
+    return 0;
+}
+
+// args: [wrap, line]
+// returns: [rows]
+static int wrap_rows(lua_State *L) {
+    ko_wrap* w = ko_towrap(L);
+    lua_Integer line = luaL_checkinteger(L, 2);
+    lua_pushinteger(L, line >= 1 ? ko_wrap_rows(w, line - 1) : 1);
+    return 1;
+}
+
+// args: [wrap, line]
+// returns: [row]
+// the visual row line starts on
+static int wrap_row(lua_State *L) {
+    ko_wrap* w = ko_towrap(L);
+    lua_Integer line = luaL_checkinteger(L, 2);
+    lua_pushinteger(L, line >= 1 ? ko_wrap_row(w, line - 1) + 1 : 1);
+    return 1;
+}
+
+// args: [wrap, row]
+// returns: [line, sub] or [nil]
+// the line visual row is on, and which of its rows it is; nil past the end
+static int wrap_find(lua_State *L) {
+    ko_wrap* w = ko_towrap(L);
+    lua_Integer row = luaL_checkinteger(L, 2);
+    
+    size_t line, sub;
+    if (!ko_wrap_find(w, row >= 1 ? row - 1 : 0, &line, &sub)) {
+        lua_pushnil(L);
+        return 1;
+    }
+    lua_pushinteger(L, line + 1);
+    lua_pushinteger(L, sub + 1);
+    return 2;
+}
+
+// args: [wrap]
+// returns: [rows]
+static int wrap_total(lua_State *L) {
+    lua_pushinteger(L, ko_wrap_total(ko_towrap(L)));
+    return 1;
+}
+
+// args: [wrap]
+// returns: [stats]
+static int wrap_stats(lua_State *L) {
+    ko_wrap_stats stats = ko_wrap_getstats(ko_towrap(L));
+    
+    lua_createtable(L, 0, 3);
+    lua_pushnumber(L, stats.lines);
+    lua_setfield(L, -2, "lines");
+    lua_pushnumber(L, stats.runs);
+    lua_setfield(L, -2, "runs");
+    lua_pushnumber(L, stats.measured);
+    lua_setfield(L, -2, "measured");
+    return 1;
+}
+
+static int wrap_gc(lua_State *L) {
+    ko_wrap** ud = luaL_checkudata(L, 1, KO_WRAP_META);
+    ko_wrap_free(*ud);
+    *ud = NULL;
+    return 0;
+}
+
+ko_wrap* ko_checkwrap(lua_State* L, int idx, const ko_buffer* b) {
+    ko_wrap* w = *(ko_wrap**)luaL_checkudata(L, idx, KO_WRAP_META);
+    
+    lua_getuservalue(L, idx);                         // [{buf}]
+    lua_rawgeti(L, -1, 1);                            // [{buf}, buf]
+    int same = ko_checkbuffer(L, -1) == b;
+    lua_pop(L, 2);                                    // []
+    luaL_argcheck(L, same, idx, "layout is for another buffer");
+    return w;
+}
+
+static const luaL_Reg wraplib_instance[] = {
+    {"setwidth", wrap_setwidth},
+    {"rows", wrap_rows},
+    {"row", wrap_row},
+    {"find", wrap_find},
+    {"total", wrap_total},
+    {"stats", wrap_stats},
+    {NULL, NULL}
+};
+
+static const luaL_Reg wraplib_meta[] = {
+    {"__gc", wrap_gc},
+    {NULL, NULL}
+};
+
+static const luaL_Reg wraplib[] = {
+    {"new", wrap_new},
+    {NULL, NULL}
+};
+
+int luaopen_wrap(lua_State* L) {
+    luaL_newmetatable(L, KO_WRAP_META);               // [meta]
+    luaL_setfuncs(L, wraplib_meta, 0);                // [meta]
+    luaL_newlib(L, wraplib_instance);                 // [meta, methods]
+    lua_setfield(L, -2, "__index");                   // [meta]
+    lua_pop(L, 1);                                    // []
+    
+    luaL_newlib(L, wraplib);
+    return 1;
+}
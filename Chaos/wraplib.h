@@ -0,0 +1,15 @@
+#ifndef KO_WRAPLIB_H
+#define KO_WRAPLIB_H
+
+#include "lua/lua.h"
+#include "lua/lauxlib.h"
+#include "wrap.h"
+
+// The `wrap` Lua module (wraplib.c), for other modules that draw wrapped text.
+
+#define KO_WRAP_META "chaos.wrap"
+
+// a wrap layout argument; errors if it isn't one, or it's for a buffer other than b
+ko_wrap* ko_checkwrap(lua_State* L, int idx, const ko_buffer* b);
+
+#endif
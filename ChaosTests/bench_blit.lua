@@ -0,0 +1,55 @@
+-- Cells per second drawn into a 200x60 window: one win:set per cell (how
+-- printdoc used to draw), against one win:blit or win:setrow per row. Each
+-- frame is committed, the way a backend would before showing it.
+--
+--     build/host bench_blit.lua [frames = 200]
+
+local frames = tonumber(... or 200)
+local cols, rows = 200, 60
+local fg, bg = "839496", "002b36"
+
+local win = window.new(cols, rows)
+
+-- a screenful of text, a bit different every frame so the commits have something to do
+local lines = {}
+for y = 1, rows do
+   lines[y] = ("%4d  local function line%d(a, b) return a + b * %d end  "):format(y, y, y):rep(4):sub(1, cols)
+end
+
+local function bench(name, draw)
+   win:frame()
+   local start = now()
+   for f = 1, frames do
+      draw(f)
+      win:frame()
+   end
+   local t = now() - start
+   print(("%-8s %8.2f ms/frame  %6.1f M cells/s"):format(name, t / frames * 1000, cols * rows * frames / t / 1e6))
+   return t
+end
+
+local byte = string.byte
+
+local set = bench("set", function(f)
+   for y = 1, rows do
+      local line = lines[(y + f) % rows + 1]
+      for x = 1, cols do
+         win:set(byte(line, x), x, y, fg, bg)
+      end
+   end
+end)
+
+local blit = bench("blit", function(f)
+   for y = 1, rows do
+      win:blit(lines[(y + f) % rows + 1], 1, y, fg, bg)
+   end
+end)
+
+local runs = {20, "b58900", bg, 0, fg, bg}
+local setrow = bench("setrow", function(f)
+   for y = 1, rows do
+      win:setrow(y, lines[(y + f) % rows + 1], runs)
+   end
+end)
+
+print(("blit is %.1fx set, setrow is %.1fx set"):format(set / blit, set / setrow))
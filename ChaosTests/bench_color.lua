@@ -0,0 +1,35 @@
+-- Colors by handle against colors by hex string, per win:set call: handles
+-- from window.color, the same few strings every time (the cached path), and
+-- thousands of different strings, which mostly miss the cache and get
+-- parsed and looked up in the palette each time.
+--
+--     build/host bench_color.lua [calls = 2000000]
+
+local calls = tonumber(... or 2000000)
+local win = window.new(200, 60)
+
+local hexes = {"839496", "002b36", "b58900", "cb4b16", "dc322f", "d33682", "6c71c4", "268bd2"}
+local handles = {}
+for i, hex in ipairs(hexes) do handles[i] = window.color(hex) end
+
+-- far more strings than the cache has slots
+local many = {}
+for i = 1, 4096 do many[i] = ("%06x"):format(i * 2654435761 % 0xFFFFFF) end
+
+local function bench(name, colors)
+   local n = #colors
+   local start = now()
+   for i = 1, calls do
+      local c = colors[i % n + 1]
+      win:set(65, i % 200 + 1, i % 60 + 1, c, c)
+   end
+   local t = now() - start
+   print(("%-16s %7.1f ns/call"):format(name, t / calls * 1e9))
+   return t
+end
+
+local handle = bench("handles", handles)
+local literal = bench("hex, cached", hexes)
+local uncached = bench("hex, uncached", many)
+
+print(("cached hex is %.2fx handles, uncached %.2fx"):format(literal / handle, uncached / handle))
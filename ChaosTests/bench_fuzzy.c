@@ -0,0 +1,69 @@
+// Quick-open over half a million made-up monorepo paths: each keystroke of
+// a query, typed on from the one before, and the whole query matched from
+// scratch, in milliseconds. Paths of up to 64 bytes are matched a bit per
+// byte with SIMD; longer ones with memchr, so both kinds are counted.
+//
+//     make -C ChaosTests build/bench_fuzzy && ChaosTests/build/bench_fuzzy [paths = 500000] [query = cmakefindzlib]
+
+#include "fuzzy.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char* dirs[] = {
+    "src", "lib", "include", "test", "tests", "third_party", "cmake", "modules", "core", "util",
+    "net", "ui", "render", "platform", "linux", "darwin", "internal", "tools", "build", "docs",
+};
+static const char* names[] = {
+    "main", "buffer", "window", "FindZLIB", "config", "parser", "lexer", "CMakeLists", "utils", "index",
+    "search", "fuzzy", "layout", "server", "client", "handler", "README", "Makefile", "types", "errors",
+};
+static const char* exts[] = { ".c", ".h", ".cpp", ".cmake", ".txt", ".md", ".lua", ".py", "", ".json" };
+
+static size_t make_path(char* s) {
+    size_t n = 0;
+    int depth = 2 + rand() % 9;
+    for (int d = 0; d < depth; d++)
+        n += sprintf(s + n, "%s/", dirs[rand() % 20]);
+    return n + sprintf(s + n, "%s%s", names[rand() % 20], exts[rand() % 10]);
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 500000;
+    const char* query = argc > 2 ? argv[2] : "cmakefindzlib";
+    size_t qlen = strlen(query);
+
+    ko_fuzzy* f = ko_fuzzy_new();
+    char path[256];
+    size_t total = 0, shorter = 0;
+    srand(1);
+    for (size_t i = 0; i < count; i++) {
+        size_t len = make_path(path);
+        ko_fuzzy_add(f, path, len);
+        total += len;
+        shorter += len <= 64;
+    }
+    printf("%zu paths, %.0f bytes on average, %.0f%% of them 64 or less\n",
+           count, (double)total / count, 100.0 * shorter / count);
+
+    ko_fuzzy_result out[50];
+    size_t matched;
+    for (size_t n = 1; n <= qlen; n++) {
+        double start = ko_test_now();
+        size_t k = ko_fuzzy_match(f, query, n, 50, out, &matched);
+        double took = ko_test_now() - start;
+        size_t len = 0;
+        const char* best = k ? ko_fuzzy_get(f, out[0].index, &len) : "";
+        printf("%-16.*s %7.2f ms %8zu matched   %.*s\n", (int)n, query, took * 1e3, matched, (int)len, best);
+    }
+
+    // a query that isn't carried on from forgets the ones before
+    ko_fuzzy_match(f, "\x01", 1, 50, out, &matched);
+    double start = ko_test_now();
+    ko_fuzzy_match(f, query, qlen, 50, out, &matched);
+    printf("from scratch     %7.2f ms %8zu matched\n", (ko_test_now() - start) * 1e3, matched);
+
+    ko_fuzzy_free(f);
+    return 0;
+}
@@ -0,0 +1,97 @@
+// What a frame costs the grid on a 200x60 screen, in microseconds: drawing
+// the same screen again, typing one character, changing every cell, and
+// scrolling a line (with a renderer that scrolls itself, and with one that
+// repaints what moved).
+//
+//     make -C ChaosTests build/bench_grid && ChaosTests/build/bench_grid [frames = 20000]
+
+#include "grid.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define COLS 200
+#define ROWS 60
+
+static char lines[ROWS][COLS + 1];
+static unsigned long painted;
+
+static void count_span(void* ctx, int y, int x, int n) {
+    (void)ctx; (void)y; (void)x;
+    painted += n;
+}
+
+static int accept_scroll(void* ctx, const ko_grid_move* m) {
+    (void)ctx; (void)m;
+    return 1;
+}
+
+static int refuse_scroll(void* ctx, const ko_grid_move* m) {
+    (void)ctx; (void)m;
+    return 0;
+}
+
+static void draw_screen(ko_grid* g, int top) {
+    for (int y = 0; y < ROWS; y++) {
+        size_t i = 0;
+        ko_grid_blit(g, 0, y, lines[(y + top) % ROWS], COLS, &i, KO_COLOR_BLACK, KO_COLOR_WHITE);
+    }
+}
+
+typedef void (*frame_fn)(ko_grid* g, int f);
+
+static void bench(const char* name, int frames, frame_fn draw, ko_grid_scroll_fn scroll) {
+    ko_grid* g = ko_grid_new(COLS, ROWS);
+    draw_screen(g, 0);
+    ko_grid_commit(g, NULL, NULL);
+
+    painted = 0;
+    double start = ko_test_now();
+    for (int f = 1; f <= frames; f++) {
+        draw(g, f);
+        ko_grid_commit_scrolls(g, scroll, NULL);
+        ko_grid_commit(g, count_span, NULL);
+    }
+    double t = ko_test_now() - start;
+
+    printf("%-22s %8.2f us/frame  %8lu cells painted/frame\n", name, t / frames * 1e6, painted / frames);
+    ko_grid_free(g);
+}
+
+static void redraw_same(ko_grid* g, int f) {
+    (void)f;
+    draw_screen(g, 0);
+}
+
+static void type_one(ko_grid* g, int f) {
+    draw_screen(g, 0);
+    ko_grid_set(g, f % COLS, 30, 'a' + f % 26, KO_COLOR_BLACK, KO_COLOR_WHITE);
+}
+
+static void change_all(ko_grid* g, int f) {
+    draw_screen(g, f);
+}
+
+static void scroll_line(ko_grid* g, int f) {
+    ko_grid_scroll(g, 0, 0, COLS, ROWS, 0, 1, KO_COLOR_WHITE);
+    size_t i = 0;
+    ko_grid_blit(g, 0, ROWS - 1, lines[(f + ROWS - 1) % ROWS], COLS, &i, KO_COLOR_BLACK, KO_COLOR_WHITE);
+}
+
+int main(int argc, char** argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : 20000;
+
+    for (int y = 0; y < ROWS; y++) {
+        for (int x = 0; x < COLS; x++)
+            lines[y][x] = " abcdefghijklmnopqrstuvwxyz(){};="[(x * 7 + y * 13) % 33];
+        lines[y][COLS] = 0;
+    }
+
+    bench("same screen again", frames, redraw_same, accept_scroll);
+    bench("one character typed", frames, type_one, accept_scroll);
+    bench("every cell changed", frames, change_all, accept_scroll);
+    bench("scroll, renderer moves", frames, scroll_line, accept_scroll);
+    bench("scroll, repainted", frames, scroll_line, refuse_scroll);
+    return 0;
+}
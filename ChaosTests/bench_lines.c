@@ -0,0 +1,104 @@
+// Jumping to line 1,000,000 and to the last line in buffers of different
+// sizes: scanning for them from the start (how printdoc found its top line),
+// against the buffer's line index, before and after a thousand edits
+// scattered through the text. The index's times shouldn't depend on how big
+// the buffer is, or how far down the line is.
+//
+//     make -C ChaosTests build/bench_lines && ChaosTests/build/bench_lines [max lines = 20000000]
+
+#include "buffer.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TARGET 1000000
+#define QUERIES 1000000
+
+static char* make_text(size_t lines, size_t* len) {
+    char* text = malloc(lines * 48 + 1);
+    size_t n = 0;
+    for (size_t i = 0; i < lines; i++)
+        n += sprintf(text + n, "line %zu of the text, and then some\n", i);
+    *len = n;
+    return text;
+}
+
+static size_t scan_to_line(const char* text, size_t len, size_t line) {
+    const char* p = text;
+    const char* end = text + len;
+    for (size_t k = 0; k < line; k++) {
+        p = memchr(p, '\n', end - p);
+        if (!p)
+            return len;
+        p++;
+    }
+    return p - text;
+}
+
+static double time_queries(ko_buffer* b, size_t line) {
+    volatile size_t sink = 0;
+    double start = ko_test_now();
+    for (size_t q = 0; q < QUERIES; q++)
+        sink += ko_buffer_line_offset(b, line - (q & 1023));
+    (void)sink;
+    return (ko_test_now() - start) / QUERIES;
+}
+
+int main(int argc, char** argv) {
+    size_t max = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000000;
+
+    printf("%10s %12s %12s %12s %12s %12s %12s %12s\n", "lines", "scan", "scan last", "index cold", "index", "index last", "edited", "line at");
+    for (size_t lines = 1250000; lines <= max; lines *= 2) {
+        size_t len;
+        char* text = make_text(lines, &len);
+
+        double start = ko_test_now();
+        size_t want = scan_to_line(text, len, TARGET);
+        double scan = ko_test_now() - start;
+        start = ko_test_now();
+        volatile size_t lastpos = scan_to_line(text, len, lines - 1);
+        (void)lastpos;
+        double scanlast = ko_test_now() - start;
+
+        ko_buffer* b = ko_buffer_new(text, len);
+
+        // the first query counts the newlines it needs
+        start = ko_test_now();
+        size_t got = ko_buffer_line_offset(b, TARGET);
+        double cold = ko_test_now() - start;
+        if (got != want) {
+            fprintf(stderr, "line %d is at %zu, not %zu\n", TARGET, got, want);
+            return 1;
+        }
+        ko_buffer_index(b, (size_t)-1);
+        double warm = time_queries(b, TARGET);
+        double last = time_queries(b, lines - 1);
+
+        // scattered edits, so it's a tree of pieces rather than one
+        srand(1);
+        for (int e = 0; e < 1000; e++) {
+            size_t pos = (size_t)(((double)rand() / RAND_MAX) * (ko_buffer_length(b) - 1));
+            if (e % 2)
+                ko_buffer_insert(b, pos, "new\nline\n", 9);
+            else
+                ko_buffer_delete(b, pos, 5);
+        }
+        double edited = time_queries(b, TARGET);
+
+        volatile size_t sink = 0;
+        size_t mid = ko_buffer_length(b) / 2;
+        start = ko_test_now();
+        for (size_t q = 0; q < QUERIES; q++)
+            sink += ko_buffer_offset_line(b, mid + (q & 4095));
+        double at = (ko_test_now() - start) / QUERIES;
+        (void)sink;
+
+        printf("%10zu %9.3f ms %9.3f ms %9.3f ms %9.0f ns %9.0f ns %9.0f ns %9.0f ns\n",
+               lines, scan * 1e3, scanlast * 1e3, cold * 1e3, warm * 1e9, last * 1e9, edited * 1e9, at * 1e9);
+
+        ko_buffer_free(b);
+        free(text);
+    }
+    return 0;
+}
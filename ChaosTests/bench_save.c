@@ -0,0 +1,99 @@
+// Saving a big file with a one-line edit in the middle: ko_buffer_save
+// streaming the pieces of a mapped file, against writing the same bytes from
+// one block of memory with write() and fsync(), which is about as fast as
+// the disk goes. (The file was just written, so reading it back comes from
+// the page cache, and both are bound by writing.)
+//
+//     make -C ChaosTests build/bench_save && ChaosTests/build/bench_save [megabytes = 1024] [dir = /tmp]
+
+#include "buffer.h"
+#include "test.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LINE "the quick brown fox jumps over the lazy dog, again and again\n"
+
+static int write_file(const char* path, size_t size, int sync) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+
+    size_t block = 1 << 20;
+    char* buf = malloc(block);
+    size_t linelen = strlen(LINE);
+    for (size_t i = 0; i < block; i++)
+        buf[i] = LINE[i % linelen];
+
+    for (size_t done = 0; done < size; ) {
+        size_t n = size - done < block ? size - done : block;
+        if (write(fd, buf, n) != (ssize_t)n) {
+            free(buf);
+            close(fd);
+            return -1;
+        }
+        done += n;
+    }
+    free(buf);
+
+    if (sync)
+        fsync(fd);
+    return close(fd);
+}
+
+int main(int argc, char** argv) {
+    size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 1024;
+    const char* dir = argc > 2 ? argv[2] : "/tmp";
+    size_t size = mb << 20;
+
+    char path[4096], copy[4096];
+    snprintf(path, sizeof(path), "%s/chaos-bench-save.txt", dir);
+    snprintf(copy, sizeof(copy), "%s/chaos-bench-save-copy.txt", dir);
+
+    if (write_file(path, size, 1) < 0) {
+        perror(path);
+        return 1;
+    }
+
+    // the baseline: the same number of bytes, straight from memory
+    double start = ko_test_now();
+    write_file(copy, size + 6, 1);
+    double raw = ko_test_now() - start;
+    unlink(copy);
+
+    ko_buffer* b = ko_buffer_open(path);
+    if (!b) {
+        perror(path);
+        return 1;
+    }
+    size_t line = ko_buffer_offset_line(b, size / 2);
+    ko_buffer_insert(b, ko_buffer_line_offset(b, line), "edit!\n", 6);
+
+    start = ko_test_now();
+    if (ko_buffer_save(b, path) < 0) {
+        perror(path);
+        return 1;
+    }
+    double save = ko_test_now() - start;
+
+    // it has to be the whole text, with the edit where it was made
+    ko_buffer* saved = ko_buffer_open(path);
+    char got[7] = {0};
+    ko_buffer_copy(saved, ko_buffer_line_offset(saved, line), 6, got);
+    if (ko_buffer_length(saved) != size + 6 || strcmp(got, "edit!\n") != 0) {
+        fprintf(stderr, "saved the wrong text\n");
+        return 1;
+    }
+    ko_buffer_free(saved);
+
+    ko_buffer_stats stats = ko_buffer_getstats(b);
+    printf("%zu MB in %zu pieces\n", mb, stats.pieces);
+    printf("write+fsync   %8.1f MB/s\n", (size + 6) / raw / 1e6);
+    printf("buffer:save   %8.1f MB/s (%.0f%% of that)\n", (size + 6) / save / 1e6, raw / save * 100);
+
+    ko_buffer_free(b);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,63 @@
+-- buf:find against string.find(s, query, 1, true) over the same text:
+-- a needle only at the very end of ordinary text, the same ignoring case,
+-- counting every match of a common word, and a needle in text that's nearly
+-- all one letter (where string.find's memchr-then-memcmp stops at every byte).
+--
+--     build/host bench_search.lua [megabytes = 1024]
+
+local mb = tonumber(... or 1024)
+local size = mb * 1024 * 1024
+
+local function bench(name, text, needle, repetitive)
+   local buf = buffer.new(text)
+
+   local start = now()
+   local a = buf:find(needle)
+   local native = now() - start
+
+   start = now()
+   local b = text:find(needle, 1, true)
+   local lua = now() - start
+
+   assert(a == b, ("%s: buf:find says %s, string.find %s"):format(name, tostring(a), tostring(b)))
+   print(("%-22s buf:find %8.1f ms %7.2f GB/s   string.find %8.1f ms %7.2f GB/s   %5.1fx"):format(
+      name, native * 1e3, #text / native / 1e9, lua * 1e3, #text / lua / 1e9, lua / native))
+   return buf
+end
+
+local line = "local function search(buffer, query) return buffer:find(query, 1) end\n"
+local text = line:rep(math.floor(size / #line)) .. "needle in a haystack"
+local buf = bench("ordinary text", text, "needle in a haystack")
+
+-- ignoring case: the nearest string.find has is a pattern with a set per letter
+local query = "NEEDLE in a HAYSTACK"
+local pattern = query:gsub("%a", function(c) return "[" .. c:lower() .. c:upper() .. "]" end)
+local start = now()
+local a = buf:find(query, 1, true)
+local native = now() - start
+start = now()
+local b = text:find(pattern)
+local lua = now() - start
+assert(a == b, ("ignoring case: %s vs %s"):format(tostring(a), tostring(b)))
+print(("%-22s buf:find %8.1f ms   string.find pattern %8.1f ms   %5.1fx"):format("ignoring case", native * 1e3, lua * 1e3, lua / native))
+
+-- counting: every "buffer" in the text
+start = now()
+local n = buf:count("buffer")
+native = now() - start
+start = now()
+local m, i = 0, 1
+while true do
+   local s, e = text:find("buffer", i, true)
+   if not s then break end
+   m, i = m + 1, e + 1
+end
+lua = now() - start
+assert(n == m, ("count: %d vs %d"):format(n, m))
+print(("%-22s buf:count %7.1f ms   string.find loop %7.1f ms   %5.1fx"):format("counting " .. n, native * 1e3, lua * 1e3, lua / native))
+
+buf, text = nil, nil
+collectgarbage()
+
+text = ("a"):rep(size) .. "ab"
+bench("nearly all 'a'", text, ("a"):rep(31) .. "b")
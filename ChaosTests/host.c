@@ -0,0 +1,149 @@
+// Runs a Lua file with the native modules, for benchmarking them the way the
+// editor calls them:
+//
+//     build/host bench_blit.lua [args...]
+//
+// `window` here has no screen: a window is just a grid, and win:frame() does
+// what a backend does each frame (runs the redraw callbacks, then commits the
+// grid) and returns how many cells changed. now() is a monotonic clock in
+// seconds, and the file gets its arguments in `arg` and as `...`.
+
+#include "lua/lauxlib.h"
+#include "lua/lualib.h"
+#include "winlib.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int luaopen_buffer(lua_State* L);
+int luaopen_regex(lua_State* L);
+int luaopen_fuzzy(lua_State* L);
+
+typedef struct ko_headless {
+    ko_window base;
+    ko_grid* grid;
+    ko_frame frame;
+} ko_headless;
+
+static void ko_headless_changed(ko_window* w) {
+    (void)w;
+}
+
+static void ko_headless_invalidate(ko_window* w) {
+    ko_frame_invalidate(w->frame, ko_test_now());
+}
+
+// args: [win]
+// returns: [cells changed]
+static int win_frame(lua_State *L) {
+    ko_headless* hw = lua_touserdata(L, lua_upvalueindex(1));
+    ko_winlib_redraw(&hw->base);
+    lua_pushnumber(L, ko_grid_commit(hw->grid, NULL, NULL));
+    return 1;
+}
+
+static int win_gc(lua_State *L) {
+    ko_headless* hw = lua_touserdata(L, 1);
+    ko_grid_free(hw->grid);
+    ko_input_free(&hw->base.input);
+    return 0;
+}
+
+static const luaL_Reg headless_instance[] = {
+    {"frame", win_frame},
+    {NULL, NULL}
+};
+
+// args: [cols = 200, rows = 60]
+// returns: [win]
+static int win_new(lua_State *L) {
+    int cols = (int)luaL_optinteger(L, 1, 200);
+    int rows = (int)luaL_optinteger(L, 2, 60);
+
+    lua_newtable(L);                                  // [..., win]
+    lua_newtable(L);                                  // [..., win, {}]
+    luaL_newlibtable(L, headless_instance);           // [..., win, {}, methods]
+
+    ko_headless* hw = lua_newuserdata(L, sizeof(ko_headless));  // [..., win, {}, methods, ud]
+    memset(hw, 0, sizeof(ko_headless));
+    hw->grid = ko_grid_new(cols, rows);
+    ko_frame_init(&hw->frame, KO_FRAME_DEFAULT_RATE);
+    hw->base = (ko_window){
+        .grid = hw->grid,
+        .frame = &hw->frame,
+        .impl = hw,
+        .changed = ko_headless_changed,
+        .invalidate = ko_headless_invalidate,
+    };
+
+    lua_newtable(L);                                  // [..., win, {}, methods, ud, {}]
+    lua_pushcfunction(L, win_gc);                     // [..., win, {}, methods, ud, {}, gc]
+    lua_setfield(L, -2, "__gc");                      // [..., win, {}, methods, ud, {...}]
+    lua_setmetatable(L, -2);                          // [..., win, {}, methods, ud]
+
+    // the methods hold on to the userdata
+    ko_winlib_setfuncs(L);                            // [..., win, {}, methods, ud]
+    luaL_setfuncs(L, headless_instance, 1);           // [..., win, {}, methods]
+
+    lua_setfield(L, -2, "__index");                   // [..., win, {...}]
+    lua_setmetatable(L, -2);                          // [..., win]
+    return 1;
+}
+
+static const luaL_Reg headlesslib[] = {
+    {"new", win_new},
+    {"color", ko_winlib_color},
+    {NULL, NULL}
+};
+
+static int ko_host_now(lua_State *L) {
+    lua_pushnumber(L, ko_test_now());
+    return 1;
+}
+
+int main(int argc, const char * argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s file.lua [args...]\n", argv[0]);
+        return 2;
+    }
+
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+
+    luaL_newlib(L, headlesslib);     // [window]
+    lua_setglobal(L, "window");      // []
+
+    luaopen_buffer(L);               // [buffer]
+    lua_setglobal(L, "buffer");      // []
+
+    luaopen_regex(L);                // [regex]
+    lua_setglobal(L, "regex");       // []
+
+    luaopen_fuzzy(L);                // [fuzzy]
+    lua_setglobal(L, "fuzzy");       // []
+
+    lua_pushcfunction(L, ko_host_now);
+    lua_setglobal(L, "now");
+
+    lua_createtable(L, argc, 0);     // [arg]
+    for (int i = 1; i < argc; i++) {
+        lua_pushstring(L, argv[i]);  // [arg, argv[i]]
+        lua_rawseti(L, -2, i - 1);   // [arg]
+    }
+    lua_setglobal(L, "arg");         // []
+
+    if (luaL_loadfile(L, argv[1])) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    for (int i = 2; i < argc; i++)
+        lua_pushstring(L, argv[i]);
+    if (lua_pcall(L, argc - 2, 0, 0)) {
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+
+    lua_close(L);
+    return 0;
+}
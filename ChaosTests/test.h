@@ -0,0 +1,41 @@
+#ifndef KO_TEST_H
+#define KO_TEST_H
+
+// What the tests and benchmarks share: checks that count failures instead of
+// stopping at the first one, and a clock.
+
+#include <stdio.h>
+#include <time.h>
+
+static int ko_test_failures;
+
+#define KO_CHECK(cond) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__, #cond); \
+        ko_test_failures++; \
+    } \
+} while (0)
+
+#define KO_CHECK_EQ(a, b) do { \
+    long long ko_a = (long long)(a), ko_b = (long long)(b); \
+    if (ko_a != ko_b) { \
+        fprintf(stderr, "%s:%d: failed: %s == %s (%lld vs %lld)\n", __FILE__, __LINE__, #a, #b, ko_a, ko_b); \
+        ko_test_failures++; \
+    } \
+} while (0)
+
+// what main returns
+static inline int ko_test_done(void) {
+    if (ko_test_failures)
+        fprintf(stderr, "%d failed\n", ko_test_failures);
+    return ko_test_failures != 0;
+}
+
+// seconds, from some fixed point
+static inline double ko_test_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#endif
@@ -0,0 +1,130 @@
+// ko_grid_bgrects: the rects it hands out have to cover exactly the cells
+// whose background isn't the one skipped, each in that cell's color, without
+// overlapping; and runs that line up on consecutive rows become one rect.
+
+#include "grid.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct cover {
+    const ko_grid* g;
+    int* hits;                  // per cell: how many rects covered it
+    int wrong;                  // rects with a cell of another color in them
+} cover;
+
+static void cover_rect(void* ctx, int x, int y, int w, int h, ko_color color) {
+    cover* c = ctx;
+    for (int r = y; r < y + h; r++) {
+        for (int k = x; k < x + w; k++) {
+            c->hits[r * c->g->cols + k]++;
+            if (ko_grid_front_row(c->g, r)[k].bg != color)
+                c->wrong++;
+        }
+    }
+}
+
+// returns the number of rects, checking they cover rows [y0, y1) exactly
+static int check_rects(ko_grid* g, int y0, int y1, ko_color skip) {
+    ko_grid_commit(g, NULL, NULL);
+
+    cover c = { g, calloc((size_t)g->cols * g->rows, sizeof(int)), 0 };
+    int n = ko_grid_bgrects(g, y0, y1, skip, cover_rect, &c);
+
+    KO_CHECK_EQ(c.wrong, 0);
+    int bad = 0;
+    for (int y = 0; y < g->rows; y++) {
+        for (int x = 0; x < g->cols; x++) {
+            int want = y >= y0 && y < y1 && ko_grid_front_row(g, y)[x].bg != skip;
+            if (c.hits[y * g->cols + x] != want)
+                bad++;
+        }
+    }
+    KO_CHECK_EQ(bad, 0);
+
+    free(c.hits);
+    return n;
+}
+
+static void test_counts(void) {
+    ko_color bg = KO_COLOR_WHITE;
+    ko_color sel = ko_color_intern(0x073642);
+    ko_color bar = ko_color_intern(0x586e75);
+    ko_grid* g = ko_grid_new(80, 24);
+
+    // nothing but the window's own background: nothing to fill
+    ko_grid_clear(g, bg);
+    KO_CHECK_EQ(check_rects(g, 0, 24, bg), 0);
+
+    // a status bar is one fill, not eighty
+    ko_grid_fill(g, 0, 23, 80, 1, ' ', bg, bar);
+    KO_CHECK_EQ(check_rects(g, 0, 24, bg), 1);
+
+    // so are whole lines selected, and a block selection
+    ko_grid_fill(g, 0, 3, 80, 5, ' ', bg, sel);
+    KO_CHECK_EQ(check_rects(g, 0, 24, bg), 2);
+    ko_grid_fill(g, 10, 12, 20, 6, ' ', bg, sel);
+    KO_CHECK_EQ(check_rects(g, 0, 24, bg), 3);
+
+    // a selection from the middle of one line to the middle of another:
+    // its first line, the whole lines in between, and its last line
+    ko_grid_clear(g, bg);
+    ko_grid_fill(g, 30, 4, 50, 1, ' ', bg, sel);
+    ko_grid_fill(g, 0, 5, 80, 4, ' ', bg, sel);
+    ko_grid_fill(g, 0, 9, 12, 1, ' ', bg, sel);
+    KO_CHECK_EQ(check_rects(g, 0, 24, bg), 3);
+
+    // runs that are the same color but don't line up stay apart
+    ko_grid_clear(g, bg);
+    for (int y = 0; y < 6; y++)
+        ko_grid_fill(g, y, y, 10, 1, ' ', bg, sel);
+    KO_CHECK_EQ(check_rects(g, 0, 24, bg), 6);
+
+    // a checkerboard can't merge at all
+    for (int y = 0; y < 24; y++)
+        for (int x = 0; x < 80; x++)
+            ko_grid_set(g, x, y, ' ', bg, (x + y) % 2 ? sel : bar);
+    KO_CHECK_EQ(check_rects(g, 0, 24, bg), 80 * 24);
+
+    // and stripes merge into columns
+    for (int y = 0; y < 24; y++)
+        for (int x = 0; x < 80; x++)
+            ko_grid_set(g, x, y, ' ', bg, x % 2 ? sel : bar);
+    KO_CHECK_EQ(check_rects(g, 0, 24, bg), 80);
+
+    // only the rows asked for, with rects cut at their edges
+    KO_CHECK_EQ(check_rects(g, 5, 9, bg), 80);
+    KO_CHECK_EQ(check_rects(g, -3, 2, bg), 80);
+    KO_CHECK_EQ(check_rects(g, 30, 40, bg), 0);
+
+    // skipping a color that's in the stripes leaves the others
+    KO_CHECK_EQ(check_rects(g, 0, 24, sel), 40);
+
+    ko_grid_free(g);
+}
+
+static void test_random(void) {
+    ko_color colors[4] = { KO_COLOR_WHITE, KO_COLOR_BLACK, ko_color_intern(0x073642), ko_color_intern(0x586e75) };
+    srand(5);
+
+    for (int round = 0; round < 500; round++) {
+        ko_grid* g = ko_grid_new(1 + rand() % 60, 1 + rand() % 30);
+        int fills = rand() % 12;
+        for (int k = 0; k < fills; k++)
+            ko_grid_fill(g, rand() % g->cols, rand() % g->rows, 1 + rand() % g->cols, 1 + rand() % g->rows, ' ', 0, colors[rand() % 4]);
+
+        int y0 = rand() % (g->rows + 1), y1 = y0 + rand() % (g->rows + 1);
+        int n = check_rects(g, y0, y1, colors[rand() % 4]);
+
+        // never more than one per run of cells
+        KO_CHECK(n <= g->cols * (y1 - y0));
+        ko_grid_free(g);
+    }
+}
+
+int main(void) {
+    test_counts();
+    test_random();
+    return ko_test_done();
+}
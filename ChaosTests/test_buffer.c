@@ -0,0 +1,560 @@
+// The buffer's text and its undo journal, checked against what the text
+// should be after each step: the piece table against a plain string given
+// the same edits, at piece boundaries and in the middle of pieces.
+
+#include "buffer.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// the whole text, in a static buffer big enough for the tests
+static const char* text_of(const ko_buffer* b) {
+    static char text[1 << 16];
+    size_t n = ko_buffer_copy(b, 0, sizeof(text) - 1, text);
+    text[n] = 0;
+    return text;
+}
+
+#define KO_CHECK_TEXT(b, want) do { \
+    const char* ko_got = text_of(b); \
+    if (strcmp(ko_got, want) != 0) { \
+        fprintf(stderr, "%s:%d: failed: text is \"%s\", not \"%s\"\n", __FILE__, __LINE__, ko_got, want); \
+        ko_test_failures++; \
+    } \
+} while (0)
+
+// the text the buffer should have, as a plain string
+typedef struct model {
+    char text[1 << 15];
+    size_t len;
+} model;
+
+static void model_insert(model* m, size_t pos, const char* str, size_t len) {
+    memmove(m->text + pos + len, m->text + pos, m->len - pos);
+    memcpy(m->text + pos, str, len);
+    m->len += len;
+    m->text[m->len] = 0;
+}
+
+static void model_delete(model* m, size_t pos, size_t len) {
+    memmove(m->text + pos, m->text + pos + len, m->len - pos - len);
+    m->len -= len;
+    m->text[m->len] = 0;
+}
+
+static void random_text(char* s, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        s[i] = rand() % 6 == 0 ? '\n' : 'a' + rand() % 26;
+}
+
+typedef struct collected {
+    char text[1 << 15];
+    size_t len, calls, stop;
+} collected;
+
+static int collect(void* ctx, const char* bytes, size_t len) {
+    collected* c = ctx;
+    memcpy(c->text + c->len, bytes, len);
+    c->len += len;
+    return ++c->calls != c->stop;
+}
+
+// rspans hands the runs over last first, so each goes in front of the ones before
+static int collect_back(void* ctx, const char* bytes, size_t len) {
+    collected* c = ctx;
+    memmove(c->text + len, c->text, c->len);
+    memcpy(c->text, bytes, len);
+    c->len += len;
+    return ++c->calls != c->stop;
+}
+
+// everything the buffer says about its text, against the model's
+static int check_text(const ko_buffer* b, const model* m) {
+    int failures = ko_test_failures;
+    KO_CHECK_EQ(ko_buffer_length(b), m->len);
+    KO_CHECK_TEXT(b, m->text);
+
+    // any range, by copying and by spans either way round
+    size_t pos = rand() % (m->len + 1), len = rand() % (m->len - pos + 1);
+    char out[sizeof(m->text)];
+    KO_CHECK_EQ(ko_buffer_copy(b, pos, len, out), len);
+    KO_CHECK(memcmp(out, m->text + pos, len) == 0);
+
+    static collected c;
+    c.len = c.calls = c.stop = 0;
+    ko_buffer_spans(b, pos, len, collect, &c);
+    KO_CHECK_EQ(c.len, len);
+    KO_CHECK(memcmp(c.text, m->text + pos, len) == 0);
+    c.len = c.calls = 0;
+    ko_buffer_rspans(b, pos, len, collect_back, &c);
+    KO_CHECK_EQ(c.len, len);
+    KO_CHECK(memcmp(c.text, m->text + pos, len) == 0);
+
+    // and lines: where each starts and ends, and the line of every offset
+    size_t lines = 1;
+    for (size_t i = 0; i < m->len; i++)
+        lines += m->text[i] == '\n';
+    KO_CHECK_EQ(ko_buffer_lines(b), lines);
+
+    size_t line = 0, start = 0;
+    for (size_t i = 0; i <= m->len && ko_test_failures == failures; i++) {
+        KO_CHECK_EQ(ko_buffer_offset_line(b, i), line);
+        if (i == m->len || m->text[i] == '\n') {
+            size_t s, e;
+            KO_CHECK(ko_buffer_line_range(b, line, &s, &e));
+            KO_CHECK_EQ(s, start);
+            KO_CHECK_EQ(e, i);
+            KO_CHECK_EQ(ko_buffer_line_offset(b, line), start);
+            line++;
+            start = i + 1;
+        }
+    }
+    size_t s, e;
+    KO_CHECK(!ko_buffer_line_range(b, lines, &s, &e));
+    return ko_test_failures == failures;
+}
+
+static void test_boundaries(void) {
+    model m = { "one\ntwo\nthree", 13 };
+    ko_buffer* b = ko_buffer_new(m.text, m.len);
+
+    // splitting the original, then inserting right at either edge of the new piece
+    ko_buffer_insert(b, 4, "X", 1);
+    model_insert(&m, 4, "X", 1);
+    ko_buffer_insert(b, 4, "[", 1);
+    model_insert(&m, 4, "[", 1);
+    ko_buffer_insert(b, 6, "]", 1);
+    model_insert(&m, 6, "]", 1);
+    check_text(b, &m);
+    KO_CHECK_TEXT(b, "one\n[X]two\nthree");
+
+    // a delete that takes out whole pieces and parts of the ones either side
+    ko_buffer_delete(b, 3, 5);
+    model_delete(&m, 3, 5);
+    check_text(b, &m);
+    KO_CHECK_TEXT(b, "onewo\nthree");
+
+    // exactly one piece, then everything
+    ko_buffer_insert(b, 5, "\n\n", 2);
+    model_insert(&m, 5, "\n\n", 2);
+    ko_buffer_delete(b, 5, 2);
+    model_delete(&m, 5, 2);
+    check_text(b, &m);
+    ko_buffer_delete(b, 0, m.len);
+    model_delete(&m, 0, m.len);
+    check_text(b, &m);
+    KO_CHECK_EQ(ko_buffer_lines(b), 1);
+
+    // past the end is clamped
+    ko_buffer_insert(b, 100, "end", 3);
+    model_insert(&m, 0, "end", 3);
+    ko_buffer_delete(b, 1, 100);
+    model_delete(&m, 1, 2);
+    ko_buffer_delete(b, 5, 1);
+    check_text(b, &m);
+    ko_buffer_free(b);
+}
+
+static void test_spans_stop(void) {
+    ko_buffer* b = ko_buffer_new("abcdef", 6);
+    ko_buffer_insert(b, 2, "12", 2);
+    ko_buffer_insert(b, 6, "34", 2);
+
+    // five pieces in the range, and fn stops after the second
+    static collected c;
+    c.stop = 2;
+    ko_buffer_spans(b, 1, 8, collect, &c);
+    KO_CHECK_EQ(c.calls, 2);
+    KO_CHECK_EQ(c.len, 3);
+    KO_CHECK(memcmp(c.text, "b12", 3) == 0);
+
+    c.len = c.calls = 0;
+    ko_buffer_rspans(b, 1, 8, collect_back, &c);
+    KO_CHECK_EQ(c.calls, 2);
+    KO_CHECK_EQ(c.len, 3);
+    KO_CHECK(memcmp(c.text, "34e", 3) == 0);
+    ko_buffer_free(b);
+}
+
+static void test_random_edits(void) {
+    for (unsigned seed = 1; seed <= 100; seed++) {
+        srand(seed);
+        static model m;
+        m.len = rand() % 200;
+        random_text(m.text, m.len);
+        m.text[m.len] = 0;
+        ko_buffer* b = ko_buffer_new(m.text, m.len);
+
+        for (int step = 0; step < 100; step++) {
+            size_t pos = rand() % (m.len + 1);
+            if (rand() % 2 && m.len < 4000) {
+                char s[16];
+                size_t len = 1 + rand() % sizeof(s);
+                random_text(s, len);
+                ko_buffer_insert(b, pos, s, len);
+                model_insert(&m, pos, s, len);
+            }
+            else {
+                size_t len = rand() % 12;
+                if (len > m.len - pos)
+                    len = m.len - pos;
+                ko_buffer_delete(b, pos, len);
+                model_delete(&m, pos, len);
+            }
+            if (!check_text(b, &m)) {
+                fprintf(stderr, "seed %u step %d\n", seed, step);
+                break;
+            }
+        }
+        ko_buffer_free(b);
+    }
+}
+
+// a file bigger than the lazy index counts at once, mapped: lines found
+// before it's all counted, then across 4K chunk edges after edits
+static void test_mapped(void) {
+    char path[] = "/tmp/chaos-test-buffer-XXXXXX";
+    int fd = mkstemp(path);
+    size_t len = 3 << 20;
+    char* text = malloc(len);
+    for (size_t i = 0; i < len; i++)
+        text[i] = i % 37 == 36 ? '\n' : 'a' + i % 26;
+    KO_CHECK_EQ(write(fd, text, len), len);
+    close(fd);
+
+    ko_buffer* b = ko_buffer_open(path);
+    KO_CHECK(b != NULL);
+    KO_CHECK(ko_buffer_getstats(b).mapped);
+    KO_CHECK_EQ(ko_buffer_line_offset(b, 10), 370);
+    KO_CHECK_EQ(ko_buffer_offset_line(b, len - 1), (len - 1) / 37);
+    KO_CHECK_EQ(ko_buffer_lines(b), len / 37 + 1);
+
+    // a newline put in at the end of a chunk, and one taken out of the next
+    ko_buffer_insert(b, 4096, "\n", 1);
+    ko_buffer_delete(b, 8192 + 36 - 8192 % 37 + 1, 1);
+    size_t lines = ko_buffer_lines(b);
+    KO_CHECK_EQ(lines, len / 37 + 1);
+    for (size_t line = 0; line < lines; line += 1 + rand() % 500) {
+        size_t start = ko_buffer_line_offset(b, line);
+        char c = '\n';
+        if (start > 0)
+            ko_buffer_copy(b, start - 1, 1, &c);
+        KO_CHECK_EQ(c, '\n');
+        KO_CHECK_EQ(ko_buffer_offset_line(b, start), line);
+    }
+
+    ko_buffer_free(b);
+    unlink(path);
+    free(text);
+}
+
+static void test_round_trip(void) {
+    ko_buffer* b = ko_buffer_new("hello world", 11);
+    static const char* steps[] = { "hello world", "hello, world", "hello, wd", "hi, wd", "hi, wd!" };
+
+    // deleting and then typing where it left off is one step
+    ko_buffer_insert(b, 5, ",", 1);
+    ko_buffer_seal(b);
+    ko_buffer_delete(b, 8, 3);
+    ko_buffer_seal(b);
+    ko_buffer_delete(b, 1, 4);
+    ko_buffer_insert(b, 1, "i", 1);
+    ko_buffer_seal(b);
+    ko_buffer_insert(b, 6, "!", 1);
+    KO_CHECK_EQ(ko_buffer_getstats(b).undo, 4);
+
+    // each undo puts the cursor back past what its step first took out
+    static const size_t ends[] = { 0, 5, 11, 5, 6 };
+    size_t pos;
+    for (int i = 4; i > 0; i--) {
+        KO_CHECK_TEXT(b, steps[i]);
+        KO_CHECK(ko_buffer_undo(b, &pos));
+        KO_CHECK_EQ(pos, ends[i]);
+    }
+    KO_CHECK_TEXT(b, steps[0]);
+    KO_CHECK(!ko_buffer_undo(b, NULL));
+    KO_CHECK_EQ(ko_buffer_getstats(b).redo, 4);
+
+    for (int i = 1; i <= 4; i++) {
+        KO_CHECK(ko_buffer_redo(b, &pos));
+        KO_CHECK_TEXT(b, steps[i]);
+    }
+    KO_CHECK_EQ(pos, 7);
+    KO_CHECK(!ko_buffer_redo(b, NULL));
+    ko_buffer_free(b);
+}
+
+static void test_redo_dropped(void) {
+    ko_buffer* b = ko_buffer_new("abc", 3);
+    ko_buffer_insert(b, 3, "d", 1);
+    ko_buffer_seal(b);
+    ko_buffer_delete(b, 0, 1);
+    ko_buffer_seal(b);
+    ko_buffer_undo(b, NULL);
+    ko_buffer_undo(b, NULL);
+    KO_CHECK_EQ(ko_buffer_getstats(b).redo, 2);
+
+    // a new edit after undoing can't redo what was undone
+    ko_buffer_insert(b, 0, "x", 1);
+    KO_CHECK_TEXT(b, "xabc");
+    KO_CHECK_EQ(ko_buffer_getstats(b).redo, 0);
+    KO_CHECK(!ko_buffer_redo(b, NULL));
+    KO_CHECK(ko_buffer_undo(b, NULL));
+    KO_CHECK_TEXT(b, "abc");
+    KO_CHECK(!ko_buffer_undo(b, NULL));
+
+    // nor can a delete, whose pieces go where the dropped ones were
+    ko_buffer_redo(b, NULL);
+    ko_buffer_undo(b, NULL);
+    ko_buffer_delete(b, 1, 1);
+    KO_CHECK(!ko_buffer_redo(b, NULL));
+    KO_CHECK(ko_buffer_undo(b, NULL));
+    KO_CHECK_TEXT(b, "abc");
+    ko_buffer_free(b);
+}
+
+static void test_steps(void) {
+    ko_buffer* b = ko_buffer_new("", 0);
+
+    // typing and then backspacing some of it is one step
+    ko_buffer_insert(b, 0, "a", 1);
+    ko_buffer_insert(b, 1, "b", 1);
+    ko_buffer_insert(b, 2, "c", 1);
+    ko_buffer_delete(b, 2, 1);
+    KO_CHECK_EQ(ko_buffer_getstats(b).undo, 1);
+
+    // backspacing all of what a step typed leaves nothing to undo
+    ko_buffer_delete(b, 1, 1);
+    ko_buffer_delete(b, 0, 1);
+    KO_CHECK_EQ(ko_buffer_getstats(b).undo, 0);
+
+    // a seal ends the step, and so does typing somewhere else
+    ko_buffer_insert(b, 0, "ab", 2);
+    ko_buffer_seal(b);
+    ko_buffer_insert(b, 2, "cd", 2);
+    ko_buffer_insert(b, 0, "_", 1);
+    KO_CHECK_EQ(ko_buffer_getstats(b).undo, 3);
+    ko_buffer_undo(b, NULL);
+    KO_CHECK_TEXT(b, "abcd");
+    ko_buffer_undo(b, NULL);
+    KO_CHECK_TEXT(b, "ab");
+
+    // backspacing past what was typed is an edit of its own
+    ko_buffer_redo(b, NULL);
+    ko_buffer_delete(b, 1, 3);
+    KO_CHECK_TEXT(b, "a");
+    KO_CHECK_EQ(ko_buffer_getstats(b).undo, 3);
+    ko_buffer_undo(b, NULL);
+    KO_CHECK_TEXT(b, "abcd");
+
+    // everything in a transaction is one step, however it's sealed in between
+    ko_buffer_begin(b);
+    ko_buffer_insert(b, 0, "1", 1);
+    ko_buffer_seal(b);
+    ko_buffer_begin(b);
+    ko_buffer_delete(b, 3, 2);
+    ko_buffer_end(b);
+    ko_buffer_insert(b, 2, "2", 1);
+    ko_buffer_end(b);
+    KO_CHECK_TEXT(b, "1a2b");
+    ko_buffer_insert(b, 4, "3", 1);
+    ko_buffer_undo(b, NULL);
+    KO_CHECK_TEXT(b, "1a2b");
+    ko_buffer_undo(b, NULL);
+    KO_CHECK_TEXT(b, "abcd");
+    ko_buffer_redo(b, NULL);
+    KO_CHECK_TEXT(b, "1a2b");
+
+    // and an empty one isn't a step at all
+    size_t undo = ko_buffer_getstats(b).undo;
+    ko_buffer_begin(b);
+    ko_buffer_end(b);
+    KO_CHECK_EQ(ko_buffer_getstats(b).undo, undo);
+    ko_buffer_free(b);
+}
+
+static void test_batches(void) {
+    ko_buffer* b = ko_buffer_new("a\nb\nc", 5);
+    size_t pieces = ko_buffer_getstats(b).pieces;
+
+    // typing at three places, a key at a time: each key grows the same three edits
+    size_t at[] = { 1, 3, 5 };
+    ko_buffer_insert_many(b, at, 3, "x", 1);
+    size_t next[] = { 2, 5, 8 };
+    ko_buffer_insert_many(b, next, 3, "y", 1);
+    KO_CHECK_TEXT(b, "axy\nbxy\ncxy");
+    KO_CHECK_EQ(ko_buffer_getstats(b).undo, 1);
+    KO_CHECK_EQ(ko_buffer_getstats(b).pieces, pieces + 5);
+
+    // backspacing at all three takes it back out of them
+    size_t back[] = { 2, 6, 10 }, one[] = { 1, 1, 1 };
+    ko_buffer_delete_many(b, back, one, 3);
+    KO_CHECK_TEXT(b, "ax\nbx\ncx");
+    KO_CHECK_EQ(ko_buffer_getstats(b).undo, 1);
+    ko_buffer_undo(b, NULL);
+    KO_CHECK_TEXT(b, "a\nb\nc");
+    ko_buffer_redo(b, NULL);
+    KO_CHECK_TEXT(b, "ax\nbx\ncx");
+
+    // past what was typed it's a step of its own, and undoes in one go
+    size_t all[] = { 0, 3, 6 }, two[] = { 2, 2, 2 };
+    ko_buffer_delete_many(b, all, two, 3);
+    KO_CHECK_TEXT(b, "\n\n");
+    KO_CHECK_EQ(ko_buffer_getstats(b).undo, 2);
+    size_t pos;
+    ko_buffer_undo(b, &pos);
+    KO_CHECK_TEXT(b, "ax\nbx\ncx");
+    KO_CHECK_EQ(pos, 2);
+
+    // a different number of places doesn't carry on from it
+    ko_buffer_seal(b);
+    size_t ends[] = { 2, 5, 8 };
+    ko_buffer_insert_many(b, ends, 3, "!", 1);
+    size_t two_ends[] = { 3, 7 };
+    ko_buffer_insert_many(b, two_ends, 2, "?", 1);
+    KO_CHECK_TEXT(b, "ax!?\nbx!?\ncx!");
+    KO_CHECK_EQ(ko_buffer_getstats(b).undo, 3);
+    ko_buffer_undo(b, NULL);
+    ko_buffer_undo(b, NULL);
+    ko_buffer_undo(b, NULL);
+    KO_CHECK_TEXT(b, "a\nb\nc");
+    ko_buffer_free(b);
+}
+
+// random edits, one step each, undone and redone at random: the text has
+// to be whatever it was that many steps back
+static void test_random_undo(void) {
+    for (unsigned seed = 1; seed <= 100; seed++) {
+        srand(seed);
+        static model history[64];
+        size_t done = 0, steps = 0;
+        model* m = &history[0];
+        m->len = rand() % 100;
+        random_text(m->text, m->len);
+        m->text[m->len] = 0;
+        ko_buffer* b = ko_buffer_new(m->text, m->len);
+
+        for (int step = 0; step < 200; step++) {
+            int op = rand() % 10;
+            if (op < 2 && done > 0) {
+                KO_CHECK(ko_buffer_undo(b, NULL));
+                done--;
+            }
+            else if (op < 4 && done < steps) {
+                KO_CHECK(ko_buffer_redo(b, NULL));
+                done++;
+            }
+            else if (done + 1 < 64) {
+                model* was = &history[done];
+                m = &history[++done];
+                *m = *was;
+                steps = done;
+                size_t pos = rand() % (m->len + 1);
+                switch (rand() % 4) {
+                    case 0: {
+                        char s[8];
+                        size_t len = 1 + rand() % sizeof(s);
+                        random_text(s, len);
+                        ko_buffer_insert(b, pos, s, len);
+                        model_insert(m, pos, s, len);
+                        break;
+                    }
+                    case 1: {
+                        size_t len = 1 + rand() % 8;
+                        if (len > m->len - pos)
+                            len = m->len - pos;
+                        if (len == 0) {
+                            ko_buffer_insert(b, pos, "z", 1);
+                            model_insert(m, pos, "z", 1);
+                            break;
+                        }
+                        ko_buffer_delete(b, pos, len);
+                        model_delete(m, pos, len);
+                        break;
+                    }
+                    case 2: {
+                        // at a few ascending places, each as of the text with the ones before done
+                        size_t at[4], n = 1 + rand() % 4;
+                        for (size_t i = 0; i < n; i++)
+                            at[i] = rand() % (m->len + 1);
+                        for (size_t i = 1; i < n; i++)
+                            for (size_t k = i; k > 0 && at[k] < at[k - 1]; k--) {
+                                size_t t = at[k]; at[k] = at[k - 1]; at[k - 1] = t;
+                            }
+                        ko_buffer_insert_many(b, at, n, "q\n", 2);
+                        for (size_t i = n; i-- > 0; )
+                            model_insert(m, at[i], "q\n", 2);
+                        break;
+                    }
+                    default: {
+                        // separate ranges, counted back to front in the model so none moves
+                        size_t at[4], len[4], n = 0, from = 0;
+                        while (n < 4 && from < m->len) {
+                            at[n] = from + rand() % (m->len - from);
+                            len[n] = 1 + rand() % 3;
+                            if (at[n] + len[n] > m->len)
+                                len[n] = m->len - at[n];
+                            from = at[n] + len[n] + 1;
+                            n++;
+                        }
+                        if (n == 0) {
+                            ko_buffer_insert(b, 0, "z", 1);
+                            model_insert(m, 0, "z", 1);
+                            break;
+                        }
+                        ko_buffer_delete_many(b, at, len, n);
+                        for (size_t i = n; i-- > 0; )
+                            model_delete(m, at[i], len[i]);
+                    }
+                }
+                ko_buffer_seal(b);
+            }
+
+            KO_CHECK_EQ(ko_buffer_getstats(b).undo, done);
+            KO_CHECK_EQ(ko_buffer_getstats(b).redo, steps - done);
+            if (!check_text(b, &history[done])) {
+                fprintf(stderr, "seed %u step %d\n", seed, step);
+                break;
+            }
+        }
+        ko_buffer_free(b);
+    }
+}
+
+static void test_delete_many_after_undo(void) {
+    // an undone edit is still in the journal when the batch goes in, until the batch cuts it off
+    ko_buffer* b = ko_buffer_new("abcdef", 6);
+    ko_buffer_insert(b, 6, "X", 1);
+    ko_buffer_undo(b, NULL);
+    KO_CHECK_TEXT(b, "abcdef");
+
+    size_t pos[] = { 1, 3 }, len[] = { 1, 1 };
+    ko_buffer_delete_many(b, pos, len, 2);
+    KO_CHECK_TEXT(b, "acef");
+    KO_CHECK_EQ(ko_buffer_getstats(b).redo, 0);
+
+    KO_CHECK(ko_buffer_undo(b, NULL));
+    KO_CHECK_TEXT(b, "abcdef");
+    KO_CHECK(ko_buffer_redo(b, NULL));
+    KO_CHECK_TEXT(b, "acef");
+    KO_CHECK(ko_buffer_undo(b, NULL));
+    KO_CHECK_TEXT(b, "abcdef");
+    KO_CHECK(!ko_buffer_undo(b, NULL));
+    ko_buffer_free(b);
+}
+
+int main(void) {
+    test_boundaries();
+    test_spans_stop();
+    test_random_edits();
+    test_mapped();
+    test_round_trip();
+    test_redo_dropped();
+    test_steps();
+    test_batches();
+    test_random_undo();
+    test_delete_many_after_undo();
+    return ko_test_done();
+}
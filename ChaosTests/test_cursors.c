@@ -0,0 +1,282 @@
+// Typing, backspacing and deleting at many cursors, against the same done
+// to a plain array one cursor at a time. A character is a lead byte and as
+// many continuation bytes as it says; anything else (a stray continuation
+// byte, a lead byte without all of its) goes a byte at a time. A cursor
+// never takes out bytes past the cursor next to it, and cursors that end up
+// in the same place become one.
+
+#include "cursors.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX 2048
+
+typedef struct model {
+    unsigned char text[MAX];
+    size_t len;
+    size_t pos[MAX];
+    size_t n;
+} model;
+
+// how long the character a byte starts is: 0 for a continuation byte
+static size_t lead_length(unsigned char c) {
+    return c < 0x80 ? 1 : c < 0xC0 ? 0 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : c < 0xF8 ? 4 : 1;
+}
+
+// takes out [at[i], at[i] + len[i]) for each cursor, then moves them and merges the ones that meet
+static void model_cut(model* m, const size_t* at, const size_t* len) {
+    size_t gone = 0, n = 0;
+    for (size_t i = 0; i < m->n; i++) {
+        size_t from = at[i] - gone;
+        memmove(m->text + from, m->text + from + len[i], m->len - from - len[i]);
+        m->len -= len[i];
+        size_t p = m->pos[i] - gone - (at[i] < m->pos[i] ? len[i] : 0);
+        gone += len[i];
+        if (n == 0 || m->pos[n - 1] != p)
+            m->pos[n++] = p;
+    }
+    m->n = n;
+}
+
+static void model_backspace(model* m) {
+    size_t at[MAX], len[MAX];
+    for (size_t i = 0; i < m->n; i++) {
+        size_t p = m->pos[i], lo = i > 0 ? m->pos[i - 1] : 0;
+        size_t n = p > lo;
+
+        // the nearest byte that isn't a continuation, if it starts a character that ends here
+        for (size_t k = 1; k <= 4 && k <= p - lo; k++) {
+            if (lead_length(m->text[p - k]) != 0) {
+                if (lead_length(m->text[p - k]) == k)
+                    n = k;
+                break;
+            }
+        }
+        at[i] = p - n;
+        len[i] = n;
+    }
+    model_cut(m, at, len);
+}
+
+static void model_delete(model* m) {
+    size_t at[MAX], len[MAX];
+    for (size_t i = 0; i < m->n; i++) {
+        size_t p = m->pos[i], hi = i + 1 < m->n ? m->pos[i + 1] : m->len;
+        size_t n = 0;
+        if (p < hi) {
+            n = lead_length(m->text[p]);
+            if (n == 0)
+                n = 1;
+            for (size_t k = 1; k < n; k++)
+                if (p + k >= hi || lead_length(m->text[p + k]) != 0) {
+                    n = 1;
+                    break;
+                }
+        }
+        at[i] = p;
+        len[i] = n;
+    }
+    model_cut(m, at, len);
+}
+
+static void model_type(model* m, const char* str, size_t len) {
+    for (size_t i = 0; i < m->n; i++) {
+        size_t p = m->pos[i] + i * len;
+        memmove(m->text + p + len, m->text + p, m->len - p);
+        memcpy(m->text + p, str, len);
+        m->len += len;
+    }
+    for (size_t i = 0; i < m->n; i++)
+        m->pos[i] += (i + 1) * len;
+}
+
+static int check(ko_cursors* c, const ko_buffer* b, const model* m) {
+    int failures = ko_test_failures;
+    char text[MAX];
+    KO_CHECK_EQ(ko_buffer_length(b), m->len);
+    KO_CHECK_EQ(ko_buffer_copy(b, 0, sizeof(text), text), m->len);
+    KO_CHECK(memcmp(text, m->text, m->len) == 0);
+
+    const size_t* pos;
+    size_t n = ko_cursors_positions(c, &pos);
+    KO_CHECK_EQ(n, m->n);
+    for (size_t i = 0; i < n && i < m->n; i++)
+        KO_CHECK_EQ(pos[i], m->pos[i]);
+    return ko_test_failures == failures;
+}
+
+static void start(ko_buffer** b, ko_cursors** c, model* m, const char* text, const size_t* pos, size_t n) {
+    m->len = strlen(text);
+    memcpy(m->text, text, m->len);
+    m->n = n;
+    memcpy(m->pos, pos, n * sizeof(size_t));
+    *b = ko_buffer_new(text, m->len);
+    *c = ko_cursors_new(*b);
+    for (size_t i = 0; i < n; i++)
+        ko_cursors_add(*c, pos[i]);
+}
+
+static void finish(ko_buffer* b, ko_cursors* c) {
+    ko_cursors_free(c);
+    ko_buffer_free(b);
+}
+
+static void test_utf8(void) {
+    ko_buffer* b;
+    ko_cursors* c;
+    model m;
+
+    // é, €, 𝄞 and a, a character each
+    static const size_t ends[] = { 2, 5, 9, 10 };
+    start(&b, &c, &m, "\xC3\xA9\xE2\x82\xAC\xF0\x9D\x84\x9E" "a", ends, 4);
+    ko_cursors_backspace(c);
+    model_backspace(&m);
+    check(c, b, &m);
+    KO_CHECK_EQ(ko_buffer_length(b), 0);
+    const size_t* pos;
+    KO_CHECK_EQ(ko_cursors_positions(c, &pos), 1);
+    KO_CHECK_EQ(pos[0], 0);
+    finish(b, c);
+
+    // and forwards
+    static const size_t starts[] = { 0, 2, 5, 9 };
+    start(&b, &c, &m, "\xC3\xA9\xE2\x82\xAC\xF0\x9D\x84\x9E" "a", starts, 4);
+    ko_cursors_delete(c);
+    model_delete(&m);
+    check(c, b, &m);
+    KO_CHECK_EQ(ko_buffer_length(b), 0);
+    finish(b, c);
+
+    // a stray continuation byte after a character goes by itself, either way
+    static const size_t stray[] = { 3, 5 };
+    start(&b, &c, &m, "\xC3\xA9\x80" "a\x80x", stray, 2);
+    ko_cursors_backspace(c);
+    model_backspace(&m);
+    check(c, b, &m);
+    KO_CHECK(memcmp(m.text, "\xC3\xA9" "ax", 4) == 0);
+    finish(b, c);
+
+    // and so does a lead byte without all of its continuation bytes
+    static const size_t before[] = { 0, 2 };
+    start(&b, &c, &m, "\x80\x80\xE2\x82", before, 2);
+    ko_cursors_delete(c);
+    model_delete(&m);
+    check(c, b, &m);
+    KO_CHECK_EQ(m.len, 2);
+    finish(b, c);
+
+    // cursors inside a character, closer than it is long: none takes out what's behind the one before
+    static const size_t inside[] = { 1, 2, 3, 4 };
+    start(&b, &c, &m, "\xF0\x9D\x84\x9E", inside, 4);
+    ko_cursors_backspace(c);
+    model_backspace(&m);
+    check(c, b, &m);
+    KO_CHECK_EQ(m.len, 0);
+    finish(b, c);
+}
+
+static void test_merging(void) {
+    ko_buffer* b;
+    ko_cursors* c;
+    model m;
+
+    // backspacing at neighbours runs them into each other
+    static const size_t pos[] = { 1, 2, 3, 5 };
+    start(&b, &c, &m, "abcdef", pos, 4);
+    ko_cursors_backspace(c);
+    model_backspace(&m);
+    check(c, b, &m);
+    KO_CHECK_EQ(m.n, 2);
+    ko_cursors_type(c, "x", 1);
+    model_type(&m, "x", 1);
+    check(c, b, &m);
+    KO_CHECK(memcmp(m.text, "xdxf", 4) == 0);
+
+    // and undoing leaves them merged, where the text moves them
+    size_t at;
+    ko_buffer_undo(b, &at);
+    const size_t* p;
+    KO_CHECK_EQ(ko_cursors_positions(c, &p), 2);
+    finish(b, c);
+
+    // adding one where there's one already is the same cursor
+    static const size_t same[] = { 1, 1, 1 };
+    start(&b, &c, &m, "ab", same, 3);
+    KO_CHECK_EQ(ko_cursors_positions(c, &p), 1);
+    finish(b, c);
+}
+
+static void random_text(unsigned char* s, size_t len) {
+    static const char* bits[] = { "a", "b", "\n", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9D\x84\x9E", "\x80", "\xE2", "\xFF" };
+    size_t n = 0;
+    while (n < len) {
+        const char* bit = bits[rand() % 9];
+        size_t k = strlen(bit);
+        if (n + k > len)
+            k = len - n;
+        memcpy(s + n, bit, k);
+        n += k;
+    }
+}
+
+static void test_random(void) {
+    static const char* typed[] = { "x", "\xC3\xA9", "\xF0\x9D\x84\x9E", "\x80", "ab" };
+
+    for (unsigned seed = 1; seed <= 300; seed++) {
+        srand(seed);
+        static model m;
+        m.len = rand() % 300;
+        random_text(m.text, m.len);
+        ko_buffer* b = ko_buffer_new((const char*)m.text, m.len);
+        ko_cursors* c = ko_cursors_new(b);
+
+        // bunched up, so they're often only a byte or two apart
+        size_t base = rand() % (m.len + 1);
+        m.n = 0;
+        for (int i = 0, k = 1 + rand() % 30; i < k; i++) {
+            size_t p = rand() % 4 ? base + rand() % 12 : rand() % (m.len + 1);
+            if (p > m.len)
+                p = m.len;
+            ko_cursors_add(c, p);
+            size_t j = m.n;
+            while (j > 0 && m.pos[j - 1] > p)
+                j--;
+            if (j > 0 && m.pos[j - 1] == p)
+                continue;
+            memmove(m.pos + j + 1, m.pos + j, (m.n - j) * sizeof(size_t));
+            m.pos[j] = p;
+            m.n++;
+        }
+
+        for (int step = 0; step < 30 && m.len + 5 * m.n < MAX; step++) {
+            int op = rand() % 3;
+            if (op == 0) {
+                ko_cursors_backspace(c);
+                model_backspace(&m);
+            }
+            else if (op == 1) {
+                ko_cursors_delete(c);
+                model_delete(&m);
+            }
+            else {
+                const char* s = typed[rand() % 5];
+                ko_cursors_type(c, s, strlen(s));
+                model_type(&m, s, strlen(s));
+            }
+            if (!check(c, b, &m)) {
+                fprintf(stderr, "seed %u step %d\n", seed, step);
+                break;
+            }
+        }
+        finish(b, c);
+    }
+}
+
+int main(void) {
+    test_utf8();
+    test_merging();
+    test_random();
+    return ko_test_done();
+}
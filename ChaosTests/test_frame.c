@@ -0,0 +1,151 @@
+// The frame scheduler under a made-up clock: invalidations between frames
+// collapse into one redraw, redraws keep to the frame rate, and late ticks
+// show up as skipped frames.
+
+#include "frame.h"
+#include "test.h"
+
+#include <math.h>
+
+#define EPS 1e-9
+
+static void test_coalescing(void) {
+    ko_frame f;
+    ko_frame_init(&f, 60);
+
+    // nothing's been drawn yet, so the first frame can run straight away
+    KO_CHECK(fabs(ko_frame_invalidate(&f, 10.0)) < EPS);
+    KO_CHECK(ko_frame_tick(&f, 10.0));
+
+    // a burst right after waits for the next frame slot, and only asks for one tick
+    double delay = ko_frame_invalidate(&f, 10.001);
+    KO_CHECK(fabs(delay - (1.0 / 60 - 0.001)) < EPS);
+    for (int i = 0; i < 9; i++)
+        KO_CHECK(ko_frame_invalidate(&f, 10.002 + i * 0.001) < 0);
+    KO_CHECK_EQ(f.stats.requests, 11);
+    KO_CHECK_EQ(f.stats.coalesced, 9);
+
+    // a tick that comes early doesn't draw, and says how long to wait
+    KO_CHECK(!ko_frame_tick(&f, 10.01));
+    KO_CHECK(fabs(ko_frame_delay(&f, 10.01) - (10.0 + 1.0 / 60 - 10.01)) < EPS);
+    KO_CHECK(ko_frame_tick(&f, 10.0 + 1.0 / 60));
+    KO_CHECK_EQ(f.stats.frames, 2);
+
+    // and with nothing invalidated there's nothing to draw
+    KO_CHECK(!ko_frame_tick(&f, 11.0));
+    KO_CHECK_EQ(f.stats.frames, 2);
+    KO_CHECK_EQ(f.stats.skipped, 0);
+
+    // after a quiet spell, the next one is right away again
+    KO_CHECK(fabs(ko_frame_invalidate(&f, 12.0)) < EPS);
+}
+
+static void test_skipped(void) {
+    ko_frame f;
+    ko_frame_init(&f, 50);
+
+    ko_frame_invalidate(&f, 0.0);
+    ko_frame_tick(&f, 0.0);
+
+    // due at 0.02; a tick 3.5 frames late missed three slots
+    ko_frame_invalidate(&f, 0.001);
+    KO_CHECK(ko_frame_tick(&f, 0.02 + 0.07));
+    KO_CHECK_EQ(f.stats.skipped, 3);
+
+    // a little late isn't a skipped frame
+    ko_frame_invalidate(&f, 0.1);
+    KO_CHECK(ko_frame_tick(&f, 0.09 + 0.02 + 0.005));
+    KO_CHECK_EQ(f.stats.skipped, 3);
+    KO_CHECK_EQ(f.stats.frames, 3);
+}
+
+static void test_rate(void) {
+    ko_frame f;
+    ko_frame_init(&f, 60);
+    ko_frame_setrate(&f, 20);
+    KO_CHECK(fabs(f.interval - 0.05) < EPS);
+
+    ko_frame_invalidate(&f, 1.0);
+    ko_frame_tick(&f, 1.0);
+    KO_CHECK(fabs(ko_frame_invalidate(&f, 1.01) - 0.04) < EPS);
+
+    // nonsense rates are the default
+    ko_frame_setrate(&f, 0);
+    KO_CHECK(fabs(f.interval - 1.0 / KO_FRAME_DEFAULT_RATE) < EPS);
+    ko_frame_setrate(&f, -5);
+    KO_CHECK(fabs(f.interval - 1.0 / KO_FRAME_DEFAULT_RATE) < EPS);
+}
+
+// a host's run loop, for one simulated second of a key every millisecond:
+// it schedules a tick when asked to, and runs it when its time comes, or
+// when the last redraw is done if that's later. returns the number of redraws.
+static unsigned long run_host(double rate, double redraw_cost, ko_frame_stats* stats, double* closest) {
+    ko_frame f;
+    ko_frame_init(&f, rate);
+
+    double tick = -1;           // when the scheduled tick runs, or -1
+    double last = -1;
+    double busy = 0;            // the host can't do anything until then
+    *closest = 1e9;
+
+    for (int ms = 0; ms <= 1100; ms++) {
+        double now = ms / 1000.0;
+
+        // keys keep coming in while it's drawing, but ticks have to wait
+        if (tick >= 0 && now >= tick && now >= busy) {
+            tick = -1;
+            if (ko_frame_tick(&f, now)) {
+                if (last >= 0 && now - last < *closest)
+                    *closest = now - last;
+                last = now;
+                busy = now + redraw_cost;
+            }
+            else if (f.dirty) {
+                tick = now + ko_frame_delay(&f, now);
+            }
+        }
+
+        if (ms < 1000) {
+            double delay = ko_frame_invalidate(&f, now);
+            if (delay >= 0)
+                tick = now + delay;
+        }
+    }
+
+    *stats = f.stats;
+    return f.stats.frames;
+}
+
+static void test_host(void) {
+    ko_frame_stats stats;
+    double closest;
+
+    // a thousand keys make sixty redraws, never closer together than a frame
+    unsigned long frames = run_host(60, 0, &stats, &closest);
+    KO_CHECK(frames >= 58 && frames <= 61);
+    KO_CHECK(closest >= 1.0 / 60 - 0.001);
+    KO_CHECK_EQ(stats.requests, 1000);
+    KO_CHECK_EQ(stats.requests - stats.coalesced, stats.frames);
+    KO_CHECK_EQ(stats.skipped, 0);
+
+    // at 30 a second, half as many
+    frames = run_host(30, 0, &stats, &closest);
+    KO_CHECK(frames >= 29 && frames <= 31);
+    KO_CHECK(closest >= 1.0 / 30 - 0.001);
+
+    // redraws that take 50ms can't keep up with 60 a second; most of the slots they miss are
+    // counted (a tick less than a whole frame late doesn't count as skipping one)
+    frames = run_host(60, 0.05, &stats, &closest);
+    KO_CHECK(frames >= 18 && frames <= 21);
+    KO_CHECK(stats.skipped >= 20);
+    KO_CHECK(stats.frames + stats.skipped >= 45 && stats.frames + stats.skipped <= 61);
+    KO_CHECK_EQ(stats.requests - stats.coalesced, stats.frames);
+}
+
+int main(void) {
+    test_coalescing();
+    test_skipped();
+    test_rate();
+    test_host();
+    return ko_test_done();
+}
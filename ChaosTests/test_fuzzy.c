@@ -0,0 +1,134 @@
+// The fuzzy matcher against a plain subsequence search: it has to match the
+// same candidates, and put the query's characters in the same places, on
+// either side of the 64 bytes it matches a word at a time. Typing a query on
+// has to find what matching it from scratch finds.
+
+#include "fuzzy.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MAXLEN 140
+
+static unsigned char lower(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+// the first run of q in order that ends earliest, starting as late as it can
+// for that end, with each character as early as it can be in between
+static int place(const char* s, size_t len, const char* q, size_t qlen, size_t* at) {
+    size_t end = 0, j = 0;
+    for (; end < len && j < qlen; end++)
+        if (lower(s[end]) == lower(q[j]))
+            j++;
+    if (j < qlen)
+        return 0;
+
+    size_t start = end;
+    for (j = qlen; j-- > 0; )
+        while (lower(s[--start]) != lower(q[j])) {}
+
+    for (size_t i = start, k = 0; k < qlen; i++)
+        if (lower(s[i]) == lower(q[k]))
+            at[k++] = i;
+    return 1;
+}
+
+static void random_string(char* s, size_t len, const char* alphabet) {
+    size_t n = strlen(alphabet);
+    for (size_t i = 0; i < len; i++)
+        s[i] = alphabet[rand() % n];
+}
+
+static void test_edges(void) {
+    ko_fuzzy* f = ko_fuzzy_new();
+    char s[MAXLEN];
+    size_t pos[4];
+
+    // the last byte of a word, the first past it, and a run across the two
+    for (size_t len = 62; len <= 66; len++) {
+        memset(s, 'a', len);
+        s[len - 1] = 'Z';
+        ko_fuzzy_clear(f);
+        ko_fuzzy_add(f, s, len);
+        KO_CHECK_EQ(ko_fuzzy_positions(f, 0, "az", 2, pos), 2);
+        KO_CHECK_EQ(pos[0], len - 2);
+        KO_CHECK_EQ(pos[1], len - 1);
+        KO_CHECK_EQ(ko_fuzzy_positions(f, 0, "za", 2, pos), 0);
+    }
+
+    // a candidate no longer than the query
+    ko_fuzzy_clear(f);
+    ko_fuzzy_add(f, "ab", 2);
+    KO_CHECK_EQ(ko_fuzzy_positions(f, 0, "ab", 2, pos), 2);
+    KO_CHECK_EQ(ko_fuzzy_positions(f, 0, "abb", 3, pos), 0);
+    ko_fuzzy_free(f);
+}
+
+static void test_random(void) {
+    static const char* alphabet = "abcAB/_.-";
+    char s[MAXLEN], q[80];
+    size_t got[80], want[80];
+    ko_fuzzy_result* out = malloc(4000 * sizeof(ko_fuzzy_result));
+    ko_fuzzy_result* fresh = malloc(4000 * sizeof(ko_fuzzy_result));
+
+    for (unsigned seed = 1; seed <= 20; seed++) {
+        srand(seed);
+        ko_fuzzy* f = ko_fuzzy_new();
+        for (int i = 0; i < 4000; i++) {
+            size_t len = 1 + rand() % MAXLEN;
+            random_string(s, len, alphabet);
+            ko_fuzzy_add(f, s, len);
+        }
+
+        // typed a character at a time, so each carries on from the one before
+        size_t qlen = seed % 5 == 0 ? 70 : 12;
+        random_string(q, qlen, alphabet);
+        for (size_t n = 1; n <= qlen; n++) {
+            size_t matched, fresh_matched;
+            size_t k = ko_fuzzy_match(f, q, n, 4000, out, &matched);
+
+            size_t expect = 0;
+            for (size_t i = 0; i < ko_fuzzy_count(f); i++) {
+                size_t len;
+                const char* text = ko_fuzzy_get(f, i, &len);
+                int found = place(text, len, q, n, want);
+                expect += found;
+                KO_CHECK_EQ(ko_fuzzy_positions(f, i, q, n, got), found ? n : 0);
+                if (found && memcmp(got, want, n * sizeof(size_t)) != 0) {
+                    fprintf(stderr, "seed %u: \"%.*s\" in \"%.*s\" is in the wrong place\n", seed, (int)n, q, (int)len, text);
+                    ko_test_failures++;
+                }
+            }
+            KO_CHECK_EQ(matched, expect);
+            KO_CHECK_EQ(k, expect < 4000 ? expect : 4000);
+
+            ko_fuzzy* g = ko_fuzzy_new();
+            for (size_t i = 0; i < ko_fuzzy_count(f); i++) {
+                size_t len;
+                const char* text = ko_fuzzy_get(f, i, &len);
+                ko_fuzzy_add(g, text, len);
+            }
+            KO_CHECK_EQ(ko_fuzzy_match(g, q, n, 4000, fresh, &fresh_matched), k);
+            KO_CHECK_EQ(fresh_matched, matched);
+            for (size_t i = 0; i < k; i++) {
+                KO_CHECK_EQ(out[i].index, fresh[i].index);
+                KO_CHECK_EQ(out[i].score, fresh[i].score);
+            }
+            ko_fuzzy_free(g);
+
+            if (ko_test_failures)
+                break;
+        }
+        ko_fuzzy_free(f);
+    }
+    free(out);
+    free(fresh);
+}
+
+int main(void) {
+    test_edges();
+    test_random();
+    return ko_test_done();
+}
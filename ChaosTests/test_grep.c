@@ -0,0 +1,194 @@
+// Grep over a directory made for it: what .gitignore files and hidden names
+// leave out, a binary file skipped, a file big enough to be mapped, and
+// lines too long to report whole, whose matches have to stay inside what
+// is reported.
+
+#include "grep.h"
+#include "test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef struct found {
+    char path[64];
+    size_t line, start, end, len;
+    char text[8];               // the start of the line
+} found;
+
+typedef struct results {
+    found all[64];
+    size_t n;
+    int bad;                    // a match outside its line's text
+} results;
+
+static char root[64];
+static char made[16][96];
+static int nmade;
+
+// writes name (under root) and remembers it, to take it away after
+static void put(const char* name, const char* text, size_t len) {
+    snprintf(made[nmade], sizeof(made[0]), "%s/%s", root, name);
+    FILE* f = fopen(made[nmade++], "wb");
+    fwrite(text, 1, len, f);
+    fclose(f);
+}
+
+static void put_dir(const char* name) {
+    snprintf(made[nmade], sizeof(made[0]), "%s/%s", root, name);
+    mkdir(made[nmade++], 0700);
+}
+
+static void collect(void* ctx, const ko_grep_match* m, size_t n) {
+    results* r = ctx;
+    size_t rootlen = strlen(root);
+    for (size_t i = 0; i < n; i++) {
+        if (m[i].start > m[i].end || m[i].end > m[i].len)
+            r->bad = 1;
+        if (r->n == sizeof(r->all) / sizeof(r->all[0]))
+            continue;
+        found* f = &r->all[r->n++];
+        size_t pathlen = m[i].pathlen - rootlen - 1;
+        if (pathlen >= sizeof(f->path))
+            pathlen = sizeof(f->path) - 1;
+        memcpy(f->path, m[i].path + rootlen + 1, pathlen);
+        f->path[pathlen] = 0;
+        f->line = m[i].line;
+        f->start = m[i].start;
+        f->end = m[i].end;
+        f->len = m[i].len;
+        size_t t = m[i].len < sizeof(f->text) - 1 ? m[i].len : sizeof(f->text) - 1;
+        memcpy(f->text, m[i].text, t);
+        f->text[t] = 0;
+    }
+}
+
+static const found* lookup(const results* r, const char* path) {
+    for (size_t i = 0; i < r->n; i++)
+        if (strcmp(r->all[i].path, path) == 0)
+            return &r->all[i];
+    return NULL;
+}
+
+static void run(const char* pattern, int flags, results* r) {
+    memset(r, 0, sizeof(*r));
+    const char* err = NULL;
+    ko_grep* g = ko_grep_start(root, pattern, strlen(pattern), flags, &err);
+    KO_CHECK(g != NULL);
+    if (!g)
+        return;
+    while (ko_grep_poll(g, collect, r))
+        usleep(1000);
+    ko_grep_free(g);
+}
+
+static void make_tree(void) {
+    put("plain.txt", "hello\nsay needle\nbye\n", 21);
+    put(".gitignore", "ignored.txt\nout/\n*.log\n!keep.log\n", 33);
+    put("ignored.txt", "needle\n", 7);
+    put("skip.log", "needle\n", 7);
+    put("keep.log", "needle\n", 7);
+    put(".hidden", "needle\n", 7);
+    put_dir("out");
+    put("out/x.txt", "needle\n", 7);
+    put_dir("sub");
+    put("sub/.gitignore", "/local.txt\n", 11);
+    put("sub/local.txt", "needle\n", 7);
+    put("sub/kept.txt", "\n\nneedle", 8);
+
+    // a zero byte near the start makes it binary
+    char bin[64] = "needle\n";
+    bin[20] = 0;
+    put("bin.dat", bin, sizeof(bin));
+
+    // big enough to be mapped, with the match on its 5001st line
+    size_t biglen = 5200 * 60;
+    char* big = malloc(biglen);
+    memset(big, 'x', biglen);
+    for (size_t i = 59; i < biglen; i += 60)
+        big[i] = '\n';
+    memcpy(big + 5000 * 60 + 10, "needle", 6);
+    put("big.txt", big, biglen);
+    free(big);
+
+    // one match inside what's reported of a long line, one well past it
+    char lng[3000];
+    memset(lng, 'y', sizeof(lng));
+    memcpy(lng + 10, "needle", 6);
+    lng[1500] = '\n';
+    memcpy(lng + 2400, "needle", 6);
+    lng[2999] = '\n';
+    put("long.txt", lng, sizeof(lng));
+}
+
+static void test_tree(void) {
+    results r;
+    run("needle", 0, &r);
+    KO_CHECK(!r.bad);
+
+    const found* f = lookup(&r, "plain.txt");
+    KO_CHECK(f && f->line == 1 && f->start == 4 && f->end == 10 && f->len == 10);
+    KO_CHECK(f && strcmp(f->text, "say nee") == 0);
+
+    // what's ignored, hidden or binary isn't there; what's taken back is
+    KO_CHECK(!lookup(&r, "ignored.txt"));
+    KO_CHECK(!lookup(&r, "skip.log"));
+    KO_CHECK(lookup(&r, "keep.log"));
+    KO_CHECK(!lookup(&r, ".hidden"));
+    KO_CHECK(!lookup(&r, "out/x.txt"));
+    KO_CHECK(!lookup(&r, "sub/local.txt"));
+    KO_CHECK(!lookup(&r, "bin.dat"));
+    f = lookup(&r, "sub/kept.txt");
+    KO_CHECK(f && f->line == 2 && f->start == 0 && f->end == 6 && f->len == 6);
+
+    f = lookup(&r, "big.txt");
+    KO_CHECK(f && f->line == 5000 && f->start == 10 && f->end == 16 && f->len == 59);
+
+    // both of long.txt's lines are cut short; the second's match is past that, so it's put at the end
+    size_t lines = 0;
+    for (size_t i = 0; i < r.n; i++) {
+        f = &r.all[i];
+        if (strcmp(f->path, "long.txt") != 0)
+            continue;
+        lines++;
+        KO_CHECK_EQ(f->len, KO_GREP_MAXLINE);
+        if (f->line == 0) {
+            KO_CHECK_EQ(f->start, 10);
+            KO_CHECK_EQ(f->end, 16);
+        }
+        else {
+            KO_CHECK_EQ(f->line, 1);
+            KO_CHECK_EQ(f->start, KO_GREP_MAXLINE);
+            KO_CHECK_EQ(f->end, KO_GREP_MAXLINE);
+        }
+    }
+    KO_CHECK_EQ(lines, 2);
+    KO_CHECK_EQ(r.n, 6);
+
+    // a regex, ignoring case, finds the same lines
+    results again;
+    run("NE+DLE", KO_GREP_REGEX | KO_GREP_ICASE, &again);
+    KO_CHECK(!again.bad);
+    KO_CHECK_EQ(again.n, r.n);
+
+    const char* err = NULL;
+    KO_CHECK(ko_grep_start(root, "(", 1, KO_GREP_REGEX, &err) == NULL);
+    KO_CHECK(err != NULL);
+}
+
+int main(void) {
+    strcpy(root, "/tmp/ko_grepXXXXXX");
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    make_tree();
+    test_tree();
+
+    while (nmade > 0)
+        remove(made[--nmade]);
+    rmdir(root);
+    return ko_test_done();
+}
@@ -0,0 +1,278 @@
+// The grid's double buffering: what a commit reports as changed, how writes
+// are clipped, and how scrolls reach the renderer. A fake renderer keeps its
+// own copy of the screen from what commits tell it, and after every commit
+// that copy has to match what was drawn.
+
+#include "grid.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// a renderer: a copy of the screen, kept up to date only through the callbacks
+typedef struct screen {
+    const ko_grid* g;
+    ko_cell* cells;
+    int spans, cells_painted;
+    int accept;                 // whether it does scrolls itself
+    int scrolls;
+} screen;
+
+static const ko_cell junk = { '?', 99, 99, 99 };
+
+static void screen_span(void* ctx, int y, int x, int n) {
+    screen* s = ctx;
+    memcpy(s->cells + (size_t)y * s->g->cols + x, ko_grid_front_row(s->g, y) + x, n * sizeof(ko_cell));
+    s->spans++;
+    s->cells_painted += n;
+}
+
+static int screen_scroll(void* ctx, const ko_grid_move* m) {
+    screen* s = ctx;
+    if (!s->accept)
+        return 0;
+
+    // what a terminal's scroll region does: move what's there, and whatever's exposed is anyone's guess
+    int cols = s->g->cols;
+    ko_cell* old = malloc((size_t)cols * s->g->rows * sizeof(ko_cell));
+    memcpy(old, s->cells, (size_t)cols * s->g->rows * sizeof(ko_cell));
+    for (int y = m->y; y < m->y + m->h; y++) {
+        for (int x = m->x; x < m->x + m->w; x++) {
+            int sy = y + m->dy, sx = x + m->dx;
+            int inside = sy >= m->y && sy < m->y + m->h && sx >= m->x && sx < m->x + m->w;
+            s->cells[(size_t)y * cols + x] = inside ? old[(size_t)sy * cols + sx] : junk;
+        }
+    }
+    free(old);
+    s->scrolls++;
+    return 1;
+}
+
+static void screen_init(screen* s, const ko_grid* g) {
+    memset(s, 0, sizeof(screen));
+    s->g = g;
+    s->cells = malloc((size_t)g->cols * g->rows * sizeof(ko_cell));
+    for (int i = 0; i < g->cols * g->rows; i++)
+        s->cells[i] = junk;
+}
+
+static unsigned long screen_commit(screen* s, ko_grid* g) {
+    s->spans = s->cells_painted = s->scrolls = 0;
+    ko_grid_commit_scrolls(g, screen_scroll, s);
+    return ko_grid_commit(g, screen_span, s);
+}
+
+static int screen_matches(const screen* s, const ko_grid* g) {
+    size_t n = (size_t)g->cols * g->rows;
+    return memcmp(s->cells, g->cells, n * sizeof(ko_cell)) == 0 && memcmp(g->front, g->cells, n * sizeof(ko_cell)) == 0;
+}
+
+static void test_commit(void) {
+    ko_grid* g = ko_grid_new(40, 10);
+    screen s;
+    screen_init(&s, g);
+
+    // a new grid is drawn whole, a row at a time
+    KO_CHECK_EQ(screen_commit(&s, g), 400);
+    KO_CHECK_EQ(s.spans, 10);
+    KO_CHECK(screen_matches(&s, g));
+
+    // nothing written, nothing to paint
+    KO_CHECK_EQ(screen_commit(&s, g), 0);
+    KO_CHECK_EQ(s.spans, 0);
+
+    // one cell is one span of one cell
+    ko_grid_set(g, 7, 3, 'x', KO_COLOR_WHITE, KO_COLOR_BLACK);
+    KO_CHECK_EQ(screen_commit(&s, g), 1);
+    KO_CHECK_EQ(s.spans, 1);
+    KO_CHECK_EQ(s.cells_painted, 1);
+    KO_CHECK(screen_matches(&s, g));
+
+    // writing what's already there isn't a change
+    ko_grid_set(g, 7, 3, 'x', KO_COLOR_WHITE, KO_COLOR_BLACK);
+    size_t i = 0;
+    ko_grid_blit(g, 0, 5, "", 0, &i, KO_COLOR_BLACK, KO_COLOR_WHITE);
+    KO_CHECK_EQ(screen_commit(&s, g), 0);
+    KO_CHECK_EQ(s.spans, 0);
+
+    // changes a few cells apart share a span; far apart, they don't
+    ko_grid_set(g, 2, 1, 'a', KO_COLOR_BLACK, KO_COLOR_WHITE);
+    ko_grid_set(g, 5, 1, 'b', KO_COLOR_BLACK, KO_COLOR_WHITE);
+    ko_grid_set(g, 30, 1, 'c', KO_COLOR_BLACK, KO_COLOR_WHITE);
+    KO_CHECK_EQ(screen_commit(&s, g), 3);
+    KO_CHECK_EQ(s.spans, 2);
+    KO_CHECK_EQ(s.cells_painted, 4 + 1);
+    KO_CHECK(screen_matches(&s, g));
+
+    // a recolor is a change too
+    ko_grid_paint(g, 0, 9, 40, KO_COLOR_WHITE, KO_COLOR_BLACK);
+    KO_CHECK_EQ(screen_commit(&s, g), 40);
+    KO_CHECK(screen_matches(&s, g));
+
+    // after a resize everything's drawn again, with the old cells kept at the top-left
+    ko_grid_resize(g, 20, 12);
+    free(s.cells);
+    screen_init(&s, g);
+    KO_CHECK_EQ(screen_commit(&s, g), 240);
+    KO_CHECK_EQ(ko_grid_row(g, 3)[7].ch, 'x');
+    KO_CHECK_EQ(ko_grid_row(g, 11)[0].ch, ' ');
+    KO_CHECK(screen_matches(&s, g));
+
+    free(s.cells);
+    ko_grid_free(g);
+}
+
+static void test_blit(void) {
+    ko_grid* g = ko_grid_new(10, 3);
+
+    // utf-8 is one cell per codepoint, and *i ends up after what was drawn
+    const char* str = "h\xc3\xa9llo \xe2\x9c\x93";
+    size_t i = 0;
+    KO_CHECK_EQ(ko_grid_blit(g, 0, 0, str, strlen(str), &i, KO_COLOR_BLACK, KO_COLOR_WHITE), 7);
+    KO_CHECK_EQ(i, strlen(str));
+    KO_CHECK_EQ(ko_grid_row(g, 0)[1].ch, 0xE9);
+    KO_CHECK_EQ(ko_grid_row(g, 0)[6].ch, 0x2713);
+
+    // clipped at the right edge, with *i at the first byte that didn't fit
+    i = 0;
+    KO_CHECK_EQ(ko_grid_blit(g, 6, 1, "abcdefgh", 8, &i, KO_COLOR_BLACK, KO_COLOR_WHITE), 4);
+    KO_CHECK_EQ(i, 4);
+    KO_CHECK_EQ(ko_grid_row(g, 1)[9].ch, 'd');
+
+    // hanging off the left edge skips the part that's off it
+    i = 0;
+    KO_CHECK_EQ(ko_grid_blit(g, -2, 2, "abcdef", 6, &i, KO_COLOR_BLACK, KO_COLOR_WHITE), 4);
+    KO_CHECK_EQ(ko_grid_row(g, 2)[0].ch, 'c');
+
+    // a row off the grid is measured but not drawn
+    i = 0;
+    KO_CHECK_EQ(ko_grid_blit(g, 0, 5, "abcdefghijkl", 12, &i, KO_COLOR_BLACK, KO_COLOR_WHITE), 10);
+    KO_CHECK_EQ(i, 10);
+
+    // malformed utf-8 is U+FFFD
+    i = 0;
+    ko_grid_blit(g, 0, 0, "\xff", 1, &i, KO_COLOR_BLACK, KO_COLOR_WHITE);
+    KO_CHECK_EQ(ko_grid_row(g, 0)[0].ch, 0xFFFD);
+
+    ko_grid_free(g);
+}
+
+static void fill_rows(ko_grid* g) {
+    for (int y = 0; y < g->rows; y++)
+        for (int x = 0; x < g->cols; x++)
+            ko_grid_set(g, x, y, 'A' + (y + x) % 26, KO_COLOR_BLACK, KO_COLOR_WHITE);
+}
+
+static void test_scroll(void) {
+    ko_grid* g = ko_grid_new(30, 10);
+    screen s;
+    screen_init(&s, g);
+    fill_rows(g);
+    screen_commit(&s, g);
+
+    // the cells move up, and the two rows scrolled in are blank
+    ko_color bg = ko_color_intern(0x123456);
+    ko_grid_scroll(g, 0, 2, 30, 6, 0, 2, bg);
+    KO_CHECK_EQ(ko_grid_row(g, 2)[0].ch, 'A' + 4);
+    KO_CHECK_EQ(ko_grid_row(g, 6)[0].ch, ' ');
+    KO_CHECK_EQ(ko_grid_row(g, 6)[0].bg, bg);
+    KO_CHECK_EQ(ko_grid_row(g, 8)[0].ch, 'A' + 8);
+
+    // a renderer that scrolls only gets the exposed rows to paint
+    s.accept = 1;
+    KO_CHECK_EQ(screen_commit(&s, g), 60);
+    KO_CHECK_EQ(s.scrolls, 1);
+    KO_CHECK_EQ(g->stats.scrolls, 1);
+    KO_CHECK(screen_matches(&s, g));
+
+    // one that doesn't repaints everything that moved
+    s.accept = 0;
+    ko_grid_scroll(g, 0, 2, 30, 6, 0, -1, bg);
+    KO_CHECK_EQ(screen_commit(&s, g), 150);
+    KO_CHECK(screen_matches(&s, g));
+
+    // scrolling the same way again adds up to one move
+    s.accept = 1;
+    ko_grid_scroll(g, 0, 0, 30, 10, 0, 1, bg);
+    ko_grid_scroll(g, 0, 0, 30, 10, 0, 1, bg);
+    KO_CHECK_EQ(g->nmoves, 1);
+    KO_CHECK_EQ(g->moves[0].dy, 2);
+    screen_commit(&s, g);
+    KO_CHECK_EQ(s.scrolls, 1);
+    KO_CHECK(screen_matches(&s, g));
+
+    // sideways, with a row drawn in between
+    fill_rows(g);
+    screen_commit(&s, g);
+    ko_grid_scroll(g, 5, 0, 20, 10, 3, 0, bg);
+    ko_grid_set(g, 0, 4, '!', KO_COLOR_BLACK, KO_COLOR_WHITE);
+    ko_grid_scroll(g, 0, 0, 30, 10, 0, -3, bg);
+    KO_CHECK_EQ(g->nmoves, 2);
+    screen_commit(&s, g);
+    KO_CHECK_EQ(s.scrolls, 2);
+    KO_CHECK_EQ(ko_grid_row(g, 7)[0].ch, '!');
+    KO_CHECK(screen_matches(&s, g));
+
+    // too many to keep track of, and it just diffs
+    for (int k = 0; k < KO_GRID_MAX_MOVES + 1; k++)
+        ko_grid_scroll(g, 0, k % 2, 30, 8, 0, k % 2 ? 1 : -1, bg);
+    screen_commit(&s, g);
+    KO_CHECK(s.scrolls <= KO_GRID_MAX_MOVES);
+    KO_CHECK(screen_matches(&s, g));
+
+    // scrolling by the whole height just clears it
+    ko_grid_scroll(g, 0, 0, 30, 10, 0, 10, bg);
+    KO_CHECK_EQ(g->nmoves, 0);
+    KO_CHECK_EQ(ko_grid_row(g, 9)[29].bg, bg);
+    screen_commit(&s, g);
+    KO_CHECK(screen_matches(&s, g));
+
+    free(s.cells);
+    ko_grid_free(g);
+}
+
+// random writes and scrolls, with renderers that do and don't scroll
+static void test_random(void) {
+    srand(1);
+    for (int round = 0; round < 200; round++) {
+        ko_grid* g = ko_grid_new(1 + rand() % 40, 1 + rand() % 20);
+        screen s;
+        screen_init(&s, g);
+
+        for (int frame = 0; frame < 30; frame++) {
+            s.accept = rand() % 2;
+            int ops = rand() % 6;
+            for (int k = 0; k < ops; k++) {
+                int x = rand() % (g->cols + 4) - 2, y = rand() % (g->rows + 4) - 2;
+                int w = rand() % (g->cols + 2), h = rand() % (g->rows + 2);
+                ko_color c = rand() % 2;
+                size_t i = 0;
+                switch (rand() % 5) {
+                    case 0: ko_grid_set(g, x, y, 'a' + rand() % 26, c, !c); break;
+                    case 1: ko_grid_blit(g, x, y, "scrolling text", 14, &i, c, !c); break;
+                    case 2: ko_grid_fill(g, x, y, w, h, '#', c, !c); break;
+                    case 3: ko_grid_scroll(g, x, y, w, h, rand() % 5 - 2, rand() % 7 - 3, c); break;
+                    case 4: ko_grid_scroll(g, 0, y, g->cols, h, 0, rand() % 5 - 2, c); break;
+                }
+            }
+            screen_commit(&s, g);
+            if (!screen_matches(&s, g)) {
+                KO_CHECK(screen_matches(&s, g));
+                fprintf(stderr, "round %d frame %d\n", round, frame);
+                frame = 30;
+                round = 200;
+            }
+        }
+
+        free(s.cells);
+        ko_grid_free(g);
+    }
+}
+
+int main(void) {
+    test_commit();
+    test_blit();
+    test_scroll();
+    test_random();
+    return ko_test_done();
+}
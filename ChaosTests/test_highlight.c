@@ -0,0 +1,142 @@
+// The incremental highlighter against one built from scratch: after edits,
+// with only some of the lines asked about in between, every line has to come
+// out styled the same. Block comments are what carry a state from one line
+// to the next, so they're what the grammar has.
+
+#include "highlight.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum { CODE, COMMENT, WORD, KEYWORD, STRING };
+
+static ko_grammar* c_grammar(void) {
+    ko_grammar* g = ko_grammar_new();
+    int code = ko_grammar_state(g, CODE);
+    int comment = ko_grammar_state(g, COMMENT);
+    int string = ko_grammar_state(g, STRING);
+    const char* err;
+
+    ko_grammar_rule(g, code, "/\\*", 3, 0, COMMENT, comment, &err);
+    ko_grammar_rule(g, code, "\"", 1, 0, STRING, string, &err);
+    ko_grammar_rule(g, code, "[a-z]+", 6, 0, WORD, -1, &err);
+    ko_grammar_keyword(g, code, "if", 2, KEYWORD);
+    ko_grammar_keyword(g, code, "for", 3, KEYWORD);
+    ko_grammar_rule(g, comment, "\\*/", 3, 0, COMMENT, code, &err);
+    ko_grammar_rule(g, string, "\\\\.", 3, 0, STRING, -1, &err);
+    ko_grammar_rule(g, string, "\"", 1, 0, STRING, code, &err);
+    return g;
+}
+
+// every line of h, against a highlighter that's never seen an edit
+static int check_lines(ko_highlight* h, ko_buffer* b, ko_grammar* g) {
+    int failures = ko_test_failures;
+    ko_highlight* fresh = ko_highlight_new(b, g);
+    size_t lines = ko_buffer_lines(b);
+
+    for (size_t line = 0; line < lines && ko_test_failures == failures; line++) {
+        const ko_hlrun* runs;
+        size_t n = ko_highlight_line(fresh, line, &runs);
+        ko_hlrun* want = malloc((n ? n : 1) * sizeof(ko_hlrun));
+        if (n)
+            memcpy(want, runs, n * sizeof(ko_hlrun));
+
+        size_t got = ko_highlight_line(h, line, &runs);
+        KO_CHECK_EQ(got, n);
+        if (got == n && n && memcmp(runs, want, n * sizeof(ko_hlrun)) != 0) {
+            fprintf(stderr, "%s:%d: line %zu is styled differently\n", __FILE__, __LINE__, line);
+            ko_test_failures++;
+        }
+        free(want);
+    }
+
+    ko_highlight_free(fresh);
+    return ko_test_failures == failures;
+}
+
+static void test_settles_after_old_edit(void) {
+    // an edit above where the last one's lexing stopped: the lines between
+    // them match states that still date from before the last one
+    ko_grammar* g = c_grammar();
+    ko_buffer* b = ko_buffer_new("*/\n\n*/ if x/*", 13);
+    ko_highlight* h = ko_highlight_new(b, g);
+    const ko_hlrun* runs;
+
+    ko_buffer_insert(b, 1, "\n\n", 2);
+    ko_buffer_insert(b, 7, " ", 1);
+    ko_buffer_insert(b, 13, "\n\n", 2);
+    ko_highlight_line(h, 6, &runs);
+    ko_buffer_insert(b, 10, "\n", 1);
+    ko_buffer_insert(b, 6, "/*", 2);
+    ko_highlight_line(h, 6, &runs);
+    ko_buffer_insert(b, 16, "for", 3);
+
+    check_lines(h, b, g);
+    ko_highlight_free(h);
+    ko_buffer_free(b);
+    ko_grammar_free(g);
+}
+
+static void random_text(char* s, size_t len) {
+    static const char* bits[] = { "/*", "*/", "\"", "\\", "\n", "\n", " ", "if", "for", "x", "y" };
+    size_t n = 0;
+    while (n < len) {
+        const char* bit = bits[rand() % 11];
+        size_t k = strlen(bit);
+        if (n + k > len)
+            k = len - n;
+        memcpy(s + n, bit, k);
+        n += k;
+    }
+}
+
+static void test_random(void) {
+    ko_grammar* g = c_grammar();
+    char text[200];
+
+    for (unsigned seed = 1; seed <= 500; seed++) {
+        srand(seed);
+        size_t len = rand() % sizeof(text);
+        random_text(text, len);
+        ko_buffer* b = ko_buffer_new(text, len);
+        ko_highlight* h = ko_highlight_new(b, g);
+
+        for (int step = 0; step < 30; step++) {
+            // some edits come before anything's asked, some after only part of the file is
+            int edits = 1 + rand() % 3;
+            for (int i = 0; i < edits; i++) {
+                size_t total = ko_buffer_length(b);
+                size_t pos = rand() % (total + 1);
+                if (rand() % 3 && total < 1000) {
+                    char s[8];
+                    size_t n = 1 + rand() % sizeof(s);
+                    random_text(s, n);
+                    ko_buffer_insert(b, pos, s, n);
+                }
+                else {
+                    ko_buffer_delete(b, pos, 1 + rand() % 6);
+                }
+            }
+
+            const ko_hlrun* runs;
+            if (rand() % 3)
+                ko_highlight_line(h, rand() % (ko_buffer_lines(b) + 1), &runs);
+            if (rand() % 4 == 0 && !check_lines(h, b, g)) {
+                fprintf(stderr, "seed %u step %d\n", seed, step);
+                break;
+            }
+        }
+        check_lines(h, b, g);
+
+        ko_highlight_free(h);
+        ko_buffer_free(b);
+    }
+    ko_grammar_free(g);
+}
+
+int main(void) {
+    test_settles_after_old_edit();
+    test_random();
+    return ko_test_done();
+}
@@ -0,0 +1,241 @@
+// Marker sets against a plain array of ranges moved by the rules in
+// markers.h, through single edits (a marker at a time) and batches (all of
+// them in one sweep):
+//
+//   text inserted where a marker starts goes before it,
+//   text inserted where it ends doesn't go in it,
+//   an empty marker moves with the text after it,
+//   deleting a marker's text leaves it empty where the text was.
+
+#include "markers.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX 400
+
+typedef struct range {
+    uint32_t id;
+    size_t start, end;
+} range;
+
+typedef struct model {
+    range r[MAX];
+    size_t n;
+} model;
+
+static void model_insert(model* m, size_t pos, size_t len) {
+    for (size_t i = 0; i < m->n; i++) {
+        range* r = &m->r[i];
+        int empty = r->start == r->end;
+        if (r->start >= pos)
+            r->start += len;
+        if (r->end > pos || (empty && r->end == pos))
+            r->end += len;
+    }
+}
+
+static size_t cut(size_t x, size_t pos, size_t len) {
+    return x < pos ? x : x >= pos + len ? x - len : pos;
+}
+
+static void model_delete(model* m, size_t pos, size_t len) {
+    for (size_t i = 0; i < m->n; i++) {
+        m->r[i].start = cut(m->r[i].start, pos, len);
+        m->r[i].end = cut(m->r[i].end, pos, len);
+    }
+}
+
+// what find should call fn with: overlapping, or empty and in the range
+static int wanted(const range* r, size_t start, size_t end) {
+    return r->start < end && (r->end > start || r->start >= start);
+}
+
+typedef struct found {
+    range r[MAX];
+    size_t n, stop;
+} found;
+
+static int collect(void* ctx, uint32_t id, size_t start, size_t end) {
+    found* f = ctx;
+    f->r[f->n++] = (range){ id, start, end };
+    return f->n != f->stop;
+}
+
+static int check(const ko_markers* set, const model* m, size_t length) {
+    int failures = ko_test_failures;
+    KO_CHECK_EQ(ko_markers_count(set), m->n);
+    for (size_t i = 0; i < m->n; i++) {
+        size_t start, end;
+        KO_CHECK(ko_markers_get(set, m->r[i].id, &start, &end));
+        KO_CHECK_EQ(start, m->r[i].start);
+        KO_CHECK_EQ(end, m->r[i].end);
+    }
+
+    // a few ranges: the right markers, each once, in the order they start
+    for (int q = 0; q < 4 && ko_test_failures == failures; q++) {
+        size_t start = rand() % (length + 2), end = start + rand() % 20;
+        static found f;
+        f.n = f.stop = 0;
+        ko_markers_find(set, start, end, collect, &f);
+
+        size_t want = 0;
+        for (size_t i = 0; i < m->n; i++)
+            want += wanted(&m->r[i], start, end);
+        KO_CHECK_EQ(f.n, want);
+        for (size_t k = 0; k < f.n; k++) {
+            KO_CHECK(wanted(&f.r[k], start, end));
+            KO_CHECK(k == 0 || f.r[k - 1].start <= f.r[k].start);
+            for (size_t j = 0; j < k; j++)
+                KO_CHECK(f.r[j].id != f.r[k].id);
+        }
+    }
+    return ko_test_failures == failures;
+}
+
+static void test_rules(void) {
+    ko_buffer* b = ko_buffer_new("0123456789", 10);
+    ko_markers* set = ko_markers_new(b);
+    uint32_t a = ko_markers_add(set, 2, 5);
+    uint32_t empty = ko_markers_add(set, 7, 7);
+    size_t start, end;
+
+    // at the start goes before it, at the end stays out of it
+    ko_buffer_insert(b, 2, "ab", 2);
+    ko_buffer_insert(b, 7, "cd", 2);
+    KO_CHECK(ko_markers_get(set, a, &start, &end));
+    KO_CHECK_EQ(start, 4);
+    KO_CHECK_EQ(end, 7);
+
+    // an empty one moves along with what's after it
+    KO_CHECK(ko_markers_get(set, empty, &start, &end));
+    KO_CHECK_EQ(start, 11);
+    ko_buffer_insert(b, 11, "e", 1);
+    KO_CHECK(ko_markers_get(set, empty, &start, &end));
+    KO_CHECK_EQ(start, 12);
+    KO_CHECK_EQ(end, 12);
+
+    // deleting more than all of it leaves it empty where its text was
+    ko_buffer_delete(b, 3, 6);
+    KO_CHECK(ko_markers_get(set, a, &start, &end));
+    KO_CHECK_EQ(start, 3);
+    KO_CHECK_EQ(end, 3);
+
+    // find: empty markers count when they're in the range, not at its end
+    static found f;
+    f.n = f.stop = 0;
+    ko_markers_find(set, 0, 3, collect, &f);
+    KO_CHECK_EQ(f.n, 0);
+    ko_markers_find(set, 3, 4, collect, &f);
+    KO_CHECK_EQ(f.n, 1);
+    KO_CHECK_EQ(f.r[0].id, a);
+
+    // stopping early, and ids of removed markers
+    uint32_t c = ko_markers_add(set, 0, 10);
+    f.n = 0;
+    f.stop = 1;
+    ko_markers_find(set, 0, 20, collect, &f);
+    KO_CHECK_EQ(f.n, 1);
+    KO_CHECK_EQ(f.r[0].id, c);
+    ko_markers_remove(set, a);
+    KO_CHECK(!ko_markers_get(set, a, &start, &end));
+    KO_CHECK_EQ(ko_markers_count(set), 2);
+    ko_markers_clear(set);
+    KO_CHECK_EQ(ko_markers_count(set), 0);
+    KO_CHECK(!ko_markers_get(set, c, &start, &end));
+
+    ko_markers_free(set);
+    ko_buffer_free(b);
+}
+
+static void test_random(void) {
+    static char text[4096];
+    memset(text, 'x', sizeof(text));
+
+    for (unsigned seed = 1; seed <= 300; seed++) {
+        srand(seed);
+        ko_buffer* b = ko_buffer_new(text, 100 + rand() % 200);
+        ko_markers* set = ko_markers_new(b);
+        static model m;
+        m.n = 0;
+
+        // few markers, so batches go through the sweep, or lots, so they're taken one at a time
+        size_t want = seed % 2 ? 8 : 300;
+        for (int step = 0; step < 60; step++) {
+            size_t length = ko_buffer_length(b);
+            while (m.n < want && rand() % 4) {
+                size_t start = rand() % (length + 1);
+                size_t end = rand() % 3 == 0 ? start : start + rand() % (length - start + 1);
+                m.r[m.n++] = (range){ ko_markers_add(set, start, end), start, end };
+            }
+            if (m.n && rand() % 8 == 0) {
+                size_t i = rand() % m.n;
+                ko_markers_remove(set, m.r[i].id);
+                m.r[i] = m.r[--m.n];
+            }
+
+            size_t pos[4], len[4], n = 1 + rand() % 4;
+            switch (rand() % 4) {
+                case 0: {
+                    size_t at = rand() % (length + 1), k = 1 + rand() % 5;
+                    ko_buffer_insert(b, at, text, k);
+                    model_insert(&m, at, k);
+                    break;
+                }
+                case 1: {
+                    size_t at = rand() % (length + 1), k = 1 + rand() % 8;
+                    if (k > length - at)
+                        k = length - at;
+                    ko_buffer_delete(b, at, k);
+                    model_delete(&m, at, k);
+                    break;
+                }
+                case 2: {
+                    // each place is as of the text with the ones before done
+                    for (size_t i = 0; i < n; i++)
+                        pos[i] = rand() % (length + 1);
+                    for (size_t i = 1; i < n; i++)
+                        for (size_t k = i; k > 0 && pos[k] < pos[k - 1]; k--) {
+                            size_t t = pos[k]; pos[k] = pos[k - 1]; pos[k - 1] = t;
+                        }
+                    ko_buffer_insert_many(b, pos, n, text, 2);
+                    for (size_t i = 0; i < n; i++)
+                        model_insert(&m, pos[i] + 2 * i, 2);
+                    break;
+                }
+                default: {
+                    size_t from = 0, k = 0;
+                    while (k < n && from < length) {
+                        pos[k] = from + rand() % (length - from);
+                        len[k] = 1 + rand() % 4;
+                        if (pos[k] + len[k] > length)
+                            len[k] = length - pos[k];
+                        from = pos[k] + len[k] + rand() % 2;
+                        k++;
+                    }
+                    ko_buffer_delete_many(b, pos, len, k);
+                    size_t gone = 0;
+                    for (size_t i = 0; i < k; i++) {
+                        model_delete(&m, pos[i] - gone, len[i]);
+                        gone += len[i];
+                    }
+                }
+            }
+
+            if (!check(set, &m, ko_buffer_length(b))) {
+                fprintf(stderr, "seed %u step %d\n", seed, step);
+                break;
+            }
+        }
+
+        ko_markers_free(set);
+        ko_buffer_free(b);
+    }
+}
+
+int main(void) {
+    test_rules();
+    test_random();
+    return ko_test_done();
+}
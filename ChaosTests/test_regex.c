@@ -0,0 +1,239 @@
+// Regular expressions: a table of patterns and where their leftmost match
+// is (anchors, classes, alternation, repetition, ignoring case), patterns
+// that shouldn't compile, buffers cut into small pieces against the same
+// text as a string, and the same answers again with the DFA caches so small
+// they're emptied over and over.
+
+#include "regex.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct regex_case {
+    const char* pattern;
+    int flags;
+    const char* text;
+    size_t pos;
+    long start, end;            // -1 for no match
+} regex_case;
+
+static const regex_case cases[] = {
+    // anchors, at the ends and at line breaks
+    { "^a", 0, "ba\na", 0, 3, 4 },
+    { "^b", 0, "ab", 1, -1, -1 },
+    { "^b", 0, "a\nb", 2, 2, 3 },
+    { "b$", 0, "ab\nab", 0, 1, 2 },
+    { "a$", 0, "ab\nab a", 0, 6, 7 },
+    { "^$", 0, "a\n\nb", 0, 2, 2 },
+    { "^abc$", 0, "abc", 0, 0, 3 },
+    { "$", 0, "abc", 0, 3, 3 },
+    { "^", 0, "abc", 1, -1, -1 },
+
+    // classes
+    { "[a-c]+", 0, "xxbcaz", 0, 2, 5 },
+    { "[^a-c]+", 0, "abxyc", 0, 2, 4 },
+    { "\\d+", 0, "ab123c", 0, 2, 5 },
+    { "\\w+", 0, "  foo_1 ", 0, 2, 7 },
+    { "\\s+", 0, "a \t\nb", 0, 1, 4 },
+    { "\\D", 0, "12a", 0, 2, 3 },
+    { "\\x41", 0, "zA", 0, 1, 2 },
+    { "\\.", 0, "a.b", 0, 1, 2 },
+    { "a.c", 0, "a\ncabc", 0, 3, 6 },
+    { ".", 0, "\xc3\xa9x", 0, 0, 2 },
+    { "[^a]", 0, "a\xe2\x82\xac" "b", 0, 1, 4 },
+
+    // ignoring case
+    { "ABC", KO_REGEX_ICASE, "xabc", 0, 1, 4 },
+    { "[a-c]+", KO_REGEX_ICASE, "XBCA", 0, 1, 4 },
+    { "ABC", 0, "xabc", 0, -1, -1 },
+
+    // alternation, preferring the earlier
+    { "cat|dog", 0, "hotdog cat", 0, 3, 6 },
+    { "a|ab", 0, "ab", 0, 0, 1 },
+    { "ab|a", 0, "ab", 0, 0, 2 },
+    { "(a|b)c", 0, "xbc", 0, 1, 3 },
+    { "x(?:ab|cd)+y", 0, "xabcdy", 0, 0, 6 },
+    { "a|", 0, "b", 0, 0, 0 },
+
+    // repetition, greedy and lazy
+    { "a*", 0, "baa", 0, 0, 0 },
+    { "a+", 0, "baa", 0, 1, 3 },
+    { "a+?", 0, "baa", 0, 1, 2 },
+    { "a*?b", 0, "aab", 0, 0, 3 },
+    { "a{2}", 0, "aaaa", 0, 0, 2 },
+    { "a{2,}", 0, "aaaa", 0, 0, 4 },
+    { "a{1,3}", 0, "aaaa", 0, 0, 3 },
+    { "a{2,3}?", 0, "aaaa", 0, 0, 2 },
+    { "a{0}b", 0, "ab", 0, 1, 2 },
+    { "colou?r", 0, "color", 0, 0, 5 },
+    { "<.*>", 0, "<a><b>", 0, 0, 6 },
+    { "<.*?>", 0, "<a><b>", 0, 0, 3 },
+    { "(ab)*c", 0, "ababc", 0, 0, 5 },
+
+    // starting further in
+    { "a", 0, "aXa", 1, 2, 3 },
+    { "a", 0, "a", 1, -1, -1 },
+    { "a*", 0, "aa", 2, 2, 2 },
+};
+
+static const char* const bad[] = {
+    "(", "a)", "[a", "*a", "a{2,1}", "\\", "\\q", "\\x4", "[z-a]",
+};
+
+static void run_cases(size_t cache) {
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const regex_case* c = &cases[i];
+        const char* err = NULL;
+        ko_regex* re = ko_regex_new(c->pattern, strlen(c->pattern), c->flags, &err);
+        KO_CHECK(re != NULL);
+        if (!re) {
+            fprintf(stderr, "%s: %s\n", c->pattern, err);
+            continue;
+        }
+        if (cache)
+            ko_regex_setcache(re, cache);
+
+        // twice, so the second goes through transitions the first worked out
+        for (int k = 0; k < 2; k++) {
+            size_t start = 0, end = 0;
+            int found = ko_regex_find_string(re, c->text, strlen(c->text), c->pos, &start, &end);
+            if (found != (c->start >= 0) || (found && ((long)start != c->start || (long)end != c->end))) {
+                fprintf(stderr, "/%s/ at %zu: %d [%zu, %zu), not [%ld, %ld)\n", c->pattern, c->pos, found, start, end, c->start, c->end);
+                ko_test_failures++;
+                break;
+            }
+        }
+        ko_regex_free(re);
+    }
+}
+
+static void test_table(void) {
+    run_cases(0);
+    run_cases(2);
+
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        const char* err = NULL;
+        ko_regex* re = ko_regex_new(bad[i], strlen(bad[i]), 0, &err);
+        KO_CHECK(re == NULL);
+        KO_CHECK(err != NULL);
+        ko_regex_free(re);
+    }
+}
+
+static void random_text(char* s, size_t len) {
+    static const char letters[] = "aaabbbcA1 \n";
+    for (size_t i = 0; i < len; i++)
+        s[i] = letters[rand() % (sizeof(letters) - 1)];
+}
+
+// a buffer of text cut into pieces of a few bytes each
+static ko_buffer* in_pieces(const char* text, size_t len) {
+    ko_buffer* b = ko_buffer_new("", 0);
+    for (size_t i = 0; i < len; ) {
+        size_t n = 1 + rand() % 5;
+        if (n > len - i)
+            n = len - i;
+        ko_buffer_insert(b, i, text + i, n);
+        ko_buffer_seal(b);
+        i += n;
+    }
+    return b;
+}
+
+// searching the buffer finds what searching the same text as a string does
+static void test_buffers(void) {
+    static const char* const patterns[] = {
+        "ab+c", "^a", "b$", "(a|b)*c", "a.?b", "[^ab\\n]+", "\\w+ \\d", "a{2,3}?b", "^$",
+    };
+    char text[600];
+    for (unsigned seed = 1; seed <= 100; seed++) {
+        srand(seed);
+        size_t len = rand() % sizeof(text);
+        random_text(text, len);
+        ko_buffer* b = in_pieces(text, len);
+
+        const char* p = patterns[seed % (sizeof(patterns) / sizeof(patterns[0]))];
+        const char* err;
+        ko_regex* re = ko_regex_new(p, strlen(p), seed % 3 ? 0 : KO_REGEX_ICASE, &err);
+        for (size_t pos = 0; pos <= len; pos++) {
+            size_t s1 = 0, e1 = 0, s2 = 0, e2 = 0;
+            int f1 = ko_regex_find_string(re, text, len, pos, &s1, &e1);
+            int f2 = ko_regex_find(re, b, pos, &s2, &e2);
+            if (f1 != f2 || s1 != s2 || e1 != e2) {
+                fprintf(stderr, "seed %u /%s/ at %zu: [%zu, %zu) in the string, [%zu, %zu) in the buffer\n", seed, p, pos, s1, e1, s2, e2);
+                ko_test_failures++;
+                break;
+            }
+        }
+        ko_regex_free(re);
+        ko_buffer_free(b);
+    }
+}
+
+// a[ab]{10}b has to remember which of the last 11 bytes were a's, so over
+// random a's and b's it reaches more DFA states than the cache holds
+static void test_cache(void) {
+    static char text[1 << 15];
+    const char* p = "a[ab]{10}b";
+    for (unsigned seed = 1; seed <= 5; seed++) {
+        srand(seed);
+        for (size_t i = 0; i < sizeof(text); i++)
+            text[i] = rand() % 2 ? 'a' : 'b';
+        size_t len = sizeof(text);
+        ko_buffer* b = in_pieces(text, len);
+
+        const char* err;
+        ko_regex* full = ko_regex_new(p, strlen(p), 0, &err);
+        ko_regex* tiny = ko_regex_new(p, strlen(p), 0, &err);
+        ko_regex_setcache(tiny, seed == 1 ? 2 : 3 + rand() % 40);
+
+        // every match, one after the next, against the obvious loop
+        size_t pos = 0, count = 0;
+        for (;;) {
+            size_t want = pos;
+            while (want + 12 <= len && !(text[want] == 'a' && text[want + 11] == 'b'))
+                want++;
+            if (want + 12 > len)
+                want = (size_t)-1;
+
+            size_t s1 = 0, e1 = 0, s2 = 0, e2 = 0;
+            int f1 = ko_regex_find_string(full, text, len, pos, &s1, &e1);
+            int f2 = ko_regex_find(tiny, b, pos, &s2, &e2);
+            KO_CHECK_EQ(f1, want != (size_t)-1);
+            KO_CHECK_EQ(f2, want != (size_t)-1);
+            if (!f1 || !f2 || want == (size_t)-1)
+                break;
+            KO_CHECK_EQ(s1, want);
+            KO_CHECK_EQ(e1, want + 12);
+            KO_CHECK_EQ(s2, want);
+            KO_CHECK_EQ(e2, want + 12);
+            if (ko_test_failures) {
+                fprintf(stderr, "seed %u at %zu\n", seed, pos);
+                break;
+            }
+            pos = s1 + 1 + rand() % 64;
+            count++;
+        }
+        KO_CHECK(count > 100);
+
+        // the small one was emptied plenty, and the full one only rarely
+        ko_regex_stats small = ko_regex_getstats(tiny), big = ko_regex_getstats(full);
+        KO_CHECK(small.resets > 100);
+        KO_CHECK(big.resets < small.resets);
+        KO_CHECK(big.states <= 2 * 1024);
+
+        ko_regex_free(full);
+        ko_regex_free(tiny);
+        ko_buffer_free(b);
+        if (ko_test_failures)
+            break;
+    }
+}
+
+int main(void) {
+    test_table();
+    test_buffers();
+    test_cache();
+    return ko_test_done();
+}
@@ -0,0 +1,249 @@
+// Substring search against the obvious loop: over strings (where the vector
+// blocks and what's left after them meet), over buffers cut into lots of
+// small pieces (where matches straddle them), ignoring case, and typed a
+// character at a time through a finder.
+
+#include "search.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned char fold(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+static int same(const char* a, const char* b, size_t len, int icase) {
+    for (size_t i = 0; i < len; i++)
+        if (icase ? fold(a[i]) != fold(b[i]) : a[i] != b[i])
+            return 0;
+    return 1;
+}
+
+// the first match at or after pos, or -1
+static long naive(const char* text, size_t len, const char* needle, size_t nlen, size_t pos, int icase) {
+    for (size_t i = pos; i + nlen <= len; i++)
+        if (same(text + i, needle, nlen, icase))
+            return (long)i;
+    return -1;
+}
+
+static size_t naive_count(const char* text, size_t len, const char* needle, size_t nlen, int icase) {
+    size_t n = 0;
+    for (size_t i = 0; i + nlen <= len; )
+        if (same(text + i, needle, nlen, icase)) {
+            n++;
+            i += nlen;
+        }
+        else {
+            i++;
+        }
+    return n;
+}
+
+// mostly a's and b's, so there are plenty of near misses; letters whose case
+// differs only by 0x20 from punctuation too
+static void random_text(char* s, size_t len) {
+    static const char letters[] = "aaaabbAB@`[{\n";
+    for (size_t i = 0; i < len; i++)
+        s[i] = letters[rand() % (sizeof(letters) - 1)];
+}
+
+// a buffer of text cut into pieces of a few bytes each
+static ko_buffer* in_pieces(const char* text, size_t len) {
+    ko_buffer* b = ko_buffer_new("", 0);
+    for (size_t i = 0; i < len; ) {
+        size_t n = 1 + rand() % 7;
+        if (n > len - i)
+            n = len - i;
+        ko_buffer_insert(b, i, text + i, n);
+        ko_buffer_seal(b);
+        i += n;
+    }
+
+    // put in out of order, so the pieces' order isn't the add buffer's
+    for (int k = 0; k < 20 && len > 1; k++) {
+        size_t at = rand() % len, n = 1 + rand() % (len - at < 6 ? len - at : 6);
+        ko_buffer_delete(b, at, n);
+        ko_buffer_insert(b, at, text + at, n);
+    }
+    return b;
+}
+
+static void test_strings(void) {
+    char text[300], needle[48];
+    for (unsigned seed = 1; seed <= 300; seed++) {
+        srand(seed);
+        size_t len = rand() % sizeof(text);
+        random_text(text, len);
+        int icase = seed % 2 ? KO_SEARCH_ICASE : 0;
+
+        size_t nlen = rand() % 4 == 0 ? 1 + rand() % sizeof(needle) : 1 + rand() % 4;
+        if (rand() % 2 && len >= nlen) {
+            // one that's in there
+            size_t at = rand() % (len - nlen + 1);
+            memcpy(needle, text + at, nlen);
+        }
+        else {
+            random_text(needle, nlen);
+        }
+
+        ko_search* s = ko_search_new(needle, nlen, icase);
+        for (size_t pos = 0; pos <= len + 1; pos++) {
+            size_t at;
+            long want = naive(text, len, needle, nlen, pos, icase);
+            int found = ko_search_find_string(s, text, len, pos, &at);
+            KO_CHECK_EQ(found, want >= 0);
+            if (found && want >= 0 && (long)at != want) {
+                fprintf(stderr, "seed %u: at %zu, not %ld\n", seed, at, want);
+                ko_test_failures++;
+                break;
+            }
+        }
+        ko_search_free(s);
+    }
+}
+
+static void test_edges(void) {
+    size_t at;
+
+    // empty needles match wherever they're asked to, and count nothing
+    ko_search* s = ko_search_new("", 0, 0);
+    KO_CHECK(ko_search_find_string(s, "abc", 3, 2, &at));
+    KO_CHECK_EQ(at, 2);
+    KO_CHECK(!ko_search_find_string(s, "abc", 3, 4, &at));
+    ko_buffer* b = ko_buffer_new("abc", 3);
+    KO_CHECK(ko_search_find(s, b, 3, &at));
+    KO_CHECK_EQ(at, 3);
+    KO_CHECK_EQ(ko_search_count(s, b, 0, 3), 0);
+    ko_search_free(s);
+
+    // longer than the text, or than what's left of it
+    s = ko_search_new("abcd", 4, 0);
+    KO_CHECK(!ko_search_find_string(s, "abc", 3, 0, &at));
+    KO_CHECK(!ko_search_find(s, b, 0, &at));
+    ko_search_free(s);
+    ko_buffer_free(b);
+
+    // ignoring case is for letters only: '@' and '`' differ by the case bit
+    s = ko_search_new("A@", 2, KO_SEARCH_ICASE);
+    KO_CHECK(!ko_search_find_string(s, "a`", 2, 0, &at));
+    KO_CHECK(ko_search_find_string(s, "xa@", 3, 0, &at));
+    KO_CHECK_EQ(at, 1);
+    ko_search_free(s);
+
+    // a needle longer than a vector block, at the very end of the text
+    char text[200], needle[70];
+    memset(text, 'a', sizeof(text));
+    memset(needle, 'a', sizeof(needle));
+    needle[69] = text[199] = 'b';
+    s = ko_search_new(needle, 70, 0);
+    KO_CHECK(ko_search_find_string(s, text, 200, 0, &at));
+    KO_CHECK_EQ(at, 130);
+    ko_search_free(s);
+}
+
+static void test_buffers(void) {
+    char text[2000], needle[40];
+    for (unsigned seed = 1; seed <= 200; seed++) {
+        srand(seed);
+        size_t len = rand() % sizeof(text);
+        random_text(text, len);
+        int icase = seed % 2 ? KO_SEARCH_ICASE : 0;
+        ko_buffer* b = in_pieces(text, len);
+
+        size_t nlen = 1 + rand() % (rand() % 3 ? 8 : sizeof(needle));
+        if (len >= nlen) {
+            size_t at = rand() % (len - nlen + 1);
+            memcpy(needle, text + at, nlen);
+        }
+        else {
+            random_text(needle, nlen);
+        }
+        ko_search* s = ko_search_new(needle, nlen, icase);
+
+        // every match, one after the next
+        size_t pos = 0, at;
+        for (;;) {
+            long want = naive(text, len, needle, nlen, pos, icase);
+            int found = ko_search_find(s, b, pos, &at);
+            KO_CHECK_EQ(found, want >= 0);
+            if (!found || want < 0)
+                break;
+            KO_CHECK_EQ(at, want);
+            pos = at + 1;
+        }
+
+        // and counted, in all of it and some of it
+        KO_CHECK_EQ(ko_search_count(s, b, 0, len), naive_count(text, len, needle, nlen, icase));
+        size_t from = len ? rand() % len : 0, n = rand() % (len - from + 1);
+        KO_CHECK_EQ(ko_search_count(s, b, from, n), naive_count(text + from, n, needle, nlen, icase));
+
+        ko_search_free(s);
+        ko_buffer_free(b);
+        if (ko_test_failures) {
+            fprintf(stderr, "seed %u\n", seed);
+            break;
+        }
+    }
+}
+
+static void test_finder(void) {
+    char text[1000];
+    for (unsigned seed = 1; seed <= 100; seed++) {
+        srand(seed);
+        size_t len = 200 + rand() % 800;
+        random_text(text, len);
+        int icase = seed % 2 ? KO_SEARCH_ICASE : 0;
+        ko_buffer* b = in_pieces(text, len);
+        ko_finder* f = ko_finder_new(icase);
+
+        size_t from = rand() % len;
+        char query[6];
+        random_text(query, sizeof(query));
+        size_t at;
+
+        // each longer query's first match is its first from where it started
+        for (size_t n = 1; n <= sizeof(query); n++) {
+            long want = naive(text, len, query, n, from, icase);
+            KO_CHECK_EQ(ko_finder_set(f, b, from, query, n, &at), want >= 0);
+            if (want >= 0)
+                KO_CHECK_EQ(at, want);
+            KO_CHECK_EQ(ko_finder_length(f), n);
+        }
+
+        // next goes through the rest, and a shorter query then longer again carries on from there
+        long last = naive(text, len, query, 2, from, icase);
+        if (last >= 0 && ko_finder_set(f, b, from, query, 2, &at)) {
+            while (ko_finder_next(f, b, &at)) {
+                long want = naive(text, len, query, 2, last + 1, icase);
+                KO_CHECK_EQ(at, want);
+                last = (long)at;
+                if (rand() % 4 == 0)
+                    break;
+            }
+            long want = naive(text, len, query, 3, last, icase);
+            KO_CHECK_EQ(ko_finder_set(f, b, from, query, 3, &at), want >= 0);
+            if (want >= 0)
+                KO_CHECK_EQ(at, want);
+            KO_CHECK_EQ(ko_finder_set(f, b, from, query, 2, &at), 1);
+            KO_CHECK_EQ(at, last);
+        }
+
+        // an edit starts it over
+        ko_buffer_insert(b, from, query, 3);
+        KO_CHECK(ko_finder_set(f, b, from, query, 3, &at));
+        KO_CHECK_EQ(at, from);
+
+        ko_finder_free(f);
+        ko_buffer_free(b);
+    }
+}
+
+int main(void) {
+    test_strings();
+    test_edges();
+    test_buffers();
+    test_finder();
+    return ko_test_done();
+}
@@ -0,0 +1,129 @@
+// The wrap layout following edits: after typing and backspacing at many
+// cursors at once (which reaches the layout as one batch), it has to agree
+// with a layout measured from scratch, line for line. Several cursors on one
+// line are the interesting case, since their changes land on lines the
+// batch has already touched.
+
+#include "wrap.h"
+#include "cursors.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// measures every line of w, then checks it against a fresh layout of the same buffer
+static int check_layout(ko_wrap* w, ko_buffer* b) {
+    int failures = ko_test_failures;
+    size_t lines = ko_buffer_lines(b);
+
+    // never more lines than there are, even before they're measured
+    KO_CHECK(ko_wrap_getstats(w).lines <= lines);
+
+    ko_wrap* fresh = ko_wrap_new(b, ko_wrap_width(w), ko_wrap_tabwidth(w));
+    for (size_t line = 0; line < lines; line++) {
+        ko_wrap_rows(w, line);
+        ko_wrap_rows(fresh, line);
+    }
+
+    KO_CHECK_EQ(ko_wrap_getstats(w).lines, lines);
+    KO_CHECK_EQ(ko_wrap_total(w), ko_wrap_total(fresh));
+    for (size_t line = 0; line < lines && ko_test_failures == failures; line++)
+        KO_CHECK_EQ(ko_wrap_row(w, line), ko_wrap_row(fresh, line));
+
+    ko_wrap_free(fresh);
+    return ko_test_failures == failures;
+}
+
+static void test_shared_line(void) {
+    // four cursors, two of them on either side of the newline: backspacing joins the lines
+    ko_buffer* b = ko_buffer_new("aa\naaaaa", 8);
+    ko_wrap* w = ko_wrap_new(b, 80, 8);
+    ko_wrap_rows(w, 1);
+
+    ko_cursors* c = ko_cursors_new(b);
+    size_t at[] = { 1, 2, 3, 6 };
+    for (int i = 0; i < 4; i++)
+        ko_cursors_add(c, at[i]);
+    ko_cursors_backspace(c);
+
+    KO_CHECK_EQ(ko_buffer_lines(b), 1);
+    KO_CHECK_EQ(ko_wrap_total(w), 1);
+    check_layout(w, b);
+
+    // and typing newlines at several cursors on one line splits it up again
+    ko_cursors_clear(c);
+    ko_cursors_add(c, 1);
+    ko_cursors_add(c, 2);
+    ko_cursors_add(c, 3);
+    ko_cursors_type(c, "x\ny", 3);
+    KO_CHECK_EQ(ko_buffer_lines(b), 4);
+    check_layout(w, b);
+
+    ko_cursors_free(c);
+    ko_wrap_free(w);
+    ko_buffer_free(b);
+}
+
+static void random_text(char* text, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        int r = rand() % 20;
+        text[i] = r == 0 ? '\n' : r == 1 ? '\t' : 'a' + r;
+    }
+}
+
+static void test_random(void) {
+    static const char* typed[] = { "x", "\n", "ab\ncd", "\n\n", "hello world, this is long", "\t" };
+    char text[400];
+
+    for (unsigned seed = 1; seed <= 300; seed++) {
+        srand(seed);
+        size_t len = rand() % sizeof(text);
+        random_text(text, len);
+
+        ko_buffer* b = ko_buffer_new(text, len);
+        ko_wrap* w = ko_wrap_new(b, 4 + rand() % 20, 4);
+        ko_cursors* c = ko_cursors_new(b);
+
+        for (int step = 0; step < 40; step++) {
+            // only some lines are known when the edit comes
+            size_t lines = ko_buffer_lines(b);
+            ko_wrap_rows(w, rand() % (lines + 1));
+
+            // cursors bunched up on a few lines
+            ko_cursors_clear(c);
+            size_t len = ko_buffer_length(b);
+            int n = 1 + rand() % 12;
+            size_t base = len ? rand() % (len + 1) : 0;
+            for (int i = 0; i < n; i++)
+                ko_cursors_add(c, rand() % 3 ? base + rand() % 8 : (len ? rand() % (len + 1) : 0));
+
+            switch (rand() % 4) {
+                case 0: ko_cursors_backspace(c); break;
+                case 1: ko_cursors_delete(c); break;
+                default: {
+                    const char* s = typed[rand() % 6];
+                    ko_cursors_type(c, s, strlen(s));
+                }
+            }
+            if (rand() % 10 == 0) {
+                size_t pos;
+                ko_buffer_undo(b, &pos);
+            }
+
+            if (!check_layout(w, b)) {
+                fprintf(stderr, "seed %u step %d\n", seed, step);
+                step = 40;
+            }
+        }
+
+        ko_cursors_free(c);
+        ko_wrap_free(w);
+        ko_buffer_free(b);
+    }
+}
+
+int main(void) {
+    test_shared_line();
+    test_random();
+    return ko_test_done();
+}